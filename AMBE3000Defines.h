@@ -0,0 +1,47 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef AMBE3000DEFINES_H
+#define AMBE3000DEFINES_H
+#include <cstdint>
+
+// Packets are START_BYTE, a 16 bit big endian length of what follows the type byte, the
+// type and then fields. The RATEP packets carry their 12 rate words from offset 5.
+#define AMBE3000_START_BYTE		0x61
+#define AMBE3000_TYPE_CONFIG	0x00
+#define AMBE3000_TYPE_CHANNEL	0x01
+#define AMBE3000_TYPE_SPEECH	0x02
+#define AMBE3000_PKT_RATEP		0x0a
+#define AMBE3000_PKT_INIT		0x0b
+#define AMBE3000_PKT_PRODID		0x30
+#define AMBE3000_PKT_VERSTRING	0x31
+#define AMBE3000_PKT_READY		0x39
+#define AMBE3000_PKT_RESET		0x33
+#define AMBE3000_PKT_PARITYMODE	0x3f
+#define AMBE3000_PKT_SPEECHD	0x00
+#define AMBE3000_PKT_CHAND		0x01
+#define AMBE3000_PKT_CHANNEL0	0x40	// 0x41 and 0x42 select the other channels of an AMBE-3003
+
+const uint8_t AMBEP251_4400_2800[17] = {AMBE3000_START_BYTE, 0x00, 0x0d, AMBE3000_TYPE_CONFIG, AMBE3000_PKT_RATEP, 0x05U, 0x58U, 0x08U, 0x6BU, 0x10U, 0x30U, 0x00U, 0x00U, 0x00U, 0x00U, 0x01U, 0x90U};		//DVSI P25 USB Dongle FEC
+const uint8_t AMBE2000_2400_1200[17] = {AMBE3000_START_BYTE, 0x00, 0x0d, AMBE3000_TYPE_CONFIG, AMBE3000_PKT_RATEP, 0x01U, 0x30U, 0x07U, 0x63U, 0x40U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x48U};
+const uint8_t AMBE3000_2450_1150[17] = {AMBE3000_START_BYTE, 0x00, 0x0d, AMBE3000_TYPE_CONFIG, AMBE3000_PKT_RATEP, 0x04U, 0x31U, 0x07U, 0x54U, 0x24U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x6fU, 0x48U};
+const uint8_t AMBE3000_2450_0000[17] = {AMBE3000_START_BYTE, 0x00, 0x0d, AMBE3000_TYPE_CONFIG, AMBE3000_PKT_RATEP, 0x04U, 0x31U, 0x07U, 0x54U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x70U, 0x31U};
+const uint8_t AMBE3000_PARITY_DISABLE[8] = {AMBE3000_START_BYTE, 0x00, 0x04, AMBE3000_TYPE_CONFIG, AMBE3000_PKT_PARITYMODE, 0x00, 0x2f, 0x14};
+const uint8_t AMBE3000_PRODID[5] = {AMBE3000_START_BYTE, 0x00, 0x01, AMBE3000_TYPE_CONFIG, AMBE3000_PKT_PRODID};
+const uint8_t AMBE3000_VERSION[5] = {AMBE3000_START_BYTE, 0x00, 0x01, AMBE3000_TYPE_CONFIG, AMBE3000_PKT_VERSTRING};
+
+#endif // AMBE3000DEFINES_H
@@ -23,7 +23,6 @@ Item {
 	property alias smsSendButton: _smsSendButton
 
 	id: logTab
-	property alias logText: logTxt
 	Button {
 		id: clearLogButton
 		x: 10
@@ -32,7 +31,18 @@ Item {
 		height: 30
 		text: qsTr("Clear")
 		onClicked: {
-			logTxt.clear();
+			droidstar.get_log_model().clear();
+		}
+	}
+	Button {
+		id: traceButton
+		x: 120
+		y: 5
+		width: 100
+		height: 30
+		text: qsTr("Trace")
+		onClicked: {
+			droidstar.dump_trace();
 		}
 	}
 	Rectangle{
@@ -42,21 +52,25 @@ Item {
 		width: parent.width - 40
 		height: parent.height - 80
 		color: "#252424"
-		Flickable{
-			id: logflick
+		ListView {
+			id: logList
+			property bool tail: true
 			anchors.fill: parent
-			contentWidth: parent.width
-			contentHeight: logTxt.y +
-						   logTxt.height
-			flickableDirection: Flickable.VerticalFlick
 			clip: true
+			model: droidstar.get_log_model()
 			ScrollBar.vertical: ScrollBar {}
-			TextArea {
-				id: logTxt
-				width: logTextBox.width
+			// Follows new lines unless scrolled back
+			onMovementEnded: tail = atYEnd
+			onCountChanged: if(tail) positionViewAtEnd()
+			delegate: TextEdit {
+				width: logList.width
+				leftPadding: 6
+				rightPadding: 6
 				readOnly: true
-				wrapMode: TextArea.WordWrap
-				text: qsTr("")
+				selectByMouse: true
+				wrapMode: TextEdit.WordWrap
+				color: palette.text
+				text: display
 			}
 		}
 	}
@@ -457,9 +457,6 @@ ApplicationWindow {
 
 			hostsTab.hostsTextEdit.text = droidstar.get_local_hosts();
         }
-		function onUpdate_log(s) {
-			logTab.logText.append(s);
-		}
 		function onOpen_vocoder_dialog() {
 			vocoderDialog.open();
 		}
@@ -495,6 +492,7 @@ ApplicationWindow {
 					mainTab.comboModule.enabled = false;
 				}
 				droidstar.set_debug(settingsTab.debugBox.checked);
+				droidstar.set_packet_capture(settingsTab.captureBox.checked);
             }
 			if(c === 2){
 				mainTab.connectbutton.text = "Disconnect";
@@ -68,13 +68,14 @@ Item {
 	property alias modemBaudEdit: _modemBaudEdit
     property alias mmdvmBox: _mmdvmBox
     property alias debugBox: _debugBox
+    property alias captureBox: _captureBox
 
 	Flickable {
 		id: flickable
 		anchors.fill: parent
 		contentWidth: parent.width
-        contentHeight: _debugBox.y +
-                       _debugBox.height + 10
+        contentHeight: _captureBox.y +
+                       _captureBox.height + 10
 		flickableDirection: Flickable.VerticalFlick
 		clip: true
 		ScrollBar.vertical: ScrollBar {}
@@ -981,5 +982,16 @@ Item {
                 droidstar.set_debug(_debugBox.checked)
             }
         }
+        CheckBox {
+            id: _captureBox
+            x: 10
+			y: 1190
+            width: parent.width
+            height: 25
+            text: qsTr("Capture packets to file")
+            onClicked:{
+                droidstar.set_packet_capture(_captureBox.checked)
+            }
+        }
 	}
 }
@@ -0,0 +1,125 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// droidstar-ambebench: bring-up time, round trip and throughput of an AMBE dongle.
+//
+//   droidstar-ambebench -p /tmp/ttyAMBE [-m DMR|YSF|REF] [-n 500]
+//
+// The port is opened with SerialAMBE as a session would, then -n frames of synthetic
+// speech are encoded all at once and the AMBE frames decoded back, each batch going
+// through SerialAMBE's window of requests in flight. Run it against droidstar-ambeemu
+// for numbers that do not depend on hardware.
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QVector>
+#include <cmath>
+#include <cstdio>
+#include "serialambe.h"
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	QCommandLineParser parser;
+
+	parser.setApplicationDescription("AMBE dongle benchmark");
+	parser.addHelpOption();
+	parser.addOption({{"p", "port"}, "Serial port of the dongle", "port"});
+	parser.addOption({{"m", "mode"}, "DMR (2450x1150), YSF (2450) or REF (2400x1200)", "mode", "DMR"});
+	parser.addOption({{"n", "frames"}, "Frames to encode and decode", "frames", "500"});
+	parser.process(app);
+
+	if(!parser.isSet("port")){
+		parser.showHelp(1);
+	}
+	const int frames = qMax(1, parser.value("frames").toInt());
+	const QString mode = parser.value("mode").toUpper();
+	const int frame_bytes = (mode == "YSF") ? 7 : 9;
+	QVector<int16_t> speech(frames * 160);
+	QVector<uint8_t> ambe;
+	QElapsedTimer t;
+	qint64 rate_ms = 0;
+	qint64 encode_ms = 0;
+	int decoded = 0;
+	int16_t pcm[160];
+
+	// A vowel with a gliding pitch
+	for(int n = 0; n < speech.size(); ++n){
+		const double f0 = 110 + 40 * sin(2 * M_PI * 0.4 * n / 8000);
+		double s = 0;
+		for(int h = 1; h * f0 < 3800; ++h){
+			s += sin(2 * M_PI * h * f0 * n / 8000) * 4000 / h;
+		}
+		speech[n] = (int16_t)qBound(-32768.0, s, 32767.0);
+	}
+
+	SerialAMBE dev(mode);
+	QTimer poll, timeout;
+
+	QObject::connect(&dev, &SerialAMBE::connected, [&](bool ok) {
+		rate_ms = t.elapsed();
+		if(!ok){
+			fprintf(stderr, "Rate not set\n");
+			app.exit(1);
+			return;
+		}
+		fprintf(stdout, "%s %s, rate set in %lld ms\n", dev.get_ambe_prodid().toStdString().c_str(), dev.get_ambe_verstring().toStdString().c_str(), rate_ms);
+		t.start();
+		for(int f = 0; f < frames; ++f){
+			dev.encode(&speech[f * 160]);
+		}
+	});
+	QObject::connect(&dev, &SerialAMBE::data_ready, [&]() {
+		uint8_t frame[9];
+		while(dev.get_ambe(frame)){
+			ambe.append(QVector<uint8_t>(frame, frame + frame_bytes));
+		}
+		if(encode_ms || (ambe.size() < frames * frame_bytes)){
+			return;
+		}
+		encode_ms = qMax((qint64)1, t.elapsed());
+		fprintf(stdout, "encode %d frames in %lld ms, %.1f frames/s, round trip %lld us, average %lld us\n", frames, encode_ms, frames * 1000.0 / encode_ms, dev.get_last_rtt_us(), dev.get_avg_rtt_us());
+		t.start();
+		for(int f = 0; f < frames; ++f){
+			dev.decode(&ambe[f * frame_bytes]);
+		}
+		poll.start(1);
+	});
+	QObject::connect(&poll, &QTimer::timeout, [&]() {
+		while(dev.get_audio(pcm)){
+			++decoded;
+		}
+		if(decoded < frames){
+			return;
+		}
+		const qint64 ms = qMax((qint64)1, t.elapsed());
+		fprintf(stdout, "decode %d frames in %lld ms, %.1f frames/s, round trip %lld us, average %lld us\n", frames, ms, frames * 1000.0 / ms, dev.get_last_rtt_us(), dev.get_avg_rtt_us());
+		app.quit();
+	});
+	QObject::connect(&timeout, &QTimer::timeout, [&]() {
+		fprintf(stderr, "Timed out: rate %s, %d of %d frames encoded, %d decoded\n", rate_ms ? "set" : "not set", (int)ambe.size() / frame_bytes, frames, decoded);
+		app.exit(1);
+	});
+	timeout.setSingleShot(true);
+	timeout.start(10000 + frames * 100);
+
+	t.start();
+	dev.connect_to_serial(parser.value("port"));
+	return app.exec();
+}
@@ -0,0 +1,87 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// droidstar-ambeemu: an AMBE dongle on a pseudo terminal, for testing without hardware.
+//
+//   droidstar-ambeemu [-d 3000|3003|2020] [-b 460800] [-l 2000] [-L /tmp/ttyAMBE] [-v]
+//
+// Point the vocoder setting, AMBEDEVICES= or droidstar-ambebench at the port it prints,
+// or at the link. -b 0 takes the serial line out, -l is the time to vocode a frame.
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTimer>
+#include <csignal>
+#include <cstdio>
+#include "ambeemulator.h"
+
+static void signal_handler(int)
+{
+	QCoreApplication::quit();
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	QCommandLineParser parser;
+
+	parser.setApplicationDescription("AMBE dongle emulator for DroidStar testing");
+	parser.addHelpOption();
+	parser.addOption({{"d", "device"}, "3000 (ThumbDV, DVstick), 3003 (three channels) or 2020 (DV Dongle)", "device", "3000"});
+	parser.addOption({{"b", "baud"}, "Serial line rate, 0 for no limit", "baud", "460800"});
+	parser.addOption({{"l", "latency"}, "Time to vocode one frame", "us", "0"});
+	parser.addOption({{"L", "link"}, "Symlink to create to the pty", "path"});
+	parser.addOption({{"v", "verbose"}, "Print every packet"});
+	parser.process(app);
+
+	const QString device = parser.value("device");
+	if((device != "3000") && (device != "3003") && (device != "2020")){
+		fprintf(stderr, "Unsupported device %s\n", device.toStdString().c_str());
+		return 1;
+	}
+
+	AMBEEmulator emu(device);
+	emu.set_baud(parser.value("baud").toInt());
+	emu.set_latency(parser.value("latency").toInt());
+	emu.set_verbose(parser.isSet("verbose"));
+	if(!emu.start(parser.value("link"))){
+		return 1;
+	}
+	fprintf(stdout, "AMBE %s on %s\n", device.toStdString().c_str(), emu.port().toStdString().c_str());
+	fflush(stdout);
+
+	signal(SIGINT, signal_handler);
+	signal(SIGTERM, signal_handler);
+
+	AMBEEmulator::STATS last = emu.stats();
+	QTimer stats;
+	QObject::connect(&stats, &QTimer::timeout, [&emu, &last]() {
+		const AMBEEmulator::STATS s = emu.stats();
+		const quint64 n = s.requests - last.requests;
+		if(n == 0){
+			return;
+		}
+		fprintf(stdout, "requests %llu decoded %llu encoded %llu errors %llu in %llu out %llu vocoder %lld us held %lld us per request\n",
+				n, s.decoded - last.decoded, s.encoded - last.encoded, s.errors - last.errors, s.bytes_in - last.bytes_in, s.bytes_out - last.bytes_out,
+				(s.vocoder_ns - last.vocoder_ns) / 1000 / (qint64)n, (s.held_ns - last.held_ns) / 1000 / (qint64)n);
+		fflush(stdout);
+		last = s;
+	});
+	stats.start(10000);
+
+	return app.exec();
+}
@@ -0,0 +1,389 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <QDebug>
+#include <cstdio>
+#include <cstring>
+#include "ambeemulator.h"
+#include "AMBE3000Defines.h"
+#include "mode.h"
+
+// The first 24 bytes of a DV Dongle AMBE packet, the frame follows
+static const uint8_t DVDONGLE_AMBE[24] = {0x32, 0xa0, 0xec, 0x13, 0x00, 0x00, 0x30, 0x10, 0x01, 0x00, 0x00, 0x00, 0x30, 0x42, 0x48, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x00};
+
+AMBEEmulator::AMBEEmulator(QString device, QObject *parent) :
+	QObject(parent),
+	m_device(device),
+	m_pty(new PtyPort(this)),
+	m_baud(460800),
+	m_latency(0),
+	m_verbose(false),
+	m_timer(new QTimer(this)),
+	m_rxfree_ns(0),
+	m_txfree_ns(0)
+{
+	memset(&m_stats, 0, sizeof(m_stats));
+	m_timer->setSingleShot(true);
+	m_timer->setTimerType(Qt::PreciseTimer);
+	connect(m_timer, &QTimer::timeout, this, &AMBEEmulator::flush_replies);
+	connect(m_pty, &PtyPort::data_received, this, &AMBEEmulator::receive);
+
+	const int n = (m_device == "3003") ? 3 : 1;
+	for(int i = 0; i < n; ++i){
+		CHANNEL c;
+		c.codec = Mode::CODEC_NONE;
+		c.vocoder = new MBEVocoder();
+		c.free_ns = 0;
+		m_channels.append(c);
+	}
+	if(m_device == "2020"){
+		m_channels[0].codec = Mode::CODEC_AMBE2400X1200;
+	}
+	m_clock.start();
+}
+
+AMBEEmulator::~AMBEEmulator()
+{
+	for(CHANNEL &c : m_channels){
+		delete c.vocoder;
+	}
+}
+
+bool AMBEEmulator::start(QString link)
+{
+	return m_pty->open(link);
+}
+
+qint64 AMBEEmulator::wire_ns(int bytes)
+{
+	return m_baud ? (qint64)bytes * 10 * 1000000000LL / m_baud : 0;
+}
+
+void AMBEEmulator::reset_channel(int ch, int codec)
+{
+	delete m_channels[ch].vocoder;
+	m_channels[ch].vocoder = new MBEVocoder();
+	m_channels[ch].codec = codec;
+}
+
+void AMBEEmulator::receive(QByteArray data)
+{
+	m_rx.append(data);
+	m_stats.bytes_in += data.size();
+	if(m_device == "2020"){
+		process_2020();
+	}
+	else{
+		process_3000();
+	}
+}
+
+// A packet is read off the line one wire time after the one before it at the earliest,
+// vocoded when its channel is free, and written one wire time after the reply before it
+void AMBEEmulator::reply(int ch, qint64 rx_ns, const QByteArray &data)
+{
+	const qint64 now = m_clock.nsecsElapsed();
+	CHANNEL &c = m_channels[ch];
+	REPLY r;
+
+	const qint64 done = qMax(rx_ns, c.free_ns) + (qint64)m_latency * 1000;
+	c.free_ns = done;
+	m_txfree_ns = qMax(done, m_txfree_ns) + wire_ns(data.size());
+	r.due_ns = m_txfree_ns;
+	r.rx_ns = now;
+	r.data = data;
+	m_replies.enqueue(r);
+	++m_stats.requests;
+	flush_replies();
+}
+
+void AMBEEmulator::flush_replies()
+{
+	const qint64 now = m_clock.nsecsElapsed();
+
+	while(!m_replies.isEmpty() && (m_replies.head().due_ns <= now)){
+		const REPLY r = m_replies.dequeue();
+		if(m_verbose){
+			fprintf(stderr, "TX %d:", (int)r.data.size());
+			for(int i = 0; i < qMin((int)r.data.size(), 16); ++i){
+				fprintf(stderr, " %02x", (uint8_t)r.data[i]);
+			}
+			fprintf(stderr, "\n");
+		}
+		m_pty->write(r.data);
+		m_stats.bytes_out += r.data.size();
+		m_stats.held_ns += now - r.rx_ns;
+	}
+	if(!m_replies.isEmpty()){
+		m_timer->start((int)((m_replies.head().due_ns - now + 999999) / 1000000));
+	}
+}
+
+void AMBEEmulator::process_3000()
+{
+	while(m_rx.size() >= 4){
+		if((uint8_t)m_rx[0] != AMBE3000_START_BYTE){
+			const int start = m_rx.indexOf((char)AMBE3000_START_BYTE);
+			m_rx.remove(0, (start == -1) ? m_rx.size() : start);
+			continue;
+		}
+		const int len = 4 + (((uint8_t)m_rx[1] << 8) | (uint8_t)m_rx[2]);
+		const uint8_t type = m_rx[3];
+		if((type > AMBE3000_TYPE_SPEECH) || (len > 4 + 1 + 2 + 320 + 2)){
+			m_rx.remove(0, 1);
+			continue;
+		}
+		if(m_rx.size() < len){
+			break;
+		}
+		const QByteArray pkt = m_rx.left(len);
+		m_rx.remove(0, len);
+		m_rxfree_ns = qMax(m_clock.nsecsElapsed(), m_rxfree_ns) + wire_ns(len);
+
+		if(m_verbose){
+			fprintf(stderr, "RX %d:", len);
+			for(int i = 0; i < qMin(len, 16); ++i){
+				fprintf(stderr, " %02x", (uint8_t)pkt[i]);
+			}
+			fprintf(stderr, "\n");
+		}
+
+		int pos = 4;
+		int ch = 0;
+		bool chfield = false;
+		if((pkt.size() > pos) && ((uint8_t)pkt[pos] >= AMBE3000_PKT_CHANNEL0) && ((uint8_t)pkt[pos] < AMBE3000_PKT_CHANNEL0 + m_channels.size())){
+			ch = (uint8_t)pkt[pos++] - AMBE3000_PKT_CHANNEL0;
+			chfield = true;
+		}
+		const QByteArray fields = pkt.mid(pos);
+		QByteArray out;
+
+		if(type == AMBE3000_TYPE_CONFIG){
+			out = config_3000(ch, fields);
+			if(chfield){
+				out.prepend((char)0x00);
+			}
+		}
+		else if((type == AMBE3000_TYPE_CHANNEL) && (fields.size() >= 2) && (fields[0] == AMBE3000_PKT_CHAND) && (fields.size() >= 2 + ((uint8_t)fields[1] + 7) / 8)){
+			out = decode(ch, (uint8_t)fields[1], (const uint8_t *)fields.constData() + 2);
+			out.prepend((char)0xa0);
+			out.prepend((char)AMBE3000_PKT_SPEECHD);
+		}
+		else if((type == AMBE3000_TYPE_SPEECH) && (fields.size() >= 2 + 320) && (fields[0] == AMBE3000_PKT_SPEECHD) && ((uint8_t)fields[1] == 160)){
+			int16_t pcm[160];
+			int bits;
+			for(int i = 0; i < 160; ++i){
+				pcm[i] = ((uint8_t)fields[2 + i * 2] << 8) | (uint8_t)fields[3 + i * 2];
+			}
+			out = encode(ch, pcm, &bits);
+			out.prepend((char)bits);
+			out.prepend((char)AMBE3000_PKT_CHAND);
+		}
+		else{
+			++m_stats.errors;
+			qDebug() << "AMBEEmulator: malformed packet of type" << type << "and" << len << "bytes";
+			continue;
+		}
+		if(chfield){
+			out.prepend((char)(AMBE3000_PKT_CHANNEL0 + ch));
+		}
+
+		// A channel packet is answered with speech and a speech packet with a channel packet
+		const uint8_t rtype = (type == AMBE3000_TYPE_CONFIG) ? AMBE3000_TYPE_CONFIG : (type == AMBE3000_TYPE_CHANNEL) ? AMBE3000_TYPE_SPEECH : AMBE3000_TYPE_CHANNEL;
+		out.prepend((char)rtype);
+		out.prepend((char)(out.size() - 1));
+		out.prepend((char)((out.size() - 2) >> 8));
+		out.prepend((char)AMBE3000_START_BYTE);
+		reply(ch, m_rxfree_ns, out);
+	}
+}
+
+// Answers the first field, a parity field after it is ignored. With a channel field the
+// status byte is put before the reply by the caller.
+QByteArray AMBEEmulator::config_3000(int ch, const QByteArray &fields)
+{
+	QByteArray out;
+
+	if(fields.isEmpty()){
+		return out;
+	}
+	const uint8_t field = fields[0];
+	out.append((char)field);
+
+	switch(field){
+	case AMBE3000_PKT_PARITYMODE:
+		out.append((char)0x00);
+		break;
+	case AMBE3000_PKT_PRODID:
+		out.append((m_device == "3003") ? "AMBE3003" : "AMBE3000R");
+		out.append((char)0x00);
+		break;
+	case AMBE3000_PKT_VERSTRING:
+		out.append("V120.E100.XXXX.C106.G514.R009.B0010411.C0020208");
+		out.append((char)0x00);
+		break;
+	case AMBE3000_PKT_RATEP: {
+		const struct { const uint8_t *table; int codec; } rates[] = {
+			{AMBE3000_2450_0000, Mode::CODEC_AMBE2450},
+			{AMBE3000_2450_1150, Mode::CODEC_AMBE2450X1150},
+			{AMBE2000_2400_1200, Mode::CODEC_AMBE2400X1200}
+		};
+		int codec = Mode::CODEC_NONE;
+		for(const auto &r : rates){
+			if((fields.size() >= 13) && !memcmp(fields.constData() + 1, r.table + 5, 12)){
+				codec = r.codec;
+			}
+		}
+		if(codec != Mode::CODEC_NONE){
+			reset_channel(ch, codec);
+		}
+		else{
+			++m_stats.errors;
+			qDebug() << "AMBEEmulator: channel" << ch << "rate not supported";
+		}
+		out.append((char)((codec != Mode::CODEC_NONE) ? 0x00 : 0x01));
+		break;
+	}
+	case AMBE3000_PKT_INIT:
+		reset_channel(ch, m_channels[ch].codec);
+		out.append((char)0x00);
+		break;
+	case AMBE3000_PKT_RESET:
+		for(int i = 0; i < m_channels.size(); ++i){
+			reset_channel(i, Mode::CODEC_NONE);
+		}
+		out[0] = (char)AMBE3000_PKT_READY;
+		break;
+	case AMBE3000_PKT_READY:
+		break;
+	default:
+		++m_stats.errors;
+		out.append((char)0x01);
+		break;
+	}
+	return out;
+}
+
+// 160 big endian samples. Before a rate is set the frame length picks it, as the DVSI
+// default rates do.
+QByteArray AMBEEmulator::decode(int ch, int bits, const uint8_t *frame)
+{
+	CHANNEL &c = m_channels[ch];
+	QElapsedTimer t;
+	int16_t pcm[160];
+	uint8_t ambe[9];
+	QByteArray out;
+
+	memset(ambe, 0, sizeof(ambe));
+	memcpy(ambe, frame, qMin(9, (bits + 7) / 8));
+	if(c.codec == Mode::CODEC_NONE){
+		c.codec = (bits == 49) ? Mode::CODEC_AMBE2450 : Mode::CODEC_AMBE2450X1150;
+	}
+	t.start();
+	if(c.codec == Mode::CODEC_AMBE2450){
+		c.vocoder->decode_2450(pcm, ambe);
+	}
+	else if(c.codec == Mode::CODEC_AMBE2450X1150){
+		c.vocoder->decode_2450x1150(pcm, ambe);
+	}
+	else{
+		c.vocoder->decode_2400x1200(pcm, ambe);
+	}
+	m_stats.vocoder_ns += t.nsecsElapsed();
+	++m_stats.decoded;
+
+	for(int i = 0; i < 160; ++i){
+		out.append((char)((pcm[i] >> 8) & 0xff));
+		out.append((char)(pcm[i] & 0xff));
+	}
+	return out;
+}
+
+QByteArray AMBEEmulator::encode(int ch, const int16_t *pcm, int *bits)
+{
+	CHANNEL &c = m_channels[ch];
+	QElapsedTimer t;
+	int16_t in[160];
+	uint8_t ambe[9];
+
+	memcpy(in, pcm, sizeof(in));
+	memset(ambe, 0, sizeof(ambe));
+	if(c.codec == Mode::CODEC_NONE){
+		c.codec = Mode::CODEC_AMBE2450X1150;
+	}
+	t.start();
+	if(c.codec == Mode::CODEC_AMBE2450){
+		c.vocoder->encode_2450(in, ambe);
+	}
+	else if(c.codec == Mode::CODEC_AMBE2450X1150){
+		c.vocoder->encode_2450x1150(in, ambe);
+	}
+	else{
+		c.vocoder->encode_2400x1200(in, ambe);
+	}
+	m_stats.vocoder_ns += t.nsecsElapsed();
+	++m_stats.encoded;
+
+	*bits = (c.codec == Mode::CODEC_AMBE2450) ? 49 : 72;
+	return QByteArray((const char *)ambe, (*bits + 7) / 8);
+}
+
+// DV Dongle packets start with a little endian word of 13 bits of length and 3 bits of
+// type. An AMBE packet is answered with the decoded speech and a speech packet with the
+// encoded frame, anything else is echoed.
+void AMBEEmulator::process_2020()
+{
+	while(m_rx.size() >= 2){
+		const uint16_t h = (uint8_t)m_rx[0] | ((uint8_t)m_rx[1] << 8);
+		const int len = h & 0x1fff;
+		if((len < 2) || (len > 400)){
+			m_rx.remove(0, 1);
+			continue;
+		}
+		if(m_rx.size() < len){
+			break;
+		}
+		const QByteArray pkt = m_rx.left(len);
+		m_rx.remove(0, len);
+		m_rxfree_ns = qMax(m_clock.nsecsElapsed(), m_rxfree_ns) + wire_ns(len);
+
+		QByteArray out;
+		if((h == 0xa032) && (len == 50)){
+			const QByteArray pcm = decode(0, 72, (const uint8_t *)pkt.constData() + 24);
+			out.append((char)0x42);
+			out.append((char)0x81);
+			for(int i = 0; i < 160; ++i){
+				out.append(pcm[i * 2 + 1]);
+				out.append(pcm[i * 2]);
+			}
+		}
+		else if((h == 0x8142) && (len == 322)){
+			int16_t pcm[160];
+			int bits;
+			for(int i = 0; i < 160; ++i){
+				pcm[i] = (uint8_t)pkt[2 + i * 2] | ((uint8_t)pkt[3 + i * 2] << 8);
+			}
+			out.append((const char *)DVDONGLE_AMBE, sizeof(DVDONGLE_AMBE));
+			out.append(encode(0, pcm, &bits));
+			out.append(QByteArray(50 - out.size(), 0));
+		}
+		else{
+			out = pkt;
+		}
+		reply(0, m_rxfree_ns, out);
+	}
+}
@@ -0,0 +1,97 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef AMBEEMULATOR_H
+#define AMBEEMULATOR_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QList>
+#include <QQueue>
+#include <QTimer>
+#include "imbe_vocoder/imbe_vocoder_api.h"
+#include "mbe/mbevocoder_api.h"
+#include "ptyport.h"
+
+// A ThumbDV (AMBE-3000), an AMBE-3003 or a DV Dongle on the slave side of a pseudo
+// terminal, vocoding with MBEVocoder. It answers the packets SerialAMBE and AMBEPool
+// send: parity mode, product ID, version, rate, init, reset, channel and speech packets
+// on up to three channels, or the DV Dongle's AMBE and PCM packets. Replies are held back
+// as a real device would hold them: every packet takes its length at the baud rate to
+// cross the serial line each way, and each channel takes the latency to vocode a frame.
+class AMBEEmulator : public QObject
+{
+	Q_OBJECT
+public:
+	AMBEEmulator(QString device, QObject *parent = nullptr);
+	~AMBEEmulator();
+	// Opens the pty, link names a symlink to create to its slave side
+	bool start(QString link = QString());
+	QString port() { return m_pty->name(); }
+	void set_baud(int baud) { m_baud = baud; }		// 0 for no limit
+	void set_latency(int us) { m_latency = us; }
+	void set_verbose(bool v) { m_verbose = v; }
+	struct STATS {
+		quint64 requests;
+		quint64 decoded;
+		quint64 encoded;
+		quint64 errors;
+		quint64 bytes_in;
+		quint64 bytes_out;
+		qint64 vocoder_ns;
+		qint64 held_ns;		// Request fully read to reply written, summed
+	};
+	STATS stats() { return m_stats; }
+private slots:
+	void receive(QByteArray data);
+	void flush_replies();
+private:
+	struct CHANNEL {
+		int codec;
+		MBEVocoder *vocoder;
+		qint64 free_ns;
+	};
+	struct REPLY {
+		qint64 due_ns;
+		qint64 rx_ns;
+		QByteArray data;
+	};
+	QString m_device;
+	PtyPort *m_pty;
+	int m_baud;
+	int m_latency;
+	bool m_verbose;
+	QTimer *m_timer;
+	QElapsedTimer m_clock;
+	QByteArray m_rx;
+	QQueue<REPLY> m_replies;
+	qint64 m_rxfree_ns;
+	qint64 m_txfree_ns;
+	QList<CHANNEL> m_channels;
+	STATS m_stats;
+
+	qint64 wire_ns(int bytes);
+	void reset_channel(int ch, int codec);
+	void reply(int ch, qint64 rx_ns, const QByteArray &data);
+	void process_3000();
+	void process_2020();
+	QByteArray config_3000(int ch, const QByteArray &fields);
+	QByteArray decode(int ch, int bits, const uint8_t *frame);
+	QByteArray encode(int ch, const int16_t *pcm, int *bits);
+};
+
+#endif // AMBEEMULATOR_H
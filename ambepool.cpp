@@ -0,0 +1,570 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <QDeadlineTimer>
+#include <QDebug>
+#include <cstring>
+#include "ambepool.h"
+#include "AMBE3000Defines.h"
+#include "mode.h"
+#include "vocoderregistry.h"
+
+AMBEPool::AMBEPool() :
+	m_thread(new QThread),
+	m_timer(nullptr),
+	m_nextstream(0)
+{
+	m_clock.start();
+	m_thread->setObjectName("ambepool");
+	moveToThread(m_thread);
+	m_thread->start();
+}
+
+AMBEPool::~AMBEPool()
+{
+	QMetaObject::invokeMethod(this, "close_ports", Qt::BlockingQueuedConnection);
+	m_thread->quit();
+	m_thread->wait();
+	delete m_thread;
+}
+
+bool AMBEPool::supports(int codec)
+{
+	return frame_bytes(codec) > 0;
+}
+
+int AMBEPool::frame_bytes(int codec)
+{
+	switch(codec){
+	case Mode::CODEC_AMBE2450:
+		return 7;
+	case Mode::CODEC_AMBE2450X1150:
+	case Mode::CODEC_AMBE2400X1200:
+		return 9;
+	default:
+		return 0;
+	}
+}
+
+QByteArray AMBEPool::packet(uint8_t type, int channel, const QByteArray &fields)
+{
+	QByteArray p;
+	const int len = 1 + fields.size();
+
+	p.append((char)AMBE3000_START_BYTE);
+	p.append((char)(len >> 8));
+	p.append((char)(len & 0xff));
+	p.append((char)type);
+	p.append((char)(AMBE3000_PKT_CHANNEL0 + channel));
+	p.append(fields);
+	return p;
+}
+
+int AMBEPool::open(const QStringList &ports, int baud)
+{
+	QDeadlineTimer deadline(TIMEOUT_MS * 2);
+
+	QMetaObject::invokeMethod(this, "open_ports", Qt::BlockingQueuedConnection, Q_ARG(QStringList, ports), Q_ARG(int, baud));
+
+	QMutexLocker l(&m_mutex);
+	for(;;){
+		bool waiting = false;
+		for(const DEVICE &d : m_devices){
+			waiting |= (d.first == -1);
+		}
+		if(!waiting || !m_done.wait(&m_mutex, deadline)){
+			break;
+		}
+	}
+	for(const DEVICE &d : m_devices){
+		if(d.first == -1){
+			qWarning() << "AMBEPool: no reply from" << d.name;
+		}
+		else{
+			qDebug() << "AMBEPool:" << d.name << d.prodid << d.version;
+		}
+	}
+	return m_channels.size();
+}
+
+int AMBEPool::channels()
+{
+	QMutexLocker l(&m_mutex);
+	return m_channels.size();
+}
+
+// Runs on m_thread
+void AMBEPool::open_ports(QStringList ports, int baud)
+{
+	for(const QString &p : ports){
+		QSerialPort *s = new QSerialPort(this);
+		s->setPortName(p);
+		s->setBaudRate(baud);
+		s->setDataBits(QSerialPort::Data8);
+		s->setStopBits(QSerialPort::OneStop);
+		s->setParity(QSerialPort::NoParity);
+		if(!s->open(QIODevice::ReadWrite)){
+			qWarning() << "AMBEPool: cannot open" << p << s->errorString();
+			delete s;
+			continue;
+		}
+		s->setFlowControl(QSerialPort::HardwareControl);
+		s->setRequestToSend(true);
+		connect(s, &QSerialPort::readyRead, this, &AMBEPool::process_serial);
+
+		DEVICE d;
+		d.port = s;
+		d.name = p;
+		d.first = -1;
+		m_mutex.lock();
+		m_devices.append(d);
+		m_mutex.unlock();
+
+		// Written back to back, the dongle answers them in order
+		s->write(reinterpret_cast<const char *>(AMBE3000_PARITY_DISABLE), sizeof(AMBE3000_PARITY_DISABLE));
+		s->write(reinterpret_cast<const char *>(AMBE3000_PRODID), sizeof(AMBE3000_PRODID));
+		s->write(reinterpret_cast<const char *>(AMBE3000_VERSION), sizeof(AMBE3000_VERSION));
+	}
+	if(m_timer == nullptr){
+		m_timer = new QTimer(this);
+		connect(m_timer, &QTimer::timeout, this, &AMBEPool::check_timeouts);
+		m_timer->start(TIMEOUT_MS / 5);
+	}
+}
+
+// Runs on m_thread
+void AMBEPool::close_ports()
+{
+	QMutexLocker l(&m_mutex);
+
+	delete m_timer;
+	m_timer = nullptr;
+	for(CHANNEL &c : m_channels){
+		while(!c.queue.isEmpty()){
+			JOB *job = c.queue.dequeue();
+			job->done = true;
+			if(job->abandoned){
+				delete job;
+			}
+		}
+		while(!c.inflight.isEmpty()){
+			JOB *job = c.inflight.dequeue();
+			job->done = true;
+			if(job->abandoned){
+				delete job;
+			}
+		}
+	}
+	for(DEVICE &d : m_devices){
+		d.port->close();
+		delete d.port;
+	}
+	m_devices.clear();
+	m_channels.clear();
+	m_done.wakeAll();
+}
+
+void AMBEPool::process_serial()
+{
+	QMutexLocker l(&m_mutex);
+	int i = 0;
+
+	while((i < m_devices.size()) && (m_devices[i].port != sender())){
+		++i;
+	}
+	if(i == m_devices.size()){
+		return;
+	}
+	DEVICE &d = m_devices[i];
+	d.rx.append(d.port->readAll());
+
+	while(d.rx.size() >= 4){
+		if((uint8_t)d.rx[0] != AMBE3000_START_BYTE){
+			const int start = d.rx.indexOf((char)AMBE3000_START_BYTE);
+			d.rx.remove(0, (start == -1) ? d.rx.size() : start);
+			continue;
+		}
+		const int len = 4 + (((uint8_t)d.rx[1] << 8) | (uint8_t)d.rx[2]);
+		if(d.rx.size() < len){
+			break;
+		}
+		handle_packet(i, d.rx.left(len));
+		d.rx.remove(0, len);
+	}
+	send();
+}
+
+// Called with m_mutex held. Replies to channel packets name the channel first, the
+// AMBE-3000 may leave it out, and a channel field in a config reply has a status byte.
+void AMBEPool::handle_packet(int device, const QByteArray &pkt)
+{
+	DEVICE &d = m_devices[device];
+	const uint8_t type = pkt[3];
+	int pos = 4;
+	int ch = 0;
+
+	if((pkt.size() > pos) && ((uint8_t)pkt[pos] >= AMBE3000_PKT_CHANNEL0) && ((uint8_t)pkt[pos] <= AMBE3000_PKT_CHANNEL0 + 2)){
+		ch = (uint8_t)pkt[pos] - AMBE3000_PKT_CHANNEL0;
+		pos += (type == AMBE3000_TYPE_CONFIG) ? 2 : 1;
+	}
+	if(pkt.size() <= pos){
+		return;
+	}
+
+	if(type == AMBE3000_TYPE_CONFIG){
+		switch((uint8_t)pkt[pos]){
+		case AMBE3000_PKT_PARITYMODE:
+			if(pkt.size() > pos + 1 && pkt[pos + 1]){
+				qDebug() << "AMBEPool:" << d.name << "parity not disabled";
+			}
+			return;
+		case AMBE3000_PKT_PRODID:
+			d.prodid = QString::fromLatin1(pkt.mid(pos + 1)).remove(QChar('\0'));
+			if(d.first == -1){
+				const int n = d.prodid.contains("3003") ? 3 : 1;
+				d.first = m_channels.size();
+				for(int c = 0; c < n; ++c){
+					CHANNEL channel;
+					channel.device = device;
+					channel.channel = c;
+					channel.codec = Mode::CODEC_NONE;
+					channel.streams = 0;
+					channel.frames = 0;
+					channel.timeouts = 0;
+					channel.last_rtt_us = 0;
+					channel.avg_rtt_us = 0;
+					channel.stale = 0;
+					channel.stale_ns = 0;
+					m_channels.append(channel);
+				}
+				m_done.wakeAll();
+			}
+			return;
+		case AMBE3000_PKT_VERSTRING:
+			d.version = QString::fromLatin1(pkt.mid(pos + 1)).remove(QChar('\0'));
+			return;
+		case AMBE3000_PKT_RATEP:
+			if(pkt.size() > pos + 1 && pkt[pos + 1]){
+				qDebug() << "AMBEPool:" << d.name << "channel" << ch << "rate not set";
+			}
+			break;
+		default:
+			return;
+		}
+	}
+
+	if((d.first == -1) || (ch >= ((d.prodid.contains("3003")) ? 3 : 1))){
+		return;
+	}
+	CHANNEL &c = m_channels[d.first + ch];
+	if(c.stale){
+		--c.stale;
+		return;
+	}
+	if(c.inflight.isEmpty()){
+		qDebug() << "AMBEPool:" << d.name << "unexpected reply on channel" << ch;
+		return;
+	}
+	JOB *job = c.inflight.dequeue();
+	const qint64 rtt = (m_clock.nsecsElapsed() - job->sent_ns) / 1000;
+	if(type != AMBE3000_TYPE_CONFIG){
+		c.avg_rtt_us = c.frames ? (c.avg_rtt_us * 7 + rtt) / 8 : rtt;
+		c.last_rtt_us = rtt;
+		++c.frames;
+	}
+	if(job->abandoned){
+		delete job;
+		return;
+	}
+	job->reply = pkt.mid(pos);
+	job->ok = true;
+	job->done = true;
+	m_done.wakeAll();
+}
+
+// Called with m_mutex held, on m_thread
+void AMBEPool::send()
+{
+	for(CHANNEL &c : m_channels){
+		while(!c.stale && (c.inflight.size() < MAX_INFLIGHT) && !c.queue.isEmpty()){
+			JOB *job = c.queue.dequeue();
+			job->sent_ns = m_clock.nsecsElapsed();
+			m_devices[c.device].port->write(job->packet);
+			c.inflight.enqueue(job);
+		}
+	}
+}
+
+void AMBEPool::pump()
+{
+	QMutexLocker l(&m_mutex);
+	send();
+}
+
+// A dongle that stops answering would hold its channel's window forever
+void AMBEPool::check_timeouts()
+{
+	QMutexLocker l(&m_mutex);
+	const qint64 now = m_clock.nsecsElapsed();
+	bool woke = false;
+
+	for(CHANNEL &c : m_channels){
+		if(c.stale && ((now - c.stale_ns) / 1000000 > TIMEOUT_MS)){
+			qDebug() << "AMBEPool:" << m_devices[c.device].name << "channel" << c.channel << c.stale << "replies never came";
+			c.stale = 0;
+		}
+		if(c.inflight.isEmpty() || ((now - c.inflight.head()->sent_ns) / 1000000 <= TIMEOUT_MS)){
+			continue;
+		}
+		// The chip may yet answer everything in flight, and a late reply would be taken
+		// for the packet written after it
+		c.timeouts += c.inflight.size();
+		c.stale += c.inflight.size();
+		c.stale_ns = now;
+		while(!c.inflight.isEmpty()){
+			JOB *job = c.inflight.dequeue();
+			if(job->abandoned){
+				delete job;
+			}
+			else{
+				job->done = true;
+				woke = true;
+			}
+		}
+	}
+	if(woke){
+		m_done.wakeAll();
+	}
+	send();
+}
+
+int AMBEPool::open_stream(int codec)
+{
+	QMutexLocker l(&m_mutex);
+	int best = -1;
+
+	if(!supports(codec)){
+		return -1;
+	}
+	for(int i = 0; i < m_channels.size(); ++i){
+		const CHANNEL &c = m_channels[i];
+		if(c.streams){
+			continue;
+		}
+		if((best == -1) || ((c.codec == codec) && (m_channels[best].codec != codec))){
+			best = i;
+		}
+	}
+	if(best == -1){
+		return -1;
+	}
+
+	CHANNEL &c = m_channels[best];
+	if(c.codec != codec){
+		const uint8_t *rate = (codec == Mode::CODEC_AMBE2450) ? AMBE3000_2450_0000 : (codec == Mode::CODEC_AMBE2450X1150) ? AMBE3000_2450_1150 : AMBE2000_2400_1200;
+		JOB *job = new JOB;
+		job->abandoned = true;
+		job->packet = packet(AMBE3000_TYPE_CONFIG, c.channel, QByteArray(reinterpret_cast<const char *>(rate) + 4, 13));
+		c.queue.enqueue(job);
+		c.codec = codec;
+		QMetaObject::invokeMethod(this, "pump", Qt::QueuedConnection);
+	}
+	c.streams = 1;
+	m_streams[m_nextstream] = best;
+	return m_nextstream++;
+}
+
+void AMBEPool::close_stream(int stream)
+{
+	QMutexLocker l(&m_mutex);
+	const int ch = m_streams.value(stream, -1);
+
+	if((ch != -1) && (ch < m_channels.size())){
+		--m_channels[ch].streams;
+	}
+	m_streams.remove(stream);
+}
+
+int AMBEPool::stream_codec(int stream)
+{
+	QMutexLocker l(&m_mutex);
+	const int ch = m_streams.value(stream, -1);
+
+	return ((ch != -1) && (ch < m_channels.size())) ? m_channels[ch].codec : (int)Mode::CODEC_NONE;
+}
+
+bool AMBEPool::submit(int stream, uint8_t type, const QByteArray &fields, QByteArray &reply)
+{
+	QMutexLocker l(&m_mutex);
+	QDeadlineTimer deadline(TIMEOUT_MS);
+	const int ch = m_streams.value(stream, -1);
+	JOB *job;
+	bool ok;
+
+	if((ch == -1) || (ch >= m_channels.size())){
+		return false;
+	}
+	job = new JOB;
+	job->packet = packet(type, m_channels[ch].channel, fields);
+	m_channels[ch].queue.enqueue(job);
+	QMetaObject::invokeMethod(this, "pump", Qt::QueuedConnection);
+
+	while(!job->done){
+		if(!m_done.wait(&m_mutex, deadline)){
+			break;
+		}
+	}
+	if(!job->done){
+		if((ch < m_channels.size()) && m_channels[ch].queue.removeOne(job)){
+			delete job;
+		}
+		else{
+			job->abandoned = true;
+		}
+		return false;
+	}
+	ok = job->ok;
+	reply = job->reply;
+	delete job;
+	return ok;
+}
+
+bool AMBEPool::decode(int stream, const uint8_t *frame, int16_t *pcm)
+{
+	const int n = frame_bytes(stream_codec(stream));
+	QByteArray fields, reply;
+
+	if(n == 0){
+		return false;
+	}
+	fields.append((char)AMBE3000_PKT_CHAND);
+	fields.append((char)((n == 7) ? 49 : 72));
+	fields.append(reinterpret_cast<const char *>(frame), n);
+	if(!submit(stream, AMBE3000_TYPE_CHANNEL, fields, reply)){
+		return false;
+	}
+	if((reply.size() < 2 + 320) || (reply[0] != AMBE3000_PKT_SPEECHD)){
+		return false;
+	}
+	for(int i = 0; i < 160; ++i){
+		pcm[i] = (((uint8_t)reply[2 + i * 2] << 8) | (uint8_t)reply[3 + i * 2]);
+	}
+	return true;
+}
+
+bool AMBEPool::encode(int stream, const int16_t *pcm, uint8_t *frame)
+{
+	const int n = frame_bytes(stream_codec(stream));
+	QByteArray fields, reply;
+
+	if(n == 0){
+		return false;
+	}
+	fields.append((char)AMBE3000_PKT_SPEECHD);
+	fields.append((char)160);
+	for(int i = 0; i < 160; ++i){
+		fields.append((char)((pcm[i] >> 8) & 0xff));
+		fields.append((char)(pcm[i] & 0xff));
+	}
+	if(!submit(stream, AMBE3000_TYPE_SPEECH, fields, reply)){
+		return false;
+	}
+	if((reply.size() < 2 + n) || (reply[0] != AMBE3000_PKT_CHAND)){
+		return false;
+	}
+	memcpy(frame, reply.constData() + 2, n);
+	return true;
+}
+
+QList<AMBEPool::CHANNEL_STATS> AMBEPool::stats()
+{
+	QMutexLocker l(&m_mutex);
+	QList<CHANNEL_STATS> s;
+
+	for(const CHANNEL &c : m_channels){
+		CHANNEL_STATS st;
+		st.device = m_devices[c.device].name;
+		st.channel = c.channel;
+		st.codec = c.codec;
+		st.streams = c.streams;
+		st.depth = c.queue.size() + c.inflight.size();
+		st.frames = c.frames;
+		st.timeouts = c.timeouts;
+		st.last_rtt_us = c.last_rtt_us;
+		st.avg_rtt_us = c.avg_rtt_us;
+		s.append(st);
+	}
+	return s;
+}
+
+AMBEPoolVocoder::AMBEPoolVocoder(AMBEPool *pool) :
+	m_pool(pool)
+{
+}
+
+AMBEPoolVocoder::~AMBEPoolVocoder()
+{
+	for(int s : m_streams){
+		if(s != -1){
+			m_pool->close_stream(s);
+		}
+	}
+	for(Vocoder *v : m_software){
+		VocoderRegistry::destroy(v);
+	}
+}
+
+int AMBEPoolVocoder::stream(int codec)
+{
+	if(!m_streams.contains(codec)){
+		m_streams[codec] = m_pool->open_stream(codec);
+	}
+	return m_streams[codec];
+}
+
+Vocoder * AMBEPoolVocoder::software(int codec)
+{
+	if(!m_software.contains(codec)){
+		m_software[codec] = VocoderRegistry::create(codec);
+	}
+	return m_software[codec];
+}
+
+void AMBEPoolVocoder::decode(int codec, int16_t *pcm, uint8_t *frame)
+{
+	const int s = stream(codec);
+
+	if((s == -1) || !m_pool->decode(s, frame, pcm)){
+		VocoderRegistry::decode(software(codec), codec, pcm, frame);
+	}
+}
+
+void AMBEPoolVocoder::encode(int codec, int16_t *pcm, uint8_t *frame)
+{
+	const int s = stream(codec);
+
+	if((s == -1) || !m_pool->encode(s, pcm, frame)){
+		VocoderRegistry::encode(software(codec), codec, pcm, frame);
+	}
+}
+
+void AMBEPoolVocoder::decode_2400x1200(int16_t *pcm, uint8_t *codec) { decode(Mode::CODEC_AMBE2400X1200, pcm, codec); }
+void AMBEPoolVocoder::decode_2450x1150(int16_t *pcm, uint8_t *codec) { decode(Mode::CODEC_AMBE2450X1150, pcm, codec); }
+void AMBEPoolVocoder::decode_2450(int16_t *pcm, uint8_t *codec) { decode(Mode::CODEC_AMBE2450, pcm, codec); }
+void AMBEPoolVocoder::encode_2400x1200(int16_t *pcm, uint8_t *codec) { encode(Mode::CODEC_AMBE2400X1200, pcm, codec); }
+void AMBEPoolVocoder::encode_2450x1150(int16_t *pcm, uint8_t *codec) { encode(Mode::CODEC_AMBE2450X1150, pcm, codec); }
+void AMBEPoolVocoder::encode_2450(int16_t *pcm, uint8_t *codec) { encode(Mode::CODEC_AMBE2450, pcm, codec); }
@@ -0,0 +1,153 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef AMBEPOOL_H
+#define AMBEPOOL_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QQueue>
+#include <QSerialPort>
+#include <QStringList>
+#include <QThread>
+#include <QTimer>
+#include <QWaitCondition>
+#include "vocoder_plugin.h"
+
+// All the channels of several AMBE-3000 and AMBE-3003 dongles, one per ThumbDV or DVstick
+// and three per AMBE-3003, shared by vocoder streams on any thread. Every packet names its
+// channel, and up to MAX_INFLIGHT packets are written to a channel before its replies come
+// back, which each channel returns in order. A stream is given a channel of its own for its
+// whole life, since the chip keeps vocoder state per channel, and open_stream() fails once
+// every channel is taken. A channel whose reply times out has lost track of which reply
+// answers which packet, so everything in flight on it is failed and nothing more is written
+// to it until the replies still owed have come in, or a further TIMEOUT_MS has passed. The
+// ports are run by a thread of the pool's own.
+class AMBEPool : public QObject
+{
+	Q_OBJECT
+public:
+	AMBEPool();
+	~AMBEPool();
+	static const int MAX_INFLIGHT = 2;
+	static const int TIMEOUT_MS = 500;
+	struct CHANNEL_STATS {
+		QString device;
+		int channel;
+		int codec;
+		int streams;
+		int depth;			// Packets queued and in flight
+		quint64 frames;
+		quint64 timeouts;
+		qint64 last_rtt_us;
+		qint64 avg_rtt_us;
+	};
+	// Opens the ports and waits for each dongle to identify itself, returns the number of
+	// channels found
+	int open(const QStringList &ports, int baud = 460800);
+	int channels();
+	static bool supports(int codec);
+	// -1 if every channel is busy with another rate
+	int open_stream(int codec);
+	void close_stream(int stream);
+	// Thread safe, block until the reply or TIMEOUT_MS
+	bool decode(int stream, const uint8_t *frame, int16_t *pcm);
+	bool encode(int stream, const int16_t *pcm, uint8_t *frame);
+	QList<CHANNEL_STATS> stats();
+private slots:
+	void open_ports(QStringList ports, int baud);
+	void close_ports();
+	void process_serial();
+	void pump();
+	void check_timeouts();
+private:
+	struct JOB {
+		QByteArray packet;
+		QByteArray reply;
+		qint64 sent_ns = 0;
+		bool done = false;
+		bool ok = false;
+		bool abandoned = false;	// Nobody waits for it, deleted with the reply
+	};
+	struct DEVICE {
+		QSerialPort *port;
+		QString name;
+		QByteArray rx;
+		QString prodid;
+		QString version;
+		int first;		// Index of its channel 0 in m_channels, -1 until identified
+	};
+	struct CHANNEL {
+		int device;
+		int channel;
+		int codec;
+		int streams;
+		QQueue<JOB *> queue;
+		QQueue<JOB *> inflight;
+		quint64 frames;
+		quint64 timeouts;
+		qint64 last_rtt_us;
+		qint64 avg_rtt_us;
+		int stale;			// Late replies still owed for packets failed on a timeout
+		qint64 stale_ns;
+	};
+	QThread *m_thread;
+	QTimer *m_timer;
+	QMutex m_mutex;
+	QWaitCondition m_done;
+	QElapsedTimer m_clock;
+	QList<DEVICE> m_devices;
+	QList<CHANNEL> m_channels;
+	QHash<int, int> m_streams;		// Stream to channel
+	int m_nextstream;
+
+	void handle_packet(int device, const QByteArray &pkt);
+	void send();
+	int stream_codec(int stream);
+	bool submit(int stream, uint8_t type, const QByteArray &fields, QByteArray &reply);
+	static QByteArray packet(uint8_t type, int channel, const QByteArray &fields);
+	static int frame_bytes(int codec);
+};
+
+// One AMBEPool channel per rate behind the Vocoder interface, for TranscodePipeline. A
+// rate with no free channel, or a frame the pool times out on, goes to the software
+// vocoder instead.
+class AMBEPoolVocoder : public Vocoder
+{
+public:
+	AMBEPoolVocoder(AMBEPool *pool);
+	~AMBEPoolVocoder();
+	void decode_2400x1200(int16_t *pcm, uint8_t *codec) override;
+	void decode_2450x1150(int16_t *pcm, uint8_t *codec) override;
+	void decode_2450(int16_t *pcm, uint8_t *codec) override;
+	void encode_2400x1200(int16_t *pcm, uint8_t *codec) override;
+	void encode_2450x1150(int16_t *pcm, uint8_t *codec) override;
+	void encode_2450(int16_t *pcm, uint8_t *codec) override;
+private:
+	AMBEPool *m_pool;
+	QHash<int, int> m_streams;		// Codec to stream, -1 when the pool had no channel
+	QHash<int, Vocoder *> m_software;
+
+	void decode(int codec, int16_t *pcm, uint8_t *frame);
+	void encode(int codec, int16_t *pcm, uint8_t *frame);
+	int stream(int codec);
+	Vocoder * software(int codec);
+};
+
+#endif // AMBEPOOL_H
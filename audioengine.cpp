@@ -16,7 +16,9 @@
 */
 
 #include "audioengine.h"
+#include "audiomixer.h"
 #include <QDebug>
+#include <QtEndian>
 #include <cmath>
 
 #if defined (Q_OS_MACOS) || defined(Q_OS_IOS)
@@ -30,6 +32,11 @@ AudioEngine::AudioEngine(QString in, QString out) :
 	m_inputdevice(in),
 	m_out(nullptr),
 	m_in(nullptr),
+	m_outdev(nullptr),
+	m_indev(nullptr),
+	m_wav(nullptr),
+	m_mixer(nullptr),
+	m_mixinput(-1),
 	m_srm(1)
 {
 	m_audio_out_temp_buf_p = m_audio_out_temp_buf;
@@ -42,6 +49,14 @@ AudioEngine::AudioEngine(QString in, QString out) :
 
 AudioEngine::~AudioEngine()
 {
+	if(m_wav != nullptr){
+		write_wav_header();
+		m_wav->close();
+		delete m_wav;
+	}
+	if(m_mixer != nullptr){
+		m_mixer->remove_input(m_mixinput);
+	}
 }
 
 QStringList AudioEngine::discover_audio_devices(uint8_t d)
@@ -73,8 +88,39 @@ void AudioEngine::init()
 
 	m_agc = true;
 
+	// "null" as the playback device decodes without opening any audio hardware
+	if(m_outputdevice == "null"){
+		return;
+	}
+
+	// "wav:<path>" as the playback device writes decoded audio to a file instead of a sound card
+	if(m_outputdevice.startsWith("wav:")){
+		m_wav = new QFile(m_outputdevice.mid(4));
+		if(m_wav->open(QIODevice::WriteOnly | QIODevice::Truncate)){
+			write_wav_header();
+			qDebug() << "Playback device: " << m_wav->fileName();
+		}
+		else{
+			qWarning() << "Cannot open WAV output " << m_wav->fileName();
+			delete m_wav;
+			m_wav = nullptr;
+		}
+		return;
+	}
+
 	QList<QAudioDevice> devices = QMediaDevices::audioOutputs();
-	if(devices.size() == 0){
+	// "mixer[:priority]" as the playback device feeds the shared AudioMixer of a multi-session front end
+	if(m_outputdevice.startsWith("mixer")){
+		m_mixer = AudioMixer::current();
+		if(m_mixer != nullptr){
+			m_mixinput = m_mixer->add_input(m_outputdevice.section(':', 1).toInt());
+			qDebug() << "Playback device: mixer input " << m_mixinput;
+		}
+		else{
+			qWarning() << "No audio mixer running";
+		}
+	}
+	else if(devices.size() == 0){
         qDebug() << "No audio playback hardware found";
 	}
 	else{
@@ -142,6 +188,16 @@ void AudioEngine::init()
 	}
 }
 
+void AudioEngine::set_output_volume(qreal v)
+{
+	if(m_mixer != nullptr){
+		m_mixer->set_gain(m_mixinput, v);
+	}
+	else if(m_out != nullptr){
+		m_out->setVolume(v);
+	}
+}
+
 void AudioEngine::start_capture()
 {
 	m_audioinq.clear();
@@ -154,9 +210,10 @@ void AudioEngine::start_capture()
 
 void AudioEngine::stop_capture()
 {
-	if(m_in != nullptr){
+	if((m_in != nullptr) && (m_indev != nullptr)){
 		m_indev->disconnect();
 		m_in->stop();
+		m_indev = nullptr;
 	}
 }
 
@@ -224,10 +281,18 @@ void AudioEngine::write(int16_t *pcm, size_t s)
 		process_audio(pcm, s);
 	}
 
-	size_t l = m_outdev->write((const char *) pcm, sizeof(int16_t) * s);
+	if(m_wav != nullptr){
+		m_wav->write((const char *) pcm, sizeof(int16_t) * s);
+	}
+	else if(m_mixer != nullptr){
+		m_mixer->write(m_mixinput, pcm, s);
+	}
+	else if(m_out != nullptr){
+		size_t l = m_outdev->write((const char *) pcm, sizeof(int16_t) * s);
 
-	if (l*2 < s){
-		qDebug() << "AudioEngine::write() " << s << ":" << l << ":" << (int)m_out->bytesFree() << ":" << m_out->bufferSize() << ":" << m_out->error();
+		if (l*2 < s){
+			qDebug() << "AudioEngine::write() " << s << ":" << l << ":" << (int)m_out->bytesFree() << ":" << m_out->bufferSize() << ":" << m_out->error();
+		}
 	}
 
 	for(uint32_t i = 0; i < s; ++i){
@@ -372,6 +437,20 @@ void AudioEngine::process_audio(int16_t *pcm, size_t s)
 	}
 }
 
+void AudioEngine::write_wav_header()
+{
+	const quint32 datalen = m_wav->size() > 44 ? m_wav->size() - 44 : 0;
+	const quint32 riff[] = { 36 + datalen, 0x45564157, 0x20746d66, 16, 0x00010001, 8000, 16000, 0x00100002, 0x61746164, datalen };
+
+	m_wav->seek(0);
+	m_wav->write("RIFF", 4);
+	for(quint32 v : riff){
+		quint32 le = qToLittleEndian(v);
+		m_wav->write((const char *)&le, 4);
+	}
+	m_wav->seek(m_wav->size());
+}
+
 void AudioEngine::handleStateChanged(QAudio::State newState)
 {
 	switch (newState) {
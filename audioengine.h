@@ -31,10 +31,13 @@
 #endif
 #include <QAudioOutput>
 #include <QQueue>
+#include <QFile>
 
 #define AUDIO_OUT 1
 #define AUDIO_IN  0
 
+class AudioMixer;
+
 class AudioEngine : public QObject
 {
 	Q_OBJECT
@@ -44,14 +47,16 @@ public:
 	~AudioEngine();
 	static QStringList discover_audio_devices(uint8_t d);
 	void init();
+	QString input_device() { return m_inputdevice; }
+	QString output_device() { return m_outputdevice; }
 	void start_capture();
 	void stop_capture();
 	void start_playback();
 	void stop_playback();
 	void write(int16_t *, size_t);
-	void set_output_buffer_size(uint32_t b) { m_out->setBufferSize(b); }
+	void set_output_buffer_size(uint32_t b) { if(m_out != nullptr) m_out->setBufferSize(b); }
 	void set_input_buffer_size(uint32_t b) { if(m_in != nullptr) m_in->setBufferSize(b); }
-	void set_output_volume(qreal v){ m_out->setVolume(v); }
+	void set_output_volume(qreal v);
 	void set_input_volume(qreal v){ if(m_in != nullptr) m_in->setVolume(v); }
 	void set_agc(bool agc) { m_agc = agc; }
 	bool frame_available() { return (m_audioinq.size() >= 320) ? true : false; }
@@ -72,6 +77,9 @@ private:
 #endif
 	QIODevice *m_outdev;
 	QIODevice *m_indev;
+	QFile *m_wav;
+	AudioMixer *m_mixer;
+	int m_mixinput;
 	QQueue<int16_t> m_audioinq;
 	uint16_t m_maxlevel;
 	bool m_agc;
@@ -100,6 +108,7 @@ private:
 private slots:
 	void input_data_received();
 	void process_audio(int16_t *pcm, size_t s);
+	void write_wav_header();
 	void handleStateChanged(QAudio::State newState);
 };
 
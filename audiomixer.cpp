@@ -0,0 +1,308 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <QDebug>
+#include <climits>
+#include <cstring>
+#include "audiomixer.h"
+#include "audioengine.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+#define MIXER_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define MIXER_NEON 1
+#endif
+
+#define Q15_UNITY 32767
+
+std::atomic<AudioMixer *> AudioMixer::s_current(nullptr);
+
+AudioMixer::AudioMixer(QString out, QObject *parent) :
+	QObject(parent),
+	m_outputdevice(out),
+	m_audio(nullptr),
+	m_timer(nullptr),
+	m_duck(to_q15(0.25)),
+	m_dropped(0),
+	m_simd(true)
+{
+	for(int i = 0; i < MAX_INPUTS; ++i){
+		m_inputs[i].used = false;
+		m_inputs[i].gain = Q15_UNITY;
+		m_inputs[i].priority = 0;
+		m_inputs[i].head = 0;
+		m_inputs[i].tail = 0;
+	}
+	memset(m_out, 0, sizeof(m_out));
+	s_current.store(this, std::memory_order_release);
+}
+
+AudioMixer::~AudioMixer()
+{
+	AudioMixer *m = this;
+	s_current.compare_exchange_strong(m, nullptr);
+	stop();
+}
+
+bool AudioMixer::simd_available()
+{
+#if defined(MIXER_SSE2) || defined(MIXER_NEON)
+	return true;
+#else
+	return false;
+#endif
+}
+
+int16_t AudioMixer::to_q15(qreal v)
+{
+	return (int16_t)(qBound(0.0, v, 1.0) * Q15_UNITY + 0.5);
+}
+
+void AudioMixer::start()
+{
+	if(m_timer != nullptr){
+		return;
+	}
+
+	if(!m_outputdevice.isEmpty()){
+		m_audio = new AudioEngine("None", m_outputdevice);
+		m_audio->init();
+		m_audio->set_agc(false);
+		m_audio->start_playback();
+	}
+
+	m_timer = new QTimer(this);
+	m_timer->setTimerType(Qt::PreciseTimer);
+	connect(m_timer, SIGNAL(timeout()), this, SLOT(tick()));
+	m_timer->start(FRAME / 8);
+}
+
+void AudioMixer::stop()
+{
+	if(m_timer != nullptr){
+		m_timer->stop();
+		delete m_timer;
+		m_timer = nullptr;
+	}
+
+	if(m_audio != nullptr){
+		m_audio->stop_playback();
+		delete m_audio;
+		m_audio = nullptr;
+	}
+}
+
+int AudioMixer::add_input(int priority, qreal gain)
+{
+	QMutexLocker lock(&m_mutex);
+
+	for(int i = 0; i < MAX_INPUTS; ++i){
+		INPUT &in = m_inputs[i];
+		if(!in.used.load(std::memory_order_relaxed)){
+			in.head.store(0, std::memory_order_relaxed);
+			in.tail.store(0, std::memory_order_relaxed);
+			in.gain.store(to_q15(gain), std::memory_order_relaxed);
+			in.priority.store(priority, std::memory_order_relaxed);
+			in.used.store(true, std::memory_order_release);
+			qDebug() << "AudioMixer: input" << i << "priority" << priority;
+			return i;
+		}
+	}
+	qWarning() << "AudioMixer: no free inputs";
+	return -1;
+}
+
+void AudioMixer::remove_input(int i)
+{
+	QMutexLocker lock(&m_mutex);
+
+	if((i >= 0) && (i < MAX_INPUTS)){
+		m_inputs[i].used.store(false, std::memory_order_release);
+	}
+}
+
+void AudioMixer::set_gain(int i, qreal gain)
+{
+	if((i >= 0) && (i < MAX_INPUTS)){
+		m_inputs[i].gain.store(to_q15(gain), std::memory_order_relaxed);
+	}
+}
+
+void AudioMixer::set_priority(int i, int priority)
+{
+	if((i >= 0) && (i < MAX_INPUTS)){
+		m_inputs[i].priority.store(priority, std::memory_order_relaxed);
+	}
+}
+
+size_t AudioMixer::write(int i, const int16_t *pcm, size_t s)
+{
+	if((i < 0) || (i >= MAX_INPUTS)){
+		return 0;
+	}
+
+	INPUT &in = m_inputs[i];
+	const uint32_t head = in.head.load(std::memory_order_relaxed);
+	const uint32_t tail = in.tail.load(std::memory_order_acquire);
+	const size_t n = qMin<size_t>(s, RING - (head - tail));
+	const size_t p = head & (RING - 1);
+	const size_t first = qMin<size_t>(n, RING - p);
+
+	memcpy(in.buf + p, pcm, first * sizeof(int16_t));
+	memcpy(in.buf, pcm + first, (n - first) * sizeof(int16_t));
+	in.head.store(head + n, std::memory_order_release);
+
+	if(n < s){
+		m_dropped.fetch_add(s - n, std::memory_order_relaxed);
+	}
+	return n;
+}
+
+int AudioMixer::mix(int16_t *out, size_t s)
+{
+	QMutexLocker lock(&m_mutex);
+	uint32_t avail[MAX_INPUTS];
+	int active = 0;
+
+	for(size_t o = 0; o < s; o += FRAME){
+		const size_t n = qMin<size_t>(FRAME, s - o);
+		int top = INT_MIN;
+		int count = 0;
+
+		memset(out + o, 0, n * sizeof(int16_t));
+
+		// Trim every ring to the latency bound and find the highest priority with audio
+		for(int i = 0; i < MAX_INPUTS; ++i){
+			INPUT &in = m_inputs[i];
+			avail[i] = 0;
+			if(!in.used.load(std::memory_order_acquire)){
+				continue;
+			}
+			uint32_t tail = in.tail.load(std::memory_order_relaxed);
+			uint32_t a = in.head.load(std::memory_order_acquire) - tail;
+			if(a > MAX_LATENCY){
+				m_dropped.fetch_add(a - MAX_LATENCY, std::memory_order_relaxed);
+				in.tail.store(tail + a - MAX_LATENCY, std::memory_order_release);
+				a = MAX_LATENCY;
+			}
+			if(a){
+				avail[i] = a;
+				top = qMax(top, in.priority.load(std::memory_order_relaxed));
+			}
+		}
+
+		for(int i = 0; i < MAX_INPUTS; ++i){
+			if(avail[i] == 0){
+				continue;
+			}
+			INPUT &in = m_inputs[i];
+			const uint32_t tail = in.tail.load(std::memory_order_relaxed);
+			const size_t take = qMin<size_t>(avail[i], n);
+			const size_t p = tail & (RING - 1);
+			const size_t first = qMin<size_t>(take, RING - p);
+			int16_t gain = in.gain.load(std::memory_order_relaxed);
+
+			if(in.priority.load(std::memory_order_relaxed) < top){
+				gain = (int16_t)(((int32_t)gain * m_duck.load(std::memory_order_relaxed) + 0x4000) >> 15);
+			}
+
+			if(m_simd){
+				accumulate(out + o, in.buf + p, gain, first);
+				accumulate(out + o + first, in.buf, gain, take - first);
+			}
+			else{
+				accumulate_scalar(out + o, in.buf + p, gain, first);
+				accumulate_scalar(out + o + first, in.buf, gain, take - first);
+			}
+			in.tail.store(tail + take, std::memory_order_release);
+			++count;
+		}
+		active = qMax(active, count);
+	}
+	return active;
+}
+
+void AudioMixer::tick()
+{
+	if(mix(m_out, FRAME) && (m_audio != nullptr)){
+		m_audio->write(m_out, FRAME);
+	}
+}
+
+void AudioMixer::accumulate_scalar(int16_t *acc, const int16_t *in, int16_t gain, size_t s)
+{
+	for(size_t i = 0; i < s; ++i){
+		int32_t x = in[i];
+		if(gain != Q15_UNITY){
+			x = (x * gain + 0x4000) >> 15;
+		}
+		x += acc[i];
+		acc[i] = (int16_t)qBound(-32768, x, 32767);
+	}
+}
+
+void AudioMixer::accumulate(int16_t *acc, const int16_t *in, int16_t gain, size_t s)
+{
+	size_t i = 0;
+#if defined(MIXER_SSE2)
+	if(gain == Q15_UNITY){
+		for(; i + 8 <= s; i += 8){
+			const __m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+			const __m128i a = _mm_loadu_si128((const __m128i *)(acc + i));
+			_mm_storeu_si128((__m128i *)(acc + i), _mm_adds_epi16(a, x));
+		}
+	}
+	else{
+		const __m128i g = _mm_set1_epi16(gain);
+#if !defined(__SSSE3__)
+		const __m128i r = _mm_set1_epi32(0x4000);
+#endif
+		for(; i + 8 <= s; i += 8){
+			__m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+			const __m128i a = _mm_loadu_si128((const __m128i *)(acc + i));
+#if defined(__SSSE3__)
+			x = _mm_mulhrs_epi16(x, g);
+#else
+			const __m128i lo = _mm_mullo_epi16(x, g);
+			const __m128i hi = _mm_mulhi_epi16(x, g);
+			const __m128i p0 = _mm_srai_epi32(_mm_add_epi32(_mm_unpacklo_epi16(lo, hi), r), 15);
+			const __m128i p1 = _mm_srai_epi32(_mm_add_epi32(_mm_unpackhi_epi16(lo, hi), r), 15);
+			x = _mm_packs_epi32(p0, p1);
+#endif
+			_mm_storeu_si128((__m128i *)(acc + i), _mm_adds_epi16(a, x));
+		}
+	}
+#elif defined(MIXER_NEON)
+	if(gain == Q15_UNITY){
+		for(; i + 8 <= s; i += 8){
+			vst1q_s16(acc + i, vqaddq_s16(vld1q_s16(acc + i), vld1q_s16(in + i)));
+		}
+	}
+	else{
+		const int16x8_t g = vdupq_n_s16(gain);
+		for(; i + 8 <= s; i += 8){
+			vst1q_s16(acc + i, vqaddq_s16(vld1q_s16(acc + i), vqrdmulhq_s16(vld1q_s16(in + i), g)));
+		}
+	}
+#endif
+	accumulate_scalar(acc + i, in + i, gain, s - i);
+}
@@ -0,0 +1,86 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef AUDIOMIXER_H
+#define AUDIOMIXER_H
+
+#include <QObject>
+#include <QMutex>
+#include <QTimer>
+#include <atomic>
+
+class AudioEngine;
+
+// Sums the 8 kHz decoded audio of several modes into one playback device. Each input is
+// a lock-free single producer ring written from its mode's thread through an AudioEngine
+// opened on the "mixer[:priority]" device. Every 20 ms one frame is taken from each ring,
+// scaled by the input gain, ducked while an input of higher priority is active, and added
+// with saturation. Rings hold at most MAX_LATENCY samples, older audio is dropped.
+class AudioMixer : public QObject
+{
+	Q_OBJECT
+public:
+	AudioMixer(QString out = QString(), QObject *parent = nullptr);
+	~AudioMixer();
+	static AudioMixer * current() { return s_current.load(std::memory_order_acquire); }
+	enum{
+		MAX_INPUTS = 16,
+		FRAME = 160,
+		RING = 2048,
+		MAX_LATENCY = FRAME * 4
+	};
+	int add_input(int priority = 0, qreal gain = 1.0);
+	void remove_input(int i);
+	void set_gain(int i, qreal gain);
+	void set_priority(int i, int priority);
+	void set_duck(qreal duck) { m_duck.store(to_q15(duck)); }
+	void set_simd(bool simd) { m_simd = simd; }
+	size_t write(int i, const int16_t *pcm, size_t s);
+	int mix(int16_t *out, size_t s);
+	quint64 dropped() { return m_dropped.load(); }
+	static bool simd_available();
+public slots:
+	void start();
+	void stop();
+private slots:
+	void tick();
+private:
+	struct INPUT {
+		std::atomic<bool> used;
+		std::atomic<int16_t> gain;
+		std::atomic<int> priority;
+		std::atomic<uint32_t> head;
+		std::atomic<uint32_t> tail;
+		int16_t buf[RING];
+	};
+	static std::atomic<AudioMixer *> s_current;
+	QString m_outputdevice;
+	AudioEngine *m_audio;
+	QTimer *m_timer;
+	QMutex m_mutex;
+	INPUT m_inputs[MAX_INPUTS];
+	int16_t m_out[FRAME];
+	std::atomic<int16_t> m_duck;
+	std::atomic<quint64> m_dropped;
+	bool m_simd;
+
+	static int16_t to_q15(qreal v);
+	static void accumulate(int16_t *acc, const int16_t *in, int16_t gain, size_t s);
+	static void accumulate_scalar(int16_t *acc, const int16_t *in, int16_t gain, size_t s);
+};
+
+#endif // AUDIOMIXER_H
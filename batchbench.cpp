@@ -0,0 +1,206 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// droidstar-batchbench: AMBE decoding one channel at a time against the batch API.
+//
+//   droidstar-batchbench [-r 2450|2450x1150|2400x1200] [-c 1,8,32] [-s seconds]
+//
+// Synthetic speech is encoded once and decoded by every channel, each with its own
+// decoder state, first with one decode call per channel and frame and then with one
+// batch call per frame for all the channels. The time is per channel and frame. The
+// level and the log spectral distance compare the batch output with the single channel
+// output of the same channel.
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QVector>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "imbe_vocoder/imbe_vocoder_api.h"
+#include "mbe/mbevocoder_api.h"
+
+static const int BINS = 32;
+
+// A vowel with a gliding pitch and a fricative, 0.4 s each
+static QVector<int16_t> synthetic_speech(int seconds)
+{
+	QVector<int16_t> pcm(seconds * 8000);
+	double phase = 0;
+	unsigned int seed = 1;
+
+	for(int n = 0; n < (int)pcm.size(); ++n){
+		const double t = n / 8000.0;
+		const double f0 = 110 + 40 * sin(2 * M_PI * 0.4 * t);
+		double s = 0;
+		if(fmod(t, 0.8) < 0.4){
+			phase += 2 * M_PI * f0 / 8000;
+			for(int h = 1; h * f0 < 3800; ++h){
+				s += sin(h * phase) * 4000 / h * ((h * f0 < 900) ? 1.0 : 0.3);
+			}
+		}
+		else{
+			seed = seed * 1103515245 + 12345;
+			s = (((seed >> 8) & 0xffff) - 32768) / 16.0;
+		}
+		pcm[n] = (int16_t)qBound(-32768.0, s, 32767.0);
+	}
+	return pcm;
+}
+
+static void encode(MBEVocoder &v, const QString &rate, int16_t *pcm, uint8_t *ambe)
+{
+	memset(ambe, 0, 9);
+	if(rate == "2400x1200"){
+		v.encode_2400x1200(pcm, ambe);
+	}
+	else if(rate == "2450x1150"){
+		v.encode_2450x1150(pcm, ambe);
+	}
+	else{
+		v.encode_2450(pcm, ambe);
+	}
+}
+
+static void decode(MBEVocoder &v, const QString &rate, int16_t *pcm, uint8_t *ambe)
+{
+	if(rate == "2400x1200"){
+		v.decode_2400x1200(pcm, ambe);
+	}
+	else if(rate == "2450x1150"){
+		v.decode_2450x1150(pcm, ambe);
+	}
+	else{
+		v.decode_2450(pcm, ambe);
+	}
+}
+
+static void decode_batch(MBEVocoder **v, const QString &rate, int16_t **pcm, uint8_t **ambe, int n)
+{
+	if(rate == "2400x1200"){
+		MBEVocoder::decode_2400x1200_batch(v, ambe, pcm, n);
+	}
+	else if(rate == "2450x1150"){
+		MBEVocoder::decode_2450x1150_batch(v, ambe, pcm, n);
+	}
+	else{
+		MBEVocoder::decode_2450_batch(v, ambe, pcm, n);
+	}
+}
+
+// Log power of a frame in BINS bands
+static void spectrum(const int16_t *pcm, double *out)
+{
+	for(int k = 0; k < BINS; ++k){
+		double re = 0, im = 0;
+		for(int i = 0; i < 160; ++i){
+			const double w = 0.5 - 0.5 * cos(2 * M_PI * i / 160);
+			re += w * pcm[i] * cos(M_PI * (k + 0.5) * i / BINS);
+			im += w * pcm[i] * sin(M_PI * (k + 0.5) * i / BINS);
+		}
+		out[k] = 10 * log10(re * re + im * im + 1);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	QCommandLineParser parser;
+
+	parser.setApplicationDescription("Batch AMBE decoding benchmark");
+	parser.addHelpOption();
+	parser.addOption({{"r", "rate"}, "2450, 2450x1150 or 2400x1200", "rate", "2450"});
+	parser.addOption({{"c", "channels"}, "Channel counts to run", "list", "1,8,32"});
+	parser.addOption({{"s", "seconds"}, "Seconds of speech", "seconds", "10"});
+	parser.process(app);
+
+	const QString rate = parser.value("rate");
+	const QVector<int16_t> speech = synthetic_speech(qMax(1, parser.value("seconds").toInt()));
+	const int frames = speech.size() / 160;
+	QVector<uint8_t> ambe(frames * 9);
+	{
+		MBEVocoder enc;
+		QVector<int16_t> pcm = speech;
+		for(int f = 0; f < frames; ++f){
+			encode(enc, rate, &pcm[f * 160], &ambe[f * 9]);
+		}
+	}
+
+	fprintf(stdout, "AMBE %s, %d frames per channel\n", rate.toStdString().c_str(), frames);
+	fprintf(stdout, "%8s %10s %10s %8s %8s %8s\n", "channels", "us_single", "us_batch", "speedup", "level", "lsd");
+
+	for(const QString &c : parser.value("channels").split(',')){
+		const int n = qMax(1, c.toInt());
+		QVector<MBEVocoder *> single(n), batch(n);
+		QVector<int16_t> a(n * frames * 160), b(n * frames * 160);
+		QVector<int16_t *> out(n);
+		QVector<uint8_t *> in(n);
+		QElapsedTimer t;
+		double us[2], ea = 0, eb = 0, lsd = 0;
+		int voiced = 0;
+
+		for(int i = 0; i < n; ++i){
+			single[i] = new MBEVocoder();
+			batch[i] = new MBEVocoder();
+		}
+
+		t.start();
+		for(int f = 0; f < frames; ++f){
+			for(int i = 0; i < n; ++i){
+				decode(*single[i], rate, &a[(i * frames + f) * 160], &ambe[f * 9]);
+			}
+		}
+		us[0] = t.nsecsElapsed() / 1000.0 / frames / n;
+
+		t.start();
+		for(int f = 0; f < frames; ++f){
+			for(int i = 0; i < n; ++i){
+				out[i] = &b[(i * frames + f) * 160];
+				in[i] = &ambe[f * 9];
+			}
+			decode_batch(batch.data(), rate, out.data(), in.data(), n);
+		}
+		us[1] = t.nsecsElapsed() / 1000.0 / frames / n;
+
+		for(int f = 0; f < frames; ++f){
+			double sa[BINS], sb[BINS], d = 0, e = 0;
+			for(int i = 0; i < 160; ++i){
+				e += (double)a[f * 160 + i] * a[f * 160 + i];
+				ea += (double)a[f * 160 + i] * a[f * 160 + i];
+				eb += (double)b[f * 160 + i] * b[f * 160 + i];
+			}
+			if(e < 160.0 * 100 * 100){
+				continue;
+			}
+			spectrum(&a[f * 160], sa);
+			spectrum(&b[f * 160], sb);
+			for(int k = 0; k < BINS; ++k){
+				d += (sa[k] - sb[k]) * (sa[k] - sb[k]);
+			}
+			lsd += sqrt(d / BINS);
+			++voiced;
+		}
+		fprintf(stdout, "%8d %10.1f %10.1f %7.2fx %+8.2f %8.2f\n", n, us[0], us[1], us[0] / us[1], 10 * log10((eb + 1) / (ea + 1)), voiced ? lsd / voiced : 0.0);
+
+		for(int i = 0; i < n; ++i){
+			delete single[i];
+			delete batch[i];
+		}
+	}
+	return 0;
+}
@@ -1527,7 +1527,7 @@ void CCodec2::synthesise(
 
 int CCodec2::codec2_rand(void)
 {
-	static unsigned long next = 1;
+	static thread_local unsigned long next = 1;
 	next = next * 1103515245 + 12345;
 	return((unsigned)(next/65536) % 32768);
 }
@@ -0,0 +1,234 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "codecrelay.h"
+
+CodecRelay::CodecRelay(Mode *a, Mode *b, QObject *parent) :
+	QObject(parent),
+	m_active(-1),
+	m_txcodec(Mode::CODEC_NONE),
+	m_txstarted(false)
+{
+	qRegisterMetaType<Mode::MODEINFO>("Mode::MODEINFO");
+	m_modes[0] = a;
+	m_modes[1] = b;
+	m_transcoder[0] = nullptr;
+	m_transcoder[1] = nullptr;
+
+	for(int i = 0; i < 2; ++i){
+		connect(m_modes[i], SIGNAL(relay_rx(int,QByteArray)), this, SLOT(mode_relay_rx(int,QByteArray)));
+		connect(m_modes[i], SIGNAL(relay_rx_end()), this, SLOT(mode_relay_rx_end()));
+		connect(m_modes[i], SIGNAL(update(Mode::MODEINFO)), this, SLOT(mode_update(Mode::MODEINFO)));
+		QMetaObject::invokeMethod(m_modes[i], "set_relay_rx", Q_ARG(bool, true));
+
+		if(!can_relay(m_modes[i], m_modes[i ^ 1])){
+			qWarning() << "CodecRelay: no common codec from" << m_modes[i]->metaObject()->className() << "to" << m_modes[i ^ 1]->metaObject()->className();
+		}
+	}
+}
+
+CodecRelay::~CodecRelay()
+{
+	for(int i = 0; i < 2; ++i){
+		if(m_modes[i]){
+			disconnect(m_modes[i], nullptr, this, nullptr);
+			QMetaObject::invokeMethod(m_modes[i], "set_relay_rx", Q_ARG(bool, false));
+			if(m_active == (i ^ 1)){
+				QMetaObject::invokeMethod(m_modes[i], "relay_tx_end");
+			}
+		}
+		delete m_transcoder[i];
+	}
+}
+
+bool CodecRelay::can_relay(Mode *from, Mode *to)
+{
+	for(int c : from->relay_codecs()){
+		if(target_codec(c, to->relay_codecs()) != Mode::CODEC_NONE){
+			return true;
+		}
+	}
+	return false;
+}
+
+int CodecRelay::side(QObject *o)
+{
+	for(int i = 0; i < 2; ++i){
+		if(m_modes[i] == o){
+			return i;
+		}
+	}
+	return -1;
+}
+
+// Same codec if the destination has it, then the other member of the AMBE 2450 family,
+// then a transcode between IMBE and AMBE 2450
+int CodecRelay::target_codec(int from, const QList<int> &to)
+{
+	if(to.contains(from)){
+		return from;
+	}
+	if((from == Mode::CODEC_AMBE2450) && to.contains(Mode::CODEC_AMBE2450X1150)){
+		return Mode::CODEC_AMBE2450X1150;
+	}
+	if((from == Mode::CODEC_AMBE2450X1150) && to.contains(Mode::CODEC_AMBE2450)){
+		return Mode::CODEC_AMBE2450;
+	}
+	if(from == Mode::CODEC_IMBE4400){
+		if(to.contains(Mode::CODEC_AMBE2450)){
+			return Mode::CODEC_AMBE2450;
+		}
+		if(to.contains(Mode::CODEC_AMBE2450X1150)){
+			return Mode::CODEC_AMBE2450X1150;
+		}
+	}
+	if(((from == Mode::CODEC_AMBE2450) || (from == Mode::CODEC_AMBE2450X1150)) && to.contains(Mode::CODEC_IMBE4400)){
+		return Mode::CODEC_IMBE4400;
+	}
+	return Mode::CODEC_NONE;
+}
+
+// Returns the number of bit errors corrected, or -1 if the frame can't be converted
+int CodecRelay::convert(int dir, int from, int to, const QByteArray &in, QByteArray &out)
+{
+	uint8_t ambe[7];
+	int errs = 0;
+
+	if(from == to){
+		out = in;
+		return 0;
+	}
+	if((from == Mode::CODEC_AMBE2450) && (to == Mode::CODEC_AMBE2450X1150) && (in.size() >= 7)){
+		out.resize(9);
+		MBEVocoder::fec_2450x1150((const uint8_t *)in.constData(), (uint8_t *)out.data());
+		return 0;
+	}
+	if((from == Mode::CODEC_AMBE2450X1150) && (to == Mode::CODEC_AMBE2450) && (in.size() >= 9)){
+		out.resize(7);
+		return MBEVocoder::unfec_2450x1150((const uint8_t *)in.constData(), (uint8_t *)out.data());
+	}
+	if((from == Mode::CODEC_IMBE4400) && (in.size() >= 11)){
+		QByteArray imbe = in;
+		m_transcoder[dir]->imbe_to_ambe_2450((uint8_t *)imbe.data(), ambe);
+		if(to == Mode::CODEC_AMBE2450){
+			out = QByteArray((const char *)ambe, 7);
+			return 0;
+		}
+		out.resize(9);
+		MBEVocoder::fec_2450x1150(ambe, (uint8_t *)out.data());
+		return 0;
+	}
+	if(to == Mode::CODEC_IMBE4400){
+		if((from == Mode::CODEC_AMBE2450X1150) && (in.size() >= 9)){
+			errs = MBEVocoder::unfec_2450x1150((const uint8_t *)in.constData(), ambe);
+		}
+		else if((from == Mode::CODEC_AMBE2450) && (in.size() >= 7)){
+			memcpy(ambe, in.constData(), 7);
+		}
+		else{
+			return -1;
+		}
+		out.resize(11);
+		m_transcoder[dir]->ambe_2450_to_imbe(ambe, (uint8_t *)out.data());
+		return errs;
+	}
+	return -1;
+}
+
+void CodecRelay::mode_relay_rx(int codec, QByteArray frame)
+{
+	const int s = side(sender());
+
+	if(s == -1){
+		return;
+	}
+
+	if(m_active == -1){
+		m_active = s;
+		m_txstarted = false;
+		m_txcodec = m_modes[s ^ 1] ? target_codec(codec, m_modes[s ^ 1]->relay_codecs()) : (int)Mode::CODEC_NONE;
+		// The transcoders predict from the previous frame, start each over from scratch
+		delete m_transcoder[s];
+		m_transcoder[s] = new MBEVocoder();
+		if(!m_over.isValid()){
+			m_over.start();
+		}
+		++m_stats[s].overs;
+		qDebug() << "CodecRelay: over from side" << s << "codec" << codec << "->" << m_txcodec;
+	}
+	else if(m_active != s){
+		++m_stats[s].dropped;
+		return;
+	}
+
+	QByteArray out;
+	const int errs = m_modes[s ^ 1] ? convert(s, codec, m_txcodec, frame, out) : -1;
+
+	if(errs < 0){
+		++m_stats[s].dropped;
+		return;
+	}
+	m_stats[s].fec_errors += errs;
+	++m_stats[s].frames;
+	QMetaObject::invokeMethod(m_modes[s ^ 1], "relay_tx", Q_ARG(int, m_txcodec), Q_ARG(QByteArray, out));
+}
+
+void CodecRelay::mode_relay_rx_end()
+{
+	const int s = side(sender());
+
+	if((s == -1) || (s != m_active)){
+		return;
+	}
+	if(m_modes[s ^ 1]){
+		QMetaObject::invokeMethod(m_modes[s ^ 1], "relay_tx_end");
+	}
+	end_over();
+}
+
+// An over is timed from the source seeing the stream header to the destination sending
+// its first frame, which includes the jitter buffer of the source and the tx queue fill
+void CodecRelay::mode_update(Mode::MODEINFO info)
+{
+	const int s = side(sender());
+
+	if(s == -1){
+		return;
+	}
+
+	if((info.stream_state == Mode::STREAM_NEW) && (m_active == -1)){
+		m_over.start();
+	}
+	else if((info.stream_state == Mode::TRANSMITTING) && (m_active == (s ^ 1)) && !m_txstarted){
+		STATS &st = m_stats[m_active];
+		m_txstarted = true;
+		st.last_ms = m_over.elapsed();
+		st.total_ms += st.last_ms;
+		st.max_ms = qMax(st.max_ms, st.last_ms);
+		emit update_log(QString("Relay %1 to %2: %3 ms").arg(m_modes[m_active] ? m_modes[m_active]->metaObject()->className() : "?", m_modes[s]->metaObject()->className()).arg(st.last_ms));
+	}
+}
+
+void CodecRelay::end_over()
+{
+	const STATS &st = m_stats[m_active];
+
+	qDebug() << "CodecRelay: over from side" << m_active << "ended, frames" << st.frames << "dropped" << st.dropped << "fec errors" << st.fec_errors;
+	m_active = -1;
+	m_txcodec = Mode::CODEC_NONE;
+	m_over.invalidate();
+}
@@ -0,0 +1,71 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef CODECRELAY_H
+#define CODECRELAY_H
+
+#include <QObject>
+#include <QPointer>
+#include <QElapsedTimer>
+#include "mode.h"
+
+// Links two modes at the codec frame level, so voice received on one is sent on the other
+// without being decoded to PCM and encoded again. Frames of the same codec are copied, DMR
+// AMBE+2 and the 49 bit AMBE of NXDN and YSF DN only have their FEC added or stripped, and
+// YSF picks VW or DN to match the source. Between IMBE and the AMBE 2450 family the
+// model parameters are requantized, which keeps the vocoders out of the path too. The
+// link is half duplex, the first side to receive holds it until its over ends.
+class CodecRelay : public QObject
+{
+	Q_OBJECT
+public:
+	CodecRelay(Mode *a, Mode *b, QObject *parent = nullptr);
+	~CodecRelay();
+	struct STATS {
+		quint64 frames = 0;
+		quint64 dropped = 0;
+		quint64 fec_errors = 0;
+		int overs = 0;
+		qint64 last_ms = -1;
+		qint64 max_ms = 0;
+		qint64 total_ms = 0;
+	};
+	// Direction 0 is a to b, 1 is b to a
+	STATS stats(int dir) { return m_stats[dir & 1]; }
+	static bool can_relay(Mode *from, Mode *to);
+signals:
+	void update_log(QString);
+private slots:
+	void mode_relay_rx(int codec, QByteArray frame);
+	void mode_relay_rx_end();
+	void mode_update(Mode::MODEINFO info);
+private:
+	QPointer<Mode> m_modes[2];
+	STATS m_stats[2];
+	int m_active;
+	int m_txcodec;
+	bool m_txstarted;
+	QElapsedTimer m_over;
+	MBEVocoder *m_transcoder[2];
+
+	int side(QObject *o);
+	int convert(int dir, int from, int to, const QByteArray &in, QByteArray &out);
+	static int target_codec(int from, const QList<int> &to);
+	void end_over();
+};
+
+#endif // CODECRELAY_H
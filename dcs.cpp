@@ -19,11 +19,16 @@
 #include "dcs.h"
 #include "CRCenc.h"
 #include "MMDVMDefines.h"
+#include "packettrace.h"
 
 DCS::DCS()
 {
     m_mode = "DCS";
 	m_attenuation = 5;
+	m_sdsync = false;
+	m_sdseq = 0;
+	::memset(m_sduserdata, 0, sizeof(m_sduserdata));
+	m_txstreamid = 0;
 }
 
 DCS::~DCS()
@@ -35,21 +40,10 @@ void DCS::process_udp()
 	QByteArray buf;
 	QHostAddress sender;
 	quint16 senderPort;
-	static bool sd_sync = 0;
-	static int sd_seq = 0;
-	static char user_data[21];
     buf.resize(200);
-    int size = m_udp->readDatagram(buf.data(), buf.size(), &sender, &senderPort);
-
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "RECV:";
-        for(int i = 0; i < buf.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)buf.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+    int size = read_datagram(buf, &sender, &senderPort);
+
+    trace("RECV", buf);
 
 	if(size == 22){ //2 way keep alive ping
 		m_modeinfo.count++;
@@ -70,8 +64,7 @@ void DCS::process_udp()
 		m_ping_timer = new QTimer();
 		connect(m_ping_timer, SIGNAL(timeout()), this, SLOT(send_ping()));
 		m_ping_timer->start(2000);
-		m_audio = new AudioEngine(m_audioin, m_audioout);
-		m_audio->init();
+		m_audio = open_audio();
 	}
 
 	if(m_modeinfo.status != CONNECTED_RW) return;
@@ -133,55 +126,55 @@ void DCS::process_udp()
 		m_modeinfo.frame_number = (uint8_t)buf.data()[0x2d];
 		
 		if((buf.data()[45] == 0) && (buf.data()[55] == 0x55) && (buf.data()[56] == 0x2d) && (buf.data()[57] == 0x16)){
-			sd_sync = 1;
-			sd_seq = 1;
-		}
-		if(sd_sync && (sd_seq == 1) && (buf.data()[45] == 1) && (buf.data()[55] == 0x30)){
-			user_data[0] = buf.data()[56] ^ 0x4f;
-			user_data[1] = buf.data()[57] ^ 0x93;
-			++sd_seq;
-		}
-		if(sd_sync && (sd_seq == 2) && (buf.data()[45] == 2)){
-			user_data[2] = buf.data()[55] ^ 0x70;
-			user_data[3] = buf.data()[56] ^ 0x4f;
-			user_data[4] = buf.data()[57] ^ 0x93;
-			++sd_seq;
-		}
-		if(sd_sync && (sd_seq == 3) && (buf.data()[45] == 3) && (buf.data()[55] == 0x31)){
-			user_data[5] = buf.data()[56] ^ 0x4f;
-			user_data[6] = buf.data()[57] ^ 0x93;
-			++sd_seq;
-		}
-		if(sd_sync && (sd_seq == 4) && (buf.data()[45] == 4)){
-			user_data[7] = buf.data()[55] ^ 0x70;
-			user_data[8] = buf.data()[56] ^ 0x4f;
-			user_data[9] = buf.data()[57] ^ 0x93;
-			++sd_seq;
-		}
-		if(sd_sync && (sd_seq == 5) && (buf.data()[45] == 5) && (buf.data()[55] == 0x32)){
-			user_data[10] = buf.data()[56] ^ 0x4f;
-			user_data[11] = buf.data()[57] ^ 0x93;
-			++sd_seq;
-		}
-		if(sd_sync && (sd_seq == 6) && (buf.data()[45] == 6)){
-			user_data[12] = buf.data()[55] ^ 0x70;
-			user_data[13] = buf.data()[56] ^ 0x4f;
-			user_data[14] = buf.data()[57] ^ 0x93;
-			++sd_seq;
-		}
-		if(sd_sync && (sd_seq == 7) && (buf.data()[45] == 7) && (buf.data()[55] == 0x33)){
-			user_data[15] = buf.data()[56] ^ 0x4f;
-			user_data[16] = buf.data()[57] ^ 0x93;
-			++sd_seq;
-		}
-		if(sd_sync && (sd_seq == 8) && (buf.data()[45] == 8)){
-			user_data[17] = buf.data()[55] ^ 0x70;
-			user_data[18] = buf.data()[56] ^ 0x4f;
-			user_data[19] = buf.data()[57] ^ 0x93;
-			user_data[20] = '\0';
-			sd_sync = 0;
-			sd_seq = 0;
-			m_modeinfo.usertxt = QString(user_data);
+			m_sdsync = 1;
+			m_sdseq = 1;
+		}
+		if(m_sdsync && (m_sdseq == 1) && (buf.data()[45] == 1) && (buf.data()[55] == 0x30)){
+			m_sduserdata[0] = buf.data()[56] ^ 0x4f;
+			m_sduserdata[1] = buf.data()[57] ^ 0x93;
+			++m_sdseq;
+		}
+		if(m_sdsync && (m_sdseq == 2) && (buf.data()[45] == 2)){
+			m_sduserdata[2] = buf.data()[55] ^ 0x70;
+			m_sduserdata[3] = buf.data()[56] ^ 0x4f;
+			m_sduserdata[4] = buf.data()[57] ^ 0x93;
+			++m_sdseq;
+		}
+		if(m_sdsync && (m_sdseq == 3) && (buf.data()[45] == 3) && (buf.data()[55] == 0x31)){
+			m_sduserdata[5] = buf.data()[56] ^ 0x4f;
+			m_sduserdata[6] = buf.data()[57] ^ 0x93;
+			++m_sdseq;
+		}
+		if(m_sdsync && (m_sdseq == 4) && (buf.data()[45] == 4)){
+			m_sduserdata[7] = buf.data()[55] ^ 0x70;
+			m_sduserdata[8] = buf.data()[56] ^ 0x4f;
+			m_sduserdata[9] = buf.data()[57] ^ 0x93;
+			++m_sdseq;
+		}
+		if(m_sdsync && (m_sdseq == 5) && (buf.data()[45] == 5) && (buf.data()[55] == 0x32)){
+			m_sduserdata[10] = buf.data()[56] ^ 0x4f;
+			m_sduserdata[11] = buf.data()[57] ^ 0x93;
+			++m_sdseq;
+		}
+		if(m_sdsync && (m_sdseq == 6) && (buf.data()[45] == 6)){
+			m_sduserdata[12] = buf.data()[55] ^ 0x70;
+			m_sduserdata[13] = buf.data()[56] ^ 0x4f;
+			m_sduserdata[14] = buf.data()[57] ^ 0x93;
+			++m_sdseq;
+		}
+		if(m_sdsync && (m_sdseq == 7) && (buf.data()[45] == 7) && (buf.data()[55] == 0x33)){
+			m_sduserdata[15] = buf.data()[56] ^ 0x4f;
+			m_sduserdata[16] = buf.data()[57] ^ 0x93;
+			++m_sdseq;
+		}
+		if(m_sdsync && (m_sdseq == 8) && (buf.data()[45] == 8)){
+			m_sduserdata[17] = buf.data()[55] ^ 0x70;
+			m_sduserdata[18] = buf.data()[56] ^ 0x4f;
+			m_sduserdata[19] = buf.data()[57] ^ 0x93;
+			m_sduserdata[20] = '\0';
+			m_sdsync = 0;
+			m_sdseq = 0;
+			m_modeinfo.usertxt = QString(m_sduserdata);
 		}
 		if(buf.data()[45] & 0x40){
 			qDebug() << "DCS RX stream ended ";
@@ -227,23 +220,15 @@ void DCS::hostname_lookup(QHostInfo i)
 		m_address = i.addresses().first();
 		m_udp = new QUdpSocket(this);
 		connect(m_udp, SIGNAL(readyRead()), this, SLOT(process_udp()));
-		m_udp->writeDatagram(out, m_address, m_modeinfo.port);
-
-        if(m_debug){
-            QDebug debug = qDebug();
-            debug.noquote();
-            QString s = "CONN:";
-            for(int i = 0; i < out.size(); ++i){
-                s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-            }
-            debug << s;
-        }
+		write_datagram(out, m_address, m_modeinfo.port);
+
+        trace("CONN", out);
 	}
 }
 
 void DCS::send_ping()
 {
-	static QByteArray out;
+	QByteArray out;
 	out.clear();
 	out.append(m_modeinfo.callsign.toUtf8());
 	out.append(7 - m_modeinfo.callsign.size(), ' ');
@@ -252,17 +237,9 @@ void DCS::send_ping()
 	out.append(m_refname.toUtf8());
 	out.append('\x00');
 	out.append(m_module);
-	m_udp->writeDatagram(out, m_address, m_modeinfo.port);
-
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "PING:";
-        for(int i = 0; i < out.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+	write_datagram(out, m_address, m_modeinfo.port);
+
+    trace("PING", out);
 }
 
 void DCS::send_disconnect()
@@ -273,17 +250,9 @@ void DCS::send_disconnect()
 	out.append(m_module);
 	out.append(' ');
 	out.append('\x00');
-	m_udp->writeDatagram(out, m_address, m_modeinfo.port);
-
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "DISC:";
-        for(int i = 0; i < out.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+	write_datagram(out, m_address, m_modeinfo.port);
+
+    trace("DISC", out);
 }
 
 void DCS::format_callsign(QString &s)
@@ -345,6 +314,17 @@ void DCS::start_tx()
 	Mode::start_tx();
 }
 
+void DCS::relay_tx(int codec, QByteArray frame)
+{
+	if(!m_tx){
+		format_callsign(m_txmycall);
+		format_callsign(m_txurcall);
+		format_callsign(m_txrptr1);
+		format_callsign(m_txrptr2);
+	}
+	Mode::relay_tx(codec, frame);
+}
+
 void DCS::transmit()
 {
     uint8_t ambe[9];
@@ -364,14 +344,23 @@ void DCS::transmit()
 		}
 	}
 #endif
-	if(m_ttsid == 0){
+	if((m_ttsid == 0) && !m_relaytx){
 		if(m_audio->read(pcm, 160)){
 		}
 		else{
 			return;
 		}
 	}
-	if(m_hwtx){
+	if(m_relaytx){
+		if(m_tx && (m_txcodecq.size() < 9)){
+			return;
+		}
+		for(int i = 0; (i < 9) && !m_txcodecq.isEmpty(); ++i){
+			ambe[i] = m_txcodecq.dequeue();
+		}
+		send_frame(ambe);
+	}
+	else if(m_hwtx){
 #if !defined(Q_OS_IOS)
 		m_ambedev->encode(pcm);
 #endif
@@ -396,23 +385,22 @@ void DCS::transmit()
 void DCS::send_frame(uint8_t *ambe)
 {
 	QByteArray txdata;
-	static uint16_t txstreamid = 0;
 
 	txdata.clear();
 	txdata.append(100, 0);
 
-	if(txstreamid == 0){
-		txstreamid = static_cast<uint16_t>((::rand() & 0xFFFF));
+	if(m_txstreamid == 0){
+		m_txstreamid = static_cast<uint16_t>((::rand() & 0xFFFF));
 	}
 
 	txdata.replace(0, 4, "0001");
 	txdata.replace(7, 8, m_txrptr2.toLocal8Bit().data());
 	txdata.replace(15, 8, m_txrptr1.toLocal8Bit().data());
 	txdata.replace(23, 8, m_txurcall.toLocal8Bit().data());
-	txdata.replace(31, 8, m_txmycall.toLocal8Bit().data());
+	txdata.replace(31, 8, relay_callsign(m_txmycall).leftJustified(8, ' ', true).toLocal8Bit().data());
 	txdata.replace(39, 4, "AMBE");
-	txdata[43] = (txstreamid >> 8) & 0xff;
-	txdata[44] = txstreamid & 0xff;
+	txdata[43] = (m_txstreamid >> 8) & 0xff;
+	txdata[44] = m_txstreamid & 0xff;
 	txdata[45] = (m_txcnt % 21) & 0xff;
 	memcpy(txdata.data() + 46, ambe, 9);
 
@@ -474,11 +462,11 @@ void DCS::send_frame(uint8_t *ambe)
 	txdata[60] = (m_txcnt >> 16) & 0xff;
 	txdata[61] = 0x01;
 
-	m_modeinfo.src = m_txmycall;
+	m_modeinfo.src = relay_callsign(m_txmycall);
 	m_modeinfo.dst = m_txurcall;
 	m_modeinfo.gw = m_txrptr1;
 	m_modeinfo.gw2 = m_txrptr2;
-	m_modeinfo.streamid = txstreamid;
+	m_modeinfo.streamid = m_txstreamid;
 	m_modeinfo.frame_number = m_txcnt;
 
 	if(m_tx){
@@ -489,29 +477,21 @@ void DCS::send_frame(uint8_t *ambe)
 		txdata[45] = (txdata[45] | 0x40);
 		txdata.replace(46, 9, (char *)last_frame);
 		m_txcnt = 0;
-		txstreamid = 0;
+		m_txstreamid = 0;
 		m_modeinfo.streamid = 0;
 		m_txtimer->stop();
 
-		if((m_ttsid == 0) && (m_modeinfo.stream_state == TRANSMITTING) ){
+		if((m_ttsid == 0) && !m_relaytx && (m_modeinfo.stream_state == TRANSMITTING) ){
 			m_audio->stop_capture();
 		}
 		m_ttscnt = 0;
 	}
 
-	m_udp->writeDatagram(txdata, m_address, m_modeinfo.port);
+	write_datagram(txdata, m_address, m_modeinfo.port);
 	emit update_output_level(m_audio->level() * 2);
 	update(m_modeinfo);
 
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "SEND:";
-        for(int i = 0; i < txdata.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)txdata.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+    trace("SEND", txdata);
 }
 
 void DCS::get_ambe()
@@ -536,29 +516,22 @@ void DCS::process_rx_data()
 		qDebug() << "DCS RX stream timeout ";
 		m_rxwatchdog = 0;
 		m_modeinfo.stream_state = STREAM_LOST;
+		PacketTrace::trigger(m_mode + " RX stream timeout");
 		m_modeinfo.ts = QDateTime::currentMSecsSinceEpoch();
 		emit update(m_modeinfo);
 		m_modeinfo.streamid = 0;
 	}
 
-	if(m_rxmodemq.size() > 2){
-		QByteArray out;
-		int s = m_rxmodemq[1];
-		if((m_rxmodemq[0] == MMDVM_FRAME_START) && (m_rxmodemq.size() >= s)){
-			for(int i = 0; i < s; ++i){
-				out.append(m_rxmodemq.dequeue());
-			}
-#if !defined(Q_OS_IOS)
-			m_modem->write(out);
-#endif
-		}
-	}
+	write_modem();
 
 	if((!m_tx) && (m_rxcodecq.size() > 8) ){
 		for(int i = 0; i < 9; ++i){
 			ambe[i] = m_rxcodecq.dequeue();
 		}
-		if(m_hwrx){
+		if(m_relayrx){
+			emit relay_rx(CODEC_AMBE2400X1200, QByteArray((char *)ambe, 9));
+		}
+		else if(m_hwrx){
 #if !defined(Q_OS_IOS)
 			m_ambedev->decode(ambe);
 
@@ -587,6 +560,9 @@ void DCS::process_rx_data()
 		m_rxcodecq.clear();
 		qDebug() << "DCS playback stopped";
 		m_modeinfo.stream_state = STREAM_IDLE;
+		if(m_relayrx){
+			emit relay_rx_end();
+		}
 		return;
 	}
 }
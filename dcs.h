@@ -27,9 +27,16 @@ public:
 	DCS();
 	~DCS();
 	uint8_t * get_frame(uint8_t *ambe);
+	QList<int> relay_codecs() { return {CODEC_AMBE2400X1200}; }
 private:
 	QString m_txusrtxt;
 	uint8_t packet_size;
+	bool m_sdsync;
+	int m_sdseq;
+	char m_sduserdata[21];
+	uint16_t m_txstreamid;
+public slots:
+	void relay_tx(int codec, QByteArray frame);
 private slots:
 	void toggle_tx(bool);
 	void start_tx();
@@ -22,9 +22,7 @@
 #include "SHA256.h"
 #include "CRCenc.h"
 #include "MMDVMDefines.h"
-#ifdef USE_MD380_VOCODER
-#include <md380_vocoder.h>
-#endif
+#include "packettrace.h"
 
 const uint32_t ENCODING_TABLE_1676[] =
 	{0x0000U, 0x0273U, 0x04E5U, 0x0696U, 0x09C9U, 0x0BBAU, 0x0D2CU, 0x0F5FU, 0x11E2U, 0x1391U, 0x1507U, 0x1774U,
@@ -41,15 +39,13 @@ const uint32_t ENCODING_TABLE_1676[] =
 
 DMR::DMR() :
 	m_txslot(2),
-	m_txcc(1)
+	m_txcc(1),
+	m_txframecnt(0)
 {
     m_mode = "DMR";
 	m_dmrcnt = 0;
 	m_flco = FLCO_GROUP;
 	m_attenuation = 5;
-#ifdef USE_MD380_VOCODER
-    md380_init();
-#endif
 }
 
 DMR::~DMR()
@@ -87,18 +83,9 @@ void DMR::process_udp()
 	CSHA256 sha256;
 	char buffer[400U];
 
-	buf.resize(m_udp->pendingDatagramSize());
-	m_udp->readDatagram(buf.data(), buf.size(), &sender, &senderPort);
+	read_datagram(buf, &sender, &senderPort);
 
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "RECV:";
-        for(int i = 0; i < buf.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)buf.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+    trace("RECV", buf);
 
 	// Handle MSTNAK - Master NAK (peer not recognized/rejected)
 	if((::memcmp(buf.data(), "MSTNAK", 6U) == 0)){
@@ -213,7 +200,7 @@ void DMR::process_udp()
 		default:
 			break;
 		}
-		m_udp->writeDatagram(out, m_address, m_modeinfo.port);
+		write_datagram(out, m_address, m_modeinfo.port);
 	}
 	if((buf.size() == 11) && (::memcmp(buf.data(), "MSTPONG", 7U) == 0)){
 		m_modeinfo.count++;
@@ -331,14 +318,8 @@ void DMR::process_udp()
 	}
 	emit update(m_modeinfo);
 
-    if(m_debug && out.size() > 0){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "SEND:";
-        for(int i = 0; i < out.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
+    if(out.size() > 0){
+        trace("SEND", out);
     }
 }
 
@@ -355,8 +336,7 @@ void DMR::setup_connection()
 	connect(m_ping_timer, SIGNAL(timeout()), this, SLOT(send_ping()));
 	m_ping_timer->start(5000);
 	if (m_modeinfo.sw_vocoder_loaded) {
-		m_audio = new AudioEngine(m_audioin, m_audioout);
-		m_audio->init();
+		m_audio = open_audio();
 	}
 }
 
@@ -374,8 +354,7 @@ void DMR::mmdvm_direct_connect()
 		connect(m_txtimer, SIGNAL(timeout()), this, SLOT(transmit()));
 		m_rxtimer = new QTimer();
 		connect(m_rxtimer, SIGNAL(timeout()), this, SLOT(process_rx_data()));
-		m_audio = new AudioEngine(m_audioin, m_audioout);
-		m_audio->init();
+		m_audio = open_audio();
 	} else {
 		qDebug() << "No modem, cant do MMDVM_DIRECT";
 	}
@@ -401,17 +380,9 @@ void DMR::hostname_lookup(QHostInfo i)
 		m_address = i.addresses().first();
 		m_udp = new QUdpSocket(this);
 		connect(m_udp, SIGNAL(readyRead()), this, SLOT(process_udp()));
-		m_udp->writeDatagram(out, m_address, m_modeinfo.port);
-
-        if(m_debug){
-            QDebug debug = qDebug();
-            debug.noquote();
-            QString s = "CONN:";
-            for(int i = 0; i < out.size(); ++i){
-                s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-            }
-            debug << s;
-        }
+		write_datagram(out, m_address, m_modeinfo.port);
+
+        trace("CONN", out);
 	}
 }
 
@@ -424,17 +395,9 @@ void DMR::send_ping()
 	out.append((m_essid >> 16) & 0xff);
 	out.append((m_essid >> 8) & 0xff);
 	out.append((m_essid >> 0) & 0xff);
-	m_udp->writeDatagram(out, m_address, m_modeinfo.port);
-
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "PING:";
-        for(int i = 0; i < out.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+	write_datagram(out, m_address, m_modeinfo.port);
+
+    trace("PING", out);
 }
 
 void DMR::send_disconnect()
@@ -453,17 +416,9 @@ void DMR::send_disconnect()
 	out.append((m_essid >> 16) & 0xff);
 	out.append((m_essid >> 8) & 0xff);
 	out.append((m_essid >> 0) & 0xff);
-	m_udp->writeDatagram(out, m_address, m_modeinfo.port);
-
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "SEND:";
-        for(int i = 0; i < out.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+	write_datagram(out, m_address, m_modeinfo.port);
+
+    trace("SEND", out);
 }
 
 void DMR::process_modem_data(QByteArray d)
@@ -512,7 +467,7 @@ void DMR::process_modem_data(QByteArray d)
 		::memcpy(m_dmrFrame + 20U, p_frame + 4, 33U);
 		txdata.append((char *)m_dmrFrame, 55);
 		if (!m_mdirect) {
-			m_udp->writeDatagram(txdata, m_address, m_modeinfo.port);
+			write_datagram(txdata, m_address, m_modeinfo.port);
 		}
 		++m_dmrcnt;
 	}
@@ -539,21 +494,13 @@ void DMR::process_modem_data(QByteArray d)
 			}
 		}
 		if (!m_mdirect) {
-			m_udp->writeDatagram(txdata, m_address, m_modeinfo.port);
+			write_datagram(txdata, m_address, m_modeinfo.port);
 		}
 		++m_dmrcnt;
 	}
 	emit update(m_modeinfo);
 
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "SEND:";
-        for(int i = 0; i < txdata.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)txdata.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+    trace("SEND", txdata);
 }
 
 void DMR::transmit()
@@ -574,7 +521,7 @@ void DMR::transmit()
 		}
 	}
 #endif
-	if(m_ttsid == 0){
+	if((m_ttsid == 0) && !m_relaytx){
 		if(m_audio && m_audio->read(pcm, 160)){
 		}
 		else{
@@ -582,18 +529,17 @@ void DMR::transmit()
 		}
 	}
 
-	if(m_hwtx){
+	if(m_relaytx){
+		// relay_tx() has already queued the codec frames
+	}
+	else if(m_hwtx){
 #if !defined(Q_OS_IOS)
 		m_ambedev->encode(pcm);
 #endif
 	}
 	else{
 		if(m_modeinfo.sw_vocoder_loaded){
-#ifdef USE_MD380_VOCODER
-            md380_encode_fec(ambe, pcm);
-#else
 			m_mbevocoder->encode_2450x1150(pcm, ambe);
-#endif
 		}
 		for(int i = 0; i < 9; ++i){
 			m_txcodecq.append(ambe[i]);
@@ -614,14 +560,13 @@ void DMR::transmit()
 void DMR::send_frame()
 {
 	QByteArray txdata;
-	static uint32_t txcnt;
 
-	m_txsrcid = m_dmrid;
+	m_txsrcid = relay_id(m_dmrid);
 	if(m_tx){
 		m_modeinfo.stream_state = TRANSMITTING;
 		m_modeinfo.slot = m_txslot;
 
-		if(!txcnt){
+		if(!m_txframecnt){
 			m_dmrcnt = 0;
             encode_header(DT_VOICE_LC_HEADER);
 			m_txstreamid = static_cast<uint32_t>(::rand());
@@ -645,7 +590,7 @@ void DMR::send_frame()
 		build_frame();
 		txdata.append((char *)m_dmrFrame, 55);
 		if (!m_mdirect) {
-			m_udp->writeDatagram(txdata, m_address, m_modeinfo.port);
+			write_datagram(txdata, m_address, m_modeinfo.port);
 		}
 		if(m_modem){
 			m_rxwatchdog = 0;
@@ -659,14 +604,14 @@ void DMR::send_frame()
 			};
 		}
 
-		++txcnt;
+		++m_txframecnt;
 		++m_dmrcnt;
 /*
 		if(!m_dmrcnt){
 			for (int i = 0U; i < 3; i++) {
 				m_dmrFrame[4U] = m_dmrcnt;
 				txdata.append((char *)m_dmrFrame, 55);
-				m_udp->writeDatagram(txdata, m_address, m_modeinfo.port);
+				write_datagram(txdata, m_address, m_modeinfo.port);
 				m_dmrcnt++;
 			}
 
@@ -674,7 +619,7 @@ void DMR::send_frame()
 		else{
 			++m_dmrcnt;
 			txdata.append((char *)m_dmrFrame, 55);
-			m_udp->writeDatagram(txdata, m_address, m_modeinfo.port);
+			write_datagram(txdata, m_address, m_modeinfo.port);
 		}
 */
 	}
@@ -684,7 +629,7 @@ void DMR::send_frame()
 		m_ttscnt = 0;
 		txdata.append((char *)m_dmrFrame, 55);
 		if (!m_mdirect) {
-			m_udp->writeDatagram(txdata, m_address, m_modeinfo.port);
+			write_datagram(txdata, m_address, m_modeinfo.port);
 		}
 		if(m_modem){
 			m_rxwatchdog = 0;
@@ -699,9 +644,9 @@ void DMR::send_frame()
 		}
 
 		m_txtimer->stop();
-		txcnt = 0;
+		m_txframecnt = 0;
 
-		if(m_ttsid == 0 && m_audio){
+		if(m_ttsid == 0 && m_audio && !m_relaytx){
 			m_audio->stop_capture();
 		}
 
@@ -712,15 +657,7 @@ void DMR::send_frame()
 	}
 	emit update(m_modeinfo);
 
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "SEND:";
-        for(int i = 0; i < txdata.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)txdata.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+    trace("SEND", txdata);
 }
 
 uint8_t * DMR::get_eot()
@@ -1074,7 +1011,6 @@ void DMR::process_rx_data()
 {
 	int16_t pcm[160];
 	uint8_t ambe[9];
-	static uint8_t cnt = 0;
 
 	if(m_rxwatchdog++ > 100){
 		//receive RF from modem
@@ -1092,31 +1028,23 @@ void DMR::process_rx_data()
 			qDebug() << "DMR RX stream timeout ";
 			m_rxwatchdog = 0;
 			m_modeinfo.stream_state = STREAM_LOST;
+			PacketTrace::trigger(m_mode + " RX stream timeout");
 			m_modeinfo.ts = QDateTime::currentMSecsSinceEpoch();
 			emit update(m_modeinfo);
 			m_modeinfo.streamid = 0;
 		}
 	}
 
-	if((m_rxmodemq.size() > 2) && (++cnt >= 3)){
-		QByteArray out;
-		int s = m_rxmodemq[1];
-		if((m_rxmodemq[0] == MMDVM_FRAME_START) && (m_rxmodemq.size() >= s)){
-			for(int i = 0; i < s; ++i){
-				out.append(m_rxmodemq.dequeue());
-			}
-#if !defined(Q_OS_IOS)
-			m_modem->write(out);
-#endif
-		}
-		cnt = 0;
-	}
+	write_modem();
 
 	if((!m_tx) && (m_rxcodecq.size() > 8) ){
 		for(int i = 0; i < 9; ++i){
 			ambe[i] = m_rxcodecq.dequeue();
 		}
-		if(m_hwrx){
+		if(m_relayrx){
+			emit relay_rx(CODEC_AMBE2450X1150, QByteArray((char *)ambe, 9));
+		}
+		else if(m_hwrx){
 #if !defined(Q_OS_IOS)
 			m_ambedev->decode(ambe);
 
@@ -1128,11 +1056,7 @@ void DMR::process_rx_data()
 		}
 		else{
 			if(m_modeinfo.sw_vocoder_loaded){
-#ifdef USE_MD380_VOCODER
-                md380_decode_fec(ambe, pcm);
-#else
 				m_mbevocoder->decode_2450x1150(pcm, ambe);
-#endif
 			}
 			else{
 				memset(pcm, 0, 160 * sizeof(int16_t));
@@ -1153,6 +1077,9 @@ void DMR::process_rx_data()
 		m_modeinfo.streamid = 0;
 		m_rxcodecq.clear();
 		qDebug() << "DMR playback stopped";
+		if(m_relayrx){
+			emit relay_rx_end();
+		}
 		m_modeinfo.stream_state = STREAM_IDLE;
 		emit update_mode(MODE_IDLE);
 	}
@@ -30,6 +30,7 @@ public:
 	~DMR();
 	void set_dmr_params(uint8_t essid, QString password, QString lat, QString lon, QString location, QString desc, QString freq, QString url, QString swid, QString pkid, QString options);
 	uint8_t * get_eot();
+	QList<int> relay_codecs() { return {CODEC_AMBE2450X1150}; }
 private slots:
 	void process_udp();
 	void process_rx_data();
@@ -67,6 +68,7 @@ private:
 	uint8_t m_dmrFrame[55];
 	uint8_t m_dataType;
 	uint32_t m_dmrcnt;
+	uint32_t m_txframecnt;
 	FLCO m_flco;
 	FLCO m_txflco;
 	CBPTC19696 m_bptc;
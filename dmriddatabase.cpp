@@ -0,0 +1,202 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <QFile>
+#include <QList>
+#include <QSaveFile>
+#include <QSet>
+#include "dmriddatabase.h"
+
+// An "id callsign [name]" line, with the value "callsign name" as the GUI shows it
+static bool parse_record(const QByteArray &line, uint32_t *id, QString *value)
+{
+	const QList<QByteArray> f = line.simplified().split(' ');
+	bool ok;
+
+	if(f.size() < 2){
+		return false;
+	}
+	*id = f.at(0).toUInt(&ok);
+	if(!ok){
+		return false;
+	}
+	*value = (f.size() == 3) ? QString::fromUtf8(f.at(1) + " " + f.at(2)) : QString::fromUtf8(f.at(1));
+	return true;
+}
+
+bool DMRIDDatabase::load(const QString &path, IDS &ids, quint32 *generation)
+{
+	QFile f(path);
+	uint32_t id;
+	QString value;
+
+	*generation = 0;
+	if(!f.open(QIODevice::ReadOnly)){
+		return false;
+	}
+	while(!f.atEnd()){
+		const QByteArray line = f.readLine();
+		if(line.startsWith('#')){
+			if(line.startsWith("# generation ")){
+				*generation = line.mid(13).trimmed().toUInt();
+			}
+			continue;
+		}
+		if(parse_record(line, &id, &value)){
+			ids[id] = value;
+		}
+	}
+	return true;
+}
+
+bool DMRIDDatabase::save(const QString &path, const IDS &ids, quint32 generation)
+{
+	QFile in(path);
+	QSaveFile f(path);
+	QByteArray out;
+	QSet<uint32_t> written;
+	uint32_t id;
+	QString value;
+
+	out.reserve(ids.size() * 24);
+	out.append("# generation " + QByteArray::number(generation) + "\n");
+
+	// The lines of IDs that are unchanged are kept as they are, with any other columns
+	if(in.open(QIODevice::ReadOnly)){
+		while(!in.atEnd()){
+			const QByteArray line = in.readLine();
+			if(line.startsWith("# generation ")){
+				continue;
+			}
+			if(!parse_record(line, &id, &value)){
+				out.append(line.endsWith('\n') ? line : line + "\n");
+				continue;
+			}
+			auto it = ids.constFind(id);
+			if((it == ids.constEnd()) || written.contains(id)){
+				continue;
+			}
+			if(it.value() == value){
+				out.append(line.endsWith('\n') ? line : line + "\n");
+			}
+			else{
+				out.append(QByteArray::number(id) + " " + it.value().toUtf8() + "\n");
+			}
+			written.insert(id);
+		}
+		in.close();
+	}
+	for(auto it = ids.constBegin(); it != ids.constEnd(); ++it){
+		if(!written.contains(it.key())){
+			out.append(QByteArray::number(it.key()) + " " + it.value().toUtf8() + "\n");
+		}
+	}
+
+	if(!f.open(QIODevice::WriteOnly)){
+		return false;
+	}
+	f.write(out);
+	return f.commit();
+}
+
+bool DMRIDDatabase::apply(const QByteArray &delta, IDS &ids, quint32 generation, DELTA *d)
+{
+	const QList<QByteArray> lines = delta.split('\n');
+	QList<QByteArray> header;
+	IDS add;
+	QList<uint32_t> remove;
+	uint32_t id;
+	QString value;
+	bool ok;
+
+	*d = DELTA();
+	header = lines.isEmpty() ? QList<QByteArray>() : lines.at(0).simplified().split(' ');
+	if((header.size() != 5) || (header.at(1) != "DMRIDs") || (header.at(2) != "delta")){
+		return false;
+	}
+	d->from = header.at(3).toUInt();
+	d->to = header.at(4).toUInt(&ok);
+	if((d->from != generation) || !ok || (d->to <= d->from)){
+		return false;
+	}
+
+	// Checked whole before any of it is applied
+	for(int i = 1; i < lines.size(); ++i){
+		const QByteArray &l = lines.at(i);
+		if(l.isEmpty() || l.startsWith('#')){
+			continue;
+		}
+		if(l.startsWith("- ")){
+			id = l.mid(2).trimmed().toUInt(&ok);
+			if(!ok){
+				return false;
+			}
+			remove.append(id);
+			++d->removed;
+		}
+		else if((l.startsWith("+ ") || l.startsWith("* ")) && parse_record(l.mid(2), &id, &value)){
+			add[id] = value;
+			(l.at(0) == '+') ? ++d->added : ++d->changed;
+		}
+		else{
+			return false;
+		}
+	}
+
+	for(uint32_t r : remove){
+		ids.remove(r);
+	}
+	for(auto it = add.constBegin(); it != add.constEnd(); ++it){
+		ids[it.key()] = it.value();
+	}
+	return true;
+}
+
+QByteArray DMRIDDatabase::make_delta(const IDS &from, const IDS &to, quint32 generation, DELTA *d)
+{
+	QByteArray out;
+
+	*d = DELTA();
+	d->from = generation;
+	d->to = generation + 1;
+	out.append("# DMRIDs delta " + QByteArray::number(d->from) + " " + QByteArray::number(d->to) + "\n");
+
+	// Both maps are in ID order, so one pass over each finds every difference
+	auto a = from.constBegin();
+	auto b = to.constBegin();
+	while((a != from.constEnd()) || (b != to.constEnd())){
+		if((b == to.constEnd()) || ((a != from.constEnd()) && (a.key() < b.key()))){
+			out.append("- " + QByteArray::number(a.key()) + "\n");
+			++d->removed;
+			++a;
+		}
+		else if((a == from.constEnd()) || (b.key() < a.key())){
+			out.append("+ " + QByteArray::number(b.key()) + " " + b.value().toUtf8() + "\n");
+			++d->added;
+			++b;
+		}
+		else{
+			if(a.value() != b.value()){
+				out.append("* " + QByteArray::number(b.key()) + " " + b.value().toUtf8() + "\n");
+				++d->changed;
+			}
+			++a;
+			++b;
+		}
+	}
+	return out;
+}
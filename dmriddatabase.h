@@ -0,0 +1,64 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef DMRIDDATABASE_H
+#define DMRIDDATABASE_H
+
+#include <QByteArray>
+#include <QMap>
+#include <QString>
+
+// DMRIDs.dat and the deltas that bring it from one generation to the next. The full file
+// is one "id callsign [name]" line per ID, any further columns are kept but not read, and
+// it may carry its generation in a "# generation N" comment line, 0 when it does not. The delta from generation N is
+// published as DMRIDs-N.delta:
+//
+//   # DMRIDs delta N N+1
+//   + id callsign [name]		added
+//   * id callsign [name]		changed
+//   - id					removed
+//
+// A client applies DMRIDs-N.delta, DMRIDs-N+1.delta and so on until one is missing, which
+// means it is up to date. The publisher keeps every delta, so the full file is downloaded
+// only by a client without a generation, when a delta does not apply or after MAX_CHAIN.
+class DMRIDDatabase
+{
+public:
+	typedef QMap<uint32_t, QString> IDS;
+	struct DELTA {
+		quint32 from = 0;
+		quint32 to = 0;
+		int added = 0;
+		int changed = 0;
+		int removed = 0;
+	};
+	// Deltas to chain before a full download is cheaper
+	static constexpr int MAX_CHAIN = 30;
+
+	static bool load(const QString &path, IDS &ids, quint32 *generation);
+	// Rewrites the file at path to hold ids as the given generation. The lines of IDs
+	// that did not change are kept as they were, columns past the name included, those
+	// added or changed are written as "id callsign [name]" and those removed are left out.
+	static bool save(const QString &path, const IDS &ids, quint32 generation);
+	static QString delta_name(quint32 generation) { return "DMRIDs-" + QString::number(generation) + ".delta"; }
+	// Applies a delta from generation to ids, false and ids untouched if it does not
+	// start from generation or does not parse
+	static bool apply(const QByteArray &delta, IDS &ids, quint32 generation, DELTA *d);
+	static QByteArray make_delta(const IDS &from, const IDS &to, quint32 generation, DELTA *d);
+};
+
+#endif // DMRIDDATABASE_H
@@ -0,0 +1,101 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// droidstar-dmriddelta: publish a new DMRIDs.dat with the delta from the last one.
+//
+//   droidstar-dmriddelta -d www new.dat
+//
+// www/DMRIDs.dat is the published file. The delta from it to new.dat is written as
+// www/DMRIDs-N.delta, N being its generation, and new.dat is published as generation N+1.
+// The sizes of the two and the time to load the full file and to apply the delta are
+// printed. Serve www with any web server and point DROIDSTAR_HOSTS_URL at it to test.
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <cstdio>
+#include "dmriddatabase.h"
+
+// The new file's own lines are published, with its generation added
+static bool publish(const QString &file, const QString &published, const DMRIDDatabase::IDS &ids, quint32 generation)
+{
+	QFile::remove(published);
+	return QFile::copy(file, published) && DMRIDDatabase::save(published, ids, generation);
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	QCommandLineParser parser;
+
+	parser.setApplicationDescription("DMR ID delta publisher for DroidStar");
+	parser.addHelpOption();
+	parser.addOption({{"d", "dir"}, "Directory of the published files", "dir", "."});
+	parser.addPositionalArgument("new", "The new full DMRIDs.dat");
+	parser.process(app);
+
+	if(parser.positionalArguments().size() != 1){
+		parser.showHelp(1);
+	}
+	const QDir dir(parser.value("dir"));
+	const QString published = dir.filePath("DMRIDs.dat");
+	DMRIDDatabase::IDS from, to, check;
+	DMRIDDatabase::DELTA d;
+	quint32 generation, unused;
+	QElapsedTimer t;
+
+	if(!DMRIDDatabase::load(parser.positionalArguments().at(0), to, &unused)){
+		fprintf(stderr, "Cannot read %s\n", parser.positionalArguments().at(0).toStdString().c_str());
+		return 1;
+	}
+	if(!DMRIDDatabase::load(published, from, &generation)){
+		// Nothing published yet, the first generation has no delta
+		if(!publish(parser.positionalArguments().at(0), published, to, 1)){
+			fprintf(stderr, "Cannot write %s\n", published.toStdString().c_str());
+			return 1;
+		}
+		fprintf(stdout, "published %d IDs as generation 1\n", (int)to.size());
+		return 0;
+	}
+
+	const QByteArray delta = DMRIDDatabase::make_delta(from, to, generation, &d);
+	QFile f(dir.filePath(DMRIDDatabase::delta_name(generation)));
+	if(!f.open(QIODevice::WriteOnly | QIODevice::Truncate) || (f.write(delta) != delta.size())){
+		fprintf(stderr, "Cannot write %s\n", f.fileName().toStdString().c_str());
+		return 1;
+	}
+	f.close();
+	if(!publish(parser.positionalArguments().at(0), published, to, d.to)){
+		fprintf(stderr, "Cannot write %s\n", published.toStdString().c_str());
+		return 1;
+	}
+
+	t.start();
+	DMRIDDatabase::load(published, check, &unused);
+	const qint64 load_us = t.nsecsElapsed() / 1000;
+	t.restart();
+	DMRIDDatabase::apply(delta, from, generation, &d);
+	const qint64 apply_us = t.nsecsElapsed() / 1000;
+
+	fprintf(stdout, "generation %u to %u: %d added, %d changed, %d removed, %s\n", d.from, d.to, d.added, d.changed, d.removed, (from == check) ? "verified" : "MISMATCH");
+	fprintf(stdout, "full %lld bytes, load %lld us\n", QFileInfo(published).size(), load_us);
+	fprintf(stdout, "delta %lld bytes, apply %lld us\n", (qint64)delta.size(), apply_us);
+	return (from == check) ? 0 : 1;
+}
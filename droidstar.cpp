@@ -16,7 +16,11 @@
 */
 
 #include "droidstar.h"
+#include "dmriddatabase.h"
 #include "httpmanager.h"
+#include "vocoderregistry.h"
+#include "hostresolver.h"
+#include "packettrace.h"
 #ifdef Q_OS_ANDROID
 #include <QCoreApplication>
 #include <QJniObject>
@@ -28,7 +32,9 @@
 #include <QDir>
 #include <QFont>
 #include <QFontDatabase>
+#include <QGuiApplication>
 #include <QSslSocket>
+#include <QThreadPool>
 #include <cstring>
 #include <fcntl.h>
 
@@ -45,11 +51,41 @@ DroidStar::DroidStar(QObject *parent) :
 	m_settings_processed = false;
 	m_modelchange = false;
 	connect_status = Mode::DISCONNECTED;
+	m_dmrgeneration = 0;
+	m_dmrdeltas = 0;
+	m_modethread = nullptr;
+	m_media = new MediaContext();
 	m_settings = new QSettings(QSettings::IniFormat, QSettings::UserScope, "dudetronics", "droidstar", this);
+	m_store = new SettingsStore(m_settings, 2000, this);
+	connect(qApp, &QGuiApplication::applicationStateChanged, this, [this](Qt::ApplicationState state) {
+		// Android can kill a suspended app without warning
+		if(state != Qt::ApplicationActive){
+			m_store->flush();
+		}
+	});
+	m_log = new LogModel(2000, this);
+	connect(this, SIGNAL(update_log(QString)), m_log, SLOT(append(QString)));
+	m_http = new HttpManager(4);
+	m_httpthread = new QThread(this);
+	m_http->moveToThread(m_httpthread);
+	connect(m_http, SIGNAL(file_downloaded(QString)), this, SLOT(file_downloaded(QString)));
+	connect(m_http, SIGNAL(url_downloaded(QString)), this, SLOT(url_downloaded(QString)));
+	connect(m_http, SIGNAL(download_failed(QString)), this, SLOT(download_failed(QString)));
+	connect(m_http, SIGNAL(update_log(QString)), this, SIGNAL(update_log(QString)));
+	connect(m_httpthread, SIGNAL(finished()), m_http, SLOT(deleteLater()));
+	m_httpthread->start();
 	config_path = QStandardPaths::writableLocation(QStandardPaths::ConfigLocation);
 #if !defined(Q_OS_ANDROID) && !defined(Q_OS_WIN)
 	config_path += "/dudetronics";
 #endif
+	// LOGFILE=name in the settings keeps the lines that scroll out of the log tab
+	if(!m_store->value("LOGFILE").toString().isEmpty()){
+		m_log->set_spill(config_path + "/" + m_store->value("LOGFILE").toString());
+	}
+	// TRACEDIR=name writes a trace there on its own whenever a stream is lost
+	if(!m_store->value("TRACEDIR").toString().isEmpty()){
+		PacketTrace::set_dump_dir(config_path + "/" + m_store->value("TRACEDIR").toString());
+	}
 #if defined(Q_OS_ANDROID)
 	keepScreenOn();
     m_USBmonitor = &AndroidSerialPort::GetInstance();
@@ -59,6 +95,16 @@ DroidStar::DroidStar(QObject *parent) :
 	discover_devices();
 	process_settings();
 
+	// Measuring the vocoders takes a second or two, so it runs off the GUI thread
+	QThreadPool::globalInstance()->start([this]() {
+		VocoderRegistry::init({config_path, QCoreApplication::applicationDirPath()});
+		QMetaObject::invokeMethod(this, [this]() {
+			for(const QString &s : VocoderRegistry::report()){
+				emit update_log("Vocoder " + s);
+			}
+		}, Qt::QueuedConnection);
+	});
+
 	qDebug() << "CPU arch: " << QSysInfo::currentCpuArchitecture();
 	qDebug() << "Build ABI: " << QSysInfo::buildAbi();
 	qDebug() << "boot ID: " << QSysInfo::bootUniqueId();
@@ -73,6 +119,15 @@ DroidStar::DroidStar(QObject *parent) :
 
 DroidStar::~DroidStar()
 {
+	m_store->flush();
+	m_httpthread->quit();
+	m_httpthread->wait();
+	// The session gives its audio and vocoders back to m_media as its thread finishes
+	if(m_modethread && m_modethread->isRunning()){
+		m_modethread->quit();
+		m_modethread->wait();
+	}
+	delete m_media;
 }
 
 #ifdef Q_OS_ANDROID
@@ -141,18 +196,7 @@ void DroidStar::discover_devices()
 
 void DroidStar::download_file(QString f, bool u)
 {
-	HttpManager *http = new HttpManager(f, u);
-	QThread *httpThread = new QThread;
-	http->moveToThread(httpThread);
-	connect(httpThread, SIGNAL(started()), http, SLOT(process()));
-	if(u){
-		connect(http, SIGNAL(file_downloaded(QString)), this, SLOT(url_downloaded(QString)));
-	}
-	else{
-		connect(http, SIGNAL(file_downloaded(QString)), this, SLOT(file_downloaded(QString)));
-	}
-	connect(httpThread, SIGNAL(finished()), http, SLOT(deleteLater()));
-	httpThread->start();
+	QMetaObject::invokeMethod(m_http, "download", Qt::QueuedConnection, Q_ARG(QString, f), Q_ARG(bool, u));
 }
 
 void DroidStar::url_downloaded(QString url)
@@ -197,12 +241,35 @@ void DroidStar::file_downloaded(QString filename)
 		else if(filename == "DMRIDs.dat"){
 			process_dmr_ids();
 		}
+		else if(filename == DMRIDDatabase::delta_name(m_dmrgeneration)){
+			apply_dmr_delta(filename);
+		}
 		else if(filename == "NXDN.csv"){
 			process_nxdn_ids();
 		}
 	}
 }
 
+void DroidStar::download_failed(QString filename)
+{
+	// Deltas are published from every generation on, so the one there is none from yet is
+	// the server's own
+	if(filename == DMRIDDatabase::delta_name(m_dmrgeneration)){
+		emit update_log("DMR IDs up to date at generation " + QString::number(m_dmrgeneration));
+	}
+}
+
+void DroidStar::dump_trace()
+{
+	const QString f = config_path + "/trace-" + QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss") + ".dstrace";
+	if(PacketTrace::dump(f, "requested")){
+		emit update_log("Trace written to " + f);
+	}
+	else{
+		emit update_log("Cannot write trace " + f);
+	}
+}
+
 void DroidStar::dtmf_send_clicked(QString dtmf)
 {
 	QByteArray tx(dtmf.simplified().toUtf8(), dtmf.simplified().size());
@@ -297,8 +364,19 @@ void DroidStar::obtain_asl_wt_creds()
     manager->post(request, postData);
 }
 
+void DroidStar::set_packet_capture(bool c)
+{
+	QString f;
+
+	if(c){
+		f = config_path + "/" + m_protocol + "-" + QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss") + ".dscap";
+	}
+	emit packet_capture_changed(f);
+}
+
 void DroidStar::process_connect()
 {
+	m_store->flush();
 	if(connect_status != Mode::DISCONNECTED){
         if(connect_status == Mode::TIMEOUT){
             m_errortxt = "Connection timed out";
@@ -360,6 +438,7 @@ void DroidStar::process_connect()
         }
 
 		connect_status = Mode::CONNECTING;
+		m_connecttime.start();
 		QStringList sl;
 
         m_host = m_hostmap[m_refname];
@@ -410,6 +489,7 @@ void DroidStar::process_connect()
 		uint16_t nxdnid = m_nxdnids.key(m_callsign);
 
 		m_mode = Mode::create_mode(m_protocol);
+		m_mode->set_media(m_media);
 		m_modethread = new QThread;
 		m_mode->moveToThread(m_modethread);
 
@@ -417,10 +497,14 @@ void DroidStar::process_connect()
             QString iaxuser = sl.at(2).simplified();
             QString iaxpass = sl.at(3).simplified();
             m_mode->set_iax_params(iaxuser, iaxpass, m_wt_callingname, m_refname, m_host, m_port);
+            m_mode->set_iax_media(m_store->value("IAXCODEC").toString(), m_store->value("IAXTRUNK").toInt());
             connect(this, SIGNAL(send_dtmf(QByteArray)), m_mode, SLOT(send_dtmf(QByteArray)));
         }
 
         m_mode->init(m_callsign, m_dmrid, nxdnid, m_module, m_refname, m_host, m_port, m_ipv6, vocoder, modem, m_capture, m_playback, m_mdirect);
+        if( (m_protocol == "M17") && !m_mdirect && m_ipv6 && (sl.size() > 2) && (sl.at(2) != "none") ){
+            m_mode->set_race_host(sl.at(0).simplified());
+        }
 		m_mode->set_modem_flags(rxInvert, txInvert, pttInvert, useCOSAsLockout, duplex);
 		m_mode->set_modem_params(m_modemBaud.toUInt(), rxfreq, txfreq, m_modemTxDelay.toInt(), m_modemRxLevel.toFloat(), m_modemRFLevel.toFloat(), ysfTXHang, m_modemCWIdTxLevel.toFloat(), m_modemDstarTxLevel.toFloat(), m_modemDMRTxLevel.toFloat(), m_modemYSFTxLevel.toFloat(), m_modemP25TxLevel.toFloat(), m_modemNXDNTxLevel.toFloat(), pocsagTXLevel, m17TXLevel);
 
@@ -444,6 +528,7 @@ void DroidStar::process_connect()
 		connect(this, SIGNAL(rptr2_changed(QString)), m_mode, SLOT(rptr2_changed(QString)));
 		connect(this, SIGNAL(usrtxt_changed(QString)), m_mode, SLOT(usrtxt_changed(QString)));
         connect(this, SIGNAL(debug_changed(bool)), m_mode, SLOT(debug_changed(bool)));
+		connect(this, SIGNAL(packet_capture_changed(QString)), m_mode, SLOT(packet_capture_changed(QString)));
 		// Allow modes to request the main app to toggle the connect button (simulate user)
 		connect(m_mode, SIGNAL(request_connect_toggle()), this, SLOT(process_connect()));
 		connect(m_mode, SIGNAL(request_reconnect(int)), this, SLOT(schedule_reconnect(int)));
@@ -622,72 +707,93 @@ void DroidStar::process_mode_change(const QString &m)
 		m_label5 = "";
 		m_label6 = "";
 	}
+	prewarm_hosts();
 	emit mode_changed();
 }
 
+// The saved reflectors found in the hosts of the current mode are looked up ahead of the
+// connect. Only m_hostmap of the current mode is loaded, so each mode's host is warmed
+// when that mode is picked.
+void DroidStar::prewarm_hosts()
+{
+	const QStringList saved = {m_saved_refhost, m_saved_dcshost, m_saved_xrfhost, m_saved_ysfhost, m_saved_fcshost, m_saved_dmrhost, m_saved_p25host, m_saved_nxdnhost, m_saved_m17host, m_saved_iaxhost};
+	QStringList hosts;
+
+	for(const QString &h : saved){
+		const QStringList sl = m_hostmap.value(h).split(',');
+		if(sl.size() > 1){
+			hosts.append(sl.at(0).simplified());
+		}
+		if((m_protocol == "M17") && (sl.size() > 2)){
+			hosts.append(sl.at(2).simplified());
+		}
+	}
+	HostResolver::prewarm(hosts);
+}
+
 void DroidStar::save_settings()
 {
-	//m_settings->setValue("PLAYBACK", ui->comboPlayback->currentText());
-	//m_settings->setValue("CAPTURE", ui->comboCapture->currentText());
-	m_settings->setValue("IPV6", m_ipv6 ? "true" : "false");
-	m_settings->setValue("MODE", m_protocol);
-	m_settings->setValue("REFHOST", m_saved_refhost);
-	m_settings->setValue("DCSHOST", m_saved_dcshost);
-	m_settings->setValue("XRFHOST", m_saved_xrfhost);
-	m_settings->setValue("YSFHOST", m_saved_ysfhost);
-	m_settings->setValue("FCSHOST", m_saved_fcshost);
-	m_settings->setValue("DMRHOST", m_saved_dmrhost);
-	m_settings->setValue("P25HOST", m_saved_p25host);
-	m_settings->setValue("NXDNHOST", m_saved_nxdnhost);
-	m_settings->setValue("M17HOST", m_saved_m17host);
-    m_settings->setValue("IAXHOST", m_saved_iaxhost);
-	m_settings->setValue("MODULE", QString(m_module));
-	m_settings->setValue("CALLSIGN", m_callsign);
-	m_settings->setValue("DMRID", m_dmrid);
-	m_settings->setValue("ESSID", m_essid);
-	m_settings->setValue("BMPASSWORD", m_bm_password);
-	m_settings->setValue("TGIFPASSWORD", m_tgif_password);
-	m_settings->setValue("ASLPASSWORD", m_asl_password);
-	m_settings->setValue("DMRTGID", m_dmr_destid);
-	m_settings->setValue("DMRLAT", m_latitude);
-	m_settings->setValue("DMRLONG", m_longitude);
-	m_settings->setValue("DMRLOC", m_location);
-	m_settings->setValue("DMRDESC", m_description);
-	m_settings->setValue("DMRFREQ", m_freq);
-	m_settings->setValue("DMRURL", m_url);
-	m_settings->setValue("DMRSWID", m_swid);
-	m_settings->setValue("DMRPKGID", m_pkgid);
-	m_settings->setValue("DMROPTS", m_dmropts);
-	m_settings->setValue("MYCALL", m_mycall);
-	m_settings->setValue("URCALL", m_urcall);
-	m_settings->setValue("RPTR1", m_rptr1);
-	m_settings->setValue("RPTR2", m_rptr2);
-	m_settings->setValue("TXTIMEOUT", m_txtimeout);
-	m_settings->setValue("TXTOGGLE", m_toggletx ? "true" : "false");
-	m_settings->setValue("XRF2REF", m_xrf2ref ? "true" : "false");
-	m_settings->setValue("USRTXT", m_dstarusertxt);
-
-	m_settings->setValue("ModemRxFreq", m_modemRxFreq);
-	m_settings->setValue("ModemTxFreq", m_modemTxFreq);
-	m_settings->setValue("ModemRxOffset", m_modemRxOffset);
-	m_settings->setValue("ModemTxOffset", m_modemTxOffset);
-	m_settings->setValue("ModemRxDCOffset", m_modemRxDCOffset);
-	m_settings->setValue("ModemTxDCOffset", m_modemTxDCOffset);
-	m_settings->setValue("ModemRxLevel", m_modemRxLevel);
-	m_settings->setValue("ModemTxLevel", m_modemTxLevel);
-	m_settings->setValue("ModemRFLevel", m_modemRFLevel);
-	m_settings->setValue("ModemTxDelay", m_modemTxDelay);
-	m_settings->setValue("ModemCWIdTxLevel", m_modemCWIdTxLevel);
-	m_settings->setValue("ModemDstarTxLevel", m_modemDstarTxLevel);
-	m_settings->setValue("ModemDMRTxLevel", m_modemDMRTxLevel);
-	m_settings->setValue("ModemYSFTxLevel", m_modemYSFTxLevel);
-	m_settings->setValue("ModemP25TxLevel", m_modemP25TxLevel);
-	m_settings->setValue("ModemNXDNTxLevel", m_modemNXDNTxLevel);
-	m_settings->setValue("ModemBaud", m_modemBaud);
-	m_settings->setValue("ModemM17CAN", m_modemM17CAN);
-	m_settings->setValue("ModemTxInvert", m_modemTxInvert ? "true" : "false");
-	m_settings->setValue("ModemRxInvert", m_modemRxInvert ? "true" : "false");
-	m_settings->setValue("ModemPTTInvert", m_modemPTTInvert ? "true" : "false");
+	//m_store->set("PLAYBACK", ui->comboPlayback->currentText());
+	//m_store->set("CAPTURE", ui->comboCapture->currentText());
+	m_store->set("IPV6", m_ipv6 ? "true" : "false");
+	m_store->set("MODE", m_protocol);
+	m_store->set("REFHOST", m_saved_refhost);
+	m_store->set("DCSHOST", m_saved_dcshost);
+	m_store->set("XRFHOST", m_saved_xrfhost);
+	m_store->set("YSFHOST", m_saved_ysfhost);
+	m_store->set("FCSHOST", m_saved_fcshost);
+	m_store->set("DMRHOST", m_saved_dmrhost);
+	m_store->set("P25HOST", m_saved_p25host);
+	m_store->set("NXDNHOST", m_saved_nxdnhost);
+	m_store->set("M17HOST", m_saved_m17host);
+    m_store->set("IAXHOST", m_saved_iaxhost);
+	m_store->set("MODULE", QString(m_module));
+	m_store->set("CALLSIGN", m_callsign);
+	m_store->set("DMRID", m_dmrid);
+	m_store->set("ESSID", m_essid);
+	m_store->set("BMPASSWORD", m_bm_password);
+	m_store->set("TGIFPASSWORD", m_tgif_password);
+	m_store->set("ASLPASSWORD", m_asl_password);
+	m_store->set("DMRTGID", m_dmr_destid);
+	m_store->set("DMRLAT", m_latitude);
+	m_store->set("DMRLONG", m_longitude);
+	m_store->set("DMRLOC", m_location);
+	m_store->set("DMRDESC", m_description);
+	m_store->set("DMRFREQ", m_freq);
+	m_store->set("DMRURL", m_url);
+	m_store->set("DMRSWID", m_swid);
+	m_store->set("DMRPKGID", m_pkgid);
+	m_store->set("DMROPTS", m_dmropts);
+	m_store->set("MYCALL", m_mycall);
+	m_store->set("URCALL", m_urcall);
+	m_store->set("RPTR1", m_rptr1);
+	m_store->set("RPTR2", m_rptr2);
+	m_store->set("TXTIMEOUT", m_txtimeout);
+	m_store->set("TXTOGGLE", m_toggletx ? "true" : "false");
+	m_store->set("XRF2REF", m_xrf2ref ? "true" : "false");
+	m_store->set("USRTXT", m_dstarusertxt);
+
+	m_store->set("ModemRxFreq", m_modemRxFreq);
+	m_store->set("ModemTxFreq", m_modemTxFreq);
+	m_store->set("ModemRxOffset", m_modemRxOffset);
+	m_store->set("ModemTxOffset", m_modemTxOffset);
+	m_store->set("ModemRxDCOffset", m_modemRxDCOffset);
+	m_store->set("ModemTxDCOffset", m_modemTxDCOffset);
+	m_store->set("ModemRxLevel", m_modemRxLevel);
+	m_store->set("ModemTxLevel", m_modemTxLevel);
+	m_store->set("ModemRFLevel", m_modemRFLevel);
+	m_store->set("ModemTxDelay", m_modemTxDelay);
+	m_store->set("ModemCWIdTxLevel", m_modemCWIdTxLevel);
+	m_store->set("ModemDstarTxLevel", m_modemDstarTxLevel);
+	m_store->set("ModemDMRTxLevel", m_modemDMRTxLevel);
+	m_store->set("ModemYSFTxLevel", m_modemYSFTxLevel);
+	m_store->set("ModemP25TxLevel", m_modemP25TxLevel);
+	m_store->set("ModemNXDNTxLevel", m_modemNXDNTxLevel);
+	m_store->set("ModemBaud", m_modemBaud);
+	m_store->set("ModemM17CAN", m_modemM17CAN);
+	m_store->set("ModemTxInvert", m_modemTxInvert ? "true" : "false");
+	m_store->set("ModemRxInvert", m_modemRxInvert ? "true" : "false");
+	m_store->set("ModemPTTInvert", m_modemPTTInvert ? "true" : "false");
 }
 
 void DroidStar::process_settings()
@@ -752,6 +858,7 @@ void DroidStar::process_settings()
 	m_modemTxInvert = (m_settings->value("ModemTxInvert", "true").toString().simplified() == "true") ? true : false;
 	m_modemRxInvert = (m_settings->value("ModemRxInvert", "false").toString().simplified() == "true") ? true : false;
 	m_modemPTTInvert = (m_settings->value("ModemPTTInvert", "false").toString().simplified() == "true") ? true : false;
+	prewarm_hosts();
 	emit update_settings();
 }
 
@@ -1114,26 +1221,48 @@ void DroidStar::process_dmr_ids()
 {
 	QFileInfo check_file(config_path + "/DMRIDs.dat");
 	if(check_file.exists() && check_file.isFile()){
-		QFile f(config_path + "/DMRIDs.dat");
-		if(f.open(QIODevice::ReadOnly)){
-			while(!f.atEnd()){
-				QString lids = f.readLine();
-				if(lids.at(0) == '#'){
-					continue;
-				}
-				QStringList llids = lids.simplified().split(' ');
-
-				if(llids.size() >= 2){
-                    if(llids.size() == 3){
-                         m_dmrids[llids.at(0).toUInt()] = llids.at(1) + " " + llids.at(2);
-                    }
-                    else{
-                        m_dmrids[llids.at(0).toUInt()] = llids.at(1);
-                    }
-				}
-			}
+		QMap<uint32_t, QString> ids;
+		QElapsedTimer t;
+		t.start();
+		if(DMRIDDatabase::load(config_path + "/DMRIDs.dat", ids, &m_dmrgeneration)){
+			m_dmrids.swap(ids);
 		}
-		f.close();
+		qDebug() << "DMR IDs: loaded" << m_dmrids.size() << "generation" << m_dmrgeneration << "in" << t.elapsed() << "ms";
+	}
+	else{
+		download_file("/DMRIDs.dat");
+	}
+}
+
+void DroidStar::apply_dmr_delta(QString filename)
+{
+	QFile f(config_path + "/" + filename);
+	DMRIDDatabase::DELTA d;
+	QByteArray delta;
+	QElapsedTimer t;
+
+	if(f.open(QIODevice::ReadOnly)){
+		delta = f.readAll();
+	}
+	f.remove();
+
+	t.start();
+	if(!DMRIDDatabase::apply(delta, m_dmrids, m_dmrgeneration, &d) || !DMRIDDatabase::save(config_path + "/DMRIDs.dat", m_dmrids, d.to)){
+		emit update_log("DMR ID delta " + filename + " not applied, downloading DMRIDs.dat");
+		QMetaObject::invokeMethod(m_http, "forget", Qt::QueuedConnection, Q_ARG(QString, "DMRIDs.dat"));
+		download_file("/DMRIDs.dat");
+		return;
+	}
+	// The server's validators are for the file before the delta
+	QMetaObject::invokeMethod(m_http, "forget", Qt::QueuedConnection, Q_ARG(QString, "DMRIDs.dat"));
+	m_dmrgeneration = d.to;
+	++m_dmrdeltas;
+	emit update_log(QString("DMR IDs generation %1: %2 added, %3 changed, %4 removed, %5 bytes applied in %6 ms")
+					.arg(d.to).arg(d.added).arg(d.changed).arg(d.removed).arg(delta.size()).arg(t.elapsed()));
+
+	// Many generations behind, the whole file is smaller than the deltas
+	if(m_dmrdeltas < DMRIDDatabase::MAX_CHAIN){
+		download_file("/" + DMRIDDatabase::delta_name(m_dmrgeneration));
 	}
 	else{
 		download_file("/DMRIDs.dat");
@@ -1142,12 +1271,14 @@ void DroidStar::process_dmr_ids()
 
 void DroidStar::update_dmr_ids()
 {
-	QFileInfo check_file(config_path + "/DMRIDs.dat");
-	if(check_file.exists() && check_file.isFile()){
-		QFile f(config_path + "/DMRIDs.dat");
-		f.remove();
+	// A file without a generation predates the deltas, it is downloaded whole if it changed
+	m_dmrdeltas = 0;
+	if(m_dmrgeneration && QFileInfo::exists(config_path + "/DMRIDs.dat")){
+		download_file("/" + DMRIDDatabase::delta_name(m_dmrgeneration));
+	}
+	else{
+		download_file("/DMRIDs.dat");
 	}
-	process_dmr_ids();
 	update_nxdn_ids();
 }
 
@@ -1326,6 +1457,7 @@ void DroidStar::update_data(Mode::MODEINFO info)
 		if(m_rptr1.isEmpty()) set_rptr1(m_callsign + " " + m_module);
         QString s = "Connected to " + m_protocol + " " + m_refname + " " + m_host + ":" + QString::number(m_port);
         emit update_log(s);
+        qDebug() << "Connected in" << m_connecttime.elapsed() << "ms, DNS cache hits/misses" << HostResolver::hits() << "/" << HostResolver::misses();
 
 		if(info.sw_vocoder_loaded){
             emit update_log("Software vocoder loaded");
@@ -1334,6 +1466,10 @@ void DroidStar::update_data(Mode::MODEINFO info)
             emit update_log("Software vocoder not loaded");
 			emit open_vocoder_dialog();
 		}
+		const QString voc = VocoderRegistry::describe(m_protocol, m_vocoder);
+		if(!voc.isEmpty()){
+			emit update_log("Vocoder " + voc);
+		}
 #ifdef Q_OS_ANDROID
         QJniObject javaNotification = QJniObject::fromString(s);
         QJniObject::callStaticMethod<void>(
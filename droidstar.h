@@ -19,7 +19,11 @@
 #define DROIDSTAR_H
 
 #include <QObject>
+#include "httpmanager.h"
+#include "logmodel.h"
+#include "mediacontext.h"
 #include "mode.h"
+#include "settingsstore.h"
 
 class DroidStar : public QObject
 {
@@ -63,6 +67,7 @@ signals:
 	void usrtxt_changed(QString);
     void dst_changed(QString);
     void debug_changed(bool);
+	void packet_capture_changed(QString);
     void update_devices();
 public slots:
 	void set_callsign(const QString &callsign) {  m_callsign = callsign.simplified(); save_settings(); }
@@ -118,6 +123,7 @@ public slots:
 	void set_iaxport(const QString &port){ m_iaxport = port.simplified().toUInt(); save_settings(); }
     void set_dst(QString dst){emit dst_changed(dst);}
     void set_debug(bool debug){emit debug_changed(debug);}
+	void set_packet_capture(bool);
 
 	void set_modemRxFreq(QString m) { m_modemRxFreq = m; save_settings(); }
 	void set_modemTxFreq(QString m) { m_modemTxFreq = m; save_settings(); }
@@ -251,6 +257,9 @@ public slots:
 	void download_file(QString, bool u = false);
 	void file_downloaded(QString);
 	void url_downloaded(QString);
+	void download_failed(QString);
+	QObject * get_log_model() { return m_log; }
+	void dump_trace();
 	unsigned short get_output_level(){ return m_outlevel; }
 	void set_output_level(unsigned short l){ m_outlevel = l; }
 	void tts_changed(QString);
@@ -260,6 +269,10 @@ private:
 	int connect_status;
 	bool m_update_host_files;
 	QSettings *m_settings;
+	SettingsStore *m_store;
+	HttpManager *m_http;
+	LogModel *m_log;
+	QThread *m_httpthread;
 	QString config_path;
 	QString hosts_filename;
 	QString m_callsign;
@@ -294,6 +307,8 @@ private:
 	uint32_t m_dmr_srcid;
 	uint32_t m_dmr_destid;
 	QMap<uint32_t, QString> m_dmrids;
+	quint32 m_dmrgeneration;
+	int m_dmrdeltas;
 	QMap<uint16_t, QString> m_nxdnids;
 	char m_module;
 	int m_port;
@@ -324,6 +339,7 @@ private:
 	QStringList m_customhosts;
 	QThread *m_modethread;
 	Mode *m_mode;
+	MediaContext *m_media;
 	QByteArray user_data;
 	QString m_localhosts;
 	int m_iaxport;
@@ -371,10 +387,13 @@ private:
 	bool m_modemRxInvert;
 	bool m_modemPTTInvert;
 	uint32_t m_dmrColorCode;
+	QElapsedTimer m_connecttime;
 #ifdef Q_OS_ANDROID
     AndroidSerialPort *m_USBmonitor;
 #endif
 
+	void prewarm_hosts();
+
 private slots:
 #ifdef Q_OS_ANDROID
 	void keepScreenOn();
@@ -390,6 +409,7 @@ private slots:
     void process_iax_hosts();
     void process_asl_hosts();
 	void process_dmr_ids();
+	void apply_dmr_delta(QString filename);
 	void process_nxdn_ids();
 	void update_data(Mode::MODEINFO);
     void updatelog(QString);
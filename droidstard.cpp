@@ -0,0 +1,400 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// droidstard: headless DroidStar daemon.
+//
+//   droidstard -c droidstard.conf
+//   droidstard -m M17 -H 127.0.0.1 -p 17000 -r M17-XXX -M C -C N0CALL
+//
+// The config file is INI. Keys outside a group apply to every session, each [SessionN]
+// group is one link and may override any of them:
+//
+//   CALLSIGN=N0CALL
+//   DMRID=3100000
+//   MIXER=OS default
+//   [Session1]
+//   MODE=M17
+//   HOST=m17-xxx.example.org
+//   PORT=17000
+//   REFNAME=M17-XXX
+//   MODULE=C
+//   [Session2]
+//   MODE=DMR
+//   HOST=3102.master.brandmeister.network
+//   PORT=62031
+//   PASSWORD=passw0rd
+//   DMRTGID=91
+//   PRIORITY=1
+//
+// A [RelayN] group retransmits voice between two sessions without decoding it. M17 needs
+// a transcoder, so with a YSF link added as [Session3] the DMR link can be relayed to it:
+//
+//   [Relay1]
+//   A=Session2
+//   B=Session3
+//
+// A [GatewayN] group decodes and re-encodes instead, so it can link any two sessions, the
+// M17 one to DMR for example. DMRIDS names a DMRIDs.dat for mapping callsigns to DMR IDs
+// and back, AGC=false turns off the levelling of the decoded audio:
+//
+//   DMRIDS=/home/pi/.config/dudetronics/DMRIDs.dat
+//   [Gateway1]
+//   A=Session1
+//   B=Session2
+//
+// AMBEDEVICES lists AMBE-3000 and AMBE-3003 dongles for the gateways to transcode AMBE on
+// instead of the software vocoder, each AMBE-3003 counting as three channels:
+//
+//   AMBEDEVICES=/dev/ttyUSB0,/dev/ttyUSB1
+//
+// IAX sessions send u-law unless IAXCODEC is alaw or slin. IAXTRUNK=n packs n voice frames
+// of a session into each IAX2 trunk frame instead of sending a mini frame for every one.
+// Sessions do not share trunk frames, and each adds (n - 1) x 20 ms of delay:
+//
+//   IAXCODEC=slin
+//   IAXTRUNK=2
+//
+// Before the sessions start every software vocoder is measured and the fastest good one is
+// used for each codec. vocoder_plugin.* libraries next to the config file or droidstard
+// are measured too.
+//
+// The last packets of every session are kept in memory. With --trace-dir they are written
+// there when a stream is lost, and on SIGUSR1; droidstar-trace prints the file.
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QSettings>
+#include <QTimer>
+#include <csignal>
+#include <cstdio>
+#if defined(Q_OS_UNIX)
+#include <unistd.h>
+#endif
+#include "packettrace.h"
+#include "sessionmanager.h"
+#include "vocoderregistry.h"
+
+static bool verbose = false;
+static volatile sig_atomic_t quit_requested = 0;
+static volatile sig_atomic_t trace_requested = 0;
+
+static void message_handler(QtMsgType type, const QMessageLogContext &context, const QString &msg)
+{
+	if((type == QtDebugMsg) && !verbose){
+		return;
+	}
+	fprintf(stderr, "%s\n", qFormatLogMessage(type, context, msg).toLocal8Bit().constData());
+}
+
+static void signal_handler(int)
+{
+	quit_requested = 1;
+}
+
+#if defined(Q_OS_UNIX)
+static void trace_handler(int)
+{
+	trace_requested = 1;
+}
+#endif
+
+static double rss_mb()
+{
+#if defined(Q_OS_LINUX)
+	QFile f("/proc/self/statm");
+	if(f.open(QIODevice::ReadOnly)){
+		const QList<QByteArray> v = f.readAll().split(' ');
+		if(v.size() > 1){
+			return v[1].toDouble() * sysconf(_SC_PAGESIZE) / (1024 * 1024);
+		}
+	}
+#endif
+	return 0;
+}
+
+// Time since the process was created, so the dynamic loading of the Qt libraries counts
+// towards start-up; falls back to the time since main() was entered.
+static qint64 startup_ms(const QElapsedTimer &main)
+{
+#if defined(Q_OS_LINUX)
+	QFile stat("/proc/self/stat");
+	QFile uptime("/proc/uptime");
+	if(stat.open(QIODevice::ReadOnly) && uptime.open(QIODevice::ReadOnly)){
+		const QByteArray s = stat.readAll();
+		const QList<QByteArray> f = s.mid(s.lastIndexOf(')') + 2).split(' ');
+		const double up = uptime.readAll().split(' ').first().toDouble();
+		if(f.size() > 19){
+			return (qint64)((up - f[19].toDouble() / sysconf(_SC_CLK_TCK)) * 1000);
+		}
+	}
+#endif
+	return main.elapsed();
+}
+
+static QHash<QString, QString> overrides;
+
+static QString value(QSettings &s, const QString &group, const QString &key, const QString &def = QString())
+{
+	const QString k = group + "/" + key;
+	if(overrides.contains(k)){
+		return overrides[k];
+	}
+	return s.value(s.contains(k) ? k : key, def).toString().simplified();
+}
+
+static SessionManager::SESSION_CONFIG read_session(QSettings &s, const QString &g)
+{
+	SessionManager::SESSION_CONFIG c;
+	const QString module = value(s, g, "MODULE", " ");
+
+	c.mode = value(s, g, "MODE").toUpper();
+	c.callsign = value(s, g, "CALLSIGN");
+	c.dmrid = value(s, g, "DMRID").toUInt();
+	c.nxdnid = value(s, g, "NXDNID").toUInt();
+	c.module = module.isEmpty() ? ' ' : module.toStdString()[0];
+	c.host = value(s, g, "HOST");
+	c.port = value(s, g, "PORT").toInt();
+	c.refname = value(s, g, "REFNAME", c.host);
+	c.ipv6 = value(s, g, "IPV6") == "true";
+	c.vocoder = value(s, g, "VOCODER", c.vocoder);
+	c.modem = value(s, g, "MODEM");
+	c.audioin = value(s, g, "AUDIOIN", c.audioin);
+	c.audioout = value(s, g, "AUDIOOUT", c.audioout);
+	c.priority = value(s, g, "PRIORITY", "0").toInt();
+	c.dmr_tgid = value(s, g, "DMRTGID", "4000").toUInt();
+	c.dmr_cc = value(s, g, "DMRCC", "1").toUInt();
+	c.dmr_essid = value(s, g, "ESSID", "0").toUInt();
+	c.dmr_password = value(s, g, "PASSWORD");
+	c.dmr_lat = value(s, g, "DMRLAT", "0");
+	c.dmr_lon = value(s, g, "DMRLONG", "0");
+	c.dmr_location = value(s, g, "DMRLOC");
+	c.dmr_desc = value(s, g, "DMRDESC");
+	c.dmr_freq = value(s, g, "DMRFREQ", "438800000");
+	c.dmr_url = value(s, g, "DMRURL", "www.qrz.com");
+	c.dmr_swid = value(s, g, "DMRSWID", "20200922");
+	c.dmr_pkgid = value(s, g, "DMRPKGID", "MMDVM_MMDVM_HS_Hat");
+	c.dmr_options = value(s, g, "DMROPTS");
+	c.iax_user = value(s, g, "IAXUSER");
+	c.iax_password = value(s, g, "PASSWORD");
+	c.iax_callingname = value(s, g, "IAXNAME", c.callsign);
+	c.iax_codec = value(s, g, "IAXCODEC", "ulaw");
+	c.iax_trunk = value(s, g, "IAXTRUNK", "0").toInt();
+	return c;
+}
+
+int main(int argc, char *argv[])
+{
+	QElapsedTimer started;
+	started.start();
+
+	QCoreApplication app(argc, argv);
+	QCommandLineParser parser;
+	QList<SessionManager::SESSION_CONFIG> configs;
+	QStringList groups;
+
+	parser.setApplicationDescription("Headless DroidStar daemon");
+	parser.addHelpOption();
+	parser.addOption({{"c", "config"}, "Config file with one [SessionN] group per link", "file"});
+	parser.addOption({{"m", "mode"}, "Protocol of a single session given on the command line", "mode"});
+	parser.addOption({{"H", "host"}, "Reflector host", "host"});
+	parser.addOption({{"p", "port"}, "Reflector port", "port"});
+	parser.addOption({{"r", "refname"}, "Reflector name", "name"});
+	parser.addOption({{"M", "module"}, "Reflector module", "module"});
+	parser.addOption({{"C", "callsign"}, "Callsign", "callsign"});
+	parser.addOption({{"i", "dmrid"}, "DMR ID", "id"});
+	parser.addOption({{"t", "tg"}, "DMR talkgroup", "tg"});
+	parser.addOption({"password", "DMR or IAX password", "password"});
+	parser.addOption({{"a", "audio"}, "Playback device, \"null\" or \"wav:<file>\"", "device"});
+	parser.addOption({"mix", "Mix all sessions to this playback device instead of one at a time", "device"});
+	parser.addOption({{"w", "threads"}, "Session threads", "n"});
+	parser.addOption({{"d", "debug"}, "Show debug output"});
+	parser.addOption({"trace-dir", "Write packet traces here on lost streams and SIGUSR1", "dir"});
+	parser.process(app);
+
+	verbose = parser.isSet("debug");
+	qInstallMessageHandler(message_handler);
+
+	QSettings settings(parser.isSet("config") ? parser.value("config") : QString(), QSettings::IniFormat);
+
+	if(parser.isSet("config")){
+		if(settings.status() != QSettings::NoError || !QFile::exists(parser.value("config"))){
+			fprintf(stderr, "Cannot read %s\n", parser.value("config").toStdString().c_str());
+			return 1;
+		}
+		for(const QString &g : settings.childGroups()){
+			if(g.startsWith("Session", Qt::CaseInsensitive)){
+				configs.append(read_session(settings, g));
+				groups.append(g);
+			}
+		}
+	}
+
+	// -m adds one more session from the command line, missing keys come from the config file
+	if(parser.isSet("mode")){
+		const QStringList keys = {"mode", "host", "port", "refname", "module", "callsign", "dmrid", "tg", "password", "audio"};
+		const QStringList ini = {"MODE", "HOST", "PORT", "REFNAME", "MODULE", "CALLSIGN", "DMRID", "DMRTGID", "PASSWORD", "AUDIOOUT"};
+		for(int i = 0; i < keys.size(); ++i){
+			if(parser.isSet(keys[i])){
+				overrides["CommandLine/" + ini[i]] = parser.value(keys[i]);
+			}
+		}
+		configs.append(read_session(settings, "CommandLine"));
+	}
+
+	if(configs.isEmpty()){
+		fprintf(stderr, "No sessions configured, use -c or -m\n");
+		return 1;
+	}
+
+	QStringList plugin_dirs = {QCoreApplication::applicationDirPath()};
+	if(parser.isSet("config")){
+		plugin_dirs.prepend(QFileInfo(parser.value("config")).absolutePath());
+	}
+	VocoderRegistry::init(plugin_dirs);
+	for(const QString &s : VocoderRegistry::report()){
+		fprintf(stdout, "Vocoder %s\n", s.toStdString().c_str());
+	}
+
+	SessionManager manager(parser.isSet("threads") ? parser.value("threads").toInt() : value(settings, "General", "THREADS", "0").toInt());
+	const QString mixer = parser.isSet("mix") ? parser.value("mix") : value(settings, "General", "MIXER");
+
+	if(!mixer.isEmpty()){
+		manager.enable_mixer(mixer);
+	}
+
+	QObject::connect(&manager, &SessionManager::session_log, [](int id, QString s) {
+		fprintf(stdout, "[%d] %s\n", id, s.toStdString().c_str());
+		fflush(stdout);
+	});
+
+	int pending = 0;
+	QHash<QString, int> ids;
+	for(int i = 0; i < configs.size(); ++i){
+		const int id = manager.add_session(configs[i]);
+		if(id == -1){
+			fprintf(stderr, "Unsupported mode %s\n", configs[i].mode.toStdString().c_str());
+			return 1;
+		}
+		ids[groups.value(i, "CommandLine").toLower()] = id;
+		++pending;
+	}
+
+	for(const QString &g : settings.childGroups()){
+		if(g.startsWith("Relay", Qt::CaseInsensitive)){
+			const QString a = settings.value(g + "/A").toString().toLower();
+			const QString b = settings.value(g + "/B").toString().toLower();
+			CodecRelay *r = (ids.contains(a) && ids.contains(b)) ? manager.add_relay(ids[a], ids[b]) : nullptr;
+			if(r == nullptr){
+				fprintf(stderr, "Cannot relay %s: %s and %s\n", g.toStdString().c_str(), a.toStdString().c_str(), b.toStdString().c_str());
+				return 1;
+			}
+			QObject::connect(r, &CodecRelay::update_log, [g](QString s) {
+				fprintf(stdout, "[%s] %s\n", g.toStdString().c_str(), s.toStdString().c_str());
+				fflush(stdout);
+			});
+		}
+	}
+
+	const QString dmrids = value(settings, "General", "DMRIDS");
+	if(!dmrids.isEmpty()){
+		fprintf(stdout, "%d DMR IDs loaded\n", manager.load_dmr_ids(dmrids));
+	}
+
+	// QSettings reads a value with commas as a list
+	const QStringList ambedevices = settings.value("AMBEDEVICES").toStringList();
+	if(!ambedevices.isEmpty()){
+		fprintf(stdout, "%d AMBE channels\n", manager.open_ambe_devices(ambedevices));
+	}
+
+	for(const QString &g : settings.childGroups()){
+		if(g.startsWith("Gateway", Qt::CaseInsensitive)){
+			const QString a = settings.value(g + "/A").toString().toLower();
+			const QString b = settings.value(g + "/B").toString().toLower();
+			TranscodeGateway *t = (ids.contains(a) && ids.contains(b)) ? manager.add_gateway(ids[a], ids[b]) : nullptr;
+			if(t == nullptr){
+				fprintf(stderr, "Cannot bridge %s: %s and %s\n", g.toStdString().c_str(), a.toStdString().c_str(), b.toStdString().c_str());
+				return 1;
+			}
+			t->set_agc(settings.value(g + "/AGC", "true").toString() != "false");
+			t->set_debug(verbose);
+			QObject::connect(t, &TranscodeGateway::update_log, [g](QString s) {
+				fprintf(stdout, "[%s] %s\n", g.toStdString().c_str(), s.toStdString().c_str());
+				fflush(stdout);
+			});
+		}
+	}
+
+	QSet<int> linked;
+	QObject::connect(&manager, &SessionManager::session_update, [&](int id, Mode::MODEINFO info) {
+		if(((info.status == Mode::CONNECTED_RW) || (info.status == Mode::CONNECTED_RO)) && !linked.contains(id)){
+			linked.insert(id);
+			fprintf(stdout, "[%d] %s linked\n", id, info.host.toStdString().c_str());
+			if(linked.size() == pending){
+				fprintf(stdout, "%d sessions linked %lld ms after start, rss %.1f MB\n", pending, startup_ms(started), rss_mb());
+			}
+			fflush(stdout);
+		}
+		else if((info.status == Mode::DISCONNECTED) || (info.status == Mode::TIMEOUT)){
+			linked.remove(id);
+		}
+	});
+	QObject::connect(&manager, &SessionManager::session_removed, [&](int id) {
+		linked.remove(id);
+		if(--pending == 0){
+			app.quit();
+		}
+	});
+
+	// Neither quitting nor writing a file is safe in a signal handler, so the handlers only
+	// set a flag that a timer polls
+	QTimer quit_timer;
+	signal(SIGINT, signal_handler);
+	signal(SIGTERM, signal_handler);
+	QObject::connect(&quit_timer, &QTimer::timeout, [&]() {
+		if(quit_requested){
+			app.quit();
+		}
+	});
+	quit_timer.start(100);
+
+	QTimer trace_timer;
+	if(parser.isSet("trace-dir")){
+		PacketTrace::set_dump_dir(parser.value("trace-dir"));
+#if defined(Q_OS_UNIX)
+		signal(SIGUSR1, trace_handler);
+		QObject::connect(&trace_timer, &QTimer::timeout, [&]() {
+			if(trace_requested){
+				trace_requested = 0;
+				const QString f = QDir(parser.value("trace-dir")).filePath("trace-" + QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss") + ".dstrace");
+				fprintf(stdout, "%s %s\n", PacketTrace::dump(f, "SIGUSR1") ? "trace written to" : "cannot write", f.toStdString().c_str());
+				fflush(stdout);
+			}
+		});
+		trace_timer.start(1000);
+#endif
+	}
+
+	fprintf(stdout, "%d sessions on %d threads, ready %lld ms after start, rss %.1f MB\n", pending, manager.threads(), startup_ms(started), rss_mb());
+	fflush(stdout);
+
+	return app.exec();
+}
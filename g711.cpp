@@ -0,0 +1,150 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "g711.h"
+
+#define ULAW_BIAS	0x84
+#define ULAW_CLIP	8159
+
+// Encoding tables are indexed by the sample shifted down to the bits the law resolves,
+// offset so that the most negative sample is entry 0
+struct G711_TABLES {
+	uint8_t ulaw[16384];
+	uint8_t alaw[8192];
+	int16_t ulaw_pcm[256];
+	int16_t alaw_pcm[256];
+
+	G711_TABLES()
+	{
+		for(int i = 0; i < 16384; ++i){
+			ulaw[i] = G711::linear_to_ulaw((int16_t)((i - 8192) * 4));
+		}
+		for(int i = 0; i < 8192; ++i){
+			alaw[i] = G711::linear_to_alaw((int16_t)((i - 4096) * 8));
+		}
+		for(int i = 0; i < 256; ++i){
+			ulaw_pcm[i] = G711::ulaw_to_linear(i);
+			alaw_pcm[i] = G711::alaw_to_linear(i);
+		}
+	}
+};
+
+static const G711_TABLES & tables()
+{
+	static const G711_TABLES t;
+	return t;
+}
+
+static int segment(int v, int first)
+{
+	int seg = 0;
+	for(int end = first; (seg < 8) && (v > end); end = (end << 1) | 1){
+		++seg;
+	}
+	return seg;
+}
+
+uint8_t G711::linear_to_ulaw(int16_t pcm)
+{
+	int v = pcm >> 2;
+	uint8_t mask = 0xff;
+
+	if(v < 0){
+		v = -v;
+		mask = 0x7f;
+	}
+	if(v > ULAW_CLIP){
+		v = ULAW_CLIP;
+	}
+	v += ULAW_BIAS >> 2;
+	const int seg = segment(v, 0x3f);
+	if(seg >= 8){
+		return 0x7f ^ mask;
+	}
+	return ((seg << 4) | ((v >> (seg + 1)) & 0x0f)) ^ mask;
+}
+
+int16_t G711::ulaw_to_linear(uint8_t ulaw)
+{
+	ulaw = ~ulaw;
+	int t = ((ulaw & 0x0f) << 3) + ULAW_BIAS;
+	t <<= (ulaw & 0x70) >> 4;
+	return (ulaw & 0x80) ? (ULAW_BIAS - t) : (t - ULAW_BIAS);
+}
+
+uint8_t G711::linear_to_alaw(int16_t pcm)
+{
+	int v = pcm >> 3;
+	uint8_t mask = 0xd5;
+
+	if(v < 0){
+		v = -v - 1;
+		mask = 0x55;
+	}
+	const int seg = segment(v, 0x1f);
+	if(seg >= 8){
+		return 0x7f ^ mask;
+	}
+	const uint8_t a = (seg << 4) | ((v >> ((seg < 2) ? 1 : seg)) & 0x0f);
+	return a ^ mask;
+}
+
+int16_t G711::alaw_to_linear(uint8_t alaw)
+{
+	alaw ^= 0x55;
+	int t = (alaw & 0x0f) << 4;
+	const int seg = (alaw & 0x70) >> 4;
+	if(seg == 0){
+		t += 8;
+	}
+	else{
+		t = (t + 0x108) << (seg - 1);
+	}
+	return (alaw & 0x80) ? t : -t;
+}
+
+void G711::ulaw_encode(const int16_t *pcm, uint8_t *ulaw, int n)
+{
+	const uint8_t *t = tables().ulaw + 8192;
+	for(int i = 0; i < n; ++i){
+		ulaw[i] = t[pcm[i] >> 2];
+	}
+}
+
+void G711::ulaw_decode(const uint8_t *ulaw, int16_t *pcm, int n)
+{
+	const int16_t *t = tables().ulaw_pcm;
+	for(int i = 0; i < n; ++i){
+		pcm[i] = t[ulaw[i]];
+	}
+}
+
+void G711::alaw_encode(const int16_t *pcm, uint8_t *alaw, int n)
+{
+	const uint8_t *t = tables().alaw + 4096;
+	for(int i = 0; i < n; ++i){
+		alaw[i] = t[pcm[i] >> 3];
+	}
+}
+
+void G711::alaw_decode(const uint8_t *alaw, int16_t *pcm, int n)
+{
+	const int16_t *t = tables().alaw_pcm;
+	for(int i = 0; i < n; ++i){
+		pcm[i] = t[alaw[i]];
+	}
+}
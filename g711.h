@@ -0,0 +1,40 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef G711_H
+#define G711_H
+
+#include <cstdint>
+
+// G.711 mu-law and A-law on 16 bit PCM, a frame at a time. mu-law only resolves 14 bits
+// and A-law 13, so every sample is encoded by one lookup in a table of 16384 or 8192
+// codes and decoded by one in a table of 256 samples. The tables are built on first use.
+class G711
+{
+public:
+	static void ulaw_encode(const int16_t *pcm, uint8_t *ulaw, int n);
+	static void ulaw_decode(const uint8_t *ulaw, int16_t *pcm, int n);
+	static void alaw_encode(const int16_t *pcm, uint8_t *alaw, int n);
+	static void alaw_decode(const uint8_t *alaw, int16_t *pcm, int n);
+	// The ITU reference arithmetic the tables are built from, one sample at a time
+	static uint8_t linear_to_ulaw(int16_t pcm);
+	static int16_t ulaw_to_linear(uint8_t ulaw);
+	static uint8_t linear_to_alaw(int16_t pcm);
+	static int16_t alaw_to_linear(uint8_t alaw);
+};
+
+#endif // G711_H
@@ -0,0 +1,190 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// droidstar-gatewaybench: throughput of the PCM transcoding gateway.
+//
+//   droidstar-gatewaybench [-f DMR] [-t M17] [-b bridges] [-w threads] [-s seconds]
+//
+// Each bridge is one TranscodePipeline fed with pre-encoded synthetic speech as fast as
+// it takes it, never more than half its queue ahead, so nothing is dropped. All bridges
+// share one thread pool. A live bridge carries one over at a time, 50 frames a second,
+// so bridges per core is the frame rate reached divided by 50 and by the threads, and
+// again from the vocoder CPU time per frame alone.
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include "transcodepipeline.h"
+#include "g711.h"
+
+static int codec(QString mode)
+{
+	mode = mode.toUpper();
+	if(mode == "DMR"){
+		return Mode::CODEC_AMBE2450X1150;
+	}
+	if((mode == "NXDN") || (mode == "YSF")){
+		return Mode::CODEC_AMBE2450;
+	}
+	if(mode == "P25"){
+		return Mode::CODEC_IMBE4400;
+	}
+	if((mode == "REF") || (mode == "XRF") || (mode == "DCS")){
+		return Mode::CODEC_AMBE2400X1200;
+	}
+	if(mode == "M17"){
+		return Mode::CODEC_CODEC2_3200;
+	}
+	if(mode == "IAX"){
+		return Mode::CODEC_ULAW;
+	}
+	return Mode::CODEC_NONE;
+}
+
+// A vowel with a moving pitch, on for 0.8 s and off for 0.2 s
+static QVector<int16_t> synthetic_speech(int seconds)
+{
+	QVector<int16_t> pcm(seconds * 8000);
+	double phase = 0;
+
+	for(int n = 0; n < pcm.size(); ++n){
+		const double t = n / 8000.0;
+		const double f0 = 120 + 30 * sin(2 * M_PI * 0.5 * t);
+		double s = 0;
+		phase += 2 * M_PI * f0 / 8000;
+		for(int h = 1; h * f0 < 3600; ++h){
+			s += sin(h * phase) * 3000 / h;
+		}
+		pcm[n] = (fmod(t, 1.0) < 0.8) ? (int16_t)qBound(-32768.0, s, 32767.0) : 0;
+	}
+	return pcm;
+}
+
+// Encodes the speech for the source mode with a pipeline from u-law, a batch at a time
+static QVector<QByteArray> encode(int to, const QVector<int16_t> &speech, QThreadPool *pool)
+{
+	QVector<QByteArray> frames;
+	TranscodePipeline p(Mode::CODEC_ULAW, to, pool);
+	QByteArray ulaw(160, 0);
+
+	p.set_agc(false);
+	QObject::connect(&p, &TranscodePipeline::frame, [&frames](int, QByteArray f) { frames.append(f); }, Qt::DirectConnection);
+	for(int i = 0; i + 160 <= speech.size(); i += 160){
+		G711::ulaw_encode(speech.constData() + i, reinterpret_cast<uint8_t *>(ulaw.data()), 160);
+		p.push(ulaw);
+		if((i / 160) % (TranscodePipeline::MAX_QUEUE / 2) == 0){
+			pool->waitForDone();
+		}
+	}
+	p.push_end();
+	pool->waitForDone();
+	return frames;
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	QCommandLineParser parser;
+
+	parser.setApplicationDescription("PCM transcoding gateway benchmark");
+	parser.addHelpOption();
+	parser.addOption({{"f", "from"}, "Source mode", "mode", "DMR"});
+	parser.addOption({{"t", "to"}, "Destination mode", "mode", "M17"});
+	parser.addOption({{"b", "bridges"}, "Bridges run at once", "n", "0"});
+	parser.addOption({{"w", "threads"}, "Pool threads", "n", "0"});
+	parser.addOption({{"s", "seconds"}, "Seconds of speech per bridge", "seconds", "10"});
+	parser.process(app);
+
+	const int from = codec(parser.value("from"));
+	const int to = codec(parser.value("to"));
+	const int threads = (parser.value("threads").toInt() > 0) ? parser.value("threads").toInt() : QThread::idealThreadCount();
+	const int bridges = (parser.value("bridges").toInt() > 0) ? parser.value("bridges").toInt() : threads * 4;
+	QThreadPool pool;
+
+	if((from == Mode::CODEC_NONE) || (to == Mode::CODEC_NONE)){
+		fprintf(stderr, "Modes are DMR, NXDN, YSF, P25, REF, XRF, DCS, M17 and IAX\n");
+		return 1;
+	}
+	pool.setMaxThreadCount(threads);
+
+	const QVector<QByteArray> frames = encode(from, synthetic_speech(qMax(1, parser.value("seconds").toInt())), &pool);
+	const double ratio = (double)TranscodePipeline::frame_samples(to) / TranscodePipeline::frame_samples(from);
+	QVector<TranscodePipeline *> pipes;
+	QVector<int> sent(bridges, 0);
+	std::atomic<int> *out = new std::atomic<int>[bridges];
+	std::atomic<int> ended(0);
+	QElapsedTimer t;
+	int done = 0;
+
+	for(int i = 0; i < bridges; ++i){
+		TranscodePipeline *p = new TranscodePipeline(from, to, &pool);
+		std::atomic<int> *o = &out[i];
+		out[i] = 0;
+		QObject::connect(p, &TranscodePipeline::frame, [o](int, QByteArray) { ++*o; }, Qt::DirectConnection);
+		QObject::connect(p, &TranscodePipeline::end, [&ended]() { ++ended; }, Qt::DirectConnection);
+		pipes.append(p);
+	}
+
+	t.start();
+	while(done < bridges){
+		bool idle = true;
+		for(int i = 0; i < bridges; ++i){
+			if(sent[i] > frames.size()){
+				continue;
+			}
+			while((sent[i] < frames.size()) && ((sent[i] - out[i] * ratio) < TranscodePipeline::MAX_QUEUE / 2)){
+				pipes[i]->push(frames[sent[i]++]);
+				idle = false;
+			}
+			if(sent[i] == frames.size()){
+				pipes[i]->push_end();
+				++sent[i];
+				++done;
+			}
+		}
+		if(idle){
+			QThread::usleep(100);
+		}
+	}
+	while(ended < bridges){
+		QThread::usleep(100);
+	}
+	const double secs = t.nsecsElapsed() / 1e9;
+
+	quint64 in = 0, dropped = 0;
+	qint64 ns = 0;
+	for(TranscodePipeline *p : pipes){
+		const TranscodePipeline::STATS st = p->stats();
+		in += st.frames_in;
+		dropped += st.dropped;
+		ns += st.decode_ns + st.encode_ns;
+		delete p;
+	}
+	delete[] out;
+
+	const double fps = in / secs;
+	fprintf(stdout, "%s -> %s, %d bridges on %d threads, %d frames each\n", parser.value("from").toUpper().toStdString().c_str(), parser.value("to").toUpper().toStdString().c_str(), bridges, threads, (int)frames.size());
+	fprintf(stdout, "%.0f frames/s, %.1f us CPU per frame, %llu dropped\n", fps, ns / 1000.0 / in, (unsigned long long)dropped);
+	fprintf(stdout, "%.1f bridges per core, %.1f from CPU time\n", fps / 50 / threads, 20e6 / ((double)ns / in));
+	return 0;
+}
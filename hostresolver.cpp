@@ -0,0 +1,173 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
+#include <QHash>
+#include <QMutex>
+#include <QPointer>
+#include "hostresolver.h"
+
+struct WAITER {
+	QPointer<QObject> context;
+	std::function<void(QHostInfo)> done;
+};
+
+struct ENTRY {
+	QList<QHostAddress> addresses;
+	qint64 resolved_ms = 0;
+	bool pending = false;
+	QList<WAITER> waiters;
+};
+
+static QMutex s_lock;
+static QHash<QString, ENTRY> s_cache;
+static quint32 s_hits = 0;
+static quint32 s_misses = 0;
+
+static QHostInfo make_info(const QString &host, const QList<QHostAddress> &addresses)
+{
+	QHostInfo i;
+	i.setHostName(host);
+	i.setAddresses(addresses);
+	return i;
+}
+
+static void deliver(const WAITER &w, const QHostInfo &i)
+{
+	if(w.context){
+		std::function<void(QHostInfo)> done = w.done;
+		QMetaObject::invokeMethod(w.context, [done, i]() { done(i); }, Qt::QueuedConnection);
+	}
+}
+
+static void finished(const QString &host, const QHostInfo &i)
+{
+	QList<WAITER> waiters;
+	QHostInfo answer = i;
+
+	s_lock.lock();
+	ENTRY &e = s_cache[host];
+	e.pending = false;
+	waiters.swap(e.waiters);
+	if((i.error() == QHostInfo::NoError) && !i.addresses().isEmpty()){
+		e.addresses = i.addresses();
+		e.resolved_ms = QDateTime::currentMSecsSinceEpoch();
+	}
+	else if(!e.addresses.isEmpty()){
+		// A failed refresh keeps the answer it would have replaced
+		qDebug() << "HostResolver: refresh of" << host << "failed:" << i.errorString();
+		answer = make_info(host, e.addresses);
+	}
+	else{
+		s_cache.remove(host);
+	}
+	s_lock.unlock();
+
+	for(const WAITER &w : waiters){
+		deliver(w, answer);
+	}
+}
+
+// Called with s_lock held. The answer comes back on the application thread, which
+// always has an event loop.
+static void resolve(const QString &host, ENTRY &e)
+{
+	e.pending = true;
+	QHostInfo::lookupHost(host, QCoreApplication::instance(), [host](const QHostInfo &i) { finished(host, i); });
+}
+
+void HostResolver::lookup(const QString &host, QObject *context, std::function<void(QHostInfo)> done)
+{
+	const qint64 now = QDateTime::currentMSecsSinceEpoch();
+	const WAITER w = {context, done};
+	QHostAddress literal;
+
+	if(literal.setAddress(host)){
+		deliver(w, make_info(host, {literal}));
+		return;
+	}
+
+	QMutexLocker l(&s_lock);
+	auto it = s_cache.find(host);
+	if((it != s_cache.end()) && !it->addresses.isEmpty() && ((now - it->resolved_ms) < MAX_STALE_S * 1000LL)){
+		++s_hits;
+		deliver(w, make_info(host, it->addresses));
+		if(((now - it->resolved_ms) >= TTL_S * 1000LL) && !it->pending){
+			resolve(host, *it);
+		}
+		return;
+	}
+
+	++s_misses;
+	ENTRY &e = s_cache[host];
+	e.addresses.clear();
+	e.waiters.append(w);
+	if(!e.pending){
+		resolve(host, e);
+	}
+}
+
+void HostResolver::prewarm(const QStringList &hosts)
+{
+	const qint64 now = QDateTime::currentMSecsSinceEpoch();
+	QHostAddress literal;
+
+	QMutexLocker l(&s_lock);
+	for(const QString &host : hosts){
+		if(host.isEmpty() || (host == "none") || literal.setAddress(host)){
+			continue;
+		}
+		ENTRY &e = s_cache[host];
+		if(!e.pending && (e.addresses.isEmpty() || ((now - e.resolved_ms) >= TTL_S * 1000LL))){
+			resolve(host, e);
+		}
+	}
+}
+
+QList<QHostAddress> HostResolver::interleave(const QList<QHostAddress> &addresses)
+{
+	QList<QHostAddress> v4, v6, out;
+
+	for(const QHostAddress &a : addresses){
+		if(!v4.contains(a) && !v6.contains(a)){
+			((a.protocol() == QAbstractSocket::IPv6Protocol) ? v6 : v4).append(a);
+		}
+	}
+	for(int i = 0; (i < v6.size()) || (i < v4.size()); ++i){
+		if(i < v6.size()){
+			out.append(v6.at(i));
+		}
+		if(i < v4.size()){
+			out.append(v4.at(i));
+		}
+	}
+	return out;
+}
+
+quint32 HostResolver::hits()
+{
+	QMutexLocker l(&s_lock);
+	return s_hits;
+}
+
+quint32 HostResolver::misses()
+{
+	QMutexLocker l(&s_lock);
+	return s_misses;
+}
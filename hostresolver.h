@@ -0,0 +1,47 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef HOSTRESOLVER_H
+#define HOSTRESOLVER_H
+
+#include <QHostInfo>
+#include <QList>
+#include <QStringList>
+#include <functional>
+
+// Reflector host names resolved once and shared by every session. An answer is used
+// for TTL_S seconds. After that it is still handed out at once, for up to MAX_STALE_S,
+// while a lookup refreshes it in the background, so the reconnects a reflector asks
+// for do not wait on DNS. QHostInfo does not give the record TTLs, so the times are
+// fixed. Address literals never reach DNS.
+class HostResolver
+{
+public:
+	static constexpr int TTL_S = 300;
+	static constexpr int MAX_STALE_S = 3600;
+
+	// done is called on context's thread, at once when host is a literal or cached
+	static void lookup(const QString &host, QObject *context, std::function<void(QHostInfo)> done);
+	// Looks the hosts up in the background so that the first connect finds them cached
+	static void prewarm(const QStringList &hosts);
+	// IPv6 and IPv4 addresses alternated, IPv6 first, for connection racing (RFC 8305)
+	static QList<QHostAddress> interleave(const QList<QHostAddress> &addresses);
+	static quint32 hits();
+	static quint32 misses();
+};
+
+#endif // HOSTRESOLVER_H
@@ -1,75 +1,186 @@
-/*
-	Copyright (C) 2019-2021 Doug McLain
-
-	This program is free software: you can redistribute it and/or modify
-	it under the terms of the GNU General Public License as published by
-	the Free Software Foundation, either version 3 of the License, or
-	(at your option) any later version.
-
-	This program is distributed in the hope that it will be useful,
-	but WITHOUT ANY WARRANTY; without even the implied warranty of
-	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
-	GNU General Public License for more details.
-
-	You should have received a copy of the GNU General Public License
-	along with this program.  If not, see <https://www.gnu.org/licenses/>.
-*/
-
 #include "httpmanager.h"
 
-HttpManager::HttpManager(QString f, bool u) : QObject(nullptr)
+HttpManager::HttpManager(int max_active) :
+	QObject(nullptr),
+	m_qnam(nullptr),
+	m_validators(nullptr),
+	m_max_active(max_active),
+	m_updated(0),
+	m_unchanged(0),
+	m_failed(0),
+	m_bytes(0)
 {
-	m_qnam = new QNetworkAccessManager(this);
-	QObject::connect(m_qnam, SIGNAL(finished(QNetworkReply*)), this, SLOT(http_finished(QNetworkReply*)));
 	m_config_path = QStandardPaths::writableLocation(QStandardPaths::ConfigLocation);
-	m_url = u;
 #if !defined(Q_OS_ANDROID) && !defined(Q_OS_WIN)
 	m_config_path += "/dudetronics";
 #endif
-	m_filename = f;
+	m_server = qEnvironmentVariable("DROIDSTAR_HOSTS_URL", "http://www.dudetronics.com/ar-dns");
 }
 
-void HttpManager::process()
+HttpManager::~HttpManager()
 {
-	QMetaObject::invokeMethod(this,"doRequest");
+	// abort() finishes the reply at once, which finds nothing left to do
+	const QHash<QNetworkReply *, TRANSFER> active = m_active;
+	m_active.clear();
+	for(auto it = active.begin(); it != active.end(); ++it){
+		it.key()->abort();
+		delete it.value().file;
+	}
 }
 
-void HttpManager::doRequest()
+// Made on first use rather than in the constructor so that they belong to the download thread
+void HttpManager::init()
 {
-	if(m_url){
-		m_qnam->get(QNetworkRequest(QUrl(m_filename)));
+	if(m_qnam == nullptr){
+		m_qnam = new QNetworkAccessManager(this);
+		QObject::connect(m_qnam, SIGNAL(finished(QNetworkReply*)), this, SLOT(http_finished(QNetworkReply*)));
+		m_validators = new QSettings(m_config_path + "/downloads.ini", QSettings::IniFormat, this);
 	}
-	else{
-		m_qnam->get(QNetworkRequest(QUrl("http://www.dudetronics.com/ar-dns" + m_filename)));
+}
+
+void HttpManager::download(QString f, bool u)
+{
+	init();
+
+	const QPair<QString, bool> job(f, u);
+	if(m_pending.contains(job)){
+		return;
+	}
+	for(const TRANSFER &t : m_active){
+		if(t.name == "/" + f.section('/', -1)){
+			return;
+		}
+	}
+	if(m_active.isEmpty() && m_pending.isEmpty()){
+		m_batch.start();
+		m_updated = 0;
+		m_unchanged = 0;
+		m_failed = 0;
+		m_bytes = 0;
+	}
+	m_pending.enqueue(job);
+	start_next();
+}
+
+void HttpManager::forget(QString f)
+{
+	init();
+	m_validators->remove(f.section('/', -1));
+	m_validators->sync();
+}
+
+void HttpManager::start_next()
+{
+	while((m_active.size() < m_max_active) && !m_pending.isEmpty()){
+		const QPair<QString, bool> job = m_pending.dequeue();
+		TRANSFER t;
+		t.url = job.second;
+		t.name = "/" + job.first.section('/', -1);
+
+		QStringList l = t.name.split('_');
+		if((l.at(0) != "/vocoder") && (l.size() > 1)){
+			continue;
+		}
+
+		QNetworkRequest request(t.url ? QUrl(job.first) : QUrl(m_server + job.first));
+		request.setTransferTimeout(30000);
+		if(QFileInfo::exists(m_config_path + t.name)){
+			m_validators->beginGroup(t.name.mid(1));
+			const QByteArray etag = m_validators->value("etag").toByteArray();
+			const QByteArray modified = m_validators->value("modified").toByteArray();
+			m_validators->endGroup();
+			if(!etag.isEmpty()){
+				request.setRawHeader("If-None-Match", etag);
+			}
+			if(!modified.isEmpty()){
+				request.setRawHeader("If-Modified-Since", modified);
+			}
+		}
+
+		t.file = new QSaveFile(m_config_path + t.name);
+		if(!t.file->open(QIODevice::WriteOnly)){
+			qDebug() << "HttpManager: cannot write" << t.file->fileName();
+			delete t.file;
+			++m_failed;
+			continue;
+		}
+
+		QNetworkReply *reply = m_qnam->get(request);
+		m_active.insert(reply, t);
+		QObject::connect(reply, &QNetworkReply::readyRead, this, [this, reply]() { ready_read(reply); });
 	}
 }
 
+void HttpManager::ready_read(QNetworkReply *reply)
+{
+	auto it = m_active.find(reply);
+
+	if(it == m_active.end()){
+		return;
+	}
+	// A 304 has no body, and an error page is not the file
+	if(reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() != 200){
+		reply->readAll();
+		return;
+	}
+	const QByteArray d = reply->readAll();
+	it->bytes += d.size();
+	it->file->write(d);
+}
+
 void HttpManager::http_finished(QNetworkReply *reply)
 {
-    //qDebug() << "http_finished() called";
-	if (reply->error()) {
+	const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+	ready_read(reply);
+	TRANSFER t = m_active.take(reply);
+
+	if(t.file == nullptr){
 		reply->deleteLater();
-		reply = nullptr;
-		qDebug() << "http_finished() error()";
 		return;
 	}
+
+	if(reply->error()){
+		qDebug() << "HttpManager:" << t.name << "failed:" << reply->errorString();
+		t.file->cancelWriting();
+		++m_failed;
+		emit download_failed(t.name.mid(1));
+	}
+	else if(status == 304){
+		t.file->cancelWriting();
+		++m_unchanged;
+	}
+	else if(status != 200){
+		qDebug() << "HttpManager:" << t.name << "failed with status" << status;
+		t.file->cancelWriting();
+		++m_failed;
+		emit download_failed(t.name.mid(1));
+	}
+	else if(!t.file->commit()){
+		qDebug() << "HttpManager: cannot write" << t.file->fileName() << t.file->errorString();
+		++m_failed;
+	}
 	else{
-		if(m_url){
-			QStringList l = m_filename.split('/');
-			m_filename = "/" + l.at(l.size() - 1);
+		m_validators->beginGroup(t.name.mid(1));
+		m_validators->setValue("etag", reply->rawHeader("ETag"));
+		m_validators->setValue("modified", reply->rawHeader("Last-Modified"));
+		m_validators->endGroup();
+		m_validators->sync();
+		m_bytes += t.bytes;
+		++m_updated;
+		if(t.url){
+			emit url_downloaded(t.name.mid(1));
+		}
+		else{
+			emit file_downloaded(t.name.mid(1));
 		}
-        //qDebug() << "m_config_path + m_filename = " << m_config_path + m_filename;
-        QStringList l = m_filename.split('_');
-        if((l.at(0) != "/vocoder") && (l.size() > 1)) return;
-		QFile *hosts_file = new QFile(m_config_path + m_filename);
-		hosts_file->open(QIODevice::WriteOnly);
-		QFileInfo fileInfo(hosts_file->fileName());
-		QString filename(fileInfo.fileName());
-		hosts_file->write(reply->readAll());
-		hosts_file->flush();
-		hosts_file->close();
-		delete hosts_file;
-		emit file_downloaded(filename);
 	}
-	QThread::currentThread()->quit();
+	delete t.file;
+	reply->deleteLater();
+
+	start_next();
+	if(m_active.isEmpty() && m_pending.isEmpty()){
+		emit update_log(QString("Downloads: %1 updated, %2 unchanged, %3 failed, %4 kB in %5 ms")
+						.arg(m_updated).arg(m_unchanged).arg(m_failed).arg(m_bytes / 1024).arg(m_batch.elapsed()));
+	}
 }
@@ -1,45 +1,69 @@
-/*
-	Copyright (C) 2019-2021 Doug McLain
-
-	This program is free software: you can redistribute it and/or modify
-	it under the terms of the GNU General Public License as published by
-	the Free Software Foundation, either version 3 of the License, or
-	(at your option) any later version.
-
-	This program is distributed in the hope that it will be useful,
-	but WITHOUT ANY WARRANTY; without even the implied warranty of
-	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
-	GNU General Public License for more details.
-
-	You should have received a copy of the GNU General Public License
-	along with this program.  If not, see <https://www.gnu.org/licenses/>.
-*/
-
 #ifndef HTTPMANAGER_H
 #define HTTPMANAGER_H
 
 #include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QQueue>
+#include <QSaveFile>
+#include <QSettings>
 #include <QtNetwork>
 
+// The one downloader of the host and ID files, living on a thread of its own for the life
+// of the app so that its QNetworkAccessManager keeps connections to the server open.
+// Up to max_active files come down at once, the rest wait their turn. A file is written to
+// a temporary file as it arrives and renamed over the old one when complete, and the
+// ETag and Last-Modified of each one are kept so that the next update of an unchanged
+// file is a 304 with no body. QNetworkAccessManager asks for gzip and deflate itself
+// and inflates them, so the sizes logged are those of the files. DROIDSTAR_HOSTS_URL in
+// the environment replaces the host file server, for testing against a local one.
 class HttpManager : public QObject
 {
 	Q_OBJECT
 public:
-	explicit HttpManager(QString, bool u = false);
-	//void start_request(QString file);
+	explicit HttpManager(int max_active = 4);
+	~HttpManager();
 
 signals:
 	void file_downloaded(QString);
+	void url_downloaded(QString);
+	// Emitted with the file name for an error or a status other than 200 and 304
+	void download_failed(QString);
+	void update_log(QString);
+
+public slots:
+	// f is a path on the host file server, or a whole URL when u is set. It is saved to
+	// the config directory under the last part of its path.
+	void download(QString f, bool u = false);
+	// Drops the ETag and Last-Modified kept for file f, once it has been rewritten locally
+	// and no longer matches them
+	void forget(QString f);
 
 private:
-	QString m_filename;
+	struct TRANSFER {
+		QString name;
+		bool url = false;
+		QSaveFile *file = nullptr;
+		qint64 bytes = 0;
+	};
 	QString m_config_path;
+	QString m_server;
 	QNetworkAccessManager *m_qnam;
-	bool m_url;
+	QSettings *m_validators;
+	int m_max_active;
+	QQueue<QPair<QString, bool>> m_pending;
+	QHash<QNetworkReply *, TRANSFER> m_active;
+	QElapsedTimer m_batch;
+	int m_updated;
+	int m_unchanged;
+	int m_failed;
+	qint64 m_bytes;
+
+	void init();
+	void start_next();
+	void ready_read(QNetworkReply *reply);
 
 private slots:
-	void process();
-	void doRequest();
 	void http_finished(QNetworkReply *reply);
 };
 
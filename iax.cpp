@@ -16,14 +16,19 @@
 */
 
 
+#include <QtEndian>
 #include "iax.h"
 #include "iaxdefines.h"
+#include "g711.h"
+#include "packettrace.h"
 #ifdef Q_OS_WIN
 #include <winsock2.h>
 #else
 #include <arpa/inet.h>
 #endif
 
+#define IAX_MAX_SAMPLES	480
+
 #ifdef USE_FLITE
 extern "C" {
 extern cst_voice * register_cmu_us_slt(const char *);
@@ -39,6 +44,9 @@ IAX::IAX() :
 	m_regdcallno(0),
 	m_iseq(0),
 	m_oseq(0),
+	m_format(AST_FORMAT_ULAW),
+	m_rxformat(AST_FORMAT_ULAW),
+	m_trunk(0),
 	m_tx(false),
 	m_rxjitter(0),
 	m_rxloss(1),
@@ -48,7 +56,8 @@ IAX::IAX() :
 	m_rxooo(0),
 	m_ttsid(0),
 	m_cnt(0),
-	m_wt(false)
+	m_wt(false),
+	m_rxkeyed(false)
 {
 #ifdef USE_FLITE
 	flite_init();
@@ -85,45 +94,19 @@ void IAX::set_iax_params(QString username, QString password, QString callingname
 	}
 }
 
-int16_t ulaw_decode(int8_t number)
-{
-   const uint16_t MULAW_BIAS = 33;
-   uint8_t sign = 0, position = 0;
-   int16_t decoded = 0;
-   number = ~number;
-   if (number & 0x80)
-   {
-	  number &= ~(1 << 7);
-	  sign = -1;
-   }
-   position = ((number & 0xF0) >> 4) + 5;
-   decoded = ((1 << position) | ((number & 0x0F) << (position - 4))
-			 | (1 << (position - 5))) - MULAW_BIAS;
-   return (sign == 0) ? (decoded) : (-(decoded));
-}
-
-int8_t ulaw_encode(int16_t number)
-{
-   const uint16_t MULAW_MAX = 0x1FFF;
-   const uint16_t MULAW_BIAS = 33;
-   uint16_t mask = 0x1000;
-   uint8_t sign = 0;
-   uint8_t position = 12;
-   uint8_t lsb = 0;
-   if (number < 0)
-   {
-	  number = -number;
-	  sign = 0x80;
-   }
-   number += MULAW_BIAS;
-   if (number > MULAW_MAX)
-   {
-	  number = MULAW_MAX;
-   }
-   for (; ((number & mask) != mask && position >= 5); mask >>= 1, position--)
-		;
-   lsb = (number >> (position - 4)) & 0x0f;
-   return (~(sign | ((position - 5) << 4) | lsb));
+void IAX::set_iax_media(QString codec, int trunk)
+{
+	if(codec == "alaw"){
+		m_format = AST_FORMAT_ALAW;
+	}
+	else if(codec == "slin"){
+		m_format = AST_FORMAT_SLINEAR;
+	}
+	else{
+		m_format = AST_FORMAT_ULAW;
+	}
+	m_rxformat = m_format;
+	m_trunk = qMax(0, trunk);
 }
 
 void IAX::send_calltoken_request()
@@ -145,17 +128,9 @@ void IAX::send_calltoken_request()
     out.append(IAX_IE_CALLTOKEN);
     out.append('\x00');
 
-    m_udp->writeDatagram(out, m_address, m_port);
+    write_datagram(out, m_address, m_port);
 
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "SEND:";
-        for(int i = 0; i < out.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+    trace("SEND", out);
 }
 
 void IAX::send_call()
@@ -204,27 +179,25 @@ void IAX::send_call()
 	out.append(IAX_IE_USERNAME);
 	out.append(m_username.size());
 	out.append(m_username.toUtf8(), m_username.size());
+	out.append(IAX_IE_CAPABILITY);
+	out.append(sizeof(int));
+	out.append('\x00');
+	out.append('\x00');
+	out.append('\x00');
+	out.append(AST_FORMAT_ULAW | m_format);
 	out.append(IAX_IE_FORMAT);
 	out.append(sizeof(int));
 	out.append('\x00');
 	out.append('\x00');
 	out.append('\x00');
-	out.append(AST_FORMAT_ULAW);
+	out.append(m_format);
     out.append(IAX_IE_CALLTOKEN);
     out.append(m_calltoken.size());
     out.append(m_calltoken);
 	m_timestamp = QDateTime::currentMSecsSinceEpoch();
-	m_udp->writeDatagram(out, m_address, m_port);
-
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "SEND:";
-        for(int i = 0; i < out.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+	write_datagram(out, m_address, m_port);
+
+    trace("SEND", out);
 }
 
 void IAX::send_call_auth()
@@ -246,17 +219,9 @@ void IAX::send_call_auth()
 	out.append(IAX_IE_MD5_RESULT);
 	out.append(result.toHex().size());
 	out.append(result.toHex());
-	m_udp->writeDatagram(out, m_address, m_port);
-
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "SEND:";
-        for(int i = 0; i < out.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+	write_datagram(out, m_address, m_port);
+
+    trace("SEND", out);
 }
 
 void IAX::send_dtmf(QByteArray dtmf)
@@ -275,17 +240,9 @@ void IAX::send_dtmf(QByteArray dtmf)
 		out.append(m_iseq);
 		out.append(AST_FRAME_DTMF);
 		out.append(dtmf.data()[i]);
-		m_udp->writeDatagram(out, m_address, m_port);
-
-        if(m_debug){
-            QDebug debug = qDebug();
-            debug.noquote();
-            QString s = "SEND:";
-            for(int i = 0; i < out.size(); ++i){
-                s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-            }
-            debug << s;
-        }
+		write_datagram(out, m_address, m_port);
+
+        trace("SEND", out);
 	}
 }
 
@@ -303,17 +260,9 @@ void IAX::send_radio_key(bool key)
 	out.append(m_iseq);
 	out.append(AST_FRAME_CONTROL);
 	out.append(key ? AST_CONTROL_KEY : AST_CONTROL_UNKEY);
-	m_udp->writeDatagram(out, m_address, m_port);
-
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "SEND:";
-        for(int i = 0; i < out.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+	write_datagram(out, m_address, m_port);
+
+    trace("SEND", out);
 }
 
 void IAX::send_ping()
@@ -331,19 +280,14 @@ void IAX::send_ping()
 	out.append(m_iseq);
 	out.append(AST_FRAME_IAX);
 	out.append(IAX_COMMAND_PING);
-	m_udp->writeDatagram(out, m_address, m_port);
-
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "SEND:";
-        for(int i = 0; i < out.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+	write_datagram(out, m_address, m_port);
+
+    trace("SEND", out);
 */
     if(++m_watchdog > 6){
+        if(m_modeinfo.status != TIMEOUT){
+            PacketTrace::trigger("IAX connection timeout");
+        }
         m_modeinfo.status = TIMEOUT;
         emit update(m_modeinfo);
     }
@@ -388,17 +332,9 @@ void IAX::send_pong(uint32_t ts)
 	out.append(IAX_IE_RR_OOO);
 	out.append(sizeof(ooo));
 	out.append((char *)&ooo, sizeof(ooo));
-	m_udp->writeDatagram(out, m_address, m_port);
-
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "SEND:";
-        for(int i = 0; i < out.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+	write_datagram(out, m_address, m_port);
+
+    trace("SEND", out);
 }
 
 void IAX::send_ack(uint16_t scall, uint16_t dcall, uint8_t oseq, uint8_t iseq, uint32_t ts)
@@ -421,17 +357,9 @@ void IAX::send_ack(uint16_t scall, uint16_t dcall, uint8_t oseq, uint8_t iseq, u
 	out.append(iseq);
 	out.append(AST_FRAME_IAX);
 	out.append(IAX_COMMAND_ACK);
-	m_udp->writeDatagram(out, m_address, m_port);
-
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "SEND:";
-        for(int i = 0; i < out.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+	write_datagram(out, m_address, m_port);
+
+    trace("SEND", out);
 }
 
 void IAX::send_lag_response(uint32_t ts)
@@ -449,17 +377,9 @@ void IAX::send_lag_response(uint32_t ts)
 	out.append(m_iseq);
 	out.append(AST_FRAME_IAX);
 	out.append(IAX_COMMAND_LAGRP);
-	m_udp->writeDatagram(out, m_address, m_port);
-
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "SEND:";
-        for(int i = 0; i < out.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+	write_datagram(out, m_address, m_port);
+
+    trace("SEND", out);
 }
 
 void IAX::send_voice_frame(int16_t *f)
@@ -475,23 +395,11 @@ void IAX::send_voice_frame(int16_t *f)
 	out.append(m_oseq);
 	out.append(m_iseq);
 	out.append(AST_FRAME_VOICE);
-	out.append(AST_FORMAT_ULAW);
-
-	for(int i = 0; i < 160; ++i){
-		out.append(ulaw_encode(f[i]));
-	}
+	out.append(m_format);
+	encode_line(f, 160, out);
+	write_datagram(out, m_address, m_port);
 
-	m_udp->writeDatagram(out, m_address, m_port);
-
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "SEND:";
-        for(int i = 0; i < out.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+    trace("SEND", out);
 }
 
 void IAX::send_registration(uint16_t dcall)
@@ -543,17 +451,9 @@ void IAX::send_registration(uint16_t dcall)
         out.append(m_calltoken.size());
         out.append(m_calltoken);
     }
-	m_udp->writeDatagram(out, m_address, m_port);
-
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "SEND:";
-        for(int i = 0; i < out.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+	write_datagram(out, m_address, m_port);
+
+    trace("SEND", out);
 }
 
 void IAX::send_disconnect()
@@ -573,17 +473,9 @@ void IAX::send_disconnect()
 	out.append(IAX_IE_CAUSE);
 	out.append(bye.size());
 	out.append(bye.toUtf8(), bye.size());
-	m_udp->writeDatagram(out, m_address, m_port);
-
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "SEND:";
-        for(int i = 0; i < out.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+	write_datagram(out, m_address, m_port);
+
+    trace("SEND", out);
 }
 
 void IAX::hostname_lookup(QHostInfo i)
@@ -619,18 +511,9 @@ void IAX::process_udp()
 	QHostAddress sender;
 	quint16 senderPort;
 
-	buf.resize(m_udp->pendingDatagramSize());
-	m_udp->readDatagram(buf.data(), buf.size(), &sender, &senderPort);
+	read_datagram(buf, &sender, &senderPort);
 
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "RECV:";
-        for(int i = 0; i < buf.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)buf.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+    trace("RECV", buf);
 
 	if( (buf.data()[0] & 0x80) &&
 		(buf.data()[10] == AST_FRAME_IAX) &&
@@ -710,6 +593,10 @@ void IAX::process_udp()
 		(buf.data()[11] == IAX_COMMAND_ACCEPT) )
 	{
 		++m_rxframes;
+		if(!parse_format(buf)){
+			qDebug() << "IAX: no format in ACCEPT, using u-law";
+			m_format = m_rxformat = AST_FORMAT_ULAW;
+		}
 		m_dcallno = (((buf.data()[0] & 0x7f) << 8) | ((uint8_t)buf.data()[1]));
 		m_iseq = buf.data()[8] + 1;
 		m_oseq = buf.data()[9];
@@ -737,6 +624,23 @@ void IAX::process_udp()
 		send_ack(m_scallno, m_dcallno, m_oseq, m_iseq);
 		//send_voice_frame(zeropcm);
 	}
+	else if( (buf.data()[0] & 0x80) &&
+		(buf.data()[10] == AST_FRAME_CONTROL) &&
+		((buf.data()[11] == AST_CONTROL_KEY) || (buf.data()[11] == AST_CONTROL_UNKEY)) )
+	{
+		++m_rxframes;
+		m_dcallno = (((buf.data()[0] & 0x7f) << 8) | ((uint8_t)buf.data()[1]));
+		m_iseq = buf.data()[8] + 1;
+		m_oseq = buf.data()[9];
+		send_ack(m_scallno, m_dcallno, m_oseq, m_iseq);
+		m_rxkeyed = (buf.data()[11] == AST_CONTROL_KEY);
+		if(!m_rxkeyed){
+			m_rxcodecq.clear();
+			if(m_relayrx){
+				emit relay_rx_end();
+			}
+		}
+	}
 	else if( (buf.data()[0] & 0x80) &&
 		(buf.data()[10] == AST_FRAME_CONTROL) &&
 		(buf.data()[11] == AST_CONTROL_ANSWER) )
@@ -790,7 +694,7 @@ void IAX::process_udp()
 	}
 	else if( (buf.data()[0] & 0x80) &&
 		(buf.data()[10] == AST_FRAME_VOICE) &&
-		(buf.data()[11] == AST_FORMAT_ULAW) )
+		((buf.data()[11] == AST_FORMAT_ULAW) || (buf.data()[11] == AST_FORMAT_ALAW) || (buf.data()[11] == AST_FORMAT_SLINEAR)) )
 	{
 		int16_t zeropcm[160];
 		memset(zeropcm, 0, 160 * sizeof(int16_t));
@@ -799,9 +703,8 @@ void IAX::process_udp()
 		m_iseq = buf.data()[8] + 1;
 		m_oseq = buf.data()[9];
 		send_ack(m_scallno, m_dcallno, m_oseq, m_iseq);
-		for(int i = 0; i < buf.size() - 12; ++i){
-			m_audioq.append(ulaw_decode(buf.data()[12+i]));
-		}
+		m_rxformat = buf.data()[11];
+		receive_voice(buf.constData() + 12, buf.size() - 12);
 		send_voice_frame(zeropcm);
 		if(!m_txtimer->isActive()){
 			m_txtimer->start(19);
@@ -838,17 +741,154 @@ void IAX::process_udp()
         uint32_t ts = (uint32_t)((buf.data()[4] << 24) | ((buf.data()[5] << 16) & 0xff0000) | ((buf.data()[6] << 8) & 0xff00) | (buf.data()[7] & 0xff));
         send_lag_response(ts);
 	}
+	else if(IAXTrunk::is_trunk(buf)){
+		QList<IAXTrunk::ENTRY> entries;
+		IAXTrunk::parse(buf, entries);
+		for(const IAXTrunk::ENTRY &e : entries){
+			if(e.callno == m_dcallno){
+				receive_voice(e.data.constData(), e.data.size());
+			}
+		}
+	}
 	else if(!(buf.data()[0] & 0x80)){
 		uint16_t dcallno = ((buf.data()[0] << 8) | ((uint8_t)buf.data()[1]));
 		if(dcallno == m_dcallno){
-			for(int i = 0; i < buf.size() - 4; ++i){
-				m_audioq.append(ulaw_decode(buf.data()[4+i]));
-			}
+			receive_voice(buf.constData() + 4, buf.size() - 4);
 		}
 	}
 	emit update(m_modeinfo);
 }
 
+// The format IE of an ACCEPT, if it is one of ours
+bool IAX::parse_format(const QByteArray &buf)
+{
+	for(int i = 12; (i + 2) <= buf.size(); i += 2 + (uint8_t)buf.at(i + 1)){
+		if(((uint8_t)buf.at(i) == IAX_IE_FORMAT) && (buf.at(i + 1) == 4) && ((i + 6) <= buf.size())){
+			const uint32_t f = qFromBigEndian<quint32>(buf.constData() + i + 2);
+			if((f == AST_FORMAT_ULAW) || (f == AST_FORMAT_ALAW) || (f == AST_FORMAT_SLINEAR)){
+				m_format = m_rxformat = f;
+				qDebug() << "IAX: format" << f;
+				return true;
+			}
+			return false;
+		}
+	}
+	return false;
+}
+
+// u-law has always been played and sent as 14 bit PCM, 12 dB from the 16 bit PCM of the
+// gateways, and A-law and slin are kept to the same levels
+void IAX::receive_voice(const char *d, int size)
+{
+	int16_t pcm[IAX_MAX_SAMPLES];
+
+	if(m_relayrx){
+		if(m_rxformat == AST_FORMAT_ULAW){
+			relay_ulaw(QByteArray(d, size));
+			return;
+		}
+		const int n = decode_line(d, size, m_rxformat, pcm);
+		QByteArray ulaw(n, 0);
+		G711::ulaw_encode(pcm, reinterpret_cast<uint8_t *>(ulaw.data()), n);
+		relay_ulaw(ulaw);
+		return;
+	}
+
+	const int n = decode_line(d, size, m_rxformat, pcm);
+	const int s = m_audioq.size();
+	m_audioq.resize(s + n);
+	int16_t *q = m_audioq.data() + s;
+	for(int i = 0; i < n; ++i){
+		q[i] = pcm[i] >> 2;
+	}
+}
+
+int IAX::decode_line(const char *d, int size, uint8_t format, int16_t *pcm)
+{
+	int n;
+
+	if(format == AST_FORMAT_SLINEAR){
+		n = qBound(0, size / 2, IAX_MAX_SAMPLES);
+		qFromBigEndian<qint16>(d, n, pcm);
+	}
+	else if(format == AST_FORMAT_ALAW){
+		n = qBound(0, size, IAX_MAX_SAMPLES);
+		G711::alaw_decode(reinterpret_cast<const uint8_t *>(d), pcm, n);
+	}
+	else{
+		n = qBound(0, size, IAX_MAX_SAMPLES);
+		G711::ulaw_decode(reinterpret_cast<const uint8_t *>(d), pcm, n);
+	}
+	return n;
+}
+
+// Appends n samples in the format sent, slin in network byte order as Asterisk sends it
+void IAX::encode_line(const int16_t *pcm, int n, QByteArray &out)
+{
+	const int s = out.size();
+
+	if(m_format == AST_FORMAT_SLINEAR){
+		out.resize(s + n * 2);
+		qToBigEndian<qint16>(pcm, n, out.data() + s);
+		return;
+	}
+	out.resize(s + n);
+	uint8_t *p = reinterpret_cast<uint8_t *>(out.data()) + s;
+	if(m_format == AST_FORMAT_ALAW){
+		G711::alaw_encode(pcm, p, n);
+	}
+	else{
+		G711::ulaw_encode(pcm, p, n);
+	}
+}
+
+// A mini frame for each payload, or with trunking one trunk frame for every m_trunk of them
+void IAX::send_voice(const QByteArray &payload, bool flush)
+{
+	const uint32_t ts = QDateTime::currentMSecsSinceEpoch() - m_timestamp;
+
+	if(m_trunk == 0){
+		if(payload.isEmpty()){
+			return;
+		}
+		uint16_t scall = htons(m_scallno);
+		uint16_t mts = htons(ts);
+		m_txbuf.clear();
+		m_txbuf.append((char *)&scall, 2);
+		m_txbuf.append((char *)&mts, 2);
+		m_txbuf.append(payload);
+		write_datagram(m_txbuf, m_address, m_port);
+		return;
+	}
+
+	if(!payload.isEmpty()){
+		m_trunkq.append({m_scallno, (uint16_t)ts, payload});
+	}
+	if(!m_trunkq.isEmpty() && (flush || (m_trunkq.size() >= m_trunk))){
+		IAXTrunk::build(m_txbuf, ts, m_trunkq);
+		write_datagram(m_txbuf, m_address, m_port);
+		m_trunkq.clear();
+	}
+}
+
+// Only audio sent while the node is keyed is relayed, in 20 ms frames
+void IAX::relay_ulaw(const QByteArray &ulaw)
+{
+	if(!m_rxkeyed){
+		return;
+	}
+	for(int i = 0; i < ulaw.size(); ++i){
+		m_rxcodecq.append(ulaw.data()[i]);
+	}
+	while(m_rxcodecq.size() >= 160){
+		QByteArray frame(160, 0);
+		for(int i = 0; i < 160; ++i){
+			frame[i] = m_rxcodecq.dequeue();
+		}
+		emit relay_rx(CODEC_ULAW, frame);
+	}
+}
+
 void IAX::connected() {
     m_regreq = true;
 	m_modeinfo.status = CONNECTED_RW;
@@ -860,8 +900,7 @@ void IAX::connected() {
     m_ping_timer = new QTimer();
     connect(m_ping_timer, SIGNAL(timeout()), this, SLOT(send_ping()));
     m_ping_timer->start(10000);
-	m_audio = new AudioEngine(m_audioin, m_audioout);
-	m_audio->init();
+	m_audio = open_audio();
 	m_audio->start_playback();
 	m_audio->set_input_buffer_size(640);
 	m_audio->start_capture();
@@ -874,9 +913,8 @@ void IAX::process_rx_data()
 	int16_t pcm[160];
 
 	if(m_audioq.size() > 160){
-		for(int i = 0; i < 160; ++i){
-			pcm[i] = (qreal)m_audioq.dequeue(); // * m_rxgain;
-		}
+		memcpy(pcm, m_audioq.constData(), sizeof(pcm));
+		m_audioq.remove(0, 160);
 		m_audio->write(pcm, 160);
 		emit update_output_level(m_audio->level());
 	}
@@ -896,6 +934,7 @@ void IAX::start_tx()
 	//QByteArray tx("*99", 3);
 	//send_dtmf(tx);
 	send_radio_key(true);
+	m_relaytx = false;
 	m_ttscnt = 0;
 	qDebug() << "start_tx() " << m_ttsid << " " << m_ttstext;
 	// Drain the audio buffer
@@ -917,14 +956,59 @@ void IAX::start_tx()
 void IAX::stop_tx()
 {
 	m_tx = false;
+	send_voice(QByteArray(), true);
 	send_radio_key(false);
 }
 
+void IAX::relay_tx(int, QByteArray frame)
+{
+	if(!m_tx){
+		send_radio_key(true);
+		m_relaytx = true;
+		m_tx = true;
+		m_txcodecq.clear();
+		if((m_modeinfo.status == CONNECTED_RW) && !m_txtimer->isActive()){
+			m_txtimer->start(19);
+		}
+	}
+	if(!m_relaytx){
+		return;			// The microphone has the transmitter
+	}
+	for(int i = 0; i < frame.size(); ++i){
+		m_txcodecq.append(frame.data()[i]);
+	}
+}
+
+void IAX::relay_tx_end()
+{
+	if(m_relaytx && m_tx){
+		stop_tx();
+	}
+}
+
 void IAX::transmit()
 {
 	QByteArray out;
 	int16_t pcm[160];
 	 uint16_t s = 0;
+	if(m_relaytx){
+		if(m_txcodecq.size() < 160){
+			return;
+		}
+		uint8_t ulaw[160];
+		for(int i = 0; i < 160; ++i){
+			ulaw[i] = m_txcodecq.dequeue();
+		}
+		if(m_format == AST_FORMAT_ULAW){
+			out.append(reinterpret_cast<const char *>(ulaw), 160);
+		}
+		else{
+			G711::ulaw_decode(ulaw, pcm, 160);
+			encode_line(pcm, 160, out);
+		}
+		send_voice(out);
+		return;
+	}
 #ifdef USE_FLITE
 	if(m_ttsid > 0){
 		m_audio->read(pcm);
@@ -948,35 +1032,26 @@ void IAX::transmit()
 	}
 	if (s == 0) return;
 
-	uint16_t scall = htons(m_scallno);
-	uint16_t ts = htons( (QDateTime::currentMSecsSinceEpoch() - m_timestamp));// + 3 );
-	out.append((char *)&scall, 2);
-	out.append((char *)&ts, 2);
 	for(int i = 0; i < s; ++i){
-		out.append(ulaw_encode(pcm[i]));
+		pcm[i] = qBound(-8192, (int)pcm[i], 8191) * 4;
 	}
+	encode_line(pcm, s, out);
 	if (!m_wt || m_tx) {
-		m_udp->writeDatagram(out, m_address, m_port);
-	}
-#ifdef DEBUG
-	fprintf(stderr, "SEND: ");
-	for(int i = 0; i < out.size(); ++i){
-		fprintf(stderr, "%02x ", (unsigned char)out.data()[i]);
+		send_voice(out);
 	}
-	fprintf(stderr, "\n");
-	fflush(stderr);
-#endif
 }
 
 void IAX::deleteLater()
 {
 	if(m_modeinfo.status == CONNECTED_RW){
-		m_udp->disconnect();
+		if(m_udp){
+			m_udp->disconnect();
+		}
 		m_txtimer->stop();
 		m_rxtimer->stop();
 		m_regtimer->stop();
 		send_disconnect();
-		//delete m_audio;
+		close_audio();
 	}
 	//m_cnt = 0;
 	QObject::deleteLater();
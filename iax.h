@@ -19,6 +19,7 @@
 #define IAX_H
 
 #include "mode.h"
+#include "iaxtrunk.h"
 
 class IAX : public Mode
 {
@@ -27,10 +28,16 @@ public:
 	IAX();//QString callsign, QString username, QString password, QString node, QString host, int port, QString audioin, QString audioout);
 	~IAX();
 	void set_iax_params(QString username, QString password, QString callingname, QString node, QString host, int port);
+	// codec is "ulaw", "alaw" or "slin", trunk the voice frames sent per trunk frame, 0 for mini frames
+	void set_iax_media(QString codec, int trunk);
 	//uint8_t get_status(){ return m_status; }
 	QString get_host() { return m_host; }
 	int get_port() { return m_port; }
 	int get_cnt() { return m_cnt; }
+	QList<int> relay_codecs() { return {CODEC_ULAW}; }
+public slots:
+	void relay_tx(int codec, QByteArray frame);
+	void relay_tx_end();
 private slots:
 	void deleteLater();
 	void process_udp();
@@ -54,9 +61,14 @@ private slots:
 	void send_dtmf(QByteArray);
 	void send_radio_key(bool);
 	void in_audio_vol_changed(qreal v){ m_audio->set_input_volume(v); }
-	void out_audio_vol_changed(qreal v){ m_audio->set_output_volume(v); }
 	void connected();
 private:
+	void relay_ulaw(const QByteArray &);
+	void receive_voice(const char *d, int size);
+	void send_voice(const QByteArray &payload, bool flush = false);
+	void encode_line(const int16_t *pcm, int n, QByteArray &out);
+	int decode_line(const char *d, int size, uint8_t format, int16_t *pcm);
+	bool parse_format(const QByteArray &buf);
 	QString m_username;
 	QString m_password;
 	QString m_callingname;
@@ -76,7 +88,12 @@ private:
 	QTimer *m_regtimer;
 	uint8_t m_iseq;
 	uint8_t m_oseq;
-	QQueue<int16_t> m_audioq;
+	QVector<int16_t> m_audioq;
+	uint8_t m_format;
+	uint8_t m_rxformat;
+	int m_trunk;
+	QList<IAXTrunk::ENTRY> m_trunkq;
+	QByteArray m_txbuf;
 	bool m_tx;
 	uint32_t m_rxjitter;
 	uint32_t m_rxloss;
@@ -90,6 +107,7 @@ private:
 	int m_cnt;
 	bool m_wt;
     bool m_regreq;
+	bool m_rxkeyed;
 #ifdef USE_FLITE
 	cst_voice *voice_slt;
 	cst_voice *voice_kal;
@@ -0,0 +1,180 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// droidstar-iaxbench: CPU per IAX call and packets per second with trunking.
+//
+//   droidstar-iaxbench [-n 20000] [-t 2]
+//
+// The media of one call, 20 ms of 8 kHz audio at a time, is run -n times each way: the
+// sample at a time path IAX used before, a QByteArray appended a byte at a time on TX and
+// a QQueue a sample at a time on RX, against a frame at a time through the G.711 tables,
+// and slin. The time per frame and the share of one core a call takes are printed.
+// Then a second of one call is sent as mini frames and as trunk frames of -t frames, as
+// IAXTRUNK=n does, since each call has its own socket and never shares a trunk frame with
+// another. The packets, bytes on the wire, parse time and the delay the trunk frames add,
+// (n - 1) x 20 ms for the first frame in each, are printed.
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QQueue>
+#include <QVector>
+#include <QtEndian>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "g711.h"
+#include "iaxtrunk.h"
+
+#define FRAME			160
+#define FRAMES_PER_SEC	50
+#define IP_UDP_BYTES	28
+
+static QVector<int16_t> speech(int frames)
+{
+	QVector<int16_t> s(frames * FRAME);
+	for(int i = 0; i < s.size(); ++i){
+		s[i] = (int16_t)(6000 * sin(i * 0.07) * sin(i * 0.0013) + 1500 * sin(i * 0.9));
+	}
+	return s;
+}
+
+static void report(const char *name, qint64 ns, int frames, int check)
+{
+	const double per = (double)ns / frames;
+	fprintf(stdout, "%-22s %9.0f %8.3f%% %10d\n", name, per, per * FRAMES_PER_SEC * 100 / 1e9, check);
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	QCommandLineParser parser;
+
+	parser.setApplicationDescription("IAX media and trunking benchmark");
+	parser.addHelpOption();
+	parser.addOption({{"n", "frames"}, "20 ms frames to code each way", "frames", "20000"});
+	parser.addOption({{"t", "trunk"}, "Frames per trunk frame, as IAXTRUNK", "frames", "2"});
+	parser.process(app);
+
+	const int frames = qMax(1, parser.value("frames").toInt());
+	const int trunk = qMax(1, parser.value("trunk").toInt());
+	const QVector<int16_t> pcm = speech(qMin(frames, 500));
+	const int nframes = pcm.size() / FRAME;
+	QElapsedTimer t;
+	int check = 0;
+
+	fprintf(stdout, "%-22s %9s %9s %10s\n", "per call, each way", "ns/frame", "core", "check");
+
+	// What IAX did before, one sample at a time
+	t.start();
+	for(int f = 0; f < frames; ++f){
+		const int16_t *p = pcm.constData() + (f % nframes) * FRAME;
+		QByteArray out;
+		for(int i = 0; i < FRAME; ++i){
+			out.append(G711::linear_to_ulaw(p[i]));
+		}
+		check += (uint8_t)out.at(f % FRAME);
+	}
+	report("u-law TX per sample", t.nsecsElapsed(), frames, check);
+
+	QVector<uint8_t> ulaw(pcm.size());
+	G711::ulaw_encode(pcm.constData(), ulaw.data(), pcm.size());
+	QQueue<int16_t> q;
+	int16_t out[FRAME];
+	check = 0;
+	t.restart();
+	for(int f = 0; f < frames; ++f){
+		const uint8_t *u = ulaw.constData() + (f % nframes) * FRAME;
+		for(int i = 0; i < FRAME; ++i){
+			q.append(G711::ulaw_to_linear(u[i]));
+		}
+		for(int i = 0; i < FRAME; ++i){
+			out[i] = q.dequeue();
+		}
+		check += out[f % FRAME];
+	}
+	report("u-law RX per sample", t.nsecsElapsed(), frames, check);
+
+	// A frame at a time into buffers that are reused
+	QByteArray buf;
+	QVector<int16_t> rxq;
+	check = 0;
+	t.restart();
+	for(int f = 0; f < frames; ++f){
+		buf.resize(FRAME);
+		G711::ulaw_encode(pcm.constData() + (f % nframes) * FRAME, reinterpret_cast<uint8_t *>(buf.data()), FRAME);
+		check += (uint8_t)buf.at(f % FRAME);
+	}
+	report("u-law TX table", t.nsecsElapsed(), frames, check);
+
+	check = 0;
+	t.restart();
+	for(int f = 0; f < frames; ++f){
+		rxq.resize(FRAME);
+		G711::ulaw_decode(ulaw.constData() + (f % nframes) * FRAME, rxq.data(), FRAME);
+		memcpy(out, rxq.constData(), sizeof(out));
+		rxq.remove(0, FRAME);
+		check += out[f % FRAME];
+	}
+	report("u-law RX table", t.nsecsElapsed(), frames, check);
+
+	check = 0;
+	t.restart();
+	for(int f = 0; f < frames; ++f){
+		buf.resize(FRAME);
+		G711::alaw_encode(pcm.constData() + (f % nframes) * FRAME, reinterpret_cast<uint8_t *>(buf.data()), FRAME);
+		check += (uint8_t)buf.at(f % FRAME);
+	}
+	report("A-law TX table", t.nsecsElapsed(), frames, check);
+
+	check = 0;
+	t.restart();
+	for(int f = 0; f < frames; ++f){
+		buf.resize(FRAME * 2);
+		qToBigEndian<qint16>(pcm.constData() + (f % nframes) * FRAME, FRAME, buf.data());
+		check += (uint8_t)buf.at(f % FRAME);
+	}
+	report("slin TX", t.nsecsElapsed(), frames, check);
+
+	// A second of one call, as mini frames and as trunk frames
+	QList<IAXTrunk::ENTRY> entries, parsed;
+	const QByteArray payload(FRAME, (char)0xff);
+	qint64 trunk_packets = 0, trunk_bytes = 0, parse_ns = 0, parsed_entries = 0;
+
+	for(int f = 0; f < FRAMES_PER_SEC; ++f){
+		entries.append({1, (uint16_t)(f * 20), payload});
+		if((entries.size() >= trunk) || (f == FRAMES_PER_SEC - 1)){
+			IAXTrunk::build(buf, f * 20, entries);
+			++trunk_packets;
+			trunk_bytes += buf.size() + IP_UDP_BYTES;
+			t.restart();
+			IAXTrunk::parse(buf, parsed);
+			parse_ns += t.nsecsElapsed();
+			parsed_entries += parsed.size();
+			entries.clear();
+		}
+	}
+	const qint64 mini_packets = FRAMES_PER_SEC;
+	const qint64 mini_bytes = mini_packets * (4 + FRAME + IP_UDP_BYTES);
+
+	fprintf(stdout, "\none call, u-law, one second\n");
+	fprintf(stdout, "%-22s %9s %12s %9s\n", "", "packets/s", "wire bytes/s", "delay ms");
+	fprintf(stdout, "%-22s %9lld %12lld %9d\n", "mini frames", mini_packets, mini_bytes, 0);
+	fprintf(stdout, "%-22s %9lld %12lld %9d  %lld entries, parse %.0f ns/packet\n", (QString::number(trunk) + " frames per trunk").toStdString().c_str(),
+			trunk_packets, trunk_bytes, (trunk - 1) * 1000 / FRAMES_PER_SEC, parsed_entries, (double)parse_ns / trunk_packets);
+	return (parsed_entries == mini_packets) ? 0 : 1;
+}
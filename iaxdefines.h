@@ -38,6 +38,8 @@
 #define AST_CONTROL_UNKEY			13
 
 #define AST_FORMAT_ULAW				4
+#define AST_FORMAT_ALAW				8
+#define AST_FORMAT_SLINEAR			64
 #define IAX_AUTH_MD5				2
 
 #define IAX_COMMAND_NEW				1
@@ -85,4 +87,8 @@
 #define IAX_IE_RR_OOO               51
 #define IAX_IE_CALLTOKEN			54
 
+#define IAX_META_TRUNK				1
+#define IAX_META_TRUNK_SUPERMINI	0
+#define IAX_META_TRUNK_MINI			1
+
 #endif // IAXDEFINES_H
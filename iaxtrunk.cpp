@@ -0,0 +1,93 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <QtEndian>
+#include "iaxtrunk.h"
+#include "iaxdefines.h"
+
+template<typename T> static void put(QByteArray &b, T v)
+{
+	T be = qToBigEndian(v);
+	b.append(reinterpret_cast<const char *>(&be), sizeof(T));
+}
+
+static uint16_t get16(const char *p)
+{
+	return qFromBigEndian<quint16>(p);
+}
+
+bool IAXTrunk::is_trunk(const QByteArray &buf)
+{
+	return (buf.size() >= 8) && (buf.at(0) == 0) && (buf.at(1) == 0) && (buf.at(2) == IAX_META_TRUNK);
+}
+
+void IAXTrunk::build(QByteArray &out, uint32_t ts, const QList<ENTRY> &entries, bool timestamps)
+{
+	out.clear();
+	put<quint16>(out, 0);
+	out.append((char)IAX_META_TRUNK);
+	out.append((char)(timestamps ? IAX_META_TRUNK_MINI : IAX_META_TRUNK_SUPERMINI));
+	put<quint32>(out, ts);
+	for(const ENTRY &e : entries){
+		if(timestamps){
+			put<quint16>(out, e.data.size());
+			put<quint16>(out, e.callno & 0x7fff);
+			put<quint16>(out, e.ts);
+		}
+		else{
+			put<quint16>(out, e.callno & 0x7fff);
+			put<quint16>(out, e.data.size());
+		}
+		out.append(e.data);
+	}
+}
+
+bool IAXTrunk::parse(const QByteArray &buf, QList<ENTRY> &entries)
+{
+	const char *p = buf.constData();
+	const bool timestamps = (buf.size() >= 4) && (buf.at(3) & IAX_META_TRUNK_MINI);
+	const int hdr = timestamps ? 6 : 4;
+	int pos = 8;
+	ENTRY e;
+
+	entries.clear();
+	if(!is_trunk(buf)){
+		return false;
+	}
+	const uint16_t ts = qFromBigEndian<quint32>(p + 4) & 0xffff;
+	while((pos + hdr) <= buf.size()){
+		int len;
+		if(timestamps){
+			len = get16(p + pos);
+			e.callno = get16(p + pos + 2) & 0x7fff;
+			e.ts = get16(p + pos + 4);
+		}
+		else{
+			e.callno = get16(p + pos) & 0x7fff;
+			len = get16(p + pos + 2);
+			e.ts = ts;
+		}
+		pos += hdr;
+		if((pos + len) > buf.size()){
+			return false;
+		}
+		e.data = buf.mid(pos, len);
+		pos += len;
+		entries.append(e);
+	}
+	return pos == buf.size();
+}
@@ -0,0 +1,45 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef IAXTRUNK_H
+#define IAXTRUNK_H
+
+#include <QByteArray>
+#include <QList>
+
+// IAX2 trunk meta frames, which carry the voice of several calls, or several frames of
+// one call, in a single datagram (all fields big endian):
+//  header: uint16 0 (meta), uint8 command (1 = trunk), uint8 flags (1 = entries have
+//          timestamps), uint32 timestamp
+//  entry:  uint16 source call number, uint16 len + payload, or with timestamps
+//          uint16 len, uint16 source call number, uint16 timestamp + payload
+class IAXTrunk
+{
+public:
+	struct ENTRY {
+		uint16_t callno;
+		uint16_t ts;
+		QByteArray data;
+	};
+	static bool is_trunk(const QByteArray &buf);
+	// Replaces out with the frame, so one buffer serves every frame
+	static void build(QByteArray &out, uint32_t ts, const QList<ENTRY> &entries, bool timestamps = true);
+	// Entries without their own timestamp are given the low 16 bits of the frame's
+	static bool parse(const QByteArray &buf, QList<ENTRY> &entries);
+};
+
+#endif // IAXTRUNK_H
@@ -21,6 +21,7 @@
 #include "typedef.h"
 #include "basic_op.h"
 #include "imbe.h"
+#include "globals.h"
 #include "aux_sub.h"
 #include "tbls.h"
 
@@ -182,3 +183,39 @@ void v_equ_shr(Word16 *vec1, Word16 *vec2, Word16 scale, Word16 n)
 		*vec1++ = shr(*vec2++,scale);   
 }
 
+
+//-----------------------------------------------------------------------------
+//	PURPOSE:
+//		Calculate the number of harmonics and bands from the refined pitch
+//
+//  INPUT:
+//		ref_pitch - Refined pitch in Q8.8 format
+//      num_bands - Pointer to place the number of bands, may be NULL
+//
+//	OUTPUT:
+//		The number of voiced/unvoiced bands
+//
+//	RETURN:
+//		The number of harmonics
+//
+//-----------------------------------------------------------------------------
+Word16 get_num_harms(Word16 ref_pitch, Word16 *num_bands)
+{
+	Word16 tmp, num_harms;
+
+	tmp = shr( add( shr(ref_pitch, 1),  CNST_0_25_Q8_8), 8);     // fix(pitch_cand / 2 + 0.5)
+	num_harms = extract_h((UWord32)CNST_0_9254_Q0_16 * tmp);       // fix(0.9254 * fix(pitch_cand / 2 + 0.5))
+	if(num_harms < NUM_HARMS_MIN)
+		num_harms = NUM_HARMS_MIN;
+	else if(num_harms > NUM_HARMS_MAX)
+		num_harms = NUM_HARMS_MAX;
+
+	if(num_bands)
+	{
+		if(num_harms <= 36)
+			*num_bands = extract_h((UWord32)(num_harms + 2) * CNST_0_33_Q0_16);   // fix((L+2)/3)
+		else
+			*num_bands = NUM_BANDS_MAX;
+	}
+	return num_harms;
+}
@@ -58,6 +58,23 @@ const UWord16 *get_bit_allocation_arr(Word16 num_harms);
 //-----------------------------------------------------------------------------
 void get_bit_allocation(Word16 num_harms, Word16 *ptr);
 
+//-----------------------------------------------------------------------------
+//	PURPOSE:
+//		Calculate the number of harmonics and bands from the refined pitch
+//
+//  INPUT:
+//		ref_pitch - Refined pitch in Q8.8 format
+//      num_bands - Pointer to place the number of bands, may be NULL
+//
+//	OUTPUT:
+//		The number of voiced/unvoiced bands
+//
+//	RETURN:
+//		The number of harmonics
+//
+//-----------------------------------------------------------------------------
+Word16 get_num_harms(Word16 ref_pitch, Word16 *num_bands);
+
 //-----------------------------------------------------------------------------
 //	PURPOSE:
 //		Set the elements of a 16 bit input vector to zero.
@@ -72,7 +72,42 @@ void imbe_vocoder_impl::decode(IMBE_PARAM *imbe_param, Word16 *frame_vector, Wor
 
 void imbe_vocoder_impl::decode_4400(int16_t *snd, uint8_t *imbe)
 {
-	int16_t frame[8U] = {0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000};
+	int16_t frame[8U];
+
+	unpack_4400(imbe, frame);
+	imbe_decode(frame, snd);
+}
+
+//-----------------------------------------------------------------------------
+//	PURPOSE:
+//		Dequantize the model parameters of an IMBE frame without
+//      synthesizing speech
+//
+//  INPUT:
+//		imbe - 88 bit IMBE frame
+//
+//	OUTPUT:
+//		ref_pitch, num_harms, v_uv_dsn and sa items of param()
+//
+//	RETURN:
+//		None
+//
+//-----------------------------------------------------------------------------
+void imbe_vocoder_impl::decode_params(uint8_t *imbe)
+{
+	int16_t frame[8U];
+
+	unpack_4400(imbe, frame);
+	decode_frame_vector(&my_imbe_param, frame);
+	v_uv_decode(&my_imbe_param);
+	sa_decode(&my_imbe_param);
+	if(my_imbe_param.b_vec[0] >= 0 && my_imbe_param.b_vec[0] <= 207)
+		my_imbe_param.ref_pitch = add(shl(my_imbe_param.b_vec[0], 7), 0x1380 + CNST_0_25_Q8_8);   // (b0 + 39.5) / 2
+}
+
+void imbe_vocoder_impl::unpack_4400(const uint8_t *imbe, int16_t *frame)
+{
+	memset(frame, 0, 8 * sizeof(int16_t));
 	unsigned int offset = 0U;
 
 	int16_t mask = 0x0800;
@@ -106,7 +141,4 @@ void imbe_vocoder_impl::decode_4400(int16_t *snd, uint8_t *imbe)
 	mask = 0x0040;
 	for (unsigned int i = 0U; i < 7U; i++, mask >>= 1, offset++)
 		frame[7U] |= READ_BIT(imbe, offset) != 0x00U ? mask : 0x0000;
-
-	imbe_decode(frame, snd);
 }
-
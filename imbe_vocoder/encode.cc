@@ -102,9 +102,72 @@ void imbe_vocoder_impl::encode(IMBE_PARAM *imbe_param, Word16 *frame_vector, Wor
 void imbe_vocoder_impl::encode_4400(int16_t *pcm, uint8_t *imbe)
 {
 	int16_t frame_vector[8];
-	memset(imbe, 0, 11);
 
 	imbe_encode(frame_vector, pcm);
+	pack_4400(frame_vector, imbe);
+}
+
+//-----------------------------------------------------------------------------
+//	PURPOSE:
+//		Quantize model parameters from another MBE coder without running
+//      the speech analysis
+//
+//  INPUT:
+//		param - ref_pitch, and sa and v_uv_dsn for every harmonic up to
+//              get_num_harms(ref_pitch)
+//
+//	OUTPUT:
+//		imbe  - 88 bit IMBE frame
+//
+//	RETURN:
+//		None
+//
+//-----------------------------------------------------------------------------
+void imbe_vocoder_impl::encode_params(const IMBE_PARAM *param, uint8_t *imbe)
+{
+	int16_t frame_vector[8];
+	Word16 i, j, k, band, voiced, num_harms, num_bands, b1_vec = 0, uv_cnt = 0;
+	Word16 ref_pitch = param->ref_pitch;
+
+	// Keep b0 within 0..207
+	if(ref_pitch < 0x1380)
+		ref_pitch = 0x1380;
+	else if(ref_pitch > 0x1380 + (207 << 7))
+		ref_pitch = 0x1380 + (207 << 7);
+
+	num_harms = get_num_harms(ref_pitch, &num_bands);
+	my_imbe_param.ref_pitch = ref_pitch;
+	my_imbe_param.num_harms = num_harms;
+	my_imbe_param.num_bands = num_bands;
+
+	// Bands are three harmonics wide, the last one takes the rest. A band is voiced
+	// when most of its harmonics are.
+	for(band = 0, i = 0; band < num_bands; band++)
+	{
+		j = (band == num_bands - 1) ? num_harms : i + 3;
+		voiced = 0;
+		for(k = i; k < j; k++)
+			voiced += param->v_uv_dsn[k] ? 1 : -1;
+		b1_vec = (b1_vec << 1) | (voiced > 0);
+		for(; i < j; i++)
+		{
+			my_imbe_param.v_uv_dsn[i] = (voiced > 0);
+			my_imbe_param.sa[i] = param->sa[i] > 0 ? param->sa[i] : 1;
+			uv_cnt += (voiced <= 0);
+		}
+	}
+	my_imbe_param.l_uv = uv_cnt;
+	my_imbe_param.b_vec[1] = b1_vec;
+	my_imbe_param.b_vec[0] = shr( sub(ref_pitch, 0x1380), 7);
+
+	sa_encode(&my_imbe_param);
+	encode_frame_vector(&my_imbe_param, frame_vector);
+	pack_4400(frame_vector, imbe);
+}
+
+void imbe_vocoder_impl::pack_4400(const int16_t *frame_vector, uint8_t *imbe)
+{
+	memset(imbe, 0, 11);
 	uint32_t offset = 0U;
 	int16_t mask = 0x0800;
 
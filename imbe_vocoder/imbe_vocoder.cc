@@ -1,5 +1,6 @@
 #include "imbe_vocoder_impl.h"
 #include "imbe_vocoder.h"
+#include "aux_sub.h"
 
 imbe_vocoder::imbe_vocoder()
 {
@@ -31,6 +32,21 @@ void imbe_vocoder::decode_4400(int16_t *snd, uint8_t *imbe)
 	Impl->decode_4400(snd, imbe);
 }
 
+void imbe_vocoder::encode_params(const IMBE_PARAM *param, uint8_t *imbe)
+{
+	Impl->encode_params(param, imbe);
+}
+
+void imbe_vocoder::decode_params(uint8_t *imbe)
+{
+	Impl->decode_params(imbe);
+}
+
+short imbe_vocoder::num_harms(short ref_pitch)
+{
+	return get_num_harms(ref_pitch, nullptr);
+}
+
 const IMBE_PARAM* imbe_vocoder::param(void)
 {
 	return Impl->param();
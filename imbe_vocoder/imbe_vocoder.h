@@ -24,6 +24,10 @@ public:
     void imbe_decode(int16_t *frame_vector, int16_t *snd);
     void encode_4400(int16_t *snd, uint8_t *imbe);
 	void decode_4400(int16_t *snd, uint8_t *imbe);
+	// Parameter level access for transcoding to and from other MBE coders
+	void encode_params(const IMBE_PARAM *param, uint8_t *imbe);
+	void decode_params(uint8_t *imbe);
+	static short num_harms(short ref_pitch);
     const IMBE_PARAM* param(void);
 
 private:
@@ -34,6 +34,8 @@ public:
 	}
 	void encode_4400(int16_t *snd, uint8_t *imbe);
 	void decode_4400(int16_t *snd, uint8_t *imbe);
+	void encode_params(const IMBE_PARAM *param, uint8_t *imbe);
+	void decode_params(uint8_t *imbe);
 	const IMBE_PARAM* param(void) {return &my_imbe_param;}
 private:
 	IMBE_PARAM my_imbe_param;
@@ -87,6 +89,8 @@ private:
 	void decode_init(IMBE_PARAM *imbe_param);
 	void decode(IMBE_PARAM *imbe_param, Word16 *frame_vector, Word16 *snd);
 	void encode_init(void);
+	static void pack_4400(const int16_t *frame_vector, uint8_t *imbe);
+	static void unpack_4400(const uint8_t *imbe, int16_t *frame);
 };
 
 #endif /* INCLUDED_IMBE_VOCODER_IMPL_H */
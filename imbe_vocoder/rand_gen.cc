@@ -24,7 +24,7 @@
 #include "typedef.h"
 #include "basic_op.h"
 
-static UWord32 seed = 1;
+static thread_local UWord32 seed = 1;
 
 
 //-----------------------------------------------------------------------------
@@ -114,17 +114,7 @@ void imbe_vocoder_impl::v_uv_det(IMBE_PARAM *imbe_param, Cmplx16 *fft_buf)
 
 	fund_freq = imbe_param->fund_freq;
 
-	tmp = shr( add( shr(imbe_param->ref_pitch, 1),  CNST_0_25_Q8_8), 8);     // fix(pitch_cand / 2 + 0.5)
-	num_harms = extract_h((UWord32)CNST_0_9254_Q0_16 * tmp);                 // fix(0.9254 * fix(pitch_cand / 2 + 0.5))
-	if(num_harms < NUM_HARMS_MIN)
-		num_harms = NUM_HARMS_MIN;
-	else if(num_harms > NUM_HARMS_MAX)
-		num_harms = NUM_HARMS_MAX;
-
-	if(num_harms <= 36)
-		num_bands = extract_h((UWord32)(num_harms + 2) * CNST_0_33_Q0_16);   // fix((L+2)/3)
-	else
-		num_bands = NUM_BANDS_MAX;
+	num_harms = get_num_harms(imbe_param->ref_pitch, &num_bands);
 
 	imbe_param->num_harms = num_harms;
 	imbe_param->num_bands = num_bands;
@@ -0,0 +1,190 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// droidstar-load: synthetic multi-stream load generator and soak benchmark.
+//
+//   droidstar-load -m DMR -n 50 [-w threads] [-t seconds] [-r seconds] [--ramp N --max M]
+//
+// Every report interval prints CPU use, streams per core, resident memory and its growth
+// rate, and the latency from posting a frame to its Mode until the Mode has parsed it.
+// With --ramp, N more streams are added every interval until the p99 latency exceeds one
+// frame interval or the generator itself falls behind, which is reported as saturation.
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTimer>
+#include <cstdio>
+#if defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+#include "loadgenerator.h"
+
+static bool verbose = false;
+
+static void message_handler(QtMsgType type, const QMessageLogContext &context, const QString &msg)
+{
+	if((type == QtDebugMsg) && !verbose){
+		return;
+	}
+	fprintf(stderr, "%s\n", qFormatLogMessage(type, context, msg).toLocal8Bit().constData());
+}
+
+static double cpu_seconds()
+{
+#if defined(Q_OS_UNIX)
+	struct rusage r;
+	getrusage(RUSAGE_SELF, &r);
+	return r.ru_utime.tv_sec + r.ru_stime.tv_sec + (r.ru_utime.tv_usec + r.ru_stime.tv_usec) / 1e6;
+#else
+	return 0;
+#endif
+}
+
+static double rss_mb()
+{
+#if defined(Q_OS_LINUX)
+	QFile f("/proc/self/statm");
+	if(f.open(QIODevice::ReadOnly)){
+		const QList<QByteArray> v = f.readAll().split(' ');
+		if(v.size() > 1){
+			return v[1].toDouble() * sysconf(_SC_PAGESIZE) / (1024 * 1024);
+		}
+	}
+#endif
+#if defined(Q_OS_UNIX)
+	struct rusage r;
+	getrusage(RUSAGE_SELF, &r);
+#if defined(Q_OS_MACOS)
+	return r.ru_maxrss / (1024.0 * 1024);
+#else
+	return r.ru_maxrss / 1024.0;
+#endif
+#else
+	return 0;
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	QCommandLineParser parser;
+	QElapsedTimer wall;
+	const QStringList modes = {"M17", "DMR", "YSF", "P25", "NXDN"};
+
+	parser.setApplicationDescription("Synthetic multi-stream load generator for DroidStar modes");
+	parser.addHelpOption();
+	parser.addOption({{"m", "mode"}, "Protocol: " + modes.join(", "), "mode", "M17"});
+	parser.addOption({{"n", "streams"}, "Number of concurrent streams", "n", "10"});
+	parser.addOption({{"w", "threads"}, "Worker threads the Mode instances are spread over", "n", QString::number(QThread::idealThreadCount())});
+	parser.addOption({{"t", "time"}, "Run time, 0 to run until interrupted", "seconds", "60"});
+	parser.addOption({{"r", "report"}, "Report interval", "seconds", "10"});
+	parser.addOption({"ramp", "Streams to add every report interval until saturated", "n", "0"});
+	parser.addOption({"max", "Upper limit on streams when ramping", "n", "10000"});
+	parser.addOption({"seed", "Random seed", "seed", "1"});
+	parser.addOption({{"d", "debug"}, "Show mode debug output"});
+	parser.process(app);
+
+	const QString mode = parser.value("mode").toUpper();
+	const int ramp = parser.value("ramp").toInt();
+	const int maxstreams = parser.value("max").toInt();
+	const int runtime = parser.value("time").toInt();
+	verbose = parser.isSet("debug");
+	qInstallMessageHandler(message_handler);
+
+	if(!modes.contains(mode)){
+		fprintf(stderr, "Unsupported mode %s\n", mode.toStdString().c_str());
+		return 1;
+	}
+
+	LoadGenerator load(mode, qMax(1, parser.value("threads").toInt()), parser.value("seed").toUInt());
+	load.add_streams(qMax(1, parser.value("streams").toInt()));
+
+	fprintf(stdout, "%s: %d streams on %d threads, %d ms frames\n", mode.toStdString().c_str(), load.streams(), load.threads(), load.frame_interval());
+	fprintf(stdout, "%8s %7s %9s %7s %9s %10s %9s %10s %8s %8s %8s %8s %6s\n", "time_s", "streams", "frames/s", "cpu%", "cpu%/str", "str/core",
+			"rss_mb", "rss_mb/h", "p50_ms", "p99_ms", "p999_ms", "max_ms", "late");
+	fflush(stdout);
+
+	double lastcpu = cpu_seconds();
+	qint64 lastwall = 0;
+	double rss0 = -1;
+	int sustained = 0;
+	bool done = false;
+
+	QObject::connect(&load, &LoadGenerator::stopped, &app, &QCoreApplication::quit);
+
+	auto finish = [&]() {
+		if(done){
+			return;
+		}
+		done = true;
+		const LoadGenerator::STATS st = load.total_stats();
+		const double cpu = cpu_seconds() / (wall.elapsed() / 1e3);
+		fprintf(stdout, "total: %llu frames, %.1f%% cpu, p50 %.2f ms, p99 %.2f ms, p99.9 %.2f ms, max %.2f ms, %llu late\n",
+				st.frames, cpu * 100, st.p50 / 1e3, st.p99 / 1e3, st.p999 / 1e3, st.max / 1e3, st.late);
+		if(ramp){
+			fprintf(stdout, "sustained %d streams (%.1f per core at the last clean interval)\n", sustained, sustained / qMax(cpu, 0.01));
+		}
+		fflush(stdout);
+		load.stop();
+	};
+
+	QTimer report;
+	QObject::connect(&report, &QTimer::timeout, [&]() {
+		const qint64 now = wall.elapsed();
+		const double cpunow = cpu_seconds();
+		const double cpu = (cpunow - lastcpu) / ((now - lastwall) / 1e3);
+		const double rss = rss_mb();
+		const LoadGenerator::STATS st = load.take_stats();
+		const int streams = load.streams();
+
+		// The first interval includes start-up allocations, growth is measured from the end of it
+		if(rss0 < 0){
+			rss0 = rss;
+		}
+		const double growth = (now > report.interval()) ? (rss - rss0) / ((now - report.interval()) / 3.6e6) : 0;
+
+		fprintf(stdout, "%8.1f %7d %9.1f %7.1f %9.3f %10.1f %9.1f %10.2f %8.2f %8.2f %8.2f %8.2f %6llu\n", now / 1e3, streams,
+				st.frames / ((now - lastwall) / 1e3), cpu * 100, cpu * 100 / streams, cpu > 0 ? streams / cpu : 0.0, rss, growth,
+				st.p50 / 1e3, st.p99 / 1e3, st.p999 / 1e3, st.max / 1e3, st.late);
+		fflush(stdout);
+		lastcpu = cpunow;
+		lastwall = now;
+
+		if(ramp){
+			if((st.p99 > (quint64)load.frame_interval() * 1000) || st.late){
+				fprintf(stdout, "saturated at %d streams\n", streams);
+				finish();
+				return;
+			}
+			sustained = streams;
+			if(streams < maxstreams){
+				load.add_streams(qMin(ramp, maxstreams - streams));
+			}
+		}
+		if(runtime && (now >= runtime * 1000)){
+			finish();
+		}
+	});
+
+	wall.start();
+	report.start(qMax(1, parser.value("report").toInt()) * 1000);
+
+	return app.exec();
+}
@@ -0,0 +1,478 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include "loadgenerator.h"
+#include "m17.h"
+#include "ysf.h"
+#include "YSFFICH.h"
+
+const uint8_t P25_LDU_TYPES[] = {0x62U, 0x63U, 0x64U, 0x65U, 0x66U, 0x67U, 0x68U, 0x69U, 0x6AU, 0x6BU, 0x6CU, 0x6DU, 0x6EU, 0x6FU, 0x70U, 0x71U, 0x72U, 0x73U};
+const uint8_t P25_LDU_SIZES[] = {22U, 14U, 17U, 17U, 17U, 17U, 17U, 17U, 16U, 22U, 14U, 17U, 17U, 17U, 17U, 17U, 17U, 16U};
+
+static void append_random(QByteArray &b, QRandomGenerator &rng, int n)
+{
+	while(n > 0){
+		const quint32 r = rng.generate();
+		for(int i = 0; (i < 4) && (n > 0); ++i, --n){
+			b.append((char)((r >> (8 * i)) & 0xff));
+		}
+	}
+}
+
+static int bucket(quint64 usec)
+{
+	if(usec < 8){
+		return usec;
+	}
+	const int msb = 63 - qCountLeadingZeroBits(usec);
+	const int b = ((msb - 2) * 8) + ((usec >> (msb - 3)) & 7);
+	return qMin(b, 255);
+}
+
+static quint64 bucket_limit(int b)
+{
+	if(b < 8){
+		return b;
+	}
+	const int msb = (b / 8) + 2;
+	return ((quint64)(8 + (b % 8) + 1) << (msb - 3)) - 1;
+}
+
+LoadGenerator::LoadGenerator(QString mode, int threads, quint32 seed, QObject *parent) :
+	QObject(parent),
+	m_mode(mode),
+	m_seed(seed),
+	m_late(0),
+	m_total_late(0),
+	m_alive(0)
+{
+	if(m_mode == "M17"){
+		m_interval = 40;
+	}
+	else if(m_mode == "DMR"){
+		m_interval = 60;
+	}
+	else if(m_mode == "YSF"){
+		m_interval = 100;
+	}
+	else if(m_mode == "NXDN"){
+		m_interval = 80;
+	}
+	else{
+		m_interval = 20;
+	}
+
+	reset(m_interval_hist);
+	reset(m_total_hist);
+
+	for(int i = 0; i < threads; ++i){
+		QThread *t = new QThread(this);
+		t->start();
+		m_threads.append(t);
+	}
+
+	m_timer = new QTimer(this);
+	m_timer->setTimerType(Qt::PreciseTimer);
+	connect(m_timer, SIGNAL(timeout()), this, SLOT(tick()));
+	m_clock.start();
+	m_timer->start(5);
+}
+
+LoadGenerator::~LoadGenerator()
+{
+	for(QThread *t : m_threads){
+		t->quit();
+		t->wait();
+	}
+	qDeleteAll(m_sessions);
+}
+
+void LoadGenerator::add_streams(int n)
+{
+	const QHostAddress reflector(QHostAddress::LocalHost);
+
+	for(int i = 0; i < n; ++i){
+		SESSION *s = new SESSION;
+		s->rng.seed(m_seed + m_sessions.size());
+		s->mode = Mode::create_mode(m_mode);
+		s->mode->init(random_callsign(s->rng), 3100000 + s->rng.bounded(100000), s->rng.bounded(65535), 'A', (m_mode == "P25") ? "10100" : "LOADTEST",
+					  "127.0.0.1", 17000, false, "Software vocoder", "", "", "null", false);
+		s->mode->moveToThread(m_threads[m_sessions.size() % m_threads.size()]);
+		connect(s->mode, SIGNAL(destroyed()), this, SLOT(session_destroyed()));
+
+		Mode *m = s->mode;
+		QMetaObject::invokeMethod(m, [m, reflector]() { m->begin_replay(reflector, 1); });
+		handshake(s);
+
+		// Spread the first overs so the sessions do not all key up on the same tick
+		s->due = m_clock.elapsed() + s->rng.bounded(1000);
+		s->ping = m_clock.elapsed() + 5000;
+		new_stream(s);
+		m_sessions.append(s);
+		m_alive++;
+	}
+}
+
+void LoadGenerator::stop()
+{
+	m_timer->stop();
+
+	if(m_alive == 0){
+		emit stopped();
+		return;
+	}
+
+	for(SESSION *s : m_sessions){
+		QMetaObject::invokeMethod(s->mode, "deleteLater");
+	}
+}
+
+void LoadGenerator::session_destroyed()
+{
+	if(--m_alive == 0){
+		for(QThread *t : m_threads){
+			t->quit();
+			t->wait();
+		}
+		emit stopped();
+	}
+}
+
+void LoadGenerator::post(SESSION *s, const QByteArray &d, bool measure)
+{
+	Mode *m = s->mode;
+	const qint64 posted = m_clock.nsecsElapsed();
+
+	QMetaObject::invokeMethod(m, [this, m, d, posted, measure]() {
+		m->replay_datagram(d, QHostAddress(QHostAddress::LocalHost), 17000);
+		if(measure){
+			record((m_clock.nsecsElapsed() - posted) / 1000);
+		}
+	});
+}
+
+void LoadGenerator::handshake(SESSION *s)
+{
+	QByteArray out;
+
+	if(m_mode == "M17"){
+		post(s, QByteArray("ACKN", 4), false);
+	}
+	else if(m_mode == "DMR"){
+		// Salt, then acks for the RPTK login and RPTC config
+		out.append("RPTACK", 6);
+		append_random(out, s->rng, 4);
+		post(s, out, false);
+		post(s, out, false);
+		post(s, out, false);
+	}
+	else if(m_mode == "YSF"){
+		post(s, QByteArray("YSFPLOADTEST  ", 14), false);
+	}
+	else if(m_mode == "P25"){
+		out.append((char)0xf0);
+		out.append("LOADTEST  ", 10);
+		post(s, out, false);
+	}
+	else if(m_mode == "NXDN"){
+		out.append("NXDNPLOADTEST   ", 15);
+		out.append(2, '\x00');
+		post(s, out, false);
+	}
+}
+
+void LoadGenerator::keepalive(SESSION *s)
+{
+	QByteArray out;
+
+	if(m_mode == "M17"){
+		out.append("PING", 4);
+		out.append(6, '\x00');
+		post(s, out, false);
+	}
+	else if(m_mode == "DMR"){
+		out.append("MSTPONG", 7);
+		out.append(4, '\x00');
+		post(s, out, false);
+	}
+	else{
+		handshake(s);
+	}
+}
+
+QString LoadGenerator::random_callsign(QRandomGenerator &rng)
+{
+	const char prefix[] = "KNW";
+	QString cs;
+
+	cs.append(prefix[rng.bounded(3)]);
+	cs.append(QChar('0' + rng.bounded(10)));
+	for(int i = 0, n = 2 + rng.bounded(2); i < n; ++i){
+		cs.append(QChar('A' + rng.bounded(26)));
+	}
+	return cs;
+}
+
+void LoadGenerator::new_stream(SESSION *s)
+{
+	s->src = random_callsign(s->rng);
+	s->dst = random_callsign(s->rng);
+	s->srcid = 3100000 + s->rng.bounded(100000);
+	s->dstid = 1 + s->rng.bounded(99999);
+	s->streamid = s->rng.generate() | 0x0100; // M17 only carries the low 16 bits, which must not be 0
+	s->frame = 0;
+	s->frames = (3000 + s->rng.bounded(17000)) / m_interval;
+	s->gap = 300 + s->rng.bounded(1700);
+}
+
+void LoadGenerator::tick()
+{
+	const qint64 now = m_clock.elapsed();
+
+	for(SESSION *s : m_sessions){
+		if(now >= s->ping){
+			keepalive(s);
+			s->ping += 5000;
+		}
+		while(s->due <= now){
+			if(s->frame > s->frames){
+				new_stream(s);
+			}
+			if((now - s->due) > m_interval){
+				m_late++;
+				m_total_late++;
+			}
+			const bool last = (s->frame == s->frames);
+			post(s, build_frame(s, last), true);
+			s->frame++;
+			s->due += last ? s->gap : m_interval;
+		}
+	}
+}
+
+QByteArray LoadGenerator::build_frame(SESSION *s, bool last)
+{
+	if(m_mode == "M17"){
+		return build_m17(s, last);
+	}
+	else if(m_mode == "DMR"){
+		return build_dmr(s, last);
+	}
+	else if(m_mode == "YSF"){
+		return build_ysf(s, last);
+	}
+	else if(m_mode == "NXDN"){
+		return build_nxdn(s, last);
+	}
+	return build_p25(s, last);
+}
+
+QByteArray LoadGenerator::build_m17(SESSION *s, bool last)
+{
+	QByteArray out("M17 ", 4);
+	uint8_t cs[10];
+	const uint16_t fn = (s->frame & 0x7fff) | (last ? 0x8000 : 0);
+
+	out.append((s->streamid >> 8) & 0xff);
+	out.append(s->streamid & 0xff);
+	for(const QString &c : {s->dst, s->src}){
+		memset(cs, 0, sizeof(cs));
+		memcpy(cs, c.toLocal8Bit().constData(), qMin(c.size(), 9));
+		M17::encode_callsign(cs);
+		out.append((char *)cs, 6);
+	}
+	out.append('\x00');
+	out.append('\x05'); // 3200 voice stream
+	out.append(14, '\x00');
+	out.append((fn >> 8) & 0xff);
+	out.append(fn & 0xff);
+	append_random(out, s->rng, 16);
+	out.append(2, '\x00');
+	return out;
+}
+
+QByteArray LoadGenerator::build_dmr(SESSION *s, bool last)
+{
+	QByteArray out("DMRD", 4);
+	uint8_t flags = 0x80; // slot 2, group call
+
+	if(s->frame == 0){
+		flags |= 0x21; // voice LC header
+	}
+	else if(last){
+		flags |= 0x22; // terminator with LC
+	}
+	else{
+		const uint8_t n = (s->frame - 1) % 6;
+		flags |= (n == 0) ? 0x10 : n;
+	}
+
+	out.append(s->frame & 0xff);
+	out.append((s->srcid >> 16) & 0xff);
+	out.append((s->srcid >> 8) & 0xff);
+	out.append(s->srcid & 0xff);
+	out.append((s->dstid >> 16) & 0xff);
+	out.append((s->dstid >> 8) & 0xff);
+	out.append(s->dstid & 0xff);
+	out.append(4, '\x00');
+	out.append(flags);
+	out.append((s->streamid >> 24) & 0xff);
+	out.append((s->streamid >> 16) & 0xff);
+	out.append((s->streamid >> 8) & 0xff);
+	out.append(s->streamid & 0xff);
+	append_random(out, s->rng, 33);
+	out.append(2, '\x00');
+	return out;
+}
+
+QByteArray LoadGenerator::build_ysf(SESSION *s, bool last)
+{
+	QByteArray out("YSFD", 4);
+	QByteArray frame;
+	CYSFFICH fich;
+
+	out.append("LOADTEST  ", 10);
+	out.append(s->src.leftJustified(10, ' ', true).toLocal8Bit());
+	out.append(QByteArray("ALL       ", 10));
+	out.append(((s->frame & 0x7f) << 1) | (last ? 1 : 0));
+
+	append_random(frame, s->rng, YSF_FRAME_LENGTH_BYTES);
+	::memcpy(frame.data(), YSF_SYNC_BYTES, YSF_SYNC_LENGTH_BYTES);
+	fich.setFI((s->frame == 0) ? YSF_FI_HEADER : (last ? YSF_FI_TERMINATOR : YSF_FI_COMMUNICATIONS));
+	fich.setCS(2U);
+	fich.setCM(0U);
+	fich.setBN(0U);
+	fich.setBT(0U);
+	fich.setFN(((s->frame == 0) || last) ? 0U : (s->frame - 1) % 7U);
+	fich.setFT(6U);
+	fich.setDev(0U);
+	fich.setMR(0U);
+	fich.setVoIP(false);
+	fich.setDT((s->streamid & 1) ? YSF_DT_VOICE_FR_MODE : YSF_DT_VD_MODE2);
+	fich.setSQL(false);
+	fich.setSQ(0U);
+	fich.encode((uint8_t *)frame.data());
+	out.append(frame);
+	return out;
+}
+
+QByteArray LoadGenerator::build_p25(SESSION *s, bool last)
+{
+	QByteArray out;
+
+	if(last){
+		out.append((char)0x80);
+		out.append(16, '\x00');
+		return out;
+	}
+
+	const int i = s->frame % 18;
+	out.append(P25_LDU_TYPES[i]);
+	append_random(out, s->rng, P25_LDU_SIZES[i] - 1);
+
+	if(P25_LDU_TYPES[i] == 0x65U){
+		out[1] = (s->dstid >> 16) & 0xff;
+		out[2] = (s->dstid >> 8) & 0xff;
+		out[3] = s->dstid & 0xff;
+	}
+	else if(P25_LDU_TYPES[i] == 0x66U){
+		out[1] = (s->srcid >> 16) & 0xff;
+		out[2] = (s->srcid >> 8) & 0xff;
+		out[3] = s->srcid & 0xff;
+	}
+	return out;
+}
+
+QByteArray LoadGenerator::build_nxdn(SESSION *s, bool last)
+{
+	QByteArray out("NXDND", 5);
+
+	out.append((s->srcid >> 8) & 0xff);
+	out.append(s->srcid & 0xff);
+	out.append((s->dstid >> 8) & 0xff);
+	out.append(s->dstid & 0xff);
+
+	if((s->frame == 0) || last){
+		out.append(last ? 0x09 : 0x01); // 0x08 marks the TX release
+		out.append((char)0x81); // RDCH, SACCH non-superframe, steal FACCH
+		out.append(32, '\x00');
+	}
+	else{
+		out.append(0x01);
+		out.append((char)0xae); // RDCH, SACCH superframe, voice
+		append_random(out, s->rng, 32);
+	}
+	return out;
+}
+
+void LoadGenerator::record(quint64 usec)
+{
+	for(HISTOGRAM *h : {&m_interval_hist, &m_total_hist}){
+		h->buckets[bucket(usec)]++;
+		h->count++;
+		quint64 max = h->max;
+		while((usec > max) && !h->max.compare_exchange_weak(max, usec));
+	}
+}
+
+void LoadGenerator::reset(HISTOGRAM &h)
+{
+	for(int i = 0; i < LATENCY_BUCKETS; ++i){
+		h.buckets[i] = 0;
+	}
+	h.count = 0;
+	h.max = 0;
+}
+
+LoadGenerator::STATS LoadGenerator::summarize(HISTOGRAM &h)
+{
+	STATS st;
+	const quint64 count = h.count;
+	const quint64 ranks[] = {(count + 1) / 2, (count * 99 + 99) / 100, (count * 999 + 999) / 1000};
+	quint64 *out[] = {&st.p50, &st.p99, &st.p999};
+	quint64 seen = 0;
+	int r = 0;
+
+	st.frames = count;
+	st.p50 = st.p99 = st.p999 = 0;
+	st.max = h.max;
+
+	for(int i = 0; (i < LATENCY_BUCKETS) && (r < 3); ++i){
+		seen += h.buckets[i];
+		while((r < 3) && ranks[r] && (seen >= ranks[r])){
+			*out[r++] = qMin(bucket_limit(i), st.max);
+		}
+	}
+	return st;
+}
+
+LoadGenerator::STATS LoadGenerator::take_stats()
+{
+	STATS st = summarize(m_interval_hist);
+	st.late = m_late;
+	m_late = 0;
+	reset(m_interval_hist);
+	return st;
+}
+
+LoadGenerator::STATS LoadGenerator::total_stats()
+{
+	STATS st = summarize(m_total_hist);
+	st.late = m_total_late;
+	return st;
+}
@@ -0,0 +1,111 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include <QObject>
+#include <QThread>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <atomic>
+#include "mode.h"
+
+// Drives synthetic M17/DMR/YSF/P25/NXDN streams into Mode instances through the replay
+// path, so the real parse and software decode code runs without sockets or audio hardware.
+// Each session is one Mode linked to a fake reflector that talks back to back overs with
+// random callsigns, IDs and codec payloads at the protocol frame rate.
+class LoadGenerator : public QObject
+{
+	Q_OBJECT
+public:
+	LoadGenerator(QString mode, int threads, quint32 seed, QObject *parent = nullptr);
+	~LoadGenerator();
+	void add_streams(int n);
+	void stop();
+	int streams() { return m_sessions.size(); }
+	int threads() { return m_threads.size(); }
+	int frame_interval() { return m_interval; }
+	struct STATS {
+		quint64 frames;
+		quint64 late;
+		quint64 p50;
+		quint64 p99;
+		quint64 p999;
+		quint64 max;
+	};
+	STATS take_stats();
+	STATS total_stats();
+signals:
+	void stopped();
+private slots:
+	void tick();
+	void session_destroyed();
+private:
+	enum{
+		LATENCY_BUCKETS = 256
+	};
+	struct HISTOGRAM {
+		std::atomic<quint64> buckets[LATENCY_BUCKETS];
+		std::atomic<quint64> count;
+		std::atomic<quint64> max;
+	};
+	struct SESSION {
+		Mode *mode;
+		QRandomGenerator rng;
+		qint64 due;
+		qint64 ping;
+		QString src;
+		QString dst;
+		uint32_t srcid;
+		uint32_t dstid;
+		uint32_t streamid;
+		int frame;
+		int frames;
+		int gap;
+	};
+	QString m_mode;
+	quint32 m_seed;
+	int m_interval;
+	QList<QThread *> m_threads;
+	QList<SESSION *> m_sessions;
+	QTimer *m_timer;
+	QElapsedTimer m_clock;
+	HISTOGRAM m_interval_hist;
+	HISTOGRAM m_total_hist;
+	quint64 m_late;
+	quint64 m_total_late;
+	int m_alive;
+
+	void post(SESSION *s, const QByteArray &d, bool measure);
+	void handshake(SESSION *s);
+	void keepalive(SESSION *s);
+	void new_stream(SESSION *s);
+	QByteArray build_frame(SESSION *s, bool last);
+	QByteArray build_m17(SESSION *s, bool last);
+	QByteArray build_dmr(SESSION *s, bool last);
+	QByteArray build_ysf(SESSION *s, bool last);
+	QByteArray build_p25(SESSION *s, bool last);
+	QByteArray build_nxdn(SESSION *s, bool last);
+	QString random_callsign(QRandomGenerator &rng);
+	void record(quint64 usec);
+	static void reset(HISTOGRAM &h);
+	static STATS summarize(HISTOGRAM &h);
+};
+
+#endif // LOADGENERATOR_H
@@ -0,0 +1,146 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// droidstar-logbench: frame time and memory of the log tab as the log grows.
+//
+//   QT_QPA_PLATFORM=offscreen droidstar-logbench [-n 10000] [-b 10] [-c 2000] [--textarea]
+//
+// Lines like those of a busy talkgroup are appended -b per frame to a ListView on a
+// LogModel of -c lines, as the log tab shows them, or with --textarea to the TextArea the
+// log tab used before. Every tenth of -n lines the frame times of the last tenth and the
+// growth of resident memory are printed. Rendering is done in software so that the frame
+// times are the work done and not a wait for vsync.
+
+#include <QGuiApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QQmlComponent>
+#include <QQmlContext>
+#include <QQuickItem>
+#include <QQuickView>
+#include <QTime>
+#include <algorithm>
+#include <cstdio>
+#if defined(Q_OS_UNIX)
+#include <unistd.h>
+#endif
+#include "logmodel.h"
+
+static double rss_mb()
+{
+#if defined(Q_OS_LINUX)
+	QFile f("/proc/self/statm");
+	if(f.open(QIODevice::ReadOnly)){
+		const QList<QByteArray> v = f.readAll().split(' ');
+		if(v.size() > 1){
+			return v[1].toDouble() * sysconf(_SC_PAGESIZE) / (1024 * 1024);
+		}
+	}
+#endif
+	return 0;
+}
+
+static const char *LIST_QML =
+	"import QtQuick\n"
+	"import QtQuick.Controls\n"
+	"ListView {\n"
+	"	width: 400; height: 600; clip: true\n"
+	"	model: logmodel\n"
+	"	delegate: TextEdit { width: ListView.view.width; text: display; readOnly: true; wrapMode: TextEdit.WordWrap }\n"
+	"	onCountChanged: positionViewAtEnd()\n"
+	"}\n";
+
+static const char *TEXTAREA_QML =
+	"import QtQuick\n"
+	"import QtQuick.Controls\n"
+	"Flickable {\n"
+	"	width: 400; height: 600; clip: true\n"
+	"	contentHeight: log.height\n"
+	"	TextArea { id: log; objectName: \"log\"; width: 400; readOnly: true; wrapMode: TextArea.WordWrap }\n"
+	"}\n";
+
+int main(int argc, char *argv[])
+{
+	QQuickWindow::setGraphicsApi(QSGRendererInterface::Software);
+	QGuiApplication app(argc, argv);
+	QCommandLineParser parser;
+
+	parser.setApplicationDescription("Log tab benchmark");
+	parser.addHelpOption();
+	parser.addOption({{"n", "lines"}, "Lines to append", "lines", "10000"});
+	parser.addOption({{"b", "batch"}, "Lines appended per frame", "lines", "10"});
+	parser.addOption({{"c", "capacity"}, "Lines the LogModel keeps", "lines", "2000"});
+	parser.addOption({"textarea", "Append to a TextArea instead"});
+	parser.process(app);
+
+	const int lines = qMax(10, parser.value("lines").toInt());
+	const int batch = qMax(1, parser.value("batch").toInt());
+	const bool textarea = parser.isSet("textarea");
+	LogModel model(parser.value("capacity").toInt());
+	QQuickView view;
+
+	view.rootContext()->setContextProperty("logmodel", &model);
+	QQmlComponent c(view.engine());
+	c.setData(textarea ? TEXTAREA_QML : LIST_QML, QUrl());
+	QQuickItem *root = qobject_cast<QQuickItem *>(c.create(view.rootContext()));
+	if(root == nullptr){
+		fprintf(stderr, "%s\n", c.errorString().toStdString().c_str());
+		return 1;
+	}
+	root->setParentItem(view.contentItem());
+	QObject *log = root->findChild<QObject *>("log");
+	view.resize(400, 600);
+	view.show();
+
+	const double rss0 = rss_mb();
+	QVector<qint64> frames;
+	QElapsedTimer t;
+	int appended = 0;
+
+	fprintf(stdout, "%s, %d lines, %d per frame\n", textarea ? "TextArea" : "ListView on LogModel", lines, batch);
+	fprintf(stdout, "%8s %9s %9s %9s %9s\n", "lines", "p50_ms", "p99_ms", "max_ms", "grown_mb");
+	QObject::connect(&view, &QQuickWindow::frameSwapped, [&]() {
+		if(t.isValid()){
+			frames.append(t.nsecsElapsed());
+		}
+		if(appended >= lines){
+			app.quit();
+			return;
+		}
+		for(int i = 0; i < batch; ++i, ++appended){
+			const QString s = QTime::currentTime().toString("hh:mm:ss") + " DMR RX started id:  srcid: " + QString::number(3100000 + appended % 5000) + " dstid: 91";
+			if(textarea){
+				QMetaObject::invokeMethod(log, "append", Q_ARG(QString, s));
+			}
+			else{
+				model.append(s);
+			}
+		}
+		if((appended % (lines / 10)) < batch){
+			std::sort(frames.begin(), frames.end());
+			fprintf(stdout, "%8d %9.2f %9.2f %9.2f %9.1f\n", appended, frames.isEmpty() ? 0 : frames.at(frames.size() / 2) / 1e6,
+					frames.isEmpty() ? 0 : frames.at(frames.size() * 99 / 100) / 1e6, frames.isEmpty() ? 0 : frames.last() / 1e6, rss_mb() - rss0);
+			fflush(stdout);
+			frames.clear();
+		}
+		t.start();
+		view.update();
+	});
+
+	return app.exec();
+}
@@ -0,0 +1,122 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <QDebug>
+#include "logmodel.h"
+
+LogModel::LogModel(int capacity, QObject *parent) :
+	QAbstractListModel(parent),
+	m_ring(qMax(1, capacity)),
+	m_head(0),
+	m_count(0),
+	m_spillmax(0),
+	m_spillfiles(0)
+{
+}
+
+LogModel::~LogModel()
+{
+	for(int i = 0; i < m_count; ++i){
+		spill(m_ring.at((m_head + i) % m_ring.size()));
+	}
+}
+
+int LogModel::rowCount(const QModelIndex &parent) const
+{
+	return parent.isValid() ? 0 : m_count;
+}
+
+QVariant LogModel::data(const QModelIndex &index, int role) const
+{
+	if(!index.isValid() || (index.row() >= m_count) || (role != Qt::DisplayRole)){
+		return QVariant();
+	}
+	return m_ring.at((m_head + index.row()) % m_ring.size());
+}
+
+QHash<int, QByteArray> LogModel::roleNames() const
+{
+	return {{Qt::DisplayRole, "display"}};
+}
+
+void LogModel::set_spill(QString path, qint64 max_bytes, int files)
+{
+	m_spill.close();
+	m_spillmax = max_bytes;
+	m_spillfiles = files;
+	if(path.isEmpty()){
+		return;
+	}
+	m_spill.setFileName(path);
+	if(!m_spill.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)){
+		qDebug() << "LogModel: cannot open" << path;
+	}
+}
+
+void LogModel::append(QString line)
+{
+	if(m_count == m_ring.size()){
+		beginRemoveRows(QModelIndex(), 0, 0);
+		spill(m_ring.at(m_head));
+		m_ring[m_head].clear();
+		m_head = (m_head + 1) % m_ring.size();
+		--m_count;
+		endRemoveRows();
+	}
+	beginInsertRows(QModelIndex(), m_count, m_count);
+	m_ring[(m_head + m_count) % m_ring.size()] = line;
+	++m_count;
+	endInsertRows();
+}
+
+void LogModel::clear()
+{
+	beginResetModel();
+	for(int i = 0; i < m_count; ++i){
+		QString &l = m_ring[(m_head + i) % m_ring.size()];
+		spill(l);
+		l.clear();
+	}
+	m_head = 0;
+	m_count = 0;
+	endResetModel();
+}
+
+void LogModel::spill(const QString &line)
+{
+	if(!m_spill.isOpen()){
+		return;
+	}
+	if((m_spillmax > 0) && (m_spill.size() >= m_spillmax)){
+		const QString path = m_spill.fileName();
+		m_spill.close();
+		QFile::remove(path + "." + QString::number(m_spillfiles));
+		for(int i = m_spillfiles - 1; i > 0; --i){
+			QFile::rename(path + "." + QString::number(i), path + "." + QString::number(i + 1));
+		}
+		if(m_spillfiles > 0){
+			QFile::rename(path, path + "." + QString::number(1));
+		}
+		else{
+			QFile::remove(path);
+		}
+		if(!m_spill.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)){
+			return;
+		}
+	}
+	m_spill.write(line.toUtf8() + "\n");
+}
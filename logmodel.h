@@ -0,0 +1,54 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LOGMODEL_H
+#define LOGMODEL_H
+
+#include <QAbstractListModel>
+#include <QFile>
+#include <QVector>
+
+// The lines of the log tab, the last capacity of them in a ring. A ListView only makes
+// delegates for the lines on screen, so a long session costs neither layout time nor
+// memory beyond the ring. Lines that fall out of the ring can be spilled to a file,
+// which is renamed to file.1, file.2 and so on as it fills.
+class LogModel : public QAbstractListModel
+{
+	Q_OBJECT
+public:
+	LogModel(int capacity, QObject *parent = nullptr);
+	~LogModel();
+	int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+	QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+	QHash<int, QByteArray> roleNames() const override;
+	// An empty path stops spilling
+	void set_spill(QString path, qint64 max_bytes = 1024 * 1024, int files = 2);
+	Q_INVOKABLE void clear();
+public slots:
+	void append(QString line);
+private:
+	QVector<QString> m_ring;
+	int m_head;
+	int m_count;
+	QFile m_spill;
+	qint64 m_spillmax;
+	int m_spillfiles;
+
+	void spill(const QString &line);
+};
+
+#endif // LOGMODEL_H
@@ -0,0 +1,629 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include "loopbackreflector.h"
+#include "iaxdefines.h"
+#include "SHA256.h"
+
+LoopbackReflector::LoopbackReflector(QString mode, quint16 port, QObject *parent) :
+	QObject(parent),
+	m_mode(mode),
+	m_udp(nullptr),
+	m_port(port),
+	m_password("passw0rd"),
+	m_echo(true),
+	m_loss(0),
+	m_jitter(0),
+	m_reorder(0),
+	m_rng(1),
+	m_ping_timer(nullptr),
+	m_inject_timer(nullptr),
+	m_injectidx(0),
+	m_injectspeed(1),
+	m_injectbase(0),
+	m_heldport(0)
+{
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+LoopbackReflector::~LoopbackReflector()
+{
+}
+
+bool LoopbackReflector::start(QHostAddress address)
+{
+	m_udp = new QUdpSocket(this);
+
+	if(!m_udp->bind(address, m_port)){
+		qDebug() << "LoopbackReflector: bind failed " << m_udp->errorString();
+		return false;
+	}
+
+	m_port = m_udp->localPort();
+	connect(m_udp, SIGNAL(readyRead()), this, SLOT(process_udp()));
+	m_ping_timer = new QTimer(this);
+	connect(m_ping_timer, SIGNAL(timeout()), this, SLOT(send_ping()));
+	m_ping_timer->start(3000);
+
+	if(m_inject.size()){
+		m_inject_timer = new QTimer(this);
+		m_inject_timer->setSingleShot(true);
+		connect(m_inject_timer, SIGNAL(timeout()), this, SLOT(inject_next()));
+		m_injectclock.start();
+		m_inject_timer->start(0);
+	}
+	qDebug() << "LoopbackReflector: " << m_mode << " listening on " << address.toString() << ":" << m_port;
+	return true;
+}
+
+bool LoopbackReflector::set_inject(QString capture, int speed)
+{
+	PacketCapture c;
+	PacketCapture::RECORD r;
+
+	if(!c.open_read(capture)){
+		return false;
+	}
+
+	m_inject.clear();
+	while(c.read(r)){
+		if((r.dir == PacketCapture::CAPTURE_RX) && is_stream(r.data)){
+			m_inject.append(r);
+		}
+	}
+	m_injectspeed = speed > 0 ? speed : 1;
+	qDebug() << "LoopbackReflector: " << m_inject.size() << " stream frames to inject from " << capture;
+	return m_inject.size() > 0;
+}
+
+bool LoopbackReflector::is_stream(const QByteArray &d)
+{
+	if(m_mode == "M17"){
+		return (d.size() == 54) && (::memcmp(d.data(), "M17 ", 4) == 0);
+	}
+	else if(m_mode == "YSF"){
+		return (d.size() == 155) && (::memcmp(d.data(), "YSFD", 4) == 0);
+	}
+	else if(m_mode == "FCS"){
+		return d.size() == 130;
+	}
+	else if(m_mode == "DMR"){
+		return (d.size() == 55) && (::memcmp(d.data(), "DMRD", 4) == 0);
+	}
+	else if(m_mode == "P25"){
+		return (d.size() > 11) && ((uint8_t)d.data()[0] != 0xf0) && ((uint8_t)d.data()[0] != 0xf1);
+	}
+	else if(m_mode == "NXDN"){
+		return (d.size() == 43) && (::memcmp(d.data(), "NXDND", 5) == 0);
+	}
+	else if(m_mode == "REF"){
+		return (d.size() > 6) && (::memcmp(d.data() + 2, "DSVT", 4) == 0);
+	}
+	else if(m_mode == "XRF"){
+		return (d.size() > 4) && (::memcmp(d.data(), "DSVT", 4) == 0);
+	}
+	else if(m_mode == "DCS"){
+		return (d.size() == 100) && (::memcmp(d.data(), "0001", 4) == 0);
+	}
+	else if(m_mode == "IAX"){
+		return (d.size() > 4) && !(d.data()[0] & 0x80);
+	}
+	return false;
+}
+
+LoopbackReflector::CLIENT * LoopbackReflector::find_client(const QHostAddress &a, quint16 p, bool create)
+{
+	for(int i = 0; i < m_clients.size(); ++i){
+		if((m_clients[i].address == a) && (m_clients[i].port == p)){
+			return &m_clients[i];
+		}
+	}
+
+	if(!create){
+		return nullptr;
+	}
+
+	CLIENT c;
+	c.address = a;
+	c.port = p;
+	c.ts = QDateTime::currentMSecsSinceEpoch();
+	c.linked = false;
+	c.callno = 0x100 + m_clients.size();
+	c.peer = 0;
+	c.iseq = 0;
+	c.oseq = 0;
+	m_clients.append(c);
+	return &m_clients.last();
+}
+
+void LoopbackReflector::link(CLIENT *c)
+{
+	if(!c->linked){
+		c->linked = true;
+		const qint64 ms = QDateTime::currentMSecsSinceEpoch() - c->ts;
+		qDebug() << "LoopbackReflector: " << c->address.toString() << ":" << c->port << " linked in " << ms << "ms";
+		emit client_linked(c->address.toString() + ":" + QString::number(c->port), ms);
+	}
+}
+
+void LoopbackReflector::unlink(const QHostAddress &a, quint16 p)
+{
+	for(int i = 0; i < m_clients.size(); ++i){
+		if((m_clients[i].address == a) && (m_clients[i].port == p)){
+			m_clients.removeAt(i);
+			qDebug() << "LoopbackReflector: " << a.toString() << ":" << p << " unlinked";
+			emit client_unlinked(a.toString() + ":" + QString::number(p));
+			return;
+		}
+	}
+}
+
+void LoopbackReflector::send(const QByteArray &d, const QHostAddress &a, quint16 p)
+{
+	if(m_loss && ((int)m_rng.bounded(100) < m_loss)){
+		m_stats.dropped++;
+		return;
+	}
+
+	if(m_reorder && m_held.isEmpty() && ((int)m_rng.bounded(100) < m_reorder)){
+		m_held = d;
+		m_heldaddr = a;
+		m_heldport = p;
+		m_stats.reordered++;
+		return;
+	}
+
+	QList<QByteArray> out;
+	out.append(d);
+	if(!m_held.isEmpty() && (m_heldaddr == a) && (m_heldport == p)){
+		out.append(m_held);
+		m_held.clear();
+	}
+
+	for(const QByteArray &o : out){
+		const int delay = m_jitter ? m_rng.bounded(m_jitter + 1) : 0;
+		if(delay){
+			QTimer::singleShot(delay, this, [this, o, a, p]() { m_udp->writeDatagram(o, a, p); });
+		}
+		else{
+			m_udp->writeDatagram(o, a, p);
+		}
+		m_stats.tx++;
+	}
+}
+
+void LoopbackReflector::relay(const QByteArray &d, CLIENT *from)
+{
+	for(int i = 0; i < m_clients.size(); ++i){
+		CLIENT *c = &m_clients[i];
+		if(!c->linked || (!m_echo && (c == from))){
+			continue;
+		}
+		if(m_mode == "IAX"){
+			QByteArray mini = d;
+			mini[0] = (c->callno >> 8) & 0x7f;
+			mini[1] = c->callno & 0xff;
+			send(mini, c->address, c->port);
+		}
+		else{
+			send(d, c->address, c->port);
+		}
+		m_stats.relayed++;
+	}
+}
+
+void LoopbackReflector::process_udp()
+{
+	QByteArray buf;
+	QHostAddress sender;
+	quint16 senderPort;
+
+	buf.resize(m_udp->pendingDatagramSize());
+	m_udp->readDatagram(buf.data(), buf.size(), &sender, &senderPort);
+	m_stats.rx++;
+
+	if(buf.isEmpty()){
+		return;
+	}
+
+	CLIENT *c = find_client(sender, senderPort, true);
+
+	if(m_mode == "M17"){
+		process_m17(buf, c);
+	}
+	else if(m_mode == "YSF"){
+		process_ysf(buf, c);
+	}
+	else if(m_mode == "FCS"){
+		process_fcs(buf, c);
+	}
+	else if(m_mode == "DMR"){
+		process_dmr(buf, c);
+	}
+	else if(m_mode == "P25"){
+		process_p25(buf, c);
+	}
+	else if(m_mode == "NXDN"){
+		process_nxdn(buf, c);
+	}
+	else if(m_mode == "REF"){
+		process_ref(buf, c);
+	}
+	else if(m_mode == "XRF"){
+		process_xrf(buf, c);
+	}
+	else if(m_mode == "DCS"){
+		process_dcs(buf, c);
+	}
+	else if(m_mode == "IAX"){
+		process_iax(buf, c);
+	}
+}
+
+void LoopbackReflector::process_m17(const QByteArray &buf, CLIENT *c)
+{
+	if((buf.size() == 11) && (::memcmp(buf.data(), "CONN", 4) == 0)){
+		send(QByteArray("ACKN", 4), c->address, c->port);
+		link(c);
+	}
+	else if((buf.size() == 10) && (::memcmp(buf.data(), "DISC", 4) == 0)){
+		send(QByteArray("DISC", 4), c->address, c->port);
+		unlink(c->address, c->port);
+	}
+	else if(c->linked && is_stream(buf)){
+		relay(buf, c);
+	}
+	else if(c->linked && (buf.size() > 33) && (::memcmp(buf.data(), "M17P", 4) == 0)){
+		relay(buf, c);
+	}
+}
+
+void LoopbackReflector::process_ysf(const QByteArray &buf, CLIENT *c)
+{
+	if((buf.size() == 14) && (::memcmp(buf.data(), "YSFP", 4) == 0)){
+		send(QByteArray("YSFPLOOPBACK  ", 14), c->address, c->port);
+		link(c);
+	}
+	else if((buf.size() == 14) && (::memcmp(buf.data(), "YSFU", 4) == 0)){
+		unlink(c->address, c->port);
+	}
+	else if(c->linked && is_stream(buf)){
+		relay(buf, c);
+	}
+}
+
+void LoopbackReflector::process_fcs(const QByteArray &buf, CLIENT *c)
+{
+	if((buf.size() > 17) && (buf.size() < 30) && (::memcmp(buf.data(), "PING", 4) == 0)){
+		send(QByteArray("PING\x00\x00\x00", 7), c->address, c->port);
+		link(c);
+	}
+	else if((buf.size() == 11) && (::memcmp(buf.data(), "CLOSE", 5) == 0)){
+		unlink(c->address, c->port);
+	}
+	else if(c->linked && is_stream(buf)){
+		relay(buf, c);
+	}
+}
+
+void LoopbackReflector::process_dmr(const QByteArray &buf, CLIENT *c)
+{
+	QByteArray out;
+	QByteArray id = buf.mid(4, 4);
+
+	if((buf.size() == 8) && (::memcmp(buf.data(), "RPTL", 4) == 0)){
+		c->salt.clear();
+		for(int i = 0; i < 4; ++i){
+			c->salt.append((char)m_rng.bounded(256));
+		}
+		out.append("RPTACK", 6);
+		out.append(c->salt);
+		send(out, c->address, c->port);
+	}
+	else if((buf.size() == 40) && (::memcmp(buf.data(), "RPTK", 4) == 0)){
+		CSHA256 sha256;
+		uint8_t hash[32];
+		QByteArray in = c->salt + m_password.toUtf8();
+		sha256.buffer((uint8_t *)in.data(), (uint32_t)in.size(), hash);
+
+		if(c->salt.size() && (::memcmp(hash, buf.data() + 8, 32) == 0)){
+			out.append("RPTACK", 6);
+		}
+		else{
+			qDebug() << "LoopbackReflector: DMR auth failed for " << c->address.toString();
+			out.append("MSTNAK", 6);
+		}
+		out.append(id);
+		send(out, c->address, c->port);
+	}
+	else if((buf.size() == 302) && (::memcmp(buf.data(), "RPTC", 4) == 0)){
+		out.append("RPTACK", 6);
+		out.append(id);
+		send(out, c->address, c->port);
+		link(c);
+	}
+	else if((buf.size() > 8) && (::memcmp(buf.data(), "RPTO", 4) == 0)){
+		out.append("RPTACK", 6);
+		out.append(id);
+		send(out, c->address, c->port);
+	}
+	else if((buf.size() == 11) && (::memcmp(buf.data(), "RPTPING", 7) == 0)){
+		out.append("MSTPONG", 7);
+		out.append(buf.mid(7, 4));
+		send(out, c->address, c->port);
+	}
+	else if((buf.size() == 9) && (::memcmp(buf.data(), "RPTCL", 5) == 0)){
+		unlink(c->address, c->port);
+	}
+	else if(c->linked && is_stream(buf)){
+		relay(buf, c);
+	}
+}
+
+void LoopbackReflector::process_p25(const QByteArray &buf, CLIENT *c)
+{
+	if((buf.size() == 11) && ((uint8_t)buf.data()[0] == 0xf0)){
+		send(buf, c->address, c->port);
+		link(c);
+	}
+	else if((buf.size() == 11) && ((uint8_t)buf.data()[0] == 0xf1)){
+		unlink(c->address, c->port);
+	}
+	else if(c->linked && is_stream(buf)){
+		relay(buf, c);
+	}
+}
+
+void LoopbackReflector::process_nxdn(const QByteArray &buf, CLIENT *c)
+{
+	if((buf.size() == 17) && (::memcmp(buf.data(), "NXDNP", 5) == 0)){
+		send(buf, c->address, c->port);
+		link(c);
+	}
+	else if((buf.size() == 17) && (::memcmp(buf.data(), "NXDNU", 5) == 0)){
+		unlink(c->address, c->port);
+	}
+	else if(c->linked && is_stream(buf)){
+		relay(buf, c);
+	}
+}
+
+void LoopbackReflector::process_ref(const QByteArray &buf, CLIENT *c)
+{
+	if((buf.size() == 5) && (buf.data()[0] == 0x05)){
+		send(buf, c->address, c->port);
+		if(buf.data()[4] == 0x00){
+			unlink(c->address, c->port);
+		}
+	}
+	else if((buf.size() == 28) && ((uint8_t)buf.data()[0] == 0x1c) && ((uint8_t)buf.data()[1] == 0xc0)){
+		send(QByteArray("\x08\xc0\x04\x00OKRW", 8), c->address, c->port);
+		link(c);
+	}
+	else if(buf.size() == 3){
+		send(buf, c->address, c->port);
+	}
+	else if(c->linked && is_stream(buf)){
+		relay(buf, c);
+	}
+}
+
+void LoopbackReflector::process_xrf(const QByteArray &buf, CLIENT *c)
+{
+	if((buf.size() == 11) && (buf.data()[10] == 11)){
+		QByteArray out = buf.left(10);
+		out.append("ACK", 3);
+		out.append('\x00');
+		send(out, c->address, c->port);
+		link(c);
+	}
+	else if((buf.size() == 11) && (buf.data()[9] == ' ')){
+		unlink(c->address, c->port);
+	}
+	else if(buf.size() == 9){
+		send(QByteArray("LOOPBACK\x00", 9), c->address, c->port);
+	}
+	else if(c->linked && is_stream(buf)){
+		relay(buf, c);
+	}
+}
+
+void LoopbackReflector::process_dcs(const QByteArray &buf, CLIENT *c)
+{
+	if(buf.size() == 519){
+		QByteArray out = buf.left(10);
+		out.append("ACK", 3);
+		out.append('\x00');
+		send(out, c->address, c->port);
+		link(c);
+	}
+	else if((buf.size() == 11) && (buf.data()[9] == ' ')){
+		unlink(c->address, c->port);
+	}
+	else if(c->linked && is_stream(buf)){
+		relay(buf, c);
+	}
+	else if((buf.size() > 10) && (buf.size() < 30)){
+		QByteArray out("LOOPBACK", 8);
+		out.append(14, '\x00');
+		send(out, c->address, c->port);
+	}
+}
+
+QByteArray LoopbackReflector::iax_ie(const QByteArray &buf, uint8_t ie)
+{
+	int i = 12;
+
+	while((i + 1) < buf.size()){
+		const uint8_t len = buf.data()[i + 1];
+		if((uint8_t)buf.data()[i] == ie){
+			return buf.mid(i + 2, len);
+		}
+		i += 2 + len;
+	}
+	return QByteArray();
+}
+
+void LoopbackReflector::send_iax(CLIENT *c, uint8_t type, uint8_t subclass, const QByteArray &ies)
+{
+	QByteArray out;
+	const uint32_t ts = QDateTime::currentMSecsSinceEpoch() - c->ts;
+
+	out.append(((c->callno >> 8) & 0x7f) | 0x80);
+	out.append(c->callno & 0xff);
+	out.append((c->peer >> 8) & 0x7f);
+	out.append(c->peer & 0xff);
+	out.append((ts >> 24) & 0xff);
+	out.append((ts >> 16) & 0xff);
+	out.append((ts >> 8) & 0xff);
+	out.append(ts & 0xff);
+	out.append(c->oseq++);
+	out.append(c->iseq);
+	out.append(type);
+	out.append(subclass);
+	out.append(ies);
+	send(out, c->address, c->port);
+}
+
+void LoopbackReflector::process_iax(const QByteArray &buf, CLIENT *c)
+{
+	QByteArray ies;
+
+	if(!(buf.data()[0] & 0x80)){
+		if(c->linked){
+			relay(buf, c);
+		}
+		return;
+	}
+
+	if(buf.size() < 12){
+		return;
+	}
+
+	c->peer = ((buf.data()[0] & 0x7f) << 8) | (uint8_t)buf.data()[1];
+	const uint8_t type = buf.data()[10];
+	const uint8_t subclass = buf.data()[11];
+	c->iseq = (uint8_t)buf.data()[8] + 1;
+
+	if(type != AST_FRAME_IAX){
+		return;
+	}
+
+	switch(subclass){
+	case IAX_COMMAND_NEW:
+		if((buf.size() == 14) && ((uint8_t)buf.data()[12] == IAX_IE_CALLTOKEN)){
+			QByteArray token("1700000000?loopback");
+			c->oseq = 0;
+			ies.append(IAX_IE_CALLTOKEN);
+			ies.append(token.size());
+			ies.append(token);
+			send_iax(c, AST_FRAME_IAX, IAX_COMMAND_CALLTOKEN, ies);
+		}
+		else{
+			c->challenge = QByteArray::number(m_rng.bounded(100000000, 999999999));
+			ies.append(IAX_IE_AUTHMETHODS);
+			ies.append(2);
+			ies.append('\x00');
+			ies.append(IAX_AUTH_MD5);
+			ies.append(IAX_IE_CHALLENGE);
+			ies.append(c->challenge.size());
+			ies.append(c->challenge);
+			send_iax(c, AST_FRAME_IAX, IAX_COMMAND_AUTHREQ, ies);
+		}
+		break;
+	case IAX_COMMAND_REGREQ:
+		if(iax_ie(buf, IAX_IE_MD5_RESULT).isEmpty()){
+			c->challenge = QByteArray::number(m_rng.bounded(100000000, 999999999));
+			ies.append(IAX_IE_AUTHMETHODS);
+			ies.append(2);
+			ies.append('\x00');
+			ies.append(IAX_AUTH_MD5);
+			ies.append(IAX_IE_CHALLENGE);
+			ies.append(c->challenge.size());
+			ies.append(c->challenge);
+			send_iax(c, AST_FRAME_IAX, IAX_COMMAND_REGAUTH, ies);
+		}
+		else if(iax_ie(buf, IAX_IE_MD5_RESULT) == QCryptographicHash::hash(c->challenge + m_password.toUtf8(), QCryptographicHash::Md5).toHex()){
+			send_iax(c, AST_FRAME_IAX, IAX_COMMAND_REGACK);
+		}
+		else{
+			qDebug() << "LoopbackReflector: IAX registration auth failed for " << c->address.toString();
+			send_iax(c, AST_FRAME_IAX, IAX_COMMAND_REGREJ);
+		}
+		break;
+	case IAX_COMMAND_AUTHREP:
+		if(iax_ie(buf, IAX_IE_MD5_RESULT) == QCryptographicHash::hash(c->challenge + m_password.toUtf8(), QCryptographicHash::Md5).toHex()){
+			send_iax(c, AST_FRAME_IAX, IAX_COMMAND_ACCEPT);
+			send_iax(c, AST_FRAME_CONTROL, AST_CONTROL_ANSWER);
+			link(c);
+		}
+		else{
+			qDebug() << "LoopbackReflector: IAX call auth failed for " << c->address.toString();
+			send_iax(c, AST_FRAME_IAX, IAX_COMMAND_REJECT);
+		}
+		break;
+	case IAX_COMMAND_HANGUP:
+		unlink(c->address, c->port);
+		break;
+	default:
+		break;
+	}
+}
+
+void LoopbackReflector::send_ping()
+{
+	for(int i = 0; i < m_clients.size(); ++i){
+		CLIENT *c = &m_clients[i];
+		if(!c->linked){
+			continue;
+		}
+		if(m_mode == "M17"){
+			QByteArray out("PING", 4);
+			out.append(6, '\x00');
+			send(out, c->address, c->port);
+		}
+		else if(m_mode == "XRF"){
+			send(QByteArray("LOOPBACK\x00", 9), c->address, c->port);
+		}
+		else if(m_mode == "IAX"){
+			send_iax(c, AST_FRAME_IAX, IAX_COMMAND_PING);
+		}
+	}
+}
+
+void LoopbackReflector::inject_next()
+{
+	if(m_injectidx >= m_inject.size()){
+		m_injectidx = 0;
+		m_injectbase = m_injectclock.nsecsElapsed() / 1000;
+	}
+
+	const PacketCapture::RECORD &r = m_inject[m_injectidx];
+	const quint64 due = m_injectbase + (r.usec - m_inject.first().usec) / m_injectspeed;
+	const quint64 now = m_injectclock.nsecsElapsed() / 1000;
+
+	if(now >= due){
+		relay(r.data, nullptr);
+		m_stats.injected++;
+		m_injectidx++;
+		m_inject_timer->start(0);
+	}
+	else{
+		m_inject_timer->start((due - now) / 1000);
+	}
+}
@@ -0,0 +1,118 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LOOPBACKREFLECTOR_H
+#define LOOPBACKREFLECTOR_H
+
+#include <QObject>
+#include <QtNetwork>
+#include <QRandomGenerator>
+#include "packetcapture.h"
+
+// Minimal stand-in for an M17/YSF/FCS/DMR/P25/NXDN/REF/XRF/DCS reflector or IAX2 node.
+// It answers the handshakes the matching Mode expects and relays voice frames between
+// linked clients (including back to the sender when echo is set), or injects the
+// stream frames from a packet capture. Everything it sends can be dropped, delayed
+// and reordered to reproduce bad links.
+class LoopbackReflector : public QObject
+{
+	Q_OBJECT
+public:
+	LoopbackReflector(QString mode, quint16 port, QObject *parent = nullptr);
+	~LoopbackReflector();
+	bool start(QHostAddress address = QHostAddress::LocalHost);
+	void set_password(QString p) { m_password = p; }
+	void set_echo(bool e) { m_echo = e; }
+	void set_loss(int pct) { m_loss = pct; }
+	void set_jitter(int ms) { m_jitter = ms; }
+	void set_reorder(int pct) { m_reorder = pct; }
+	void set_seed(quint32 s) { m_rng.seed(s); }
+	bool set_inject(QString capture, int speed);
+	quint16 port() { return m_port; }
+	struct STATS {
+		quint32 rx;
+		quint32 tx;
+		quint32 relayed;
+		quint32 injected;
+		quint32 dropped;
+		quint32 reordered;
+		quint32 clients;
+	};
+	STATS stats() { m_stats.clients = m_clients.size(); return m_stats; }
+signals:
+	void client_linked(QString client, qint64 ms);
+	void client_unlinked(QString client);
+private slots:
+	void process_udp();
+	void send_ping();
+	void inject_next();
+private:
+	struct CLIENT {
+		QHostAddress address;
+		quint16 port;
+		qint64 ts;
+		bool linked;
+		QByteArray salt;
+		QByteArray challenge;
+		uint16_t callno;
+		uint16_t peer;
+		uint8_t iseq;
+		uint8_t oseq;
+	};
+	QString m_mode;
+	QUdpSocket *m_udp;
+	quint16 m_port;
+	QString m_password;
+	bool m_echo;
+	int m_loss;
+	int m_jitter;
+	int m_reorder;
+	QRandomGenerator m_rng;
+	QTimer *m_ping_timer;
+	QTimer *m_inject_timer;
+	QList<CLIENT> m_clients;
+	QList<PacketCapture::RECORD> m_inject;
+	int m_injectidx;
+	int m_injectspeed;
+	QElapsedTimer m_injectclock;
+	quint64 m_injectbase;
+	QByteArray m_held;
+	QHostAddress m_heldaddr;
+	quint16 m_heldport;
+	STATS m_stats;
+
+	CLIENT * find_client(const QHostAddress &a, quint16 p, bool create);
+	void link(CLIENT *c);
+	void unlink(const QHostAddress &a, quint16 p);
+	void send(const QByteArray &d, const QHostAddress &a, quint16 p);
+	void relay(const QByteArray &d, CLIENT *from);
+	bool is_stream(const QByteArray &d);
+	void process_m17(const QByteArray &buf, CLIENT *c);
+	void process_ysf(const QByteArray &buf, CLIENT *c);
+	void process_fcs(const QByteArray &buf, CLIENT *c);
+	void process_dmr(const QByteArray &buf, CLIENT *c);
+	void process_p25(const QByteArray &buf, CLIENT *c);
+	void process_nxdn(const QByteArray &buf, CLIENT *c);
+	void process_ref(const QByteArray &buf, CLIENT *c);
+	void process_xrf(const QByteArray &buf, CLIENT *c);
+	void process_dcs(const QByteArray &buf, CLIENT *c);
+	void process_iax(const QByteArray &buf, CLIENT *c);
+	void send_iax(CLIENT *c, uint8_t type, uint8_t subclass, const QByteArray &ies = QByteArray());
+	QByteArray iax_ie(const QByteArray &buf, uint8_t ie);
+};
+
+#endif // LOOPBACKREFLECTOR_H
@@ -20,11 +20,14 @@
 #include <iostream>
 #include "MMDVMDefines.h"
 #include "m17.h"
+#include "hostresolver.h"
 #include "M17Defines.h"
 #include "M17Convolution.h"
 #include "Golay24128.h"
+#include "packettrace.h"
 
 #define M17CHARACTERS " ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-/."
+#define M17_RACE_MS 250
 
 const uint8_t SCRAMBLER[] = {
 	0x00U, 0x00U, 0xD6U, 0xB5U, 0xE2U, 0x30U, 0x82U, 0xFFU, 0x84U, 0x62U, 0xBAU, 0x4EU, 0x96U, 0x90U, 0xD8U, 0x98U, 0xDDU,
@@ -83,8 +86,18 @@ const uint8_t BIT_MASK_TABLE[] = {0x80U, 0x40U, 0x20U, 0x10U, 0x08U, 0x04U, 0x02
 
 M17::M17() :
 	m_c2(NULL),
-	m_txrate(1)
+	m_txrate(1),
+	m_txstreamid(0),
+	m_txframecnt(0),
+	m_rfstreamid(0),
+	m_rfvalidlsf(false),
+	m_modemlsfcnt(0),
+	m_attempts(0),
+	m_racetimer(nullptr)
 {
+	::memset(m_rflsf, 0, sizeof(m_rflsf));
+	::memset(m_rflsfchunks, 0, sizeof(m_rflsfchunks));
+	::memset(m_modemlsf, 0, sizeof(m_modemlsf));
 #ifdef Q_OS_WIN
 	m_txtimerint = 30; // Qt timers on windows seem to be slower than desired value
 
@@ -97,6 +110,14 @@ M17::M17() :
 
 M17::~M17()
 {
+#ifndef USE_EXTERNAL_CODEC2
+	if(m_media){
+		m_media->give_codec2(m_c2);
+	}
+	else{
+		delete m_c2;
+	}
+#endif
 }
 
 void M17::encode_callsign(uint8_t *callsign)
@@ -205,26 +226,33 @@ void M17::process_udp()
 	QHostAddress sender;
 	quint16 senderPort;
 
-	buf.resize(m_udp->pendingDatagramSize());
-	m_udp->readDatagram(buf.data(), buf.size(), &sender, &senderPort);
-
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "RECV:";
-        for(int i = 0; i < buf.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)buf.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+	read_datagram(buf, &sender, &senderPort);
+
+    trace("RECV", buf);
 	if((m_modeinfo.status != CONNECTED_RW) && (buf.size() == 4) && (::memcmp(buf.data(), "NACK", 4U) == 0)){
 		m_modeinfo.status = DISCONNECTED;
 	}
 	if((buf.size() == 4) && (::memcmp(buf.data(), "ACKN", 4U) == 0)){
 		if(m_modeinfo.status == CONNECTING){
+			if(m_racetimer){
+				m_racetimer->stop();
+			}
+			for(int i = 0; i < m_attempts; ++i){
+				if(m_candidates.at(i).isEqual(sender, QHostAddress::ConvertV4MappedToIPv4)){
+					m_address = m_candidates.at(i);
+				}
+			}
+			for(int i = 0; i < m_attempts; ++i){
+				if(m_candidates.at(i) != m_address){
+					send_disc(m_candidates.at(i));
+				}
+			}
+			if(m_candidates.size() > 1){
+				qDebug() << "M17: connected via" << m_address.toString() << "after" << m_attempts << "attempts";
+			}
 			m_modeinfo.status = CONNECTED_RW;
 #ifndef USE_EXTERNAL_CODEC2
-			m_c2 = new CCodec2(true);
+			m_c2 = m_media ? m_media->take_codec2() : new CCodec2(true);
 #endif
 			m_txtimer = new QTimer();
 			connect(m_txtimer, SIGNAL(timeout()), this, SLOT(transmit()));
@@ -233,8 +261,7 @@ void M17::process_udp()
 			m_ping_timer = new QTimer();
 			connect(m_ping_timer, SIGNAL(timeout()), this, SLOT(send_ping()));
 			m_ping_timer->start(8000);
-			m_audio = new AudioEngine(m_audioin, m_audioout);
-			m_audio->init();
+			m_audio = open_audio();
 			m_modeinfo.sw_vocoder_loaded = true;
 		}
 		emit update(m_modeinfo);
@@ -331,36 +358,60 @@ void M17::process_udp()
 	//emit update(m_modeinfo);
 }
 
+// With more than one address, IPv6 and IPv4 alternated when IPv6 is enabled, a CONN goes
+// to the next every M17_RACE_MS until one answers (RFC 8305). The first to send ACKN is
+// kept and the others are sent DISC.
 void M17::hostname_lookup(QHostInfo i)
 {
 	if (!i.addresses().isEmpty()) {
-		QByteArray out;
 		uint8_t cs[10];
 		memset(cs, ' ', 9);
 		memcpy(cs, m_modeinfo.callsign.toLocal8Bit(), m_modeinfo.callsign.size());
 		cs[8] = 'D';
 		cs[9] = 0x00;
 		M17::encode_callsign(cs);
-		out.append('C');
-		out.append('O');
-		out.append('N');
-		out.append('N');
-		out.append((char *)cs, 6);
-		out.append(m_module);
-		m_address = i.addresses().first();
+		m_conn.clear();
+		m_conn.append('C');
+		m_conn.append('O');
+		m_conn.append('N');
+		m_conn.append('N');
+		m_conn.append((char *)cs, 6);
+		m_conn.append(m_module);
+
+		m_candidates.clear();
+		for(const QHostAddress &a : HostResolver::interleave(i.addresses())){
+			if(m_ipv6 || (a.protocol() != QAbstractSocket::IPv6Protocol)){
+				m_candidates.append(a);
+			}
+		}
+		if(m_candidates.isEmpty()){
+			m_candidates = i.addresses();
+		}
+		m_attempts = 0;
+		m_address = m_candidates.first();
 		m_udp = new QUdpSocket(this);
 		connect(m_udp, SIGNAL(readyRead()), this, SLOT(process_udp()));
-		m_udp->writeDatagram(out, m_address, m_modeinfo.port);
-
-        if(m_debug){
-            QDebug debug = qDebug();
-            debug.noquote();
-            QString s = "CONN:";
-            for(int i = 0; i < out.size(); ++i){
-                s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-            }
-            debug << s;
-        }
+		race_next();
+	}
+}
+
+void M17::race_next()
+{
+	if((m_modeinfo.status != CONNECTING) || (m_attempts >= m_candidates.size())){
+		return;
+	}
+	const QHostAddress a = m_candidates.at(m_attempts++);
+	write_datagram(m_conn, a, m_modeinfo.port);
+	qDebug() << "M17: CONN to" << a.toString();
+
+	trace("CONN", m_conn);
+	if(m_attempts < m_candidates.size()){
+		if(m_racetimer == nullptr){
+			m_racetimer = new QTimer(this);
+			m_racetimer->setSingleShot(true);
+			connect(m_racetimer, SIGNAL(timeout()), this, SLOT(race_next()));
+		}
+		m_racetimer->start(M17_RACE_MS);
 	}
 }
 
@@ -377,14 +428,13 @@ void M17::mmdvm_direct_connect()
 	}
 
 #ifndef USE_EXTERNAL_CODEC2
-	m_c2 = new CCodec2(true);
+	m_c2 = m_media ? m_media->take_codec2() : new CCodec2(true);
 #endif
 	m_txtimer = new QTimer();
 	connect(m_txtimer, SIGNAL(timeout()), this, SLOT(transmit()));
 	m_rxtimer = new QTimer();
 	connect(m_rxtimer, SIGNAL(timeout()), this, SLOT(process_rx_data()));
-	m_audio = new AudioEngine(m_audioin, m_audioout);
-	m_audio->init();
+	m_audio = open_audio();
 	emit update(m_modeinfo);
 }
 
@@ -402,27 +452,9 @@ void M17::send_ping()
 	out.append('N');
 	out.append('G');
 	out.append((char *)cs, 6);
-	m_udp->writeDatagram(out, m_address, m_modeinfo.port);
-
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "PING:";
-        for(int i = 0; i < out.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+	write_datagram(out, m_address, m_modeinfo.port);
 
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "PING:";
-        for(int i = 0; i < out.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+    trace("PING", out);
 }
 
 void M17::send_disconnect()
@@ -432,6 +464,11 @@ void M17::send_disconnect()
 	}
 
 	qDebug() << "send_disconnect()";
+	send_disc(m_address);
+}
+
+void M17::send_disc(const QHostAddress &a)
+{
 	QByteArray out;
 	uint8_t cs[10];
 	memset(cs, ' ', 9);
@@ -444,32 +481,22 @@ void M17::send_disconnect()
 	out.append('S');
 	out.append('C');
 	out.append((char *)cs, 6);
-	m_udp->writeDatagram(out, m_address, m_modeinfo.port);
-
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "SEND:";
-        for(int i = 0; i < out.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+	write_datagram(out, a, m_modeinfo.port);
+
+    trace("SEND", out);
 }
 
 void M17::send_modem_data(QByteArray d)
 {
 	CM17Convolution conv;
-	static uint8_t lsf[M17_LSF_LENGTH_BYTES];
-	static uint8_t lsfcnt = 0;
 	uint8_t txframe[M17_FRAME_LENGTH_BYTES];
 	uint8_t tmp[M17_FRAME_LENGTH_BYTES];
 
 	if(m_modeinfo.stream_state == STREAM_NEW){
-		::memcpy(lsf, &d.data()[6], M17_LSF_LENGTH_BYTES);
-		encodeCRC16(lsf, M17_LSF_LENGTH_BYTES);
+		::memcpy(m_modemlsf, &d.data()[6], M17_LSF_LENGTH_BYTES);
+		encodeCRC16(m_modemlsf, M17_LSF_LENGTH_BYTES);
 		::memcpy(txframe, M17_LINK_SETUP_SYNC_BYTES, 2);
-		conv.encodeLinkSetup(lsf, txframe + M17_SYNC_LENGTH_BYTES);
+		conv.encodeLinkSetup(m_modemlsf, txframe + M17_SYNC_LENGTH_BYTES);
 		interleave(txframe, tmp);
 		decorrelate(tmp, txframe);
 
@@ -485,16 +512,16 @@ void M17::send_modem_data(QByteArray d)
 		//}
 	}
 
-	if(lsfcnt == 0){
-		::memcpy(lsf, &d.data()[6], M17_LSF_LENGTH_BYTES);
+	if(m_modemlsfcnt == 0){
+		::memcpy(m_modemlsf, &d.data()[6], M17_LSF_LENGTH_BYTES);
 	}
 
 	::memcpy(txframe, M17_STREAM_SYNC_BYTES, 2);
 
 	uint8_t lich[M17_LICH_FRAGMENT_LENGTH_BYTES];
-	encodeCRC16(lsf, M17_LSF_LENGTH_BYTES);
-	::memcpy(lich, lsf + (lsfcnt * M17_LSF_FRAGMENT_LENGTH_BYTES), M17_LSF_FRAGMENT_LENGTH_BYTES);
-	lich[5U] = (lsfcnt & 0x07U) << 5;
+	encodeCRC16(m_modemlsf, M17_LSF_LENGTH_BYTES);
+	::memcpy(lich, m_modemlsf + (m_modemlsfcnt * M17_LSF_FRAGMENT_LENGTH_BYTES), M17_LSF_FRAGMENT_LENGTH_BYTES);
+	lich[5U] = (m_modemlsfcnt & 0x07U) << 5;
 
 	uint32_t frag1, frag2, frag3, frag4;
 	splitFragmentLICH(lich, frag1, frag2, frag3, frag4);
@@ -516,18 +543,14 @@ void M17::send_modem_data(QByteArray d)
 	for(uint32_t i = 0; i < M17_FRAME_LENGTH_BYTES; ++i){
 		m_rxmodemq.append(txframe[i]);
 	}
-	lsfcnt++;
-	if (lsfcnt >= 6U)
-		lsfcnt = 0U;
+	m_modemlsfcnt++;
+	if (m_modemlsfcnt >= 6U)
+		m_modemlsfcnt = 0U;
 }
 
 void M17::process_modem_data(QByteArray d)
 {
 	QByteArray txframe;
-	static uint16_t txstreamid = 0;
-	static uint8_t lsf[M17_LSF_LENGTH_BYTES] = {0};
-	static uint8_t lsfchunks[M17_LSF_LENGTH_BYTES] = {0};
-	static bool validlsf = false;
 	CM17Convolution conv;
 	uint8_t tmp[M17_FRAME_LENGTH_BYTES];
 
@@ -556,31 +579,31 @@ void M17::process_modem_data(QByteArray d)
 	}
 
 	if((d.data()[2] == MMDVM_M17_LOST) || (d.data()[2] == MMDVM_M17_EOT)){
-		txstreamid = 0;
+		m_rfstreamid = 0;
         if(m_mdirect){
 			m_modeinfo.streamid = 0;
 			m_modeinfo.dst.clear();
 			m_modeinfo.src.clear();
 			m_modeinfo.stream_state = STREAM_END;
-			::memset(lsf, 0, M17_LSF_LENGTH_BYTES);
-			::memset(lsfchunks, 0, M17_LSF_LENGTH_BYTES);
-			validlsf = false;
+			::memset(m_rflsf, 0, M17_LSF_LENGTH_BYTES);
+			::memset(m_rflsfchunks, 0, M17_LSF_LENGTH_BYTES);
+			m_rfvalidlsf = false;
 		}
 		qDebug() << "End of M17 stream";
 	}
 	else if(d.data()[2] == MMDVM_M17_LINK_SETUP){
-		::memset(lsf, 0x00U, M17_LSF_LENGTH_BYTES);
-		uint32_t  ber = conv.decodeLinkSetup(p + M17_SYNC_LENGTH_BYTES, lsf);
-		validlsf = checkCRC16(lsf, M17_LSF_LENGTH_BYTES);
-		txstreamid = static_cast<uint16_t>((::rand() & 0xFFFF));
-		qDebug() << "M17 LSF received valid == " << validlsf << "ber: " << ber;
+		::memset(m_rflsf, 0x00U, M17_LSF_LENGTH_BYTES);
+		uint32_t  ber = conv.decodeLinkSetup(p + M17_SYNC_LENGTH_BYTES, m_rflsf);
+		m_rfvalidlsf = checkCRC16(m_rflsf, M17_LSF_LENGTH_BYTES);
+		m_rfstreamid = static_cast<uint16_t>((::rand() & 0xFFFF));
+		qDebug() << "M17 LSF received valid == " << m_rfvalidlsf << "ber: " << ber;
 
-        if(validlsf && m_mdirect){
+        if(m_rfvalidlsf && m_mdirect){
 			uint8_t cs[10];
-			::memcpy(cs, lsf, 6);
+			::memcpy(cs, m_rflsf, 6);
 			decode_callsign(cs);
 			m_modeinfo.dst = QString((char *)cs);
-			::memcpy(cs, lsf+6, 6);
+			::memcpy(cs, m_rflsf+6, 6);
 			decode_callsign(cs);
 			m_modeinfo.src = QString((char *)cs);
 		}
@@ -591,7 +614,7 @@ void M17::process_modem_data(QByteArray d)
 		uint16_t fn = (frame[0U] << 8) + (frame[1U] << 0);
 
 		uint8_t netframe[M17_LSF_LENGTH_BYTES + M17_FN_LENGTH_BYTES + M17_PAYLOAD_LENGTH_BYTES + M17_CRC_LENGTH_BYTES];
-		::memcpy(netframe, lsf, M17_LSF_LENGTH_BYTES);
+		::memcpy(netframe, m_rflsf, M17_LSF_LENGTH_BYTES);
 		::memcpy(netframe + M17_LSF_LENGTH_BYTES - M17_CRC_LENGTH_BYTES, frame, M17_FN_LENGTH_BYTES + M17_PAYLOAD_LENGTH_BYTES);
 		netframe[M17_LSF_LENGTH_BYTES - M17_CRC_LENGTH_BYTES + 0U] &= 0x7FU;
 
@@ -606,17 +629,17 @@ void M17::process_modem_data(QByteArray d)
 			combineFragmentLICH(lich1, lich2, lich3, lich4, lich);
 
 			uint32_t n = (lich4 >> 5) & 0x07U;
-			::memcpy(lsfchunks + (n * M17_LSF_FRAGMENT_LENGTH_BYTES), lich, M17_LSF_FRAGMENT_LENGTH_BYTES);
+			::memcpy(m_rflsfchunks + (n * M17_LSF_FRAGMENT_LENGTH_BYTES), lich, M17_LSF_FRAGMENT_LENGTH_BYTES);
 
-			bool valid = checkCRC16(lsfchunks, M17_LSF_LENGTH_BYTES);
+			bool valid = checkCRC16(m_rflsfchunks, M17_LSF_LENGTH_BYTES);
 			qDebug() << "lich valid == " << valid << " lich n == " << n;
 			if (valid) {
-				::memcpy(lsf, lsfchunks, M17_LSF_LENGTH_BYTES);
-				::memset(lsfchunks, 0, M17_LSF_LENGTH_BYTES);
-				validlsf = valid;
+				::memcpy(m_rflsf, m_rflsfchunks, M17_LSF_LENGTH_BYTES);
+				::memset(m_rflsfchunks, 0, M17_LSF_LENGTH_BYTES);
+				m_rfvalidlsf = valid;
 			}
 
-			if(!validlsf){
+			if(!m_rfvalidlsf){
 				qDebug() << "No LSF yet...";
 				return;
 			}
@@ -624,20 +647,20 @@ void M17::process_modem_data(QByteArray d)
 
         if(m_mdirect){
 			if( !m_tx && (m_modeinfo.streamid == 0) ){
-				if(txstreamid == 0){
+				if(m_rfstreamid == 0){
 					qDebug() << "No header, late entry...";
 					uint8_t cs[10];
-					::memcpy(cs, lsf, 6);
+					::memcpy(cs, m_rflsf, 6);
 					decode_callsign(cs);
 					m_modeinfo.dst = QString((char *)cs);
-					::memcpy(cs, lsf+6, 6);
+					::memcpy(cs, m_rflsf+6, 6);
 					decode_callsign(cs);
 					m_modeinfo.src = QString((char *)cs);
-					txstreamid = static_cast<uint16_t>((::rand() & 0xFFFF));
+					m_rfstreamid = static_cast<uint16_t>((::rand() & 0xFFFF));
 				}
 
 				m_modeinfo.stream_state = STREAM_NEW;
-				m_modeinfo.streamid = txstreamid;
+				m_modeinfo.streamid = m_rfstreamid;
 				m_modeinfo.ts = QDateTime::currentMSecsSinceEpoch();
 				qDebug() << "New RF stream from " << m_modeinfo.src << " to " << m_modeinfo.dst << " id == " << QString::number(m_modeinfo.streamid, 16) << "FN == " << fn << " ber == " << ber;
 
@@ -683,9 +706,9 @@ void M17::process_modem_data(QByteArray d)
 			emit update(m_modeinfo);
 		}
 		else{
-			if(txstreamid == 0){
+			if(m_rfstreamid == 0){
 				qDebug() << "No header for netframe";
-				txstreamid = static_cast<uint16_t>((::rand() & 0xFFFF));
+				m_rfstreamid = static_cast<uint16_t>((::rand() & 0xFFFF));
 			}
 
 			uint8_t dst[10];
@@ -699,8 +722,8 @@ void M17::process_modem_data(QByteArray d)
 			txframe.append('1');
 			txframe.append('7');
 			txframe.append(' ');
-			txframe.append(txstreamid >> 8);
-			txframe.append(txstreamid & 0xff);
+			txframe.append(m_rfstreamid >> 8);
+			txframe.append(m_rfstreamid & 0xff);
 			txframe.append((char *)dst, 6);
 			//txframe.append((char *)src, 6);
 			txframe.append((char *)&netframe[6], 6);
@@ -711,17 +734,9 @@ void M17::process_modem_data(QByteArray d)
 			txframe.append((char)netframe[29] & 0xff);
 			txframe.append((char *)&netframe[30], 16);
 			txframe.append(2, 0x00);
-			m_udp->writeDatagram(txframe, m_address, m_modeinfo.port);
-
-            if(m_debug){
-                QDebug debug = qDebug();
-                debug.noquote();
-                QString s = "SEND:";
-                for(int i = 0; i < txframe.size(); ++i){
-                    s += " " + QString("%1").arg((uint8_t)txframe.data()[i], 2, 16, QChar('0'));
-                }
-                debug << s;
-            }
+			write_datagram(txframe, m_address, m_modeinfo.port);
+
+            trace("SEND", txframe);
 		}
 	}
 }
@@ -739,24 +754,31 @@ void M17::start_tx()
 	Mode::start_tx();
 }
 
+// The relayed stream is sent at the rate it arrives in
+void M17::relay_tx(int codec, QByteArray frame)
+{
+	if(!m_tx){
+		m_txtimerint = 38;
+		set_mode(codec == CODEC_CODEC2_3200);
+	}
+	Mode::relay_tx(codec, frame);
+}
+
 void M17::transmit()
 {
 	QByteArray txframe;
-	static uint16_t txstreamid = 0;
-	static uint16_t tx_cnt = 0;
 	int16_t pcm[320];
 	uint8_t c2[16];
 #ifdef USE_FLITE
-	static uint16_t ttscnt = 0;
 	if(m_ttsid > 0){
 		for(int i = 0; i < 320; ++i){
-			if(ttscnt >= tts_audio->num_samples/2){
+			if(m_ttscnt >= tts_audio->num_samples/2){
 				//audiotx_cnt = 0;
 				pcm[i] = 0;
 			}
 			else{
-				pcm[i] = tts_audio->samples[ttscnt*2] / 8;
-				ttscnt++;
+				pcm[i] = tts_audio->samples[m_ttscnt*2] / 8;
+				m_ttscnt++;
 			}
 		}
 
@@ -767,7 +789,16 @@ void M17::transmit()
 		}
 	}
 #endif
-	if(m_ttsid == 0){
+	if(m_relaytx){
+		const int n = get_mode() ? 16 : 8;
+		if(m_tx && (m_txcodecq.size() < n)){
+			return;
+		}
+		for(int i = 0; (i < n) && !m_txcodecq.isEmpty(); ++i){
+			c2[i] = m_txcodecq.dequeue();
+		}
+	}
+	else if(m_ttsid == 0){
 		if(m_audio->read(pcm, 320)){
 			encode_c2(pcm, c2);
 			if(get_mode()){
@@ -784,8 +815,8 @@ void M17::transmit()
 	int r = get_mode() ? 0x05 : 0x07;
 
 	if(m_tx){
-		if(txstreamid == 0){
-		   txstreamid = static_cast<uint16_t>((::rand() & 0xFFFF));
+		if(m_txstreamid == 0){
+		   m_txstreamid = static_cast<uint16_t>((::rand() & 0xFFFF));
            if(!m_rxtimer->isActive() && m_mdirect){
 			   m_rxmodemq.clear();
 			   m_modeinfo.stream_state = STREAM_NEW;
@@ -813,7 +844,7 @@ void M17::transmit()
 		dst[9] = 0x00;
 		encode_callsign(dst);
 		memset(src, ' ', 9);
-		memcpy(src, m_modeinfo.callsign.toLocal8Bit(), m_modeinfo.callsign.size());
+		memcpy(src, relay_callsign(m_modeinfo.callsign).left(8).toLocal8Bit(), relay_callsign(m_modeinfo.callsign).left(8).size());
 		src[8] = 'D';
 		src[9] = 0x00;
 		encode_callsign(src);
@@ -822,15 +853,15 @@ void M17::transmit()
 		txframe.append('1');
 		txframe.append('7');
 		txframe.append(' ');
-		txframe.append(txstreamid >> 8);
-		txframe.append(txstreamid & 0xff);
+		txframe.append(m_txstreamid >> 8);
+		txframe.append(m_txstreamid & 0xff);
 		txframe.append((char *)dst, 6);
 		txframe.append((char *)src, 6);
 		txframe.append(m_txcan >> 1);
 		txframe.append(((m_txcan << 7) & 0x80U) | r);
 		txframe.append(14, 0x00); //Blank nonce
-		txframe.append((char)(tx_cnt >> 8));
-		txframe.append((char)tx_cnt & 0xff);
+		txframe.append((char)(m_txframecnt >> 8));
+		txframe.append((char)m_txframecnt & 0xff);
 		txframe.append((char *)c2, 16);
 
 		for(int i = 0; i < 28; ++i){
@@ -846,27 +877,19 @@ void M17::transmit()
 			m_rxwatchdog = 0;
 		}
 		else{
-			m_udp->writeDatagram(txframe, m_address, m_modeinfo.port);
+			write_datagram(txframe, m_address, m_modeinfo.port);
 		}
 
-		++tx_cnt;
+		++m_txframecnt;
 		m_modeinfo.src = m_modeinfo.callsign;
 		m_modeinfo.dst = m_refname;
         m_modeinfo.module = m_module;
 		m_modeinfo.type = get_mode();
-		m_modeinfo.frame_number = tx_cnt;
-		m_modeinfo.streamid = txstreamid;
+		m_modeinfo.frame_number = m_txframecnt;
+		m_modeinfo.streamid = m_txstreamid;
 		emit update(m_modeinfo);
 
-        if(m_debug){
-            QDebug debug = qDebug();
-            debug.noquote();
-            QString s = "SEND:";
-            for(int i = 0; i < txframe.size(); ++i){
-                s += " " + QString("%1").arg((uint8_t)txframe.data()[i], 2, 16, QChar('0'));
-            }
-            debug << s;
-        }
+        trace("SEND", txframe);
 	}
 	else{
 		const uint8_t quiet3200[] = { 0x00, 0x01, 0x43, 0x09, 0xe4, 0x9c, 0x08, 0x21 };
@@ -880,25 +903,25 @@ void M17::transmit()
 		dst[9] = 0x00;
 		encode_callsign(dst);
 		memset(src, ' ', 9);
-		memcpy(src, m_modeinfo.callsign.toLocal8Bit(), m_modeinfo.callsign.size());
+		memcpy(src, relay_callsign(m_modeinfo.callsign).left(8).toLocal8Bit(), relay_callsign(m_modeinfo.callsign).left(8).size());
 		src[8] = 'D';
 		src[9] = 0x00;
 		M17::encode_callsign(src);
-		tx_cnt |= 0x8000u;
+		m_txframecnt |= 0x8000u;
 
 		txframe.append('M');
 		txframe.append('1');
 		txframe.append('7');
 		txframe.append(' ');
-		txframe.append(txstreamid >> 8);
-		txframe.append(txstreamid & 0xff);
+		txframe.append(m_txstreamid >> 8);
+		txframe.append(m_txstreamid & 0xff);
 		txframe.append((char *)dst, 6);
 		txframe.append((char *)src, 6);
         txframe.append(m_txcan >> 1);
         txframe.append(((m_txcan << 7) & 0x80U) | r);
 		txframe.append(14, 0x00); //Blank nonce
-		txframe.append((char)(tx_cnt >> 8));
-		txframe.append((char)tx_cnt & 0xff);
+		txframe.append((char)(m_txframecnt >> 8));
+		txframe.append((char)m_txframecnt & 0xff);
 		txframe.append((char *)quiet, 8);
 		txframe.append((char *)quiet, 8);
 		txframe.append(2, 0x00);
@@ -908,33 +931,25 @@ void M17::transmit()
 			m_modeinfo.stream_state = STREAM_END;
 		}
 		else{
-			m_udp->writeDatagram(txframe, m_address, m_modeinfo.port);
+			write_datagram(txframe, m_address, m_modeinfo.port);
 		}
-		txstreamid = 0;
-		tx_cnt = 0;
+		m_txstreamid = 0;
+		m_txframecnt = 0;
 #ifdef USE_FLITE
-		ttscnt = 0;
+		m_ttscnt = 0;
 #endif
 		m_txtimer->stop();
-		if(m_ttsid == 0){
+		if((m_ttsid == 0) && !m_relaytx){
 			m_audio->stop_capture();
 		}
 		m_modeinfo.src = m_modeinfo.callsign;
 		m_modeinfo.dst = m_refname;
 		m_modeinfo.type = get_mode();
-		m_modeinfo.frame_number = tx_cnt;
-		m_modeinfo.streamid = txstreamid;
+		m_modeinfo.frame_number = m_txframecnt;
+		m_modeinfo.streamid = m_txstreamid;
 		emit update(m_modeinfo);
 
-        if(m_debug){
-            QDebug debug = qDebug();
-            debug.noquote();
-            QString s = "LAST:";
-            for(int i = 0; i < txframe.size(); ++i){
-                s += " " + QString("%1").arg((uint8_t)txframe.data()[i], 2, 16, QChar('0'));
-            }
-            debug << s;
-        }
+        trace("LAST", txframe);
 	}
 }
 
@@ -974,7 +989,7 @@ void M17::tx_packet(QString sms)
     txframe.append(1, 0x00);
     txframe.append(lsf[28]);
     txframe.append(lsf[29]);
-    m_udp->writeDatagram(txframe, m_address, m_modeinfo.port);
+    write_datagram(txframe, m_address, m_modeinfo.port);
 
     m_modeinfo.stream_state = PACKET_SENT;
     m_modeinfo.src = m_modeinfo.callsign;
@@ -984,50 +999,34 @@ void M17::tx_packet(QString sms)
     m_modeinfo.usertxt = sms;
     emit update(m_modeinfo);
 
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "PACK:";
-        for(int i = 0; i < txframe.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)txframe.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+    trace("PACK", txframe);
 }
 
 void M17::process_rx_data()
 {
 	int16_t pcm[320];
 	uint8_t codec2[8];
-	static uint8_t cnt = 0;
 
 	if(m_rxwatchdog++ > 50){
 		qDebug() << "RX stream timeout ";
 		m_rxwatchdog = 0;
 		m_modeinfo.stream_state = STREAM_LOST;
+		PacketTrace::trigger(m_mode + " RX stream timeout");
 		m_modeinfo.ts = QDateTime::currentMSecsSinceEpoch();
 		emit update(m_modeinfo);
 		m_modeinfo.streamid = 0;
 	}
 
-	if((m_rxmodemq.size() > 2) && (++cnt >= 2)){
-		QByteArray out;
-		int s = m_rxmodemq[1];
-		if((m_rxmodemq[0] == MMDVM_FRAME_START) && (m_rxmodemq.size() >= s)){
-			for(int i = 0; i < s; ++i){
-				out.append(m_rxmodemq.dequeue());
-			}
-#if !defined(Q_OS_IOS)
-			m_modem->write(out);
-#endif
-		}
-		cnt = 0;
-	}
+	write_modem();
 
 	if((!m_tx) && (m_rxcodecq.size() > 7) ){
 		for(int i = 0; i < 8; ++i){
 			codec2[i] = m_rxcodecq.dequeue();
 		}
+		if(m_relayrx){
+			emit relay_rx(get_mode() ? CODEC_CODEC2_3200 : CODEC_CODEC2_1600, QByteArray((char *)codec2, 8));
+			return;
+		}
 		decode_c2(pcm, codec2);
 		int s = get_mode() ? 160 : 320;
 		m_audio->write(pcm, s);
@@ -1042,6 +1041,9 @@ void M17::process_rx_data()
 		m_rxmodemq.clear();
 		qDebug() << "M17 playback stopped";
 		m_modeinfo.stream_state = STREAM_IDLE;
+		if(m_relayrx){
+			emit relay_rx_end();
+		}
 		return;
 	}
 }
@@ -20,6 +20,7 @@
 
 #include <string>
 #include "mode.h"
+#include "M17Defines.h"
 #ifdef USE_EXTERNAL_CODEC2
 #include <codec2/codec2.h>
 #else
@@ -38,11 +39,14 @@ public:
 	void encode_c2(int16_t *, uint8_t *);
 	void set_mode(bool);
 	bool get_mode();
+	QList<int> relay_codecs() { return {CODEC_CODEC2_3200, CODEC_CODEC2_1600}; }
 #ifdef USE_EXTERNAL_CODEC2
 	CODEC2 *m_c2;
 #else
 	CCodec2 *m_c2;
 #endif
+public slots:
+	void relay_tx(int codec, QByteArray frame);
 private slots:
 	void process_udp();
 	void process_modem_data(QByteArray);
@@ -54,6 +58,7 @@ private slots:
 	void transmit();
     void tx_packet(QString);
     void hostname_lookup(QHostInfo);
+	void race_next();
 	void mmdvm_direct_connect();
 	void rate_changed(int r) { m_txrate = r; }
 	void can_changed(int c) { m_txcan = c; qDebug() << "CAN == " << c; }
@@ -69,6 +74,20 @@ private slots:
 private:
 	int m_txrate;
 	uint8_t m_txcan;
+	uint16_t m_txstreamid;
+	uint16_t m_txframecnt;
+	uint16_t m_rfstreamid;
+	uint8_t m_rflsf[M17_LSF_LENGTH_BYTES];
+	uint8_t m_rflsfchunks[M17_LSF_LENGTH_BYTES];
+	bool m_rfvalidlsf;
+	uint8_t m_modemlsf[M17_LSF_LENGTH_BYTES];
+	uint8_t m_modemlsfcnt;
+	QByteArray m_conn;
+	QList<QHostAddress> m_candidates;	// Addresses raced to connect, in order
+	int m_attempts;
+	QTimer *m_racetimer;
+
+	void send_disc(const QHostAddress &a);
 };
 
 #endif // M17_H
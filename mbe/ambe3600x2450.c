@@ -584,11 +584,16 @@ mbe_demodulateAmbe3600x2450Data (char ambe_fr[4][24])
     }
 }
 
-void
-mbe_processAmbe2450Dataf (float *aout_buf, int *errs2, char *err_str, char ambe_d[49], mbe_parms * cur_mp, mbe_parms * prev_mp, mbe_parms * prev_mp_enhanced, int uvquality)
+/*
+ * Everything of mbe_processAmbe2450Dataf() but the synthesis. Returns 1 when the caller
+ * must synthesize cur_mp against prev_mp_enhanced and then call
+ * mbe_moveMbeParms (cur_mp, prev_mp_enhanced), 0 when the frame is silence.
+ */
+int
+mbe_processAmbe2450Parms (int *errs2, char *err_str, char ambe_d[49], mbe_parms * cur_mp, mbe_parms * prev_mp, mbe_parms * prev_mp_enhanced)
 {
 
-  int i, bad;
+  int i, bad, synth = 0;
 
   for (i = 0; i < *errs2; i++)
     {
@@ -629,23 +634,36 @@ mbe_processAmbe2450Dataf (float *aout_buf, int *errs2, char *err_str, char ambe_
         {
           mbe_moveMbeParms (cur_mp, prev_mp);
           mbe_spectralAmpEnhance (cur_mp);
-          mbe_synthesizeSpeechf (aout_buf, cur_mp, prev_mp_enhanced, uvquality);
-          mbe_moveMbeParms (cur_mp, prev_mp_enhanced);
+          synth = 1;
         }
       else
         {
           *err_str = 'M';
           err_str++;
-          mbe_synthesizeSilencef (aout_buf);
           mbe_initMbeParms (cur_mp, prev_mp, prev_mp_enhanced);
         }
     }
   else
     {
-      mbe_synthesizeSilencef (aout_buf);
       mbe_initMbeParms (cur_mp, prev_mp, prev_mp_enhanced);
     }
   *err_str = 0;
+  return synth;
+}
+
+void
+mbe_processAmbe2450Dataf (float *aout_buf, int *errs2, char *err_str, char ambe_d[49], mbe_parms * cur_mp, mbe_parms * prev_mp, mbe_parms * prev_mp_enhanced, int uvquality)
+{
+
+  if (mbe_processAmbe2450Parms (errs2, err_str, ambe_d, cur_mp, prev_mp, prev_mp_enhanced))
+    {
+      mbe_synthesizeSpeechf (aout_buf, cur_mp, prev_mp_enhanced, uvquality);
+      mbe_moveMbeParms (cur_mp, prev_mp_enhanced);
+    }
+  else
+    {
+      mbe_synthesizeSilencef (aout_buf);
+    }
 }
 
 void
@@ -671,6 +689,20 @@ mbe_processAmbe3600x2450Framef (float *aout_buf, int *errs2, char *err_str, char
   mbe_processAmbe2450Dataf (aout_buf, errs2, err_str, ambe_d, cur_mp, prev_mp, prev_mp_enhanced, uvquality);
 }
 
+int
+mbe_processAmbe3600x2450Parms (int *errs2, char *err_str, char ambe_fr[4][24], char ambe_d[49], mbe_parms * cur_mp, mbe_parms * prev_mp, mbe_parms * prev_mp_enhanced)
+{
+
+  int errs = 0;
+  *errs2 = 0;
+  errs = mbe_eccAmbe3600x2450C0 (ambe_fr);
+  mbe_demodulateAmbe3600x2450Data (ambe_fr);
+  *errs2 = errs;
+  *errs2 += mbe_eccAmbe3600x2450Data (ambe_fr, ambe_d);
+
+  return mbe_processAmbe2450Parms (errs2, err_str, ambe_d, cur_mp, prev_mp, prev_mp_enhanced);
+}
+
 void
 mbe_processAmbe3600x2450Frame (short *aout_buf, int *errs2, char *err_str, char ambe_fr[4][24], char ambe_d[49], mbe_parms * cur_mp, mbe_parms * prev_mp, mbe_parms * prev_mp_enhanced, int uvquality)
 {
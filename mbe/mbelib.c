@@ -17,11 +17,18 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 
 #include "mbelib.h"
 #include "mbelib_const.h"
 
+#if defined(_MSC_VER)
+#define MBE_RESTRICT __restrict
+#else
+#define MBE_RESTRICT restrict
+#endif
+
 /**
  * \return A pseudo-random float between [0.0, 1.0].
  * See http://www.azillionmonkeys.com/qed/random.html for further improvements
@@ -41,6 +48,30 @@ mbe_rand_phase()
   return mbe_rand() * (((float)M_PI) * 2.0F) - ((float)M_PI);
 }
 
+/**
+ * \return The next state of the linear congruential generator in seed.
+ */
+static unsigned int
+mbe_lcg (unsigned int *seed)
+{
+  *seed = *seed * 1103515245U + 12345U;
+  return *seed;
+}
+
+/**
+ * \return A pseudo-random float between [-pi, +pi] from the generator in seed, or from
+ * rand() when seed is NULL.
+ */
+static float
+mbe_next_phase (unsigned int *seed)
+{
+  if (seed == NULL)
+    {
+      return mbe_rand_phase ();
+    }
+  return (float) (mbe_lcg (seed) >> 8) * ((((float) M_PI) * 2.0F) / (float) 16777216) - ((float) M_PI);
+}
+
 void
 mbe_printVersion (char *str)
 {
@@ -214,6 +245,67 @@ mbe_synthesizeSilence (short *aout_buf)
     }
 }
 
+/*
+ * Extends the shorter of the two frames with silent voiced bands (eq 128 and 129) and
+ * updates the phases of cur_mp (eq 139 and 140), the random part from seed as in
+ * mbe_next_phase(). Returns the number of bands to synthesize.
+ */
+static int
+mbe_updateBands (mbe_parms * cur_mp, mbe_parms * prev_mp, int N, unsigned int *seed)
+{
+
+  int l, maxl, numUv;
+  float cw0, pw0;
+
+  // count number of unvoiced bands
+  numUv = 0;
+  for (l = 1; l <= cur_mp->L; l++)
+    {
+      if (cur_mp->Vl[l] == 0)
+        {
+          numUv++;
+        }
+    }
+
+  cw0 = cur_mp->w0;
+  pw0 = prev_mp->w0;
+
+  // eq 128 and 129
+  if (cur_mp->L > prev_mp->L)
+    {
+      maxl = cur_mp->L;
+      for (l = prev_mp->L + 1; l <= maxl; l++)
+        {
+          prev_mp->Ml[l] = (float) 0;
+          prev_mp->Vl[l] = 1;
+        }
+    }
+  else
+    {
+      maxl = prev_mp->L;
+      for (l = cur_mp->L + 1; l <= maxl; l++)
+        {
+          cur_mp->Ml[l] = (float) 0;
+          cur_mp->Vl[l] = 1;
+        }
+    }
+
+  // update phil from eq 139,140
+  for (l = 1; l <= 56; l++)
+    {
+      cur_mp->PSIl[l] = prev_mp->PSIl[l] + ((pw0 + cw0) * ((float) (l * N) / (float) 2));
+      if (l <= (int) (cur_mp->L / 4))
+        {
+          cur_mp->PHIl[l] = cur_mp->PSIl[l];
+        }
+      else
+        {
+          cur_mp->PHIl[l] = cur_mp->PSIl[l] + ((numUv * mbe_next_phase (seed)) / cur_mp->L);
+        }
+    }
+  return maxl;
+}
+
 void
 mbe_synthesizeSpeechf (float *aout_buf, mbe_parms * cur_mp, mbe_parms * prev_mp, int uvquality)
 {
@@ -222,7 +314,6 @@ mbe_synthesizeSpeechf (float *aout_buf, mbe_parms * cur_mp, mbe_parms * prev_mp,
   float *Ss, loguvquality;
   float C1, C2, C3, C4;
   //float deltaphil, deltawl, thetaln, aln;
-  int numUv;
   float cw0, pw0, cw0l, pw0l;
   float uvsine, uvrand, uvthreshold, uvthresholdf;
   float uvstep, uvoffset;
@@ -259,16 +350,6 @@ mbe_synthesizeSpeechf (float *aout_buf, mbe_parms * cur_mp, mbe_parms * prev_mp,
   qfactor = loguvquality;
   uvoffset = (uvstep * (float) (uvquality - 1)) / (float) 2;
 
-  // count number of unvoiced bands
-  numUv = 0;
-  for (l = 1; l <= cur_mp->L; l++)
-    {
-      if (cur_mp->Vl[l] == 0)
-        {
-          numUv++;
-        }
-    }
-
   cw0 = cur_mp->w0;
   pw0 = prev_mp->w0;
 
@@ -280,39 +361,7 @@ mbe_synthesizeSpeechf (float *aout_buf, mbe_parms * cur_mp, mbe_parms * prev_mp,
       Ss++;
     }
 
-  // eq 128 and 129
-  if (cur_mp->L > prev_mp->L)
-    {
-      maxl = cur_mp->L;
-      for (l = prev_mp->L + 1; l <= maxl; l++)
-        {
-          prev_mp->Ml[l] = (float) 0;
-          prev_mp->Vl[l] = 1;
-        }
-    }
-  else
-    {
-      maxl = prev_mp->L;
-      for (l = cur_mp->L + 1; l <= maxl; l++)
-        {
-          cur_mp->Ml[l] = (float) 0;
-          cur_mp->Vl[l] = 1;
-        }
-    }
-
-  // update phil from eq 139,140
-  for (l = 1; l <= 56; l++)
-    {
-      cur_mp->PSIl[l] = prev_mp->PSIl[l] + ((pw0 + cw0) * ((float) (l * N) / (float) 2));
-      if (l <= (int) (cur_mp->L / 4))
-        {
-          cur_mp->PHIl[l] = cur_mp->PSIl[l];
-        }
-      else
-        {
-          cur_mp->PHIl[l] = cur_mp->PSIl[l] + ((numUv * mbe_rand_phase()) / cur_mp->L);
-        }
-    }
+  maxl = mbe_updateBands (cur_mp, prev_mp, N, NULL);
 
   for (l = 1; l <= maxl; l++)
     {
@@ -455,6 +504,244 @@ mbe_synthesizeSpeechf (float *aout_buf, mbe_parms * cur_mp, mbe_parms * prev_mp,
     }
 }
 
+/*
+ * Oscillator bank for mbe_synthesizeSpeechBatchf(), for one block of up to
+ * MBE_BATCH_CHANNELS channels. Slot s of channel c is at s * channels + c, so each step
+ * of the synthesis runs over the channels of the block with unit stride. The banks are
+ * sized for the most bands and for uvquality up to MBE_BATCH_UVQUALITY, and live on the
+ * stack.
+ */
+#define MBE_BATCH_CHANNELS	8
+#define MBE_BATCH_UVQUALITY	4
+#define MBE_BATCH_BANDS		56
+
+typedef struct
+{
+  int slots;
+  int used[MBE_BATCH_CHANNELS];
+  float re[MBE_BATCH_BANDS * MBE_BATCH_UVQUALITY * MBE_BATCH_CHANNELS];
+  float im[MBE_BATCH_BANDS * MBE_BATCH_UVQUALITY * MBE_BATCH_CHANNELS];
+  float cr[MBE_BATCH_BANDS * MBE_BATCH_UVQUALITY * MBE_BATCH_CHANNELS];
+  float ci[MBE_BATCH_BANDS * MBE_BATCH_UVQUALITY * MBE_BATCH_CHANNELS];
+  float amp[MBE_BATCH_BANDS * MBE_BATCH_UVQUALITY * MBE_BATCH_CHANNELS];
+} mbe_oscBank;
+
+typedef struct
+{
+  int slots;
+  int used[MBE_BATCH_CHANNELS];
+  unsigned int state[MBE_BATCH_BANDS * MBE_BATCH_CHANNELS];
+  float amp[MBE_BATCH_BANDS * MBE_BATCH_CHANNELS];
+} mbe_noiseBank;
+
+static void
+mbe_addOsc (mbe_oscBank * b, int channels, int c, float w, float phase, float amp)
+{
+
+  int k = b->used[c]++ * channels + c;
+
+  b->re[k] = cosf (phase);
+  b->im[k] = sinf (phase);
+  b->cr[k] = cosf (w);
+  b->ci[k] = sinf (w);
+  b->amp[k] = amp;
+}
+
+static void
+mbe_addNoise (mbe_noiseBank * b, int channels, int c, float amp, unsigned int *seed)
+{
+
+  int k = b->used[c]++ * channels + c;
+
+  b->state[k] = (mbe_lcg (seed) << 1) | 1;
+  b->amp[k] = amp;
+}
+
+/*
+ * A seed for the random phases and noise of one channel's frame, taken from its
+ * parameters so that it changes from frame to frame without any state shared between calls
+ */
+static unsigned int
+mbe_frameSeed (const mbe_parms * mp, int c)
+{
+
+  unsigned int seed;
+
+  memcpy (&seed, &mp->w0, sizeof (seed));
+  return seed ^ ((unsigned int) mp->L << 24) ^ ((unsigned int) c * 0x9E3779B9U);
+}
+
+static void
+mbe_synthesizeSpeechBlockf (float **aout_buf, mbe_parms ** cur_mp, mbe_parms ** prev_mp, int channels, int uvquality)
+{
+
+  int b, c, i, l, n, s, q, maxl[MBE_BATCH_CHANNELS];
+  unsigned int seed[MBE_BATCH_CHANNELS];
+  float loguvquality, uvsine, uvrand, uvthreshold, uvstep, uvoffset, qfactor, w0, M;
+  float acc[MBE_BATCH_CHANNELS];
+  mbe_oscBank osc;
+  mbe_noiseBank noise;
+  mbe_parms *mp;
+
+  const int N = 160;
+
+  uvthreshold = (((float) 2700 * M_PI) / (float) 4000);
+  uvsine = (float) 1.3591409 *M_E;
+  uvrand = (float) 2.0;
+  loguvquality = (uvquality == 1) ? (float) 1 / M_E : log ((float) uvquality) / (float) uvquality;
+  uvstep = (float) 1.0 / (float) uvquality;
+  qfactor = loguvquality;
+  uvoffset = (uvstep * (float) (uvquality - 1)) / (float) 2;
+
+  for (c = 0; c < channels; c++)
+    {
+      seed[c] = mbe_frameSeed (cur_mp[c], c);
+      maxl[c] = mbe_updateBands (cur_mp[c], prev_mp[c], N, &seed[c]);
+    }
+
+  // bank 0 is the previous frame, windowed by Ws[n + N], and bank 1 the current, by Ws[n]
+  for (b = 0; b < 2; b++)
+    {
+      osc.slots = 0;
+      noise.slots = 0;
+      for (c = 0; c < channels; c++)
+        {
+          int no = 0, nn = 0;
+          mp = b ? cur_mp[c] : prev_mp[c];
+          for (l = 1; l <= maxl[c]; l++)
+            {
+              no += mp->Vl[l] ? 1 : uvquality;
+              nn += mp->Vl[l] ? 0 : 1;
+            }
+          if (no > osc.slots)
+            {
+              osc.slots = no;
+            }
+          if (nn > noise.slots)
+            {
+              noise.slots = nn;
+            }
+          osc.used[c] = 0;
+          noise.used[c] = 0;
+        }
+      // slots a channel leaves unused are silent
+      memset (osc.re, 0, osc.slots * channels * sizeof (float));
+      memset (osc.im, 0, osc.slots * channels * sizeof (float));
+      memset (osc.cr, 0, osc.slots * channels * sizeof (float));
+      memset (osc.ci, 0, osc.slots * channels * sizeof (float));
+      memset (osc.amp, 0, osc.slots * channels * sizeof (float));
+      memset (noise.amp, 0, noise.slots * channels * sizeof (float));
+      for (i = 0; i < noise.slots * channels; i++)
+        {
+          noise.state[i] = 1;
+        }
+
+      // eq 131-133, the previous frame is synthesized from n = 0 and the current from n = -N
+      for (c = 0; c < channels; c++)
+        {
+          mp = b ? cur_mp[c] : prev_mp[c];
+          w0 = mp->w0;
+          for (l = 1; l <= maxl[c]; l++)
+            {
+              M = mp->Ml[l];
+              if (mp->Vl[l])
+                {
+                  mbe_addOsc (&osc, channels, c, w0 * (float) l, mp->PHIl[l] - (b ? w0 * (float) l * (float) N : 0), M);
+                }
+              else
+                {
+                  for (i = 0; i < uvquality; i++)
+                    {
+                      mbe_addOsc (&osc, channels, c, w0 * ((float) l + ((float) i * uvstep) - uvoffset), mbe_next_phase (&seed[c]), uvsine * M * qfactor);
+                    }
+                  if (w0 * (float) l > uvthreshold)
+                    {
+                      mbe_addNoise (&noise, channels, c, (w0 * (float) l - uvthreshold) * uvrand * uvsine * M * qfactor, &seed[c]);
+                    }
+                }
+            }
+        }
+
+      for (n = 0; n < N; n++)
+        {
+          const float W = b ? Ws[n] : Ws[n + N];
+          for (c = 0; c < channels; c++)
+            {
+              acc[c] = 0;
+            }
+          for (s = 0; s < osc.slots; s++)
+            {
+              float *MBE_RESTRICT re = osc.re + s * channels;
+              float *MBE_RESTRICT im = osc.im + s * channels;
+              const float *MBE_RESTRICT cr = osc.cr + s * channels;
+              const float *MBE_RESTRICT ci = osc.ci + s * channels;
+              const float *MBE_RESTRICT amp = osc.amp + s * channels;
+              for (c = 0; c < channels; c++)
+                {
+                  const float r = re[c];
+                  const float j = im[c];
+                  acc[c] += amp[c] * r;
+                  re[c] = r * cr[c] - j * ci[c];
+                  im[c] = r * ci[c] + j * cr[c];
+                }
+            }
+          for (s = 0; s < noise.slots; s++)
+            {
+              unsigned int *MBE_RESTRICT st = noise.state + s * channels;
+              const float *MBE_RESTRICT amp = noise.amp + s * channels;
+              for (c = 0; c < channels; c++)
+                {
+                  unsigned int x = st[c];
+                  float u = 0;
+                  for (q = 0; q < uvquality; q++)
+                    {
+                      x ^= x << 13;
+                      x ^= x >> 17;
+                      x ^= x << 5;
+                      u += (float) (x >> 8) * ((float) 1 / (float) 16777216);
+                    }
+                  st[c] = x;
+                  acc[c] += amp[c] * u;
+                }
+            }
+          for (c = 0; c < channels; c++)
+            {
+              aout_buf[c][n] = (b ? aout_buf[c][n] : 0) + W * acc[c];
+            }
+        }
+    }
+}
+
+/*
+ * mbe_synthesizeSpeechf() for several independent channels at once, a block of up to
+ * MBE_BATCH_CHANNELS at a time with no allocation. Every voiced band and every sine of the
+ * unvoiced multisine mix becomes an oscillator advanced by a complex rotation per sample
+ * instead of a cosf() call, and the oscillators of a block are stored as a structure of
+ * arrays with the channel innermost, so the loops over channels vectorise. Voiced output
+ * matches the single channel synthesis to within float rounding. The random phases come
+ * from a generator seeded from each channel's frame instead of rand(), so the function is
+ * reentrant, and the noise part of the unvoiced mix from a per-oscillator xorshift
+ * generator with the same distribution as mbe_rand(), so unvoiced output is not sample
+ * identical.
+ */
+void
+mbe_synthesizeSpeechBatchf (float **aout_buf, mbe_parms ** cur_mp, mbe_parms ** prev_mp, int channels, int uvquality)
+{
+
+  int c;
+
+  if ((uvquality < 1) || (uvquality > MBE_BATCH_UVQUALITY))
+    {
+      printf ("\nmbelib: Error - uvquality must be within the range 1 - %d for batches, setting to default value of 3\n", MBE_BATCH_UVQUALITY);
+      uvquality = 3;
+    }
+  for (c = 0; c < channels; c += MBE_BATCH_CHANNELS)
+    {
+      const int n = ((channels - c) < MBE_BATCH_CHANNELS) ? (channels - c) : MBE_BATCH_CHANNELS;
+      mbe_synthesizeSpeechBlockf (aout_buf + c, cur_mp + c, prev_mp + c, n, uvquality);
+    }
+}
+
 void
 mbe_synthesizeSpeech (short *aout_buf, mbe_parms * cur_mp, mbe_parms * prev_mp, int uvquality)
 {
@@ -15,6 +15,7 @@
 #include <stdio.h>
 #include <cstring>
 #include <cmath>
+#include <vector>
 
 #include "mbevocoder.h"
 #include "vocoder_tables.h"
@@ -992,7 +993,7 @@ void encode_ambe(const IMBE_PARAM *imbe_param, int b[], mbe_parms*cur_mp, mbe_pa
     void MBEVocoder::decode_2400x1200(int16_t *pcm, uint8_t *ambe)
 	{
 		int samples = 0;
-		process_2400x1200(ambe);
+		synthesize(prepare_2400x1200(ambe));
 		int16_t *p = getAudio(samples);
 		memcpy(pcm, p, samples * sizeof(int16_t));
 		resetAudio();
@@ -1001,7 +1002,7 @@ void encode_ambe(const IMBE_PARAM *imbe_param, int b[], mbe_parms*cur_mp, mbe_pa
     void MBEVocoder::decode_2450x1150(int16_t *pcm, uint8_t *ambe)
 	{
 		int samples = 0;
-		process_2450x1150(ambe);
+		synthesize(prepare_2450x1150(ambe));
 		int16_t *p = getAudio(samples);
 		memcpy(pcm, p, samples * sizeof(int16_t));
 		resetAudio();
@@ -1010,7 +1011,7 @@ void encode_ambe(const IMBE_PARAM *imbe_param, int b[], mbe_parms*cur_mp, mbe_pa
     void MBEVocoder::decode_2450(int16_t *pcm, uint8_t *ambe)
 	{
 		int samples = 0;
-		process_2450(ambe);
+		synthesize(prepare_2450(ambe));
 		int16_t *p = getAudio(samples);
 		memcpy(pcm, p, samples * sizeof(int16_t));
 		resetAudio();
@@ -1020,15 +1021,19 @@ void encode_ambe(const IMBE_PARAM *imbe_param, int b[], mbe_parms*cur_mp, mbe_pa
 	{
 		int b[9];
 		int16_t frame_vector[8];	// result ignored
-		uint8_t ambe_frame[72];
 		
+		vocoder.imbe_encode(frame_vector, pcm);
+		encode_ambe(vocoder.param(), b, m_mbelibParms->m_cur_mp, m_mbelibParms->m_prev_mp, true, 1.0);
+		pack_2400x1200(b, ambe);
+	}
+
+    void MBEVocoder::pack_2400x1200(const int *b, uint8_t *ambe)
+	{
+		uint8_t ambe_frame[72];
 		uint8_t pbuf[48];
 		uint8_t tbuf[48];
 		int tbufp = 0;
 		
-		vocoder.imbe_encode(frame_vector, pcm);
-		encode_ambe(vocoder.param(), b, m_mbelibParms->m_cur_mp, m_mbelibParms->m_prev_mp, true, 1.0);
-		
 		for (int i=0; i < 9; i++) {
 			store_reg(b[i], &tbuf[tbufp], b_lengths[i]);
 			tbufp += b_lengths[i];
@@ -1060,17 +1065,23 @@ void encode_ambe(const IMBE_PARAM *imbe_param, int b[], mbe_parms*cur_mp, mbe_pa
 	}
 	
     void MBEVocoder::encode_2450x1150(int16_t *pcm, uint8_t *ambe)
+	{
+		uint8_t tmp[9];
+
+		memset(tmp, 0, 9);
+		encode_2450(pcm, tmp);
+		fec_2450x1150(tmp, ambe);
+	}
+
+    void MBEVocoder::fec_2450x1150(const uint8_t *tmp, uint8_t *ambe)
 	{
 		unsigned int aOrig = 0U;
 		unsigned int bOrig = 0U;
 		unsigned int cOrig = 0U;
 		unsigned int MASK = 0x000800U;
-		uint8_t tmp[9];
-		
-		memset(tmp, 0, 9);
+
 		memset(ambe, 0, 9);
-		encode_2450(pcm, tmp);
-		
+
 		for (unsigned int i = 0U; i < 12U; i++, MASK >>= 1) {
 			unsigned int n1 = i;
 			unsigned int n2 = i + 12U;
@@ -1114,14 +1125,51 @@ void encode_ambe(const IMBE_PARAM *imbe_param, int b[], mbe_parms*cur_mp, mbe_pa
 		}
 	}
 	
+    int MBEVocoder::unfec_2450x1150(const uint8_t *ambe72, uint8_t *ambe49)
+	{
+		char ambe_fr[4][24];
+		char ambe_d[49];
+		const int *w = rW, *x = rX, *y = rY, *z = rZ;
+		int errs;
+
+		memset(ambe_fr, 0, 96);
+		memset(ambe49, 0, 7);
+
+		for(int i = 0; i < 9; ++i){
+			for(int j = 0; j < 8; j+=2){
+				ambe_fr[*y][*z] = (1 & (ambe72[i] >> (7 - (j+1))));
+				ambe_fr[*w][*x] = (1 & (ambe72[i] >> (7 - j)));
+				w++;
+				x++;
+				y++;
+				z++;
+			}
+		}
+
+		errs = mbe_eccAmbe3600x2450C0(ambe_fr);
+		mbe_demodulateAmbe3600x2450Data(ambe_fr);
+		errs += mbe_eccAmbe3600x2450Data(ambe_fr, ambe_d);
+
+		for(int i = 0; i < 49; ++i){
+			ambe49[i >> 3] |= (ambe_d[i] & 1) << (7 - (i & 7));
+		}
+		return errs;
+	}
+
     void MBEVocoder::encode_2450(int16_t *pcm, uint8_t *ambe)
 	{
 		int b[9];
 		int16_t frame_vector[8];	// result ignored
-        uint8_t ambe_frame[56];
 		
 		vocoder.imbe_encode(frame_vector, pcm);
 		encode_ambe(vocoder.param(), b, m_mbelibParms->m_cur_mp, m_mbelibParms->m_prev_mp, false, 1.0);
+		pack_2450(b, ambe);
+	}
+
+    void MBEVocoder::pack_2450(const int *b, uint8_t *ambe)
+	{
+        uint8_t ambe_frame[56];
+
         memset(ambe_frame, 0, 56);
 		
 		ambe_frame[0] = (b[0] >> 6) & 1;
@@ -1181,6 +1229,146 @@ void encode_ambe(const IMBE_PARAM *imbe_param, int b[], mbe_parms*cur_mp, mbe_pa
 		}
 	}
 
+    void MBEVocoder::imbe_to_ambe(uint8_t *imbe, int *b, bool dstar)
+	{
+		IMBE_PARAM p;
+
+		vocoder.decode_params(imbe);
+		p = *vocoder.param();
+
+		// encode_ambe() covers pitch periods of 19.875 to 123.125 samples
+		if(p.ref_pitch < 0x13e0){
+			p.ref_pitch = 0x13e0;
+		}
+		else if(p.ref_pitch > 0x7b20){
+			p.ref_pitch = 0x7b20;
+		}
+
+		for(int i = 0; i < 9; ++i){
+			b[i] = -1;
+		}
+		encode_ambe(&p, b, m_mbelibParms->m_cur_mp, m_mbelibParms->m_prev_mp, dstar, 1.0);
+
+		// No AMBE pitch gives the same number of harmonics, send silence
+		if(b[8] < 0){
+			memset(b, 0, 9 * sizeof(int));
+			b[0] = 124;
+		}
+	}
+
+    void MBEVocoder::imbe_to_ambe_2450(uint8_t *imbe, uint8_t *ambe)
+	{
+		int b[9];
+
+		imbe_to_ambe(imbe, b, false);
+		memset(ambe, 0, 7);
+		pack_2450(b, ambe);
+	}
+
+    void MBEVocoder::imbe_to_ambe_2400x1200(uint8_t *imbe, uint8_t *ambe)
+	{
+		int b[9];
+
+		imbe_to_ambe(imbe, b, true);
+		memset(ambe, 0, 9);
+		pack_2400x1200(b, ambe);
+	}
+
+    void MBEVocoder::ambe_2450_to_imbe(uint8_t *ambe, uint8_t *imbe)
+	{
+		char ambe_data[49];
+
+		for(int i = 0; i < 6; ++i){
+			for(int j = 0; j < 8; j++){
+				ambe_data[j+(8*i)] = (1 & (ambe[i] >> (7 - j)));
+			}
+		}
+		ambe_data[48] = (1 & (ambe[6] >> 7));
+		params_to_imbe(mbe_decodeAmbe2450Parms(ambe_data, m_mbelibParms->m_cur_mp, m_mbelibParms->m_prev_mp), imbe);
+	}
+
+    void MBEVocoder::ambe_2400x1200_to_imbe(uint8_t *ambe, uint8_t *imbe)
+	{
+		char ambe_fr[4][24];
+		char ambe_data[49];
+		const int *w = dW, *x = dX;
+
+		memset(ambe_fr, 0, 96);
+		for(int i = 0; i < 9; ++i){
+			for(int j = 0; j < 8; ++j){
+				ambe_fr[*w][*x] = (1 & (ambe[i] >> j));
+				w++;
+				x++;
+			}
+		}
+		mbe_eccAmbe3600x2400C0(ambe_fr);
+		mbe_demodulateAmbe3600x2400Data(ambe_fr);
+		mbe_eccAmbe3600x2400Data(ambe_fr, ambe_data);
+		params_to_imbe(mbe_decodeAmbe2400Parms(ambe_data, m_mbelibParms->m_cur_mp, m_mbelibParms->m_prev_mp), imbe);
+	}
+
+	// Resamples the dequantized AMBE model onto the IMBE harmonic grid. The decoder has
+	// already taken 0.5 * log2(L) off the gain, so only the gain adjust of encode_ambe()
+	// and, for unvoiced bands, its w0 term are put back.
+    void MBEVocoder::params_to_imbe(int bad, uint8_t *imbe)
+	{
+		static const uint8_t IMBE_SILENCE[11] = {0x04, 0x0c, 0xfd, 0x7b, 0xfb, 0x7d, 0xf2, 0x7b, 0x3d, 0x9e, 0x45};
+		mbe_parms *mp = m_mbelibParms->m_cur_mp;
+		IMBE_PARAM p;
+
+		if(bad == 2){
+			mbe_useLastMbeParms(mp, m_mbelibParms->m_prev_mp);
+		}
+		else if(bad){
+			mbe_initMbeParms(mp, m_mbelibParms->m_prev_mp, m_mbelibParms->m_prev_mp_enhanced);
+			memcpy(imbe, IMBE_SILENCE, 11);
+			return;
+		}
+		mbe_moveMbeParms(mp, m_mbelibParms->m_prev_mp);
+
+		memset(&p, 0, sizeof(IMBE_PARAM));
+		int b0 = (int)(4.0f * (float)M_PI / mp->w0 - 39.0f);
+		b0 = (b0 < 0) ? 0 : (b0 > 207) ? 207 : b0;
+		p.ref_pitch = 0x1380 + (b0 << 7) + 0x40;
+
+		const int L = imbe_vocoder::num_harms(p.ref_pitch);
+		const int bands = (L <= 36) ? (L + 2) / 3 : 12;
+		const float w0 = 4.0f * (float)M_PI / ((float)b0 + 39.5f);
+		const float uv_offset = 0.5f * log2f(mp->w0) + 2.289f;
+		float lsa[NUM_HARMS_MAX];
+
+		for(int l = 1; l <= L; ++l){
+			float k = (float)l * w0 / mp->w0;
+			int k0 = (int)k;
+			float f = k - k0;
+			if(k0 < 1){
+				k0 = 1;
+				f = 0;
+			}
+			else if(k0 >= mp->L){
+				k0 = mp->L;
+				f = 0;
+			}
+			lsa[l-1] = (1.0f - f) * mp->log2Ml[k0] + ((f > 0) ? f * mp->log2Ml[k0 + 1] : 0);
+			int v = (int)(k + 0.5f);
+			p.v_uv_dsn[l-1] = mp->Vl[(v < 1) ? 1 : (v > mp->L) ? mp->L : v];
+		}
+
+		for(int band = 0, i = 0; band < bands; ++band){
+			const int j = (band == bands - 1) ? L : i + 3;
+			int voiced = 0;
+			for(int k = i; k < j; ++k){
+				voiced += p.v_uv_dsn[k] ? 1 : -1;
+			}
+			for(; i < j; ++i){
+				float sa = exp2f(lsa[i] + 1.0f - ((voiced > 0) ? 0.0f : uv_offset));
+				p.v_uv_dsn[i] = (voiced > 0);
+				p.sa[i] = (short)((sa < 1.0f) ? 1.0f : (sa > 32767.0f) ? 32767.0f : sa);
+			}
+		}
+		vocoder.encode_params(&p, imbe);
+	}
+
     void MBEVocoder::initMbeParms()
 	{
 		mbe_initMbeParms(m_mbelibParms->m_cur_mp, m_mbelibParms->m_prev_mp, m_mbelibParms->m_prev_mp_enhanced);
@@ -1189,7 +1377,7 @@ void encode_ambe(const IMBE_PARAM *imbe_param, int b[], mbe_parms*cur_mp, mbe_pa
 		m_err_str[0] = 0;
 	}
 	
-    void MBEVocoder::process_2400x1200(unsigned char *d)
+    int MBEVocoder::prepare_2400x1200(unsigned char *d)
 	{
 		char ambe_fr[4][24];
     
@@ -1205,11 +1393,10 @@ void encode_ambe(const IMBE_PARAM *imbe_param, int b[], mbe_parms*cur_mp, mbe_pa
 			}
 		}
 
-		mbe_processAmbe3600x2400Framef(m_audio_out_temp_buf, &m_errs2, m_err_str, ambe_fr, ambe_d,m_mbelibParms-> m_cur_mp, m_mbelibParms->m_prev_mp, m_mbelibParms->m_prev_mp_enhanced, 3);
-		processAudio();
+		return mbe_processAmbe3600x2400Parms(&m_errs2, m_err_str, ambe_fr, ambe_d, m_mbelibParms->m_cur_mp, m_mbelibParms->m_prev_mp, m_mbelibParms->m_prev_mp_enhanced);
 	}
 
-    void MBEVocoder::process_2450x1150(unsigned char *d)
+    int MBEVocoder::prepare_2450x1150(unsigned char *d)
 	{
 		char ambe_fr[4][24];
 
@@ -1230,11 +1417,10 @@ void encode_ambe(const IMBE_PARAM *imbe_param, int b[], mbe_parms*cur_mp, mbe_pa
 			}
 		}
 
-		mbe_processAmbe3600x2450Framef(m_audio_out_temp_buf, &m_errs2, m_err_str, ambe_fr, ambe_d,m_mbelibParms-> m_cur_mp, m_mbelibParms->m_prev_mp, m_mbelibParms->m_prev_mp_enhanced, 3);
-		processAudio();
+		return mbe_processAmbe3600x2450Parms(&m_errs2, m_err_str, ambe_fr, ambe_d, m_mbelibParms->m_cur_mp, m_mbelibParms->m_prev_mp, m_mbelibParms->m_prev_mp_enhanced);
 	}
 
-    void MBEVocoder::process_2450(unsigned char *d)
+    int MBEVocoder::prepare_2450(unsigned char *d)
 	{
 		char ambe_data[49];
 		char dvsi_data[7];
@@ -1246,14 +1432,65 @@ void encode_ambe(const IMBE_PARAM *imbe_param, int b[], mbe_parms*cur_mp, mbe_pa
 			}
 		}
 		ambe_data[48] = (1 & (d[6] >> 7));
-		processData(ambe_data);
+		return mbe_processAmbe2450Parms(&m_errs2, m_err_str, ambe_data, m_mbelibParms->m_cur_mp, m_mbelibParms->m_prev_mp, m_mbelibParms->m_prev_mp_enhanced);
 	}
-	
-    void MBEVocoder::processData(char ambe_data[49])
+
+    void MBEVocoder::synthesize(int speech)
 	{
-		mbe_processAmbe2450Dataf(m_audio_out_temp_buf, &m_errs2, m_err_str, ambe_data, m_mbelibParms->m_cur_mp,m_mbelibParms->m_prev_mp, m_mbelibParms->m_prev_mp_enhanced, 3);
+		if(speech){
+			mbe_synthesizeSpeechf(m_audio_out_temp_buf, m_mbelibParms->m_cur_mp, m_mbelibParms->m_prev_mp_enhanced, 3);
+			mbe_moveMbeParms(m_mbelibParms->m_cur_mp, m_mbelibParms->m_prev_mp_enhanced);
+		}
+		else{
+			mbe_synthesizeSilencef(m_audio_out_temp_buf);
+		}
 		processAudio();
 	}
+
+    void MBEVocoder::decode_batch(MBEVocoder **v, uint8_t **ambe, int16_t **pcm, int n, int (MBEVocoder::*prepare)(unsigned char *))
+	{
+		std::vector<float *> out;
+		std::vector<mbe_parms *> cur, prev;
+		std::vector<int> speech(n);
+
+		for(int i = 0; i < n; ++i){
+			speech[i] = (v[i]->*prepare)(ambe[i]);
+			if(speech[i]){
+				out.push_back(v[i]->m_audio_out_temp_buf);
+				cur.push_back(v[i]->m_mbelibParms->m_cur_mp);
+				prev.push_back(v[i]->m_mbelibParms->m_prev_mp_enhanced);
+			}
+			else{
+				mbe_synthesizeSilencef(v[i]->m_audio_out_temp_buf);
+			}
+		}
+		mbe_synthesizeSpeechBatchf(out.data(), cur.data(), prev.data(), (int)out.size(), 3);
+		for(int i = 0; i < n; ++i){
+			int samples = 0;
+			if(speech[i]){
+				mbe_moveMbeParms(v[i]->m_mbelibParms->m_cur_mp, v[i]->m_mbelibParms->m_prev_mp_enhanced);
+			}
+			v[i]->processAudio();
+			int16_t *p = v[i]->getAudio(samples);
+			memcpy(pcm[i], p, samples * sizeof(int16_t));
+			v[i]->resetAudio();
+		}
+	}
+
+    void MBEVocoder::decode_2400x1200_batch(MBEVocoder **v, uint8_t **ambe, int16_t **pcm, int n)
+	{
+		decode_batch(v, ambe, pcm, n, &MBEVocoder::prepare_2400x1200);
+	}
+
+    void MBEVocoder::decode_2450x1150_batch(MBEVocoder **v, uint8_t **ambe, int16_t **pcm, int n)
+	{
+		decode_batch(v, ambe, pcm, n, &MBEVocoder::prepare_2450x1150);
+	}
+
+    void MBEVocoder::decode_2450_batch(MBEVocoder **v, uint8_t **ambe, int16_t **pcm, int n)
+	{
+		decode_batch(v, ambe, pcm, n, &MBEVocoder::prepare_2450);
+	}
 	
     short * MBEVocoder::getAudio(int& nbSamples)
 	{
@@ -30,6 +30,23 @@ public:
 	void encode_2400x1200(int16_t *pcm, uint8_t *codec);
 	void encode_2450x1150(int16_t *pcm, uint8_t *codec);
 	void encode_2450(int16_t *pcm, uint8_t *codec);
+	// Decode one frame for each of n independent channels, v[i] holding the state of
+	// channel i. The speech of all the channels is synthesized together, see
+	// mbe_synthesizeSpeechBatchf(). Only droidstar-batchbench uses them so far, the
+	// pipelines decode a frame at a time as it arrives.
+	static void decode_2400x1200_batch(MBEVocoder **v, uint8_t **codec, int16_t **pcm, int n);
+	static void decode_2450x1150_batch(MBEVocoder **v, uint8_t **codec, int16_t **pcm, int n);
+	static void decode_2450_batch(MBEVocoder **v, uint8_t **codec, int16_t **pcm, int n);
+	// Add or strip the DMR 3600x2450 FEC around a 49 bit AMBE frame without decoding it.
+	// Stripping returns the number of bit errors corrected.
+	static void fec_2450x1150(const uint8_t *ambe49, uint8_t *ambe72);
+	static int unfec_2450x1150(const uint8_t *ambe72, uint8_t *ambe49);
+	// Transcode between IMBE and AMBE model parameters without synthesizing and
+	// analysing speech. An instance keeps the predictor state of one direction.
+	void imbe_to_ambe_2450(uint8_t *imbe, uint8_t *ambe);
+	void imbe_to_ambe_2400x1200(uint8_t *imbe, uint8_t *ambe);
+	void ambe_2450_to_imbe(uint8_t *ambe, uint8_t *imbe);
+	void ambe_2400x1200_to_imbe(uint8_t *ambe, uint8_t *imbe);
 	
 private:
 	imbe_vocoder vocoder;
@@ -50,13 +67,18 @@ private:
 	char ambe_d[49];
 	
 	void initMbeParms();
-	void process_2400x1200(unsigned char *d);
-	void process_2450x1150(unsigned char *d);
-	void process_2450(unsigned char *d);
-	void processData(char ambe_data[49]);
+	int prepare_2400x1200(unsigned char *d);
+	int prepare_2450x1150(unsigned char *d);
+	int prepare_2450(unsigned char *d);
+	void synthesize(int speech);
+	static void decode_batch(MBEVocoder **v, uint8_t **ambe, int16_t **pcm, int n, int (MBEVocoder::*prepare)(unsigned char *));
 	short *getAudio(int& nbSamples);
 	void resetAudio();
 	void processAudio();
+	void imbe_to_ambe(uint8_t *imbe, int *b, bool dstar);
+	void params_to_imbe(int bad, uint8_t *imbe);
+	static void pack_2400x1200(const int *b, uint8_t *ambe);
+	static void pack_2450(const int *b, uint8_t *ambe);
 };
 
 #endif // MBEVOCODER_H
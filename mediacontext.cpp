@@ -0,0 +1,153 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QThread>
+#include "mediacontext.h"
+#include "vocoderregistry.h"
+
+MediaContext::MediaContext() :
+	m_audio(nullptr),
+#ifndef USE_EXTERNAL_CODEC2
+	m_codec2(nullptr),
+#endif
+	m_reused(0),
+	m_created(0)
+{
+}
+
+MediaContext::~MediaContext()
+{
+	delete m_audio;
+	for(Vocoder *v : m_vocoders){
+		VocoderRegistry::destroy(v);
+	}
+#ifndef USE_EXTERNAL_CODEC2
+	delete m_codec2;
+#endif
+}
+
+AudioEngine * MediaContext::take_audio(QString in, QString out)
+{
+	QElapsedTimer t;
+	AudioEngine *a;
+	quint32 reused, created;
+
+	t.start();
+	m_lock.lock();
+	a = m_audio;
+	m_audio = nullptr;
+	m_lock.unlock();
+
+	if(a && (a->input_device() == in) && (a->output_device() == out)){
+		a->moveToThread(QThread::currentThread());
+		m_lock.lock();
+		reused = ++m_reused;
+		created = m_created;
+		m_lock.unlock();
+		qDebug() << "MediaContext: audio reused in" << t.nsecsElapsed() / 1000 << "us," << reused << "reused" << created << "created";
+		return a;
+	}
+
+	delete a;
+	a = new AudioEngine(in, out);
+	a->init();
+	m_lock.lock();
+	reused = m_reused;
+	created = ++m_created;
+	m_lock.unlock();
+	qDebug() << "MediaContext: audio opened in" << t.elapsed() << "ms," << reused << "reused" << created << "created";
+	return a;
+}
+
+void MediaContext::give_audio(AudioEngine *a)
+{
+	if(a == nullptr){
+		return;
+	}
+
+	// A WAV file is finished when its engine is deleted, one file per session
+	if(a->output_device().startsWith("wav:")){
+		delete a;
+		return;
+	}
+
+	a->stop_capture();
+	a->stop_playback();
+	a->moveToThread(nullptr);
+
+	m_lock.lock();
+	AudioEngine *old = m_audio;
+	m_audio = a;
+	m_lock.unlock();
+	delete old;
+}
+
+Vocoder * MediaContext::take_vocoder(int codec)
+{
+	QMutexLocker l(&m_lock);
+
+	if(m_vocoders.contains(codec)){
+		return m_vocoders.take(codec);
+	}
+	return VocoderRegistry::create(codec);
+}
+
+void MediaContext::give_vocoder(int codec, Vocoder *v)
+{
+	if(v == nullptr){
+		return;
+	}
+
+	QMutexLocker l(&m_lock);
+	if(m_vocoders.contains(codec)){
+		VocoderRegistry::destroy(v);
+	}
+	else{
+		m_vocoders.insert(codec, v);
+	}
+}
+
+#ifndef USE_EXTERNAL_CODEC2
+CCodec2 * MediaContext::take_codec2()
+{
+	m_lock.lock();
+	CCodec2 *c = m_codec2;
+	m_codec2 = nullptr;
+	m_lock.unlock();
+
+	if(c == nullptr){
+		return new CCodec2(true);
+	}
+	c->codec2_set_mode(true);
+	return c;
+}
+
+void MediaContext::give_codec2(CCodec2 *c)
+{
+	if(c == nullptr){
+		return;
+	}
+
+	m_lock.lock();
+	CCodec2 *old = m_codec2;
+	m_codec2 = c;
+	m_lock.unlock();
+	delete old;
+}
+#endif
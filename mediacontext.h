@@ -0,0 +1,64 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef MEDIACONTEXT_H
+#define MEDIACONTEXT_H
+
+#include <QHash>
+#include <QMutex>
+#include "audioengine.h"
+#include "vocoder_plugin.h"
+#ifndef USE_EXTERNAL_CODEC2
+#include "codec2/codec2_api.h"
+#endif
+
+// The audio engine and vocoders of a session, kept when it ends and handed to the next
+// one so that switching reflectors or reconnecting does not open the audio devices and
+// set the vocoders up again. Sessions run one after another on threads of their own: a
+// session takes what it needs when it connects and gives it back when it is torn down.
+// A parked AudioEngine is stopped and has no thread, so the next session's thread can
+// take it over. Anything asked for that is not parked is made new. A parked vocoder or
+// Codec2 is not reset: its filter memory and the parameters of the last frame it coded
+// carry over, so the first frame of the next session is smoothed into the end of the
+// last one's, as after a lost frame, and after that the old state is gone.
+class MediaContext
+{
+public:
+	MediaContext();
+	~MediaContext();
+	// An engine initialized for the in and out devices, on the calling thread
+	AudioEngine * take_audio(QString in, QString out);
+	void give_audio(AudioEngine *a);
+	Vocoder * take_vocoder(int codec);
+	void give_vocoder(int codec, Vocoder *v);
+#ifndef USE_EXTERNAL_CODEC2
+	// Set to 3200 bps, with the state the last session left
+	CCodec2 * take_codec2();
+	void give_codec2(CCodec2 *c);
+#endif
+private:
+	QMutex m_lock;
+	AudioEngine *m_audio;
+	QHash<int, Vocoder *> m_vocoders;
+#ifndef USE_EXTERNAL_CODEC2
+	CCodec2 *m_codec2;
+#endif
+	quint32 m_reused;
+	quint32 m_created;
+};
+
+#endif // MEDIACONTEXT_H
@@ -0,0 +1,83 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// droidstar-mixbench: AudioMixer throughput at 2, 4 and 8 inputs.
+//
+//   droidstar-mixbench [-f frames]
+//
+// Each iteration writes one 20 ms frame of noise into every input, as the mode threads
+// would, and mixes one output frame with half the inputs at unity gain, the rest at a
+// lower gain and priority so the ducked path is exercised too.
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <cstdio>
+#include "audiomixer.h"
+
+static double run(int inputs, int frames, bool simd)
+{
+	AudioMixer mixer;
+	QRandomGenerator rng(1);
+	int16_t pcm[8][AudioMixer::FRAME];
+	int16_t out[AudioMixer::FRAME];
+	QElapsedTimer t;
+	int id[8];
+
+	for(int i = 0; i < inputs; ++i){
+		id[i] = mixer.add_input((i & 1) ? 0 : 1, (i & 1) ? 0.7 : 1.0);
+		for(int j = 0; j < AudioMixer::FRAME; ++j){
+			pcm[i][j] = (int16_t)(rng.bounded(65536) - 32768);
+		}
+	}
+	mixer.set_simd(simd);
+
+	t.start();
+	for(int f = 0; f < frames; ++f){
+		for(int i = 0; i < inputs; ++i){
+			mixer.write(id[i], pcm[i], AudioMixer::FRAME);
+		}
+		mixer.mix(out, AudioMixer::FRAME);
+	}
+	return t.nsecsElapsed() / (double)frames;
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	QCommandLineParser parser;
+
+	parser.setApplicationDescription("AudioMixer benchmark");
+	parser.addHelpOption();
+	parser.addOption({{"f", "frames"}, "Frames to mix per run", "frames", "200000"});
+	parser.process(app);
+
+	const int frames = qMax(1, parser.value("frames").toInt());
+	const double budget = AudioMixer::FRAME * 1e9 / 8000;
+
+	fprintf(stdout, "%d frames of %d samples, simd %s, latency bound %d ms\n", frames, (int)AudioMixer::FRAME,
+			AudioMixer::simd_available() ? "yes" : "no", (int)AudioMixer::MAX_LATENCY / 8);
+	fprintf(stdout, "%6s %12s %12s %8s %12s\n", "inputs", "simd_ns", "scalar_ns", "speedup", "frame_pct");
+
+	for(int inputs : {2, 4, 8}){
+		const double simd = run(inputs, frames, true);
+		const double scalar = run(inputs, frames, false);
+		fprintf(stdout, "%6d %12.1f %12.1f %8.2f %12.5f\n", inputs, simd, scalar, scalar / simd, simd * 100 / budget);
+	}
+	return 0;
+}
@@ -0,0 +1,107 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// droidstar-mmdvmemu: an MMDVM modem on a pseudo terminal, for testing without hardware.
+//
+//   droidstar-mmdvmemu [-P 1|2] [-L /tmp/ttyMMDVM] [-i rf.dscap [-s 1] [--loop]] [-r out.dscap] [-b 10] [-v]
+//
+// Point the modem setting at the port it prints, or at the link. Once the host has sent its
+// config, the MMDVM frames in -i are sent to it as RF at the rate they go on air. Every over
+// the host transmits is printed with its frames, the delay from the start of the last RF
+// over, the longest gap between frames and the times the -b frame buffer ran dry.
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTimer>
+#include <csignal>
+#include <cstdio>
+#include "mmdvmemulator.h"
+
+static void signal_handler(int)
+{
+	QCoreApplication::quit();
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	QCommandLineParser parser;
+
+	parser.setApplicationDescription("MMDVM modem emulator for DroidStar testing");
+	parser.addHelpOption();
+	parser.addOption({{"P", "protocol"}, "MMDVM protocol version, 1 or 2", "protocol", "1"});
+	parser.addOption({{"L", "link"}, "Symlink to create to the pty", "path"});
+	parser.addOption({{"i", "inject"}, "Capture of MMDVM frames to send as RF", "file"});
+	parser.addOption({{"s", "speed"}, "Injection speed multiplier", "speed", "1"});
+	parser.addOption({"loop", "Inject the capture over and over"});
+	parser.addOption({{"r", "record"}, "Record the frames both ways to a capture", "file"});
+	parser.addOption({{"b", "buffer"}, "Transmit buffer of each mode", "frames", "10"});
+	parser.addOption({{"v", "verbose"}, "Print every frame from the host"});
+	parser.process(app);
+
+	const int protocol = parser.value("protocol").toInt();
+	if((protocol != 1) && (protocol != 2)){
+		fprintf(stderr, "Unsupported protocol %d\n", protocol);
+		return 1;
+	}
+
+	MMDVMEmulator emu(protocol);
+	emu.set_buffer(qMax(1, parser.value("buffer").toInt()));
+	emu.set_verbose(parser.isSet("verbose"));
+	if(parser.isSet("inject") && !emu.set_inject(parser.value("inject"), parser.value("speed").toInt(), parser.isSet("loop"))){
+		fprintf(stderr, "No MMDVM frames in %s\n", parser.value("inject").toStdString().c_str());
+		return 1;
+	}
+	if(!emu.start(parser.value("link"))){
+		return 1;
+	}
+	if(parser.isSet("record") && !emu.set_record(parser.value("record"))){
+		fprintf(stderr, "Cannot write %s\n", parser.value("record").toStdString().c_str());
+		return 1;
+	}
+	fprintf(stdout, "MMDVM protocol %d on %s\n", protocol, emu.port().toStdString().c_str());
+	fflush(stdout);
+
+	signal(SIGINT, signal_handler);
+	signal(SIGTERM, signal_handler);
+
+	QObject::connect(&emu, &MMDVMEmulator::configured, [](uint8_t modes) {
+		fprintf(stdout, "configured, modes %02x\n", modes);
+		fflush(stdout);
+	});
+	QObject::connect(&emu, &MMDVMEmulator::rx_over, [](int frames) {
+		fprintf(stdout, "RF over of %d frames sent\n", frames);
+		fflush(stdout);
+	});
+	QObject::connect(&emu, &MMDVMEmulator::tx_over, [](uint8_t type, int frames, qint64 latency_ms, qint64 max_gap_ms, int underruns) {
+		fprintf(stdout, "TX over type %02x of %d frames, latency %lld ms, max gap %lld ms, underruns %d\n", type, frames, latency_ms, max_gap_ms, underruns);
+		fflush(stdout);
+	});
+
+	MMDVMEmulator::STATS last = emu.stats();
+	QTimer stats;
+	QObject::connect(&stats, &QTimer::timeout, [&emu, &last]() {
+		const MMDVMEmulator::STATS s = emu.stats();
+		fprintf(stdout, "commands %u polls %u naks %u injected %u tx %u overflows %u\n",
+				s.commands - last.commands, s.polls - last.polls, s.naks - last.naks, s.injected - last.injected, s.tx_frames - last.tx_frames, s.overflows - last.overflows);
+		fflush(stdout);
+		last = s;
+	});
+	stats.start(10000);
+
+	return app.exec();
+}
@@ -0,0 +1,453 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <QDebug>
+#include <cstdio>
+#include <cstring>
+#include "mmdvmemulator.h"
+#include "MMDVMDefines.h"
+
+#define IDLE_MS 500
+
+static const char MMDVM_DESCRIPTION[] = "MMDVM 20210101 DroidStar emulator";
+static const uint8_t BUFFER_MODE[7] = {MODE_DSTAR, MODE_DMR, MODE_DMR, MODE_YSF, MODE_P25, MODE_NXDN, MODE_M17};
+static const uint8_t BUFFER_ENABLE[7] = {0x01, 0x02, 0x02, 0x04, 0x08, 0x10, 0x40};
+static const int BUFFER_MS[7] = {20, 60, 60, 100, 180, 80, 40};
+
+MMDVMEmulator::MMDVMEmulator(int protocol, QObject *parent) :
+	QObject(parent),
+	m_protocol(protocol),
+	m_pty(new PtyPort(this)),
+	m_verbose(false),
+	m_configured(false),
+	m_modes(0),
+	m_mode(MODE_IDLE),
+	m_buffer(10),
+	m_injecttimer(new QTimer(this)),
+	m_injectidx(0),
+	m_injectspeed(1),
+	m_injectloop(false),
+	m_injectbase(0),
+	m_injectlast(0),
+	m_injectover(-1),
+	m_injectframes(0),
+	m_txtimer(new QTimer(this)),
+	m_txtype(0),
+	m_txframes(0),
+	m_txlast(0),
+	m_txlatency(-1),
+	m_txmaxgap(0),
+	m_txunderruns(0)
+{
+	memset(&m_stats, 0, sizeof(m_stats));
+	memset(m_buffers, 0, sizeof(m_buffers));
+	m_injecttimer->setSingleShot(true);
+	m_injecttimer->setTimerType(Qt::PreciseTimer);
+	connect(m_injecttimer, &QTimer::timeout, this, &MMDVMEmulator::inject_next);
+	m_txtimer->setSingleShot(true);
+	connect(m_txtimer, &QTimer::timeout, this, &MMDVMEmulator::tx_end);
+	connect(m_pty, &PtyPort::data_received, this, &MMDVMEmulator::receive);
+	m_clock.start();
+}
+
+MMDVMEmulator::~MMDVMEmulator()
+{
+	m_record.close();
+}
+
+bool MMDVMEmulator::start(QString link)
+{
+	return m_pty->open(link);
+}
+
+bool MMDVMEmulator::set_record(QString capture)
+{
+	PacketCapture::HEADER h;
+
+	h.mode = "MMDVM";
+	h.module = 0;
+	h.dmrid = 0;
+	h.host = m_pty->name();
+	h.port = 0;
+	h.start = 0;
+	return m_record.open_write(capture, h);
+}
+
+bool MMDVMEmulator::set_inject(QString capture, int speed, bool loop)
+{
+	PacketCapture c;
+	PacketCapture::RECORD r;
+
+	if(!c.open_read(capture)){
+		return false;
+	}
+
+	// Frames the host wrote are laid out as the modem would have received them, so a
+	// capture in either direction will do
+	m_inject.clear();
+	while(c.read(r)){
+		if((r.data.size() >= 3) && ((uint8_t)r.data[0] == MMDVM_FRAME_START) && ((uint8_t)r.data[1] == r.data.size()) && frame_ms(r.data[2])){
+			m_inject.append(r);
+		}
+	}
+	m_injectspeed = speed > 0 ? speed : 1;
+	m_injectloop = loop;
+	qDebug() << "MMDVMEmulator:" << m_inject.size() << "frames to inject from" << capture;
+	return m_inject.size() > 0;
+}
+
+int MMDVMEmulator::frame_ms(uint8_t type)
+{
+	switch(type){
+	case MMDVM_DSTAR_HEADER:
+	case MMDVM_DSTAR_DATA:
+	case MMDVM_DSTAR_EOT:
+		return 20;
+	case MMDVM_DMR_DATA1:
+	case MMDVM_DMR_DATA2:
+		return 60;
+	case MMDVM_YSF_DATA:
+		return 100;
+	case MMDVM_P25_HDR:
+	case MMDVM_P25_LDU:
+		return 180;
+	case MMDVM_NXDN_DATA:
+		return 80;
+	case MMDVM_M17_LINK_SETUP:
+	case MMDVM_M17_STREAM:
+	case MMDVM_M17_EOT:
+		return 40;
+	default:
+		return 0;
+	}
+}
+
+int MMDVMEmulator::frame_buffer(uint8_t type)
+{
+	switch(type){
+	case MMDVM_DSTAR_HEADER:
+	case MMDVM_DSTAR_DATA:
+	case MMDVM_DSTAR_EOT:
+		return 0;
+	case MMDVM_DMR_DATA1:
+		return 1;
+	case MMDVM_DMR_DATA2:
+		return 2;
+	case MMDVM_YSF_DATA:
+		return 3;
+	case MMDVM_P25_HDR:
+	case MMDVM_P25_LDU:
+		return 4;
+	case MMDVM_NXDN_DATA:
+		return 5;
+	case MMDVM_M17_LINK_SETUP:
+	case MMDVM_M17_STREAM:
+	case MMDVM_M17_EOT:
+		return 6;
+	default:
+		return -1;
+	}
+}
+
+// D-Star and M17 end an over with a frame of their own, DMR with a terminator burst. The
+// others are taken to end when the frames stop.
+bool MMDVMEmulator::is_eot(const QByteArray &f)
+{
+	const uint8_t type = f[2];
+
+	if((type == MMDVM_DSTAR_EOT) || (type == MMDVM_M17_EOT)){
+		return true;
+	}
+	if(((type == MMDVM_DMR_DATA1) || (type == MMDVM_DMR_DATA2)) && (f.size() > 3)){
+		return ((f[3] & 0x40) && ((f[3] & 0x0f) == 0x02));
+	}
+	return false;
+}
+
+void MMDVMEmulator::receive(QByteArray data)
+{
+	m_rx.append(data);
+
+	while(m_rx.size() >= 3){
+		if((uint8_t)m_rx[0] != MMDVM_FRAME_START){
+			const int start = m_rx.indexOf((char)MMDVM_FRAME_START);
+			m_rx.remove(0, (start == -1) ? m_rx.size() : start);
+			continue;
+		}
+		const int len = (uint8_t)m_rx[1];
+		if(len < 3){
+			m_rx.remove(0, 1);
+			continue;
+		}
+		if(m_rx.size() < len){
+			break;
+		}
+		const QByteArray f = m_rx.left(len);
+		m_rx.remove(0, len);
+		if(m_verbose){
+			fprintf(stderr, "RX %d:", len);
+			for(int i = 0; i < qMin(len, 16); ++i){
+				fprintf(stderr, " %02x", (uint8_t)f[i]);
+			}
+			fprintf(stderr, "\n");
+		}
+		if(m_record.is_open()){
+			m_record.write(PacketCapture::CAPTURE_TX, f, QHostAddress(), 0);
+		}
+		handle_frame(f);
+	}
+}
+
+void MMDVMEmulator::reply(const QByteArray &f)
+{
+	QByteArray out;
+
+	out.append(MMDVM_FRAME_START);
+	out.append(f.size() + 2);
+	out.append(f);
+	m_pty->write(out);
+}
+
+void MMDVMEmulator::ack(uint8_t command)
+{
+	QByteArray f;
+
+	f.append(MMDVM_ACK);
+	f.append(command);
+	reply(f);
+}
+
+void MMDVMEmulator::nak(uint8_t command, uint8_t reason)
+{
+	QByteArray f;
+
+	f.append(MMDVM_NAK);
+	f.append(command);
+	f.append(reason);
+	reply(f);
+	++m_stats.naks;
+}
+
+void MMDVMEmulator::handle_frame(const QByteArray &f)
+{
+	const uint8_t type = f[2];
+	const qint64 now = m_clock.nsecsElapsed();
+	QByteArray r;
+
+	if(frame_ms(type)){
+		handle_tx(f);
+		return;
+	}
+
+	++m_stats.commands;
+	switch(type){
+	case MMDVM_GET_VERSION:
+		r.append(MMDVM_GET_VERSION);
+		r.append(m_protocol);
+		if(m_protocol == 2){
+			r.append(0x7f);		// D-Star, DMR, YSF, P25, NXDN, M17, FM
+			r.append(0x03);		// POCSAG, AX.25
+			r.append(0x02);		// STM32
+			r.append(QByteArray(16, 0));
+		}
+		r.append(MMDVM_DESCRIPTION);
+		reply(r);
+		break;
+	case MMDVM_GET_STATUS:
+		++m_stats.polls;
+		r.append(MMDVM_GET_STATUS);
+		if(m_protocol == 1){
+			r.append(m_modes);
+		}
+		r.append(m_mode);
+		r.append((char)0);
+		for(int b = 0; b < 7; ++b){
+			drain(b, now);
+			if(m_buffers[b].depth){
+				r[m_protocol == 1 ? 3 : 2] = 0x01;		// Transmitting
+			}
+		}
+		if(m_protocol == 2){
+			r.append((char)0);
+		}
+		for(int b = 0; b < 7; ++b){
+			if((m_protocol == 1) && (b == 6)){
+				r.append((char)0);		// POCSAG, before M17 in protocol 1
+			}
+			r.append((char)qBound(0, m_buffer - m_buffers[b].depth, 255));
+		}
+		if(m_protocol == 2){
+			r.append(QByteArray(3, 0));		// FM, POCSAG, AX.25
+		}
+		reply(r);
+		break;
+	case MMDVM_SET_CONFIG:
+		if(f.size() < 5){
+			nak(type, 4);
+			break;
+		}
+		m_modes = f[4];
+		ack(type);
+		if(!m_configured){
+			m_configured = true;
+			emit configured(m_modes);
+			if(m_inject.size()){
+				m_injectidx = 0;
+				m_injectbase = m_clock.nsecsElapsed();
+				m_injectlast = m_injectbase;
+				m_injecttimer->start(0);
+			}
+		}
+		break;
+	case MMDVM_SET_MODE:
+		if(f.size() > 3){
+			m_mode = f[3];
+		}
+		ack(type);
+		break;
+	case MMDVM_SET_FREQ:
+	case MMDVM_SEND_CWID:
+	case MMDVM_DMR_SHORTLC:
+	case MMDVM_DMR_START:
+	case MMDVM_DMR_ABORT:
+		ack(type);
+		break;
+	default:
+		nak(type, 1);
+		break;
+	}
+}
+
+// The frame on air is counted in the depth until it ends
+void MMDVMEmulator::drain(int b, qint64 now)
+{
+	BUFFER &buf = m_buffers[b];
+	const qint64 period = BUFFER_MS[b] * 1000000LL;
+
+	while(buf.depth && (buf.next_ns <= now)){
+		if(--buf.depth){
+			buf.next_ns += period;
+		}
+	}
+}
+
+void MMDVMEmulator::handle_tx(const QByteArray &f)
+{
+	const uint8_t type = f[2];
+	const int b = frame_buffer(type);
+	const qint64 now = m_clock.nsecsElapsed();
+	BUFFER &buf = m_buffers[b];
+
+	if(m_modes && !(m_modes & BUFFER_ENABLE[b])){
+		nak(type, 2);		// Wrong mode
+		return;
+	}
+	m_txtype = type;
+	drain(b, now);
+	if(buf.depth >= m_buffer){
+		++m_stats.overflows;
+		nak(type, 5);		// No space
+		return;
+	}
+
+	if(m_txframes == 0){
+		m_txlatency = (m_injectover >= 0) ? (now - m_injectover) / 1000000 : -1;
+		m_txmaxgap = 0;
+		m_txunderruns = 0;
+	}
+	else{
+		m_txmaxgap = qMax(m_txmaxgap, (now - m_txlast) / 1000000);
+		if((buf.depth == 0) && (buf.next_ns < now)){
+			++m_txunderruns;
+		}
+	}
+	if(buf.depth == 0){
+		buf.next_ns = now + BUFFER_MS[b] * 1000000LL;
+	}
+	++buf.depth;
+	m_mode = BUFFER_MODE[b];
+	m_txlast = now;
+	++m_txframes;
+	++m_stats.tx_frames;
+
+	if(is_eot(f)){
+		m_txtimer->stop();
+		tx_end();
+	}
+	else{
+		m_txtimer->start(IDLE_MS);
+	}
+}
+
+void MMDVMEmulator::tx_end()
+{
+	if(m_txframes){
+		emit tx_over(m_txtype, m_txframes, m_txlatency, m_txmaxgap, m_txunderruns);
+	}
+	m_txframes = 0;
+	m_mode = MODE_IDLE;
+}
+
+// Each frame is due at its time in the capture, but no sooner than the air time of the
+// frame before it allows
+void MMDVMEmulator::inject_next()
+{
+	if(m_injectidx >= m_inject.size()){
+		if(m_injectframes){
+			emit rx_over(m_injectframes);
+			m_injectframes = 0;
+		}
+		if(!m_injectloop){
+			return;
+		}
+		m_injectidx = 0;
+		m_injectbase = m_clock.nsecsElapsed();
+		m_injectlast = m_injectbase;
+	}
+
+	const PacketCapture::RECORD &r = m_inject[m_injectidx];
+	const qint64 now = m_clock.nsecsElapsed();
+	qint64 due = m_injectbase + (qint64)(r.usec - m_inject.first().usec) * 1000 / m_injectspeed;
+
+	if(m_injectidx){
+		const PacketCapture::RECORD &p = m_inject[m_injectidx - 1];
+		due = qMax(due, m_injectlast + frame_ms(p.data[2]) * 1000000LL / m_injectspeed);
+		if(is_eot(p.data) || (r.usec - p.usec > IDLE_MS * 1000)){
+			if(m_injectframes){
+				emit rx_over(m_injectframes);
+			}
+			m_injectframes = 0;
+		}
+	}
+
+	if(now < due){
+		m_injecttimer->start((int)((due - now + 999999) / 1000000));
+		return;
+	}
+	if(m_injectframes == 0){
+		m_injectover = now;
+	}
+	m_pty->write(r.data);
+	if(m_record.is_open()){
+		m_record.write(PacketCapture::CAPTURE_RX, r.data, QHostAddress(), 0);
+	}
+	m_injectlast = due;
+	++m_injectframes;
+	++m_stats.injected;
+	++m_injectidx;
+	m_injecttimer->start(0);
+}
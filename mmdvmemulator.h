@@ -0,0 +1,113 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef MMDVMEMULATOR_H
+#define MMDVMEMULATOR_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QList>
+#include <QTimer>
+#include "packetcapture.h"
+#include "ptyport.h"
+
+// An MMDVM modem or hotspot board on a pseudo terminal, speaking protocol 1 or 2. It
+// answers version and status polls and ACKs config, mode and frequency commands like the
+// firmware. Frames the host writes for transmission fill a buffer per mode that empties at
+// the air rate of the mode, whose free space the status replies report, and every over is
+// reported with its length, gaps and the delay from the last injected over. RF is injected
+// from a capture of MMDVM frames, such as one recorded from the host by this emulator,
+// paced at the air rate of each frame.
+class MMDVMEmulator : public QObject
+{
+	Q_OBJECT
+public:
+	MMDVMEmulator(int protocol, QObject *parent = nullptr);
+	~MMDVMEmulator();
+	bool start(QString link = QString());
+	QString port() { return m_pty->name(); }
+	// Frames the host writes are recorded as CAPTURE_TX, injected ones as CAPTURE_RX
+	bool set_record(QString capture);
+	bool set_inject(QString capture, int speed, bool loop);
+	void set_buffer(int frames) { m_buffer = frames; }
+	void set_verbose(bool v) { m_verbose = v; }
+	struct STATS {
+		quint32 commands;
+		quint32 polls;
+		quint32 naks;
+		quint32 injected;
+		quint32 tx_frames;
+		quint32 overflows;
+	};
+	STATS stats() { return m_stats; }
+	// Frame period on air in ms, 0 for a command
+	static int frame_ms(uint8_t type);
+signals:
+	void configured(uint8_t modes);
+	void rx_over(int frames);
+	// latency is from the start of the last injected over to the first frame, -1 if none
+	// came before. underruns counts the times the buffer ran dry during the over.
+	void tx_over(uint8_t type, int frames, qint64 latency_ms, qint64 max_gap_ms, int underruns);
+private slots:
+	void receive(QByteArray data);
+	void inject_next();
+	void tx_end();
+private:
+	struct BUFFER {
+		int depth;
+		qint64 next_ns;		// When the frame on air ends, or the last one ended
+	};
+	int m_protocol;
+	PtyPort *m_pty;
+	QByteArray m_rx;
+	QElapsedTimer m_clock;
+	bool m_verbose;
+	bool m_configured;
+	uint8_t m_modes;
+	uint8_t m_mode;
+	int m_buffer;
+	BUFFER m_buffers[7];		// D-Star, DMR slot 1 and 2, YSF, P25, NXDN, M17 as in the status
+	PacketCapture m_record;
+	QList<PacketCapture::RECORD> m_inject;
+	QTimer *m_injecttimer;
+	int m_injectidx;
+	int m_injectspeed;
+	bool m_injectloop;
+	qint64 m_injectbase;		// Time of the first injected frame, capture time 0
+	qint64 m_injectlast;		// Time the last injected frame was due
+	qint64 m_injectover;		// Start of the last injected over
+	int m_injectframes;
+	QTimer *m_txtimer;
+	uint8_t m_txtype;
+	int m_txframes;
+	qint64 m_txlast;
+	qint64 m_txlatency;
+	qint64 m_txmaxgap;
+	int m_txunderruns;
+	STATS m_stats;
+
+	void handle_frame(const QByteArray &f);
+	void handle_tx(const QByteArray &f);
+	void reply(const QByteArray &f);
+	void ack(uint8_t command);
+	void nak(uint8_t command, uint8_t reason);
+	void drain(int b, qint64 now);
+	static int frame_buffer(uint8_t type);
+	static bool is_eot(const QByteArray &f);
+};
+
+#endif // MMDVMEMULATOR_H
@@ -0,0 +1,61 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// droidstar-mmdvmstatus: checks the TX buffer space SerialModem reads from MMDVM status
+// frames of both protocols.
+//
+//   droidstar-mmdvmstatus
+//
+// Each frame is laid out as the firmware sends it, with a different space in every field
+// so a wrong offset shows. Prints one line per frame and exits 1 if any space is wrong.
+
+#include <QByteArray>
+#include <cstdio>
+#include "serialmodem.h"
+
+struct STATUS_FRAME {
+	const char *name;
+	uint8_t protocol;
+	QByteArray frame;
+	int space[7];		// D-Star, DMR slot 1 and 2, YSF, P25, NXDN, M17
+};
+
+int main()
+{
+	const STATUS_FRAME frames[] = {
+		// Modes, state, flags, then D-Star to NXDN, POCSAG and M17
+		{"protocol 1", 1, QByteArray::fromHex("e00e01bf0000" "0a0b0c0d0e0f" "05" "10"), {10, 11, 12, 13, 14, 15, 16}},
+		// Firmware from before M17
+		{"protocol 1, no M17", 1, QByteArray::fromHex("e00d01bf0000" "0a0b0c0d0e0f" "05"), {10, 11, 12, 13, 14, 15, -1}},
+		// State, flags, a reserved byte, then D-Star to NXDN, M17, FM, POCSAG and AX.25
+		{"protocol 2", 2, QByteArray::fromHex("e010010000" "00" "0a0b0c0d0e0f" "10" "030405"), {10, 11, 12, 13, 14, 15, 16}},
+	};
+	int failed = 0;
+
+	for(const STATUS_FRAME &s : frames){
+		bool ok = true;
+		fprintf(stdout, "%-20s", s.name);
+		for(int b = 0; b < 7; ++b){
+			const int space = SerialModem::status_space(s.frame, s.protocol, b);
+			ok &= (space == s.space[b]);
+			fprintf(stdout, " %3d", space);
+		}
+		fprintf(stdout, "  %s\n", ok ? "ok" : "WRONG");
+		failed += ok ? 0 : 1;
+	}
+	return failed ? 1 : 0;
+}
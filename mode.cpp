@@ -14,12 +14,12 @@
 	You should have received a copy of the GNU General Public License
 	along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
+#include <cstring>
 #include "mode.h"
-#ifdef Q_OS_WIN
-#include <windows.h>
-#else
-#include <dlfcn.h>
-#endif
+#include "vocoderregistry.h"
+#include "MMDVMDefines.h"
+#include "hostresolver.h"
+#include "packettrace.h"
 
 #include "m17.h"
 #include "ysf.h"
@@ -73,12 +73,20 @@ Mode* Mode::create_mode(QString m)
 	return mode;
 }
 
-Mode::Mode()
+Mode::Mode() :
+	m_mbevocoder(nullptr)
 {
 }
 
 Mode::~Mode()
 {
+	delete m_capture;
+	if(m_media){
+		m_media->give_vocoder(VocoderRegistry::mode_codec(m_mode), m_mbevocoder);
+	}
+	else{
+		VocoderRegistry::destroy(m_mbevocoder);
+	}
 }
 
 void Mode::init(QString callsign, uint32_t dmrid, uint16_t nxdnid, char module, QString refname, QString host, int port, bool ipv6, QString vocoder, QString modem, QString audioin, QString audioout, bool mdirect)
@@ -96,7 +104,6 @@ void Mode::init(QString callsign, uint32_t dmrid, uint16_t nxdnid, char module,
 
 	m_modem = nullptr;
 	m_ambedev = nullptr;
-    m_mbevocoder = nullptr;
 	m_hwrx = false;
 	m_hwtx = false;
 	m_tx = false;
@@ -171,7 +178,10 @@ void Mode::in_audio_vol_changed(qreal v)
 
 void Mode::out_audio_vol_changed(qreal v)
 {
-	m_audio->set_output_volume(v);
+	m_outvol = v;
+	if (m_audio) {
+		m_audio->set_output_volume(v);
+	}
 }
 
 void Mode::agc_state_changed(int s)
@@ -224,25 +234,141 @@ void Mode::host_lookup()
     if(m_mdirect && ((m_mode == "M17") || (m_mode == "DMR"))){ // MMDVM_DIRECT currently only supported by M17 and DMR
         mmdvm_direct_connect();
     }
-    else if(m_ipv6 && (m_modeinfo.host != "none")){
-        qDebug() << "Host == " << m_modeinfo.host;
-        QList<QHostAddress> h;
-        QHostInfo i;
-        h.append(QHostAddress(m_modeinfo.host));
-        i.setAddresses(h);
-        hostname_lookup(i);
+    else if(!m_racehost.isEmpty()){
+        // Both addresses of a dual-stack reflector, for the mode to race
+        HostResolver::lookup(m_modeinfo.host, this, [this](QHostInfo a) {
+            HostResolver::lookup(m_racehost, this, [this, a](QHostInfo b) {
+                QHostInfo i = a.addresses().isEmpty() ? b : a;
+                i.setAddresses(a.addresses() + b.addresses());
+                hostname_lookup(i);
+            });
+        });
     }
     else{
-        QHostInfo::lookupHost(m_modeinfo.host, this, SLOT(hostname_lookup(QHostInfo)));
+        HostResolver::lookup(m_modeinfo.host, this, [this](QHostInfo i) {
+            if(m_ipv6){
+                i.setAddresses(HostResolver::interleave(i.addresses()));
+            }
+            hostname_lookup(i);
+        });
     }
 }
 
+void Mode::begin_replay(QHostAddress address, int speed)
+{
+	QList<QHostAddress> h;
+	QHostInfo i;
+
+	m_replay = true;
+	m_hwrx = false;
+	m_hwtx = false;
+	m_modeinfo.status = CONNECTING;
+
+	if(speed == 0){
+		m_rxtimerint = 0;
+		m_txtimerint = 0;
+	}
+	else if(speed > 1){
+		m_rxtimerint = qMax(1, m_rxtimerint / speed);
+		m_txtimerint = qMax(1, m_txtimerint / speed);
+	}
+
+	h.append(address);
+	i.setAddresses(h);
+	hostname_lookup(i);
+}
+
+void Mode::replay_datagram(QByteArray d, QHostAddress a, quint16 p)
+{
+	m_replayrec.data = d;
+	m_replayrec.address = a;
+	m_replayrec.port = p;
+	process_udp();
+}
+
+void Mode::packet_capture_changed(QString f)
+{
+	if(f.isEmpty()){
+		delete m_capture;
+		m_capture = nullptr;
+		return;
+	}
+
+	if(m_capture == nullptr){
+		m_capture = new PacketCapture();
+	}
+
+	PacketCapture::HEADER h;
+	h.mode = m_mode;
+	h.callsign = m_modeinfo.callsign;
+	h.module = m_module;
+	h.dmrid = m_dmrid;
+	h.refname = m_refname;
+	h.host = m_modeinfo.host;
+	h.port = m_modeinfo.port;
+
+	if(m_capture->open_write(f, h)){
+		emit update_log("Capturing packets to " + f);
+	}
+}
+
+qint64 Mode::read_datagram(QByteArray &buf, QHostAddress *sender, quint16 *port)
+{
+	qint64 size;
+
+	if(m_replay){
+		if(buf.isEmpty()){
+			buf = m_replayrec.data;
+			size = buf.size();
+		}
+		else{
+			size = qMin(buf.size(), m_replayrec.data.size());
+			memcpy(buf.data(), m_replayrec.data.constData(), size);
+		}
+		*sender = m_replayrec.address;
+		*port = m_replayrec.port;
+	}
+	else{
+		if(buf.isEmpty()){
+			buf.resize(m_udp->pendingDatagramSize());
+		}
+		size = m_udp->readDatagram(buf.data(), buf.size(), sender, port);
+	}
+
+	if(m_capture && (size > 0)){
+		m_capture->write(PacketCapture::CAPTURE_RX, buf.left(size), *sender, *port);
+	}
+
+	return size;
+}
+
+qint64 Mode::write_datagram(const QByteArray &buf, const QHostAddress &address, quint16 port)
+{
+	if(m_capture){
+		m_capture->write(PacketCapture::CAPTURE_TX, buf, address, port);
+	}
+
+	if(m_replay || (m_udp == nullptr)){
+		return buf.size();
+	}
+
+	return m_udp->writeDatagram(buf, address, port);
+}
+
 void Mode::toggle_tx(bool tx)
 {
 	tx ? start_tx() : stop_tx();
 }
 
 void Mode::start_tx()
+{
+	m_relaytx = false;
+	m_relaycall.clear();
+	m_relayid = 0;
+	begin_tx();
+}
+
+void Mode::begin_tx()
 {
 #if !defined(Q_OS_IOS)
 	if(m_hwtx){
@@ -269,7 +395,7 @@ void Mode::start_tx()
 	}
 #endif
 	if(!m_txtimer->isActive()){
-		if(m_ttsid == 0 && m_audio){
+		if(m_ttsid == 0 && m_audio && !m_relaytx){
 			m_audio->set_input_buffer_size(640);
 			m_audio->start_capture();
 			//audioin->start(&audio_buffer);
@@ -283,14 +409,93 @@ void Mode::stop_tx()
 	m_tx = false;
 }
 
+// Frames queued here are sent by transmit() in place of encoded microphone audio
+void Mode::relay_tx(int, QByteArray frame)
+{
+	if(!m_tx){
+		m_relaytx = true;
+		begin_tx();
+	}
+	if(!m_relaytx){
+		return;			// The microphone has the transmitter
+	}
+	for(int i = 0; i < frame.size(); ++i){
+		m_txcodecq.append(frame.data()[i]);
+	}
+}
+
+void Mode::relay_tx_end()
+{
+	if(m_relaytx){
+		stop_tx();
+	}
+}
+
+// Every complete frame queued for the modem goes to it at once, SerialModem holds them
+// until the modem's buffer has room
+void Mode::write_modem()
+{
+#if !defined(Q_OS_IOS)
+	while((m_rxmodemq.size() > 2) && (m_rxmodemq[0] == MMDVM_FRAME_START) && (m_rxmodemq[1] > 2) && (m_rxmodemq.size() >= m_rxmodemq[1])){
+		QByteArray out;
+		const int s = m_rxmodemq[1];
+		for(int i = 0; i < s; ++i){
+			out.append(m_rxmodemq.dequeue());
+		}
+		m_modem->write(out);
+	}
+#endif
+}
+
+// The volume may have been set before there was an engine to set it on
+AudioEngine * Mode::open_audio()
+{
+	AudioEngine *a;
+
+	if(m_media){
+		a = m_media->take_audio(m_audioin, m_audioout);
+	}
+	else{
+		a = new AudioEngine(m_audioin, m_audioout);
+		a->init();
+	}
+	a->set_output_volume(m_outvol);
+	return a;
+}
+
+void Mode::close_audio()
+{
+	if(m_media){
+		m_media->give_audio(m_audio);
+	}
+	else{
+		delete m_audio;
+	}
+	m_audio = nullptr;
+}
+
+void Mode::trace(const char *tag, const QByteArray &d)
+{
+	if(m_tracemode.isEmpty()){
+		m_tracemode = m_mode.toLatin1();
+	}
+	PacketTrace::record(tag, m_tracemode.constData(), d.constData(), d.size());
+	if(m_debug){
+		qDebug().noquote() << PacketTrace::format(tag, d);
+	}
+}
+
 bool Mode::load_vocoder_plugin()
 {
 	if(m_vocoder == "None") {
 		return false;
 	}
 
-    m_mbevocoder = new MBEVocoder();
-    return true;
+	if(m_mbevocoder == nullptr){
+		const int codec = VocoderRegistry::mode_codec(m_mode);
+		m_mbevocoder = m_media ? m_media->take_vocoder(codec) : VocoderRegistry::create(codec);
+	}
+	return m_mbevocoder != nullptr;
 }
 
 void Mode::deleteLater()
@@ -299,8 +504,7 @@ void Mode::deleteLater()
 		//m_udp->disconnect();
 		//m_ping_timer->stop();
 		send_disconnect();
-        delete m_audio;
-        //if(m_mbevocoder != nullptr) delete m_mbevocoder;
+		close_audio();
 #if !defined(Q_OS_IOS)
 		if(m_hwtx){
 			delete m_ambedev;
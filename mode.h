@@ -25,7 +25,10 @@
 #endif
 #include "imbe_vocoder/imbe_vocoder_api.h"
 #include "mbe/mbevocoder_api.h"
+#include "vocoder_plugin.h"
 #include "audioengine.h"
+#include "mediacontext.h"
+#include "packetcapture.h"
 #if !defined(Q_OS_IOS)
 #include "serialambe.h"
 #include "serialmodem.h"
@@ -67,11 +70,17 @@ public:
 	}
 	virtual void set_dmr_params(uint8_t, QString, QString, QString, QString, QString, QString, QString, QString, QString, QString) {}
 	virtual void set_iax_params(QString, QString, QString, QString, QString, int) {}
+	virtual void set_iax_media(QString, int) {}
+	// A second host for the same reflector, looked up with the first and raced against it
+	void set_race_host(QString host) { m_racehost = host; }
+	// Audio and vocoders are taken from media and given back to it, if set, instead of made
+	void set_media(MediaContext *media) { m_media = media; }
 	void set_dmr_cc(uint32_t cc) { m_dmrColorCode = cc; }
 	bool get_hwrx() { return m_hwrx; }
 	bool get_hwtx() { return m_hwtx; }
 	void set_hostname(std::string);
 	void set_callsign(std::string);
+	void begin_replay(QHostAddress address, int speed);
 	struct MODEINFO {
 		qint64 ts;
 		int status;
@@ -130,6 +139,18 @@ public:
         PACKET_RECEIVED,
         PACKET_SENT
 	};
+	enum{
+		CODEC_NONE,
+		CODEC_AMBE2450,
+		CODEC_AMBE2450X1150,
+		CODEC_AMBE2400X1200,
+		CODEC_IMBE4400,
+		CODEC_CODEC2_3200,
+		CODEC_CODEC2_1600,
+		CODEC_ULAW
+	};
+	// Codecs whose frames can be sent as they are through relay_tx()
+	virtual QList<int> relay_codecs() { return QList<int>(); }
 signals:
 	void update(Mode::MODEINFO);
     void update_log(QString);
@@ -139,7 +160,18 @@ signals:
     void request_connect_toggle();
 	// Request the application schedule a reconnect after the given milliseconds
 	void request_reconnect(int ms);
+	// Received codec frames while relaying, emitted instead of decoding them
+	void relay_rx(int codec, QByteArray frame);
+	void relay_rx_end();
+public slots:
+	void replay_datagram(QByteArray d, QHostAddress a, quint16 p);
+	void set_relay_rx(bool r) { m_relayrx = r; }
+	virtual void relay_tx(int codec, QByteArray frame);
+	virtual void relay_tx_end();
+	// Source of the next relayed transmission, for modes that put one in their headers
+	void relay_talker(QString callsign, uint32_t id) { m_relaycall = callsign; m_relayid = id; }
 protected slots:
+	virtual void process_udp(){}
 	virtual void send_disconnect(){}
 	virtual void hostname_lookup(QHostInfo){}
 	virtual void mmdvm_direct_connect(){}
@@ -167,9 +199,27 @@ protected slots:
     void dst_changed(QString dst){ m_refname = dst; }
     void host_lookup();
     void debug_changed(bool debug){ m_debug = debug; }
+	void packet_capture_changed(QString);
 protected:
+	void begin_tx();
+	qint64 read_datagram(QByteArray &buf, QHostAddress *sender, quint16 *port);
+	qint64 write_datagram(const QByteArray &buf, const QHostAddress &address, quint16 port);
+	void write_modem();
+	AudioEngine * open_audio();
+	void close_audio();
+	void trace(const char *tag, const QByteArray &d);
+	QString relay_callsign(const QString &own) { return (m_relaytx && !m_relaycall.isEmpty()) ? m_relaycall : own; }
+	uint32_t relay_id(uint32_t own) { return (m_relaytx && m_relayid) ? m_relayid : own; }
     QString m_mode;
+	QByteArray m_tracemode;
 	QUdpSocket *m_udp = nullptr;
+	PacketCapture *m_capture = nullptr;
+	bool m_replay = false;
+	bool m_relayrx = false;
+	bool m_relaytx = false;
+	QString m_relaycall;
+	uint32_t m_relayid = 0;
+	PacketCapture::RECORD m_replayrec;
 	QHostAddress m_address;
 	char m_module;
     uint8_t m_watchdog;
@@ -196,6 +246,8 @@ protected:
 	QTimer *m_txtimer;
 	QTimer *m_rxtimer;
 	AudioEngine *m_audio = nullptr;
+	qreal m_outvol = 1.0;		// Given to m_audio when it is opened
+	MediaContext *m_media = nullptr;
 	QString m_audioin;
 	QString m_audioout;
     bool m_mdirect;
@@ -207,9 +259,10 @@ protected:
 	QQueue<uint8_t> m_txcodecq;
 	QQueue<uint8_t> m_rxmodemq;
     imbe_vocoder m_imbevocoder;
-    MBEVocoder *m_mbevocoder;
+    Vocoder *m_mbevocoder;
 	QString m_vocoder;
 	QString m_modemport;
+	QString m_racehost;
 #if defined(Q_OS_IOS)
 	void *m_modem;
 	void *m_ambedev;
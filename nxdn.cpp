@@ -16,10 +16,8 @@
 */
 
 #include "nxdn.h"
+#include "packettrace.h"
 #include <cstring>
-#ifdef USE_MD380_VOCODER
-#include <md380_vocoder.h>
-#endif
 
 const int dvsi_interleave[49] = {
 	0, 3, 6,  9, 12, 15, 18, 21, 24, 27, 30, 33, 36, 39, 41, 43, 45, 47,
@@ -46,9 +44,6 @@ NXDN::NXDN()
 	m_txcnt = 0;
 	m_txtimerint = 19;
 	m_attenuation = 5;
-#ifdef USE_MD380_VOCODER
-    md380_init();
-#endif
 }
 
 NXDN::~NXDN()
@@ -62,18 +57,9 @@ void NXDN::process_udp()
 	quint16 senderPort;
 	uint8_t ambe[7];
 
-	buf.resize(m_udp->pendingDatagramSize());
-	m_udp->readDatagram(buf.data(), buf.size(), &sender, &senderPort);
-
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "RECV:";
-        for(int i = 0; i < buf.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)buf.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+	read_datagram(buf, &sender, &senderPort);
+
+    trace("RECV", buf);
 	if(buf.size() == 17){
 		if(m_modeinfo.status == CONNECTING){
 			m_modeinfo.status = CONNECTED_RW;
@@ -85,8 +71,7 @@ void NXDN::process_udp()
 			connect(m_ping_timer, SIGNAL(timeout()), this, SLOT(send_ping()));
 			//m_mbeenc->set_gain_adjust(2.5);
 			m_modeinfo.sw_vocoder_loaded = load_vocoder_plugin();
-			m_audio = new AudioEngine(m_audioin, m_audioout);
-			m_audio->init();
+			m_audio = open_audio();
 			m_ping_timer->start(1000);
 		}
 		if( (m_modeinfo.stream_state == STREAM_LOST) || (m_modeinfo.stream_state == STREAM_END) ){
@@ -222,17 +207,9 @@ void NXDN::send_ping(bool disconnect)
 	out.append(10 - m_modeinfo.callsign.size(), ' ');
 	out.append((m_modeinfo.gwid >> 8) & 0xff);
 	out.append((m_modeinfo.gwid >> 0) & 0xff);
-	m_udp->writeDatagram(out, m_address, m_modeinfo.port);
-
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "PING:";
-        for(int i = 0; i < out.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+	write_datagram(out, m_address, m_modeinfo.port);
+
+    trace("PING", out);
 }
 
 void NXDN::transmit()
@@ -255,7 +232,7 @@ void NXDN::transmit()
 		}
 	}
 #endif
-	if(m_ttsid == 0){
+	if((m_ttsid == 0) && !m_relaytx){
 		if(m_audio->read(pcm, 160)){
 		}
 		else{
@@ -263,18 +240,17 @@ void NXDN::transmit()
 		}
 	}
 
-	if(m_hwtx){
+	if(m_relaytx){
+		// relay_tx() has already queued the codec frames
+	}
+	else if(m_hwtx){
 #if !defined(Q_OS_IOS)
 		m_ambedev->encode(pcm);
 #endif
 	}
 	else{
 		if(m_modeinfo.sw_vocoder_loaded){
-#ifdef USE_MD380_VOCODER
-            md380_encode(ambe, pcm);
-#else
             m_mbevocoder->encode_2450(pcm, ambe);
-#endif
 		}
 		ambe[6] &= 0x80;
 
@@ -302,17 +278,9 @@ void NXDN::send_frame()
 		m_modeinfo.stream_state = TRANSMITTING;
 		temp_nxdn = get_frame();
 		txdata.append((char *)temp_nxdn, 43);
-		m_udp->writeDatagram(txdata, m_address, m_modeinfo.port);
-
-        if(m_debug){
-            QDebug debug = qDebug();
-            debug.noquote();
-            QString s = "SEND:";
-            for(int i = 0; i < txdata.size(); ++i){
-                s += " " + QString("%1").arg((uint8_t)txdata.data()[i], 2, 16, QChar('0'));
-            }
-            debug << s;
-        }
+		write_datagram(txdata, m_address, m_modeinfo.port);
+
+        trace("SEND", txdata);
 	}
 	else{
 		fprintf(stderr, "NXDN TX stopped\n");
@@ -320,7 +288,7 @@ void NXDN::send_frame()
 		temp_nxdn = get_eot();
 		m_ttscnt = 0;
 		txdata.append((char *)temp_nxdn, 43);
-		m_udp->writeDatagram(txdata, m_address, m_modeinfo.port);
+		write_datagram(txdata, m_address, m_modeinfo.port);
 		m_modeinfo.stream_state = STREAM_IDLE;
 	}
 	m_modeinfo.srcid = m_nxdnid;
@@ -638,6 +606,7 @@ void NXDN::process_rx_data()
 		qDebug() << "NXDN RX stream timeout ";
 		m_rxwatchdog = 0;
 		m_modeinfo.stream_state = STREAM_LOST;
+		PacketTrace::trigger(m_mode + " RX stream timeout");
 		m_modeinfo.ts = QDateTime::currentMSecsSinceEpoch();
 		emit update(m_modeinfo);
 		m_rxcodecq.clear();
@@ -647,7 +616,10 @@ void NXDN::process_rx_data()
 		for(int i = 0; i < 7; ++i){
 			ambe[i] = m_rxcodecq.dequeue();
 		}
-		if(m_hwrx){
+		if(m_relayrx){
+			emit relay_rx(CODEC_AMBE2450, QByteArray((char *)ambe, 7));
+		}
+		else if(m_hwrx){
 #if !defined(Q_OS_IOS)
 			m_ambedev->decode(ambe);
 
@@ -659,11 +631,7 @@ void NXDN::process_rx_data()
 		}
 		else{
 			if(m_modeinfo.sw_vocoder_loaded){
-#ifdef USE_MD380_VOCODER
-                md380_decode(ambe, pcm);
-#else
 				m_mbevocoder->decode_2450(pcm, ambe);
-#endif
 			}
 			else{
 				memset(pcm, 0, 160 * sizeof(int16_t));
@@ -680,6 +648,9 @@ void NXDN::process_rx_data()
 		m_rxcodecq.clear();
 		qDebug() << "YSF playback stopped";
 		m_modeinfo.stream_state = STREAM_IDLE;
+		if(m_relayrx){
+			emit relay_rx_end();
+		}
 		return;
 	}
 }
@@ -30,6 +30,7 @@ public:
 	uint8_t * get_frame();
 	uint8_t * get_eot(){m_eot = true; return get_frame();}
 	void set_hwtx(bool hw){m_hwtx = hw;}
+	QList<int> relay_codecs() { return {CODEC_AMBE2450}; }
 private slots:
 	void process_udp();
 	void process_rx_data();
@@ -17,6 +17,7 @@
 
 #include <cstring>
 #include "p25.h"
+#include "packettrace.h"
 
 const uint8_t REC62[] = {0x62U, 0x02U, 0x02U, 0x0CU, 0x0BU, 0x12U, 0x64U, 0x00U, 0x00U, 0x80U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U,0x00U, 0x00U, 0x00U, 0x00U, 0x00U};
 const uint8_t REC63[] = {0x63U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x02U};
@@ -46,6 +47,7 @@ P25::P25()
 {
     m_mode = "P25";
 	m_p25cnt = 0;
+	m_p25step = 0;
 	m_txtimerint = 19;
 	m_attenuation = 2;
 }
@@ -60,18 +62,9 @@ void P25::process_udp()
 	QHostAddress sender;
 	quint16 senderPort;
 
-	buf.resize(m_udp->pendingDatagramSize());
-	m_udp->readDatagram(buf.data(), buf.size(), &sender, &senderPort);
+	read_datagram(buf, &sender, &senderPort);
 
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "RECV:";
-        for(int i = 0; i < buf.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)buf.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+    trace("RECV", buf);
 	if(buf.size() == 11){
 		if(m_modeinfo.status == CONNECTING){
 			m_modeinfo.status = CONNECTED_RW;
@@ -84,8 +77,7 @@ void P25::process_udp()
 			m_ping_timer = new QTimer();
 			connect(m_ping_timer, SIGNAL(timeout()), this, SLOT(send_ping()));
 			m_ping_timer->start(5000);
-			m_audio = new AudioEngine(m_audioin, m_audioout);
-			m_audio->init();
+			m_audio = open_audio();
 			m_modeinfo.sw_vocoder_loaded = true;
 		}
 		if((m_modeinfo.stream_state == STREAM_LOST) || (m_modeinfo.stream_state == STREAM_END) ){
@@ -185,17 +177,9 @@ void P25::hostname_lookup(QHostInfo i)
 		m_address = i.addresses().first();
 		m_udp = new QUdpSocket(this);
 		connect(m_udp, SIGNAL(readyRead()), this, SLOT(process_udp()));
-		m_udp->writeDatagram(out, m_address, m_modeinfo.port);
+		write_datagram(out, m_address, m_modeinfo.port);
 
-        if(m_debug){
-            QDebug debug = qDebug();
-            debug.noquote();
-            QString s = "CONN:";
-            for(int i = 0; i < out.size(); ++i){
-                s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-            }
-            debug << s;
-        }
+        trace("CONN", out);
 	}
 }
 
@@ -205,17 +189,9 @@ void P25::send_ping()
 	out.append(0xf0);
 	out.append(m_modeinfo.callsign.toUtf8());
 	out.append(10 - m_modeinfo.callsign.size(), ' ');
-	m_udp->writeDatagram(out, m_address, m_modeinfo.port);
+	write_datagram(out, m_address, m_modeinfo.port);
 
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "PING:";
-        for(int i = 0; i < out.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+    trace("PING", out);
 }
 
 void P25::send_disconnect()
@@ -224,17 +200,9 @@ void P25::send_disconnect()
 	out.append(0xf1);
 	out.append(m_modeinfo.callsign.toUtf8());
 	out.append(10 - m_modeinfo.callsign.size(), ' ');
-	m_udp->writeDatagram(out, m_address, m_modeinfo.port);
+	write_datagram(out, m_address, m_modeinfo.port);
 
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "SEND:";
-        for(int i = 0; i < out.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+    trace("SEND", out);
 }
 
 void P25::transmit()
@@ -243,7 +211,6 @@ void P25::transmit()
 	uint8_t imbe[11];
 	int16_t pcm[160];
 	uint8_t buffer[22];
-	static uint8_t p25step = 0;
 #ifdef USE_FLITE
 	if(m_ttsid > 0){
 		for(int i = 0; i < 160; ++i){
@@ -259,7 +226,15 @@ void P25::transmit()
         m_imbevocoder.encode_4400(pcm, imbe);
 	}
 #endif
-	if(m_ttsid == 0){
+	if(m_relaytx){
+		if(m_tx && (m_txcodecq.size() < 11)){
+			return;
+		}
+		for(int i = 0; (i < 11) && !m_txcodecq.isEmpty(); ++i){
+			imbe[i] = m_txcodecq.dequeue();
+		}
+	}
+	else if(m_ttsid == 0){
 		if(m_audio->read(pcm, 160)){
             m_imbevocoder.encode_4400(pcm, imbe);
 		}
@@ -269,25 +244,25 @@ void P25::transmit()
 	}
 
 	if(m_tx){
-		switch (p25step) {
+		switch (m_p25step) {
 		case 0x00U:
 			::memcpy(buffer, REC62, 22U);
 			::memcpy(buffer + 10U, imbe, 11U);
 			txdata.append((char *)buffer, 22U);
-			++p25step;
+			++m_p25step;
 			break;
 		case 0x01U:
 			::memcpy(buffer, REC63, 14U);
 			::memcpy(buffer + 1U, imbe, 11U);
 			txdata.append((char *)buffer, 14U);
-			++p25step;
+			++m_p25step;
 			break;
 		case 0x02U:
 			::memcpy(buffer, REC64, 17U);
 			::memcpy(buffer + 5U, imbe, 11U);
 			buffer[1U] = 0x00U;
 			txdata.append((char *)buffer, 17U);
-			++p25step;
+			++m_p25step;
 			break;
 		case 0x03U:
 			::memcpy(buffer, REC65, 17U);
@@ -296,112 +271,112 @@ void P25::transmit()
 			buffer[2U] = (m_dstid >> 8) & 0xFFU;
 			buffer[3U] = (m_dstid >> 0) & 0xFFU;
 			txdata.append((char *)buffer, 17U);
-			++p25step;
+			++m_p25step;
 			break;
 		case 0x04U:
 			::memcpy(buffer, REC66, 17U);
 			::memcpy(buffer + 5U, imbe, 11U);
-			buffer[1U] = (m_dmrid >> 16) & 0xFFU;
-			buffer[2U] = (m_dmrid >> 8) & 0xFFU;
-			buffer[3U] = (m_dmrid >> 0) & 0xFFU;
+			buffer[1U] = (relay_id(m_dmrid) >> 16) & 0xFFU;
+			buffer[2U] = (relay_id(m_dmrid) >> 8) & 0xFFU;
+			buffer[3U] = (relay_id(m_dmrid) >> 0) & 0xFFU;
 			txdata.append((char *)buffer, 17U);
-			++p25step;
+			++m_p25step;
 			break;
 		case 0x05U:
 			::memcpy(buffer, REC67, 17U);
 			::memcpy(buffer + 5U, imbe, 11U);
 			txdata.append((char *)buffer, 17U);
-			++p25step;
+			++m_p25step;
 			break;
 		case 0x06U:
 			::memcpy(buffer, REC68, 17U);
 			::memcpy(buffer + 5U, imbe, 11U);
 			txdata.append((char *)buffer, 17U);
-			++p25step;
+			++m_p25step;
 			break;
 		case 0x07U:
 			::memcpy(buffer, REC69, 17U);
 			::memcpy(buffer + 5U, imbe, 11U);
 			txdata.append((char *)buffer, 17U);
-			++p25step;
+			++m_p25step;
 			break;
 		case 0x08U:
 			::memcpy(buffer, REC6A, 16U);
 			::memcpy(buffer + 4U, imbe, 11U);
 			txdata.append((char *)buffer, 16U);
-			++p25step;
+			++m_p25step;
 			break;
 		case 0x09U:
 			::memcpy(buffer, REC6B, 22U);
 			::memcpy(buffer + 10U, imbe, 11U);
 			txdata.append((char *)buffer, 22U);
-			++p25step;
+			++m_p25step;
 			break;
 		case 0x0AU:
 			::memcpy(buffer, REC6C, 14U);
 			::memcpy(buffer + 1U, imbe, 11U);
 			txdata.append((char *)buffer, 14U);
-			++p25step;
+			++m_p25step;
 			break;
 		case 0x0BU:
 			::memcpy(buffer, REC6D, 17U);
 			::memcpy(buffer + 5U, imbe, 11U);
 			txdata.append((char *)buffer, 17U);
-			++p25step;
+			++m_p25step;
 			break;
 		case 0x0CU:
 			::memcpy(buffer, REC6E, 17U);
 			::memcpy(buffer + 5U, imbe, 11U);
 			txdata.append((char *)buffer, 17U);
-			++p25step;
+			++m_p25step;
 			break;
 		case 0x0DU:
 			::memcpy(buffer, REC6F, 17U);
 			::memcpy(buffer + 5U, imbe, 11U);
 			txdata.append((char *)buffer, 17U);
-			++p25step;
+			++m_p25step;
 			break;
 		case 0x0EU:
 			::memcpy(buffer, REC70, 17U);
 			::memcpy(buffer + 5U, imbe, 11U);
 			buffer[1U] = 0x80U;
 			txdata.append((char *)buffer, 17U);
-			++p25step;
+			++m_p25step;
 			break;
 		case 0x0FU:
 			::memcpy(buffer, REC71, 17U);
 			::memcpy(buffer + 5U, imbe, 11U);
 			txdata.append((char *)buffer, 17U);
-			++p25step;
+			++m_p25step;
 			break;
 		case 0x10U:
 			::memcpy(buffer, REC72, 17U);
 			::memcpy(buffer + 5U, imbe, 11U);
 			txdata.append((char *)buffer, 17U);
-			++p25step;
+			++m_p25step;
 			break;
 		case 0x11U:
 			::memcpy(buffer, REC73, 16U);
 			::memcpy(buffer + 4U, imbe, 11U);
 			txdata.append((char *)buffer, 16U);
-			p25step = 0;
+			m_p25step = 0;
 			break;
 		}
 		m_modeinfo.stream_state = TRANSMITTING;
-		m_modeinfo.srcid = m_dmrid;
+		m_modeinfo.srcid = relay_id(m_dmrid);
 		m_modeinfo.dstid = m_dstid;
-		m_modeinfo.frame_number = p25step;
-		m_udp->writeDatagram(txdata, m_address, m_modeinfo.port);
+		m_modeinfo.frame_number = m_p25step;
+		write_datagram(txdata, m_address, m_modeinfo.port);
 	}
 	else{
 		txdata.append((char *)REC80, 17U);
-		m_udp->writeDatagram(txdata, m_address, m_modeinfo.port);
+		write_datagram(txdata, m_address, m_modeinfo.port);
 		fprintf(stderr, "P25 TX stopped\n");
 		m_txtimer->stop();
-		if(m_ttsid == 0){
+		if((m_ttsid == 0) && !m_relaytx){
 			m_audio->stop_capture();
 		}
-		p25step = 0;
+		m_p25step = 0;
 		m_modeinfo.stream_state = STREAM_IDLE;
 		m_modeinfo.srcid = 0;
 		m_modeinfo.dstid = 0;
@@ -411,15 +386,7 @@ void P25::transmit()
 	emit update_output_level(m_audio->level() * 6);
 	emit update(m_modeinfo);
 
-        if(m_debug){
-            QDebug debug = qDebug();
-            debug.noquote();
-            QString s = "SEND:";
-            for(int i = 0; i < txdata.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)txdata.data()[i], 2, 16, QChar('0'));
-            }
-            debug << s;
-        }
+        trace("SEND", txdata);
 }
 
 void P25::process_rx_data()
@@ -428,6 +395,7 @@ void P25::process_rx_data()
 		qDebug() << "P25 RX stream timeout ";
 		m_rxwatchdog = 0;
 		m_modeinfo.stream_state = STREAM_LOST;
+		PacketTrace::trigger(m_mode + " RX stream timeout");
 		m_modeinfo.ts = QDateTime::currentMSecsSinceEpoch();
 		emit update(m_modeinfo);
 		m_modeinfo.streamid = 0;
@@ -441,6 +409,10 @@ void P25::process_rx_data()
 			imbe[i] = m_rxcodecq.dequeue();
 		}
 
+		if(m_relayrx){
+			emit relay_rx(CODEC_IMBE4400, QByteArray((char *)imbe, 11));
+			return;
+		}
         m_imbevocoder.decode_4400(pcm, imbe);
 		m_audio->write(pcm, 160);
 		emit update_output_level(m_audio->level());
@@ -453,5 +425,8 @@ void P25::process_rx_data()
 		m_rxcodecq.clear();
 		qDebug() << "P25 playback stopped";
 		m_modeinfo.stream_state = STREAM_IDLE;
+		if(m_relayrx){
+			emit relay_rx_end();
+		}
 	}
 }
@@ -27,8 +27,10 @@ public:
 	P25();
 	~P25();
 	uint8_t * get_frame(uint8_t *ambe);
+	QList<int> relay_codecs() { return {CODEC_IMBE4400}; }
 private:
 	int m_p25cnt;
+	uint8_t m_p25step;
 	uint8_t imbe[11U];
 	int m_dstid;
 	uint32_t m_txdstid;
@@ -0,0 +1,211 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include <QDateTime>
+#include <QtEndian>
+#include <QDebug>
+#include "packetcapture.h"
+
+#define CAPTURE_MAGIC	"DSCP"
+#define CAPTURE_VERSION	1
+
+template<typename T> static void put(QByteArray &b, T v)
+{
+	T le = qToLittleEndian(v);
+	b.append(reinterpret_cast<const char *>(&le), sizeof(T));
+}
+
+PacketCapture::PacketCapture() :
+	m_count(0),
+	m_flushed(0)
+{
+	m_rec.reserve(1024);
+}
+
+PacketCapture::~PacketCapture()
+{
+	close();
+}
+
+void PacketCapture::put_string(QByteArray &b, const QString &s)
+{
+	QByteArray u = s.toUtf8().left(255);
+	b.append((char)u.size());
+	b.append(u);
+}
+
+bool PacketCapture::get(void *p, qint64 len)
+{
+	return m_file.read(reinterpret_cast<char *>(p), len) == len;
+}
+
+bool PacketCapture::get_string(QString &s)
+{
+	uint8_t len;
+	if(!get(&len, 1)){
+		return false;
+	}
+	QByteArray u = m_file.read(len);
+	s = QString::fromUtf8(u);
+	return u.size() == len;
+}
+
+bool PacketCapture::open_write(QString path, const HEADER &h)
+{
+	close();
+	m_file.setFileName(path);
+
+	if(!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)){
+		qDebug() << "PacketCapture: cannot open " << path << ":" << m_file.errorString();
+		return false;
+	}
+
+	m_header = h;
+	m_header.start = QDateTime::currentMSecsSinceEpoch();
+	m_count = 0;
+
+	QByteArray b;
+	b.append(CAPTURE_MAGIC, 4);
+	put<quint16>(b, CAPTURE_VERSION);
+	put_string(b, m_header.mode);
+	put_string(b, m_header.callsign);
+	b.append(m_header.module);
+	put<quint32>(b, m_header.dmrid);
+	put_string(b, m_header.refname);
+	put_string(b, m_header.host);
+	put<quint16>(b, m_header.port);
+	put<qint64>(b, m_header.start);
+	m_file.write(b);
+	m_file.flush();
+	m_timer.start();
+	m_flushed = 0;
+	return true;
+}
+
+bool PacketCapture::open_read(QString path)
+{
+	char magic[4];
+	quint16 version;
+
+	close();
+	m_file.setFileName(path);
+
+	if(!m_file.open(QIODevice::ReadOnly)){
+		qDebug() << "PacketCapture: cannot open " << path << ":" << m_file.errorString();
+		return false;
+	}
+
+	m_count = 0;
+
+	if( !get(magic, 4) || (memcmp(magic, CAPTURE_MAGIC, 4) != 0) || !get(&version, 2) ||
+		(qFromLittleEndian(version) != CAPTURE_VERSION) ||
+		!get_string(m_header.mode) || !get_string(m_header.callsign) ||
+		!get(&m_header.module, 1) || !get(&m_header.dmrid, 4) || !get_string(m_header.refname) ||
+		!get_string(m_header.host) || !get(&m_header.port, 2) || !get(&m_header.start, 8) )
+	{
+		qDebug() << "PacketCapture: " << path << " is not a capture file";
+		m_file.close();
+		return false;
+	}
+
+	m_header.dmrid = qFromLittleEndian(m_header.dmrid);
+	m_header.port = qFromLittleEndian(m_header.port);
+	m_header.start = qFromLittleEndian(m_header.start);
+	return true;
+}
+
+void PacketCapture::close()
+{
+	if(m_file.isOpen()){
+		m_file.close();
+	}
+}
+
+void PacketCapture::write(uint8_t dir, const QByteArray &d, const QHostAddress &a, quint16 port)
+{
+	if(!m_file.isOpen()){
+		return;
+	}
+
+	m_rec.clear();
+	put<quint64>(m_rec, static_cast<quint64>(m_timer.nsecsElapsed() / 1000));
+	m_rec.append(dir);
+
+	if(a.protocol() == QAbstractSocket::IPv6Protocol){
+		Q_IPV6ADDR ip6 = a.toIPv6Address();
+		m_rec.append((char)16);
+		m_rec.append(reinterpret_cast<const char *>(ip6.c), 16);
+	}
+	else{
+		quint32 ip4 = a.toIPv4Address();
+		m_rec.append((char)4);
+		put<quint32>(m_rec, ip4);
+	}
+
+	put<quint16>(m_rec, port);
+	put<quint16>(m_rec, static_cast<quint16>(d.size()));
+	m_rec.append(d);
+	m_file.write(m_rec);
+	m_count++;
+
+	if(m_timer.elapsed() - m_flushed >= FLUSH_MS){
+		m_file.flush();
+		m_flushed = m_timer.elapsed();
+	}
+}
+
+bool PacketCapture::read(RECORD &r)
+{
+	uint8_t alen;
+	quint16 len;
+
+	if(!get(&r.usec, 8) || !get(&r.dir, 1) || !get(&alen, 1)){
+		return false;
+	}
+	r.usec = qFromLittleEndian(r.usec);
+
+	if(alen == 16){
+		Q_IPV6ADDR ip6;
+		if(!get(ip6.c, 16)){
+			return false;
+		}
+		r.address.setAddress(ip6);
+	}
+	else if(alen == 4){
+		quint32 ip4;
+		if(!get(&ip4, 4)){
+			return false;
+		}
+		r.address.setAddress(qFromLittleEndian(ip4));
+	}
+	else{
+		return false;
+	}
+
+	if(!get(&r.port, 2) || !get(&len, 2)){
+		return false;
+	}
+	r.port = qFromLittleEndian(r.port);
+	r.data = m_file.read(qFromLittleEndian(len));
+
+	if(r.data.size() != qFromLittleEndian(len)){
+		return false;
+	}
+	m_count++;
+	return true;
+}
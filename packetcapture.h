@@ -0,0 +1,80 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef PACKETCAPTURE_H
+#define PACKETCAPTURE_H
+
+#include <QFile>
+#include <QElapsedTimer>
+#include <QHostAddress>
+
+// Append-only capture file layout (all fields little endian):
+//  header: "DSCP" magic, uint16 version, uint8 mode len + mode, uint8 callsign len + callsign,
+//          uint8 module, uint32 dmrid, uint8 refname len + refname,
+//          uint8 host len + host, uint16 port, int64 start (ms since epoch)
+//  record: uint64 usec since start, uint8 dir, uint8 addr len (4 or 16) + addr, uint16 port, uint16 len + payload
+// Records are buffered by QFile and flushed by the first write() FLUSH_MS after the last
+// flush and by close(), so a crash can lose the records of the last second or so.
+class PacketCapture
+{
+public:
+	static const int FLUSH_MS = 1000;
+	enum{
+		CAPTURE_RX,
+		CAPTURE_TX
+	};
+	struct RECORD {
+		quint64 usec;
+		uint8_t dir;
+		QHostAddress address;
+		quint16 port;
+		QByteArray data;
+	};
+	struct HEADER {
+		QString mode;
+		QString callsign;
+		char module;
+		uint32_t dmrid;
+		QString refname;
+		QString host;
+		quint16 port;
+		qint64 start;
+	};
+	PacketCapture();
+	~PacketCapture();
+	bool open_write(QString path, const HEADER &h);
+	bool open_read(QString path);
+	void close();
+	void write(uint8_t dir, const QByteArray &d, const QHostAddress &a, quint16 port);
+	bool read(RECORD &r);
+	bool is_open() { return m_file.isOpen(); }
+	const HEADER & header() { return m_header; }
+	quint32 count() { return m_count; }
+private:
+	QFile m_file;
+	QElapsedTimer m_timer;
+	HEADER m_header;
+	quint32 m_count;
+	qint64 m_flushed;
+	QByteArray m_rec;
+
+	static void put_string(QByteArray &b, const QString &s);
+	bool get_string(QString &s);
+	bool get(void *p, qint64 len);
+};
+
+#endif // PACKETCAPTURE_H
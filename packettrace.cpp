@@ -0,0 +1,237 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QMutex>
+#include <QSaveFile>
+#include <QtEndian>
+#include <QDebug>
+#include "packettrace.h"
+
+#define TRACE_MAGIC		"DSTR"
+#define TRACE_VERSION	1
+
+// seq is 2n+1 while record n is being written to the slot and 2n+2 once it is complete,
+// so a reader can tell a torn or overwritten slot from the one it expects
+struct SLOT {
+	std::atomic<quint64> seq;
+	quint64 ns;
+	char tag[4];
+	char mode[4];
+	quint16 size;
+	quint16 stored;
+	char data[PacketTrace::PAYLOAD];
+};
+
+static SLOT s_ring[PacketTrace::SLOTS];
+static std::atomic<quint64> s_next(0);
+static QMutex s_lock;
+static QString s_dir;
+static quint64 s_lasttrigger = 0;
+
+static quint64 now_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template<typename T> static void put(QByteArray &b, T v)
+{
+	T le = qToLittleEndian(v);
+	b.append(reinterpret_cast<const char *>(&le), sizeof(T));
+}
+
+template<typename T> static bool get(const QByteArray &b, int &pos, T *v)
+{
+	if((pos + (int)sizeof(T)) > b.size()){
+		return false;
+	}
+	memcpy(v, b.constData() + pos, sizeof(T));
+	*v = qFromLittleEndian(*v);
+	pos += sizeof(T);
+	return true;
+}
+
+static void copy_name(char *dst, const char *src)
+{
+	memset(dst, 0, 4);
+	strncpy(dst, src, 4);
+}
+
+void PacketTrace::record(const char *tag, const char *mode, const char *data, int size)
+{
+	const quint64 n = s_next.fetch_add(1, std::memory_order_relaxed);
+	SLOT &s = s_ring[n % SLOTS];
+
+	s.seq.store(2 * n + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	s.ns = now_ns();
+	copy_name(s.tag, tag);
+	copy_name(s.mode, mode);
+	s.size = qBound(0, size, 0xffff);
+	s.stored = qMin(s.size, (quint16)PAYLOAD);
+	memcpy(s.data, data, s.stored);
+	s.seq.store(2 * n + 2, std::memory_order_release);
+}
+
+QList<PacketTrace::RECORD> PacketTrace::snapshot()
+{
+	const quint64 next = s_next.load(std::memory_order_acquire);
+	QList<RECORD> records;
+	RECORD r;
+
+	records.reserve(qMin(next, (quint64)SLOTS));
+	for(quint64 n = (next > SLOTS) ? next - SLOTS : 0; n < next; ++n){
+		const SLOT &s = s_ring[n % SLOTS];
+		if(s.seq.load(std::memory_order_acquire) != (2 * n + 2)){
+			continue;
+		}
+		r.ns = s.ns;
+		r.tag = QByteArray(s.tag, qstrnlen(s.tag, 4));
+		r.mode = QByteArray(s.mode, qstrnlen(s.mode, 4));
+		r.size = s.size;
+		r.data = QByteArray(s.data, qMin(s.stored, (quint16)PAYLOAD));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		// Rewritten while it was copied
+		if(s.seq.load(std::memory_order_relaxed) != (2 * n + 2)){
+			continue;
+		}
+		records.append(r);
+	}
+	return records;
+}
+
+bool PacketTrace::dump(const QString &path, const QString &reason)
+{
+	const QList<RECORD> records = snapshot();
+	const QByteArray u = reason.toUtf8().left(255);
+	QSaveFile f(path);
+	QByteArray b;
+
+	b.reserve(32 + u.size() + records.size() * (20 + PAYLOAD));
+	b.append(TRACE_MAGIC, 4);
+	put<quint16>(b, TRACE_VERSION);
+	put<qint64>(b, QDateTime::currentMSecsSinceEpoch());
+	put<quint64>(b, now_ns());
+	b.append((char)u.size());
+	b.append(u);
+	put<quint32>(b, records.size());
+	for(const RECORD &r : records){
+		put<quint64>(b, r.ns);
+		b.append(r.tag.leftJustified(4, '\0', true));
+		b.append(r.mode.leftJustified(4, '\0', true));
+		put<quint16>(b, r.size);
+		put<quint16>(b, r.data.size());
+		b.append(r.data);
+	}
+
+	if(!f.open(QIODevice::WriteOnly)){
+		qDebug() << "PacketTrace: cannot open " << path << ":" << f.errorString();
+		return false;
+	}
+	f.write(b);
+	return f.commit();
+}
+
+void PacketTrace::set_dump_dir(const QString &dir)
+{
+	QMutexLocker l(&s_lock);
+	s_dir = dir;
+	if(!dir.isEmpty()){
+		QDir().mkpath(dir);
+	}
+}
+
+QString PacketTrace::dump_dir()
+{
+	QMutexLocker l(&s_lock);
+	return s_dir;
+}
+
+QString PacketTrace::trigger(const QString &reason)
+{
+	QMutexLocker l(&s_lock);
+	const quint64 now = now_ns();
+
+	if(s_dir.isEmpty() || (s_lasttrigger && ((now - s_lasttrigger) < TRIGGER_INTERVAL * 1000000000ULL))){
+		return QString();
+	}
+	s_lasttrigger = now;
+	const QString path = QDir(s_dir).filePath("trace-" + QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss") + ".dstrace");
+	if(!dump(path, reason)){
+		return QString();
+	}
+	qDebug() << "PacketTrace: " << reason << ", trace written to " << path;
+	return path;
+}
+
+bool PacketTrace::load(const QString &path, HEADER &h, QList<RECORD> &records)
+{
+	QFile f(path);
+	QByteArray b;
+	int pos = 4;
+	quint16 version, stored;
+	quint8 len;
+	quint32 count;
+	RECORD r;
+
+	if(!f.open(QIODevice::ReadOnly)){
+		return false;
+	}
+	b = f.readAll();
+	if(!b.startsWith(TRACE_MAGIC) || !get(b, pos, &version) || (version != TRACE_VERSION) ||
+		!get(b, pos, &h.wall_ms) || !get(b, pos, &h.wall_ns) || !get(b, pos, &len) || ((pos + len) > b.size()))
+	{
+		return false;
+	}
+	h.reason = QString::fromUtf8(b.mid(pos, len));
+	pos += len;
+	if(!get(b, pos, &count)){
+		return false;
+	}
+
+	records.clear();
+	for(quint32 i = 0; i < count; ++i){
+		if(!get(b, pos, &r.ns) || ((pos + 8) > b.size())){
+			return false;
+		}
+		r.tag = b.mid(pos, 4);
+		r.tag.truncate(qstrnlen(r.tag.constData(), 4));
+		r.mode = b.mid(pos + 4, 4);
+		r.mode.truncate(qstrnlen(r.mode.constData(), 4));
+		pos += 8;
+		if(!get(b, pos, &r.size) || !get(b, pos, &stored) || ((pos + stored) > b.size())){
+			return false;
+		}
+		r.data = b.mid(pos, stored);
+		pos += stored;
+		records.append(r);
+	}
+	return true;
+}
+
+QString PacketTrace::format(const char *tag, const QByteArray &data)
+{
+	if(data.isEmpty()){
+		return QString(tag) + ":";
+	}
+	return QString(tag) + ": " + QString::fromLatin1(data.toHex(' '));
+}
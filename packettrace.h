@@ -0,0 +1,70 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef PACKETTRACE_H
+#define PACKETTRACE_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+// The last SLOTS packets of every mode, always recorded. A record is a copy into a fixed
+// slot of a ring shared by all mode threads, claimed with one atomic add, so recording
+// takes no lock and allocates nothing. Nothing is formatted until the ring is dumped,
+// by dump() on demand or trigger() when a mode loses its stream.
+//
+// Trace file layout (all fields little endian):
+//  header: "DSTR" magic, uint16 version, int64 dump time (ms since epoch),
+//          uint64 dump time (ns on the trace clock), uint8 reason len + reason, uint32 records
+//  record: uint64 ns on the trace clock, 4 byte tag, 4 byte mode, uint16 len,
+//          uint16 stored len + stored payload (the first PAYLOAD bytes)
+class PacketTrace
+{
+public:
+	enum{
+		SLOTS = 4096,
+		PAYLOAD = 228,
+		TRIGGER_INTERVAL = 60
+	};
+	struct RECORD {
+		quint64 ns;
+		QByteArray tag;
+		QByteArray mode;
+		quint16 size;
+		QByteArray data;
+	};
+	struct HEADER {
+		qint64 wall_ms;
+		quint64 wall_ns;
+		QString reason;
+	};
+	// tag and mode are up to 4 characters
+	static void record(const char *tag, const char *mode, const char *data, int size);
+	static QList<RECORD> snapshot();
+	static bool dump(const QString &path, const QString &reason);
+	// Where trigger() writes, made if missing. Nothing is written while it is empty
+	static void set_dump_dir(const QString &dir);
+	static QString dump_dir();
+	// Dumps to a new file in the dump directory, at most once every TRIGGER_INTERVAL
+	// seconds. Returns the file written or an empty string
+	static QString trigger(const QString &reason);
+	static bool load(const QString &path, HEADER &h, QList<RECORD> &records);
+	// "TAG: xx xx xx", as the debug output has always printed a packet
+	static QString format(const char *tag, const QByteArray &data);
+};
+
+#endif // PACKETTRACE_H
@@ -0,0 +1,121 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <QDebug>
+#include <QFile>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include "ptyport.h"
+
+PtyPort::PtyPort(QObject *parent) :
+	QObject(parent),
+	m_master(-1),
+	m_slave(-1),
+	m_notifier(nullptr),
+	m_retry(new QTimer(this))
+{
+	m_retry->setSingleShot(true);
+	connect(m_retry, &QTimer::timeout, this, &PtyPort::flush);
+}
+
+PtyPort::~PtyPort()
+{
+	if(!m_link.isEmpty()){
+		QFile::remove(m_link);
+	}
+	if(m_slave != -1){
+		::close(m_slave);
+	}
+	if(m_master != -1){
+		::close(m_master);
+	}
+}
+
+bool PtyPort::open(QString link)
+{
+	struct termios t;
+
+	m_master = posix_openpt(O_RDWR | O_NOCTTY);
+	if((m_master == -1) || grantpt(m_master) || unlockpt(m_master)){
+		qWarning() << "PtyPort: cannot open a pty:" << strerror(errno);
+		return false;
+	}
+	m_name = ptsname(m_master);
+
+	// Holding the slave open keeps the master readable between clients, raw so that no
+	// byte is translated or echoed
+	m_slave = ::open(m_name.toLocal8Bit().constData(), O_RDWR | O_NOCTTY);
+	if((m_slave == -1) || tcgetattr(m_slave, &t)){
+		qWarning() << "PtyPort: cannot open" << m_name << strerror(errno);
+		return false;
+	}
+	cfmakeraw(&t);
+	tcsetattr(m_slave, TCSANOW, &t);
+	fcntl(m_master, F_SETFL, fcntl(m_master, F_GETFL) | O_NONBLOCK);
+
+	if(!link.isEmpty()){
+		QFile::remove(link);
+		if(symlink(m_name.toLocal8Bit().constData(), link.toLocal8Bit().constData())){
+			qWarning() << "PtyPort: cannot link" << link << strerror(errno);
+		}
+		else{
+			m_link = link;
+		}
+	}
+
+	m_notifier = new QSocketNotifier(m_master, QSocketNotifier::Read, this);
+	connect(m_notifier, &QSocketNotifier::activated, this, &PtyPort::read_master);
+	return true;
+}
+
+void PtyPort::read_master()
+{
+	QByteArray d;
+	char buf[4096];
+	ssize_t n;
+
+	while((n = ::read(m_master, buf, sizeof(buf))) > 0){
+		d.append(buf, n);
+	}
+	if(!d.isEmpty()){
+		emit data_received(d);
+	}
+}
+
+void PtyPort::write(const QByteArray &data)
+{
+	m_out.append(data);
+	flush();
+}
+
+void PtyPort::flush()
+{
+	while(!m_out.isEmpty()){
+		const ssize_t n = ::write(m_master, m_out.constData(), m_out.size());
+		if(n <= 0){
+			break;
+		}
+		m_out.remove(0, n);
+	}
+	// The client has stopped reading, try again shortly
+	if(!m_out.isEmpty() && !m_retry->isActive()){
+		m_retry->start(1);
+	}
+}
@@ -0,0 +1,53 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef PTYPORT_H
+#define PTYPORT_H
+
+#include <QObject>
+#include <QSocketNotifier>
+#include <QTimer>
+
+// The master side of a raw pseudo terminal, for the device emulators. Clients open the
+// slave side, or a symlink to it, as they would a USB serial port.
+class PtyPort : public QObject
+{
+	Q_OBJECT
+public:
+	PtyPort(QObject *parent = nullptr);
+	~PtyPort();
+	// link names a symlink to create to the slave side
+	bool open(QString link = QString());
+	QString name() { return m_name; }
+	// What the client is not reading yet is kept and written later
+	void write(const QByteArray &data);
+signals:
+	void data_received(QByteArray);
+private slots:
+	void read_master();
+	void flush();
+private:
+	int m_master;
+	int m_slave;
+	QString m_name;
+	QString m_link;
+	QSocketNotifier *m_notifier;
+	QTimer *m_retry;
+	QByteArray m_out;
+};
+
+#endif // PTYPORT_H
@@ -18,6 +18,7 @@
 #include <cstring>
 #include "ref.h"
 #include "CRCenc.h"
+#include "packettrace.h"
 
 
 const uint8_t MMDVM_DSTAR_HEADER = 0x10U;
@@ -29,6 +30,15 @@ REF::REF()
 {
     m_mode = "REF";
 	m_attenuation = 5;
+	m_sdsync = false;
+	m_sdtxtseq = 0;
+	m_sdgpscnt = 0;
+	m_sdhdrcnt = 0;
+	m_sddebugcnt = 0;
+	::memset(m_sduserdata, 0, sizeof(m_sduserdata));
+	::memset(m_sddebugdata, 0, sizeof(m_sddebugdata));
+	m_txstreamid = 0;
+	m_txsendheader = true;
 }
 
 REF::~REF()
@@ -41,29 +51,12 @@ void REF::process_udp()
 	QByteArray out;
 	QHostAddress sender;
 	quint16 senderPort;
-	static bool sd_sync = 0;
-    static int sd_txt_seq = 0;
-    static int sd_gps_cnt = 0;
-    static int sd_hdr_cnt = 0;
-    static int sd_debug_cnt = 0;
-	static char user_data[21];
-    static QByteArray gps_data;
-    static uint8_t debug_data[64];
 
 	const uint8_t header[5] = {0x80,0x44,0x53,0x56,0x54};
 
-	buf.resize(m_udp->pendingDatagramSize());
-	m_udp->readDatagram(buf.data(), buf.size(), &sender, &senderPort);
+	read_datagram(buf, &sender, &senderPort);
 
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "RECV:";
-        for(int i = 0; i < buf.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)buf.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+    trace("RECV", buf);
 
 	if ((buf.size() == 5) && (buf.data()[0] == 5)){
 		int x = (::rand() % (999999 - 7245 + 1)) + 7245;
@@ -75,7 +68,7 @@ void REF::process_udp()
 		out.append(m_modeinfo.callsign.toUpper().toLocal8Bit().data(), 6);
 		out.append(10,'\x00');
 		out.append(serial.toUtf8());
-		m_udp->writeDatagram(out, m_address, 20001);
+		write_datagram(out, m_address, 20001);
 	}
 	if(buf.size() == 3){ //2 way keep alive ping
 		m_modeinfo.count++;
@@ -85,14 +78,8 @@ void REF::process_udp()
 		emit update(m_modeinfo);
 	}
 
-    if(m_debug && out.size() > 0){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "RECV:";
-        for(int i = 0; i < out.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
+    if(out.size() > 0){
+        trace("RECV", out);
     }
 
 	if((m_modeinfo.status == CONNECTING) && (buf.size() == 0x08)){
@@ -105,8 +92,7 @@ void REF::process_udp()
 			m_ping_timer = new QTimer();
 			connect(m_ping_timer, SIGNAL(timeout()), this, SLOT(send_ping()));
 			m_ping_timer->start(1000);
-			m_audio = new AudioEngine(m_audioin, m_audioout);
-			m_audio->init();
+			m_audio = open_audio();
 
 			if(buf.data()[7] == 0x57){ //OKRW
 				m_modeinfo.status = CONNECTED_RW;
@@ -179,8 +165,8 @@ void REF::process_udp()
 
 				qDebug() << "New stream from " << m_modeinfo.src << " to " << m_modeinfo.dst << " id == " << QString::number(m_modeinfo.streamid, 16);
 				emit update(m_modeinfo);
-                sd_gps_cnt = 0;
-                gps_data.clear();
+                m_sdgpscnt = 0;
+                m_sdgpsdata.clear();
 			}
 		}
 		else{
@@ -205,134 +191,134 @@ void REF::process_udp()
 			}
 		}
 		if((buf.data()[16] == 0) && (buf.data()[26] == 0x55) && (buf.data()[27] == 0x2d) && (buf.data()[28] == 0x16)){
-			sd_sync = 1;
-            sd_txt_seq = 1;
-            //sd_debug_cnt = 0;
+			m_sdsync = 1;
+            m_sdtxtseq = 1;
+            //m_sddebugcnt = 0;
             //for(int i = 0; i < 63; i++){
-            //    fprintf(stderr, "%02x ", debug_data[i]);
+            //    fprintf(stderr, "%02x ", m_sddebugdata[i]);
             //}
            // fprintf(stderr, "\n");
 		}
-        //debug_data[sd_debug_cnt++] = buf.data()[26] ^ 0x70;
-        //debug_data[sd_debug_cnt++] = buf.data()[27] ^ 0x4f;
-        //debug_data[sd_debug_cnt++] = buf.data()[28] ^ 0x93;
+        //m_sddebugdata[m_sddebugcnt++] = buf.data()[26] ^ 0x70;
+        //m_sddebugdata[m_sddebugcnt++] = buf.data()[27] ^ 0x4f;
+        //m_sddebugdata[m_sddebugcnt++] = buf.data()[28] ^ 0x93;
 
         char c = buf.data()[26] ^ 0x70;
 
-        if( sd_sync && !sd_gps_cnt && ((c & 0xf0) == 0x50)){
-            sd_hdr_cnt = (c & 0x0f);
+        if( m_sdsync && !m_sdgpscnt && ((c & 0xf0) == 0x50)){
+            m_sdhdrcnt = (c & 0x0f);
         }
-        else if(sd_hdr_cnt){
+        else if(m_sdhdrcnt){
             c = 0;
-            sd_hdr_cnt = 0;
+            m_sdhdrcnt = 0;
         }
-        if( sd_sync && !sd_gps_cnt && ((c & 0xf0) == 0x30)){
-            sd_gps_cnt = (c & 0x0f);
+        if( m_sdsync && !m_sdgpscnt && ((c & 0xf0) == 0x30)){
+            m_sdgpscnt = (c & 0x0f);
             c = buf.data()[27] ^ 0x4f;
             if( (c == 0x0a) || (c == 0x0d) ){
-                gps_data.append('\0');
-                sd_gps_cnt = 0;
-                QTextStream(stderr) << "GPS: " << QString(gps_data) << Qt::endl;
-                if(gps_data[0] == '$') emit update_log("GPS: " + QString(gps_data));
-                gps_data.clear();
+                m_sdgpsdata.append('\0');
+                m_sdgpscnt = 0;
+                QTextStream(stderr) << "GPS: " << QString(m_sdgpsdata) << Qt::endl;
+                if(m_sdgpsdata[0] == '$') emit update_log("GPS: " + QString(m_sdgpsdata));
+                m_sdgpsdata.clear();
             }
             else{
-                sd_gps_cnt--;
-                gps_data.append(c);
+                m_sdgpscnt--;
+                m_sdgpsdata.append(c);
                 c = buf.data()[28] ^ 0x93;
                 if( (c == 0x0a) || (c == 0x0d) ){
-                    gps_data.append('\0');
-                    sd_gps_cnt = 0;
-                    QTextStream(stderr) << "GPS: " << QString(gps_data) << Qt::endl;
-                    if(gps_data[0] == '$') emit update_log("GPS: " + QString(gps_data));
-                    gps_data.clear();
+                    m_sdgpsdata.append('\0');
+                    m_sdgpscnt = 0;
+                    QTextStream(stderr) << "GPS: " << QString(m_sdgpsdata) << Qt::endl;
+                    if(m_sdgpsdata[0] == '$') emit update_log("GPS: " + QString(m_sdgpsdata));
+                    m_sdgpsdata.clear();
                 }
                 else{
-                    sd_gps_cnt--;
-                    gps_data.append(c);
+                    m_sdgpscnt--;
+                    m_sdgpsdata.append(c);
                 }
             }
         }
-        else if(sd_gps_cnt && (buf.data()[16] != 0)){
+        else if(m_sdgpscnt && (buf.data()[16] != 0)){
             if( (c == 0x0a) || (c == 0x0d) ){
-                gps_data.append('\0');
-                sd_gps_cnt = 0;
-                QTextStream(stderr) << "GPS: " << QString(gps_data) << Qt::endl;
-                if(gps_data[0] == '$') emit update_log("GPS: " + QString(gps_data));
-                gps_data.clear();
+                m_sdgpsdata.append('\0');
+                m_sdgpscnt = 0;
+                QTextStream(stderr) << "GPS: " << QString(m_sdgpsdata) << Qt::endl;
+                if(m_sdgpsdata[0] == '$') emit update_log("GPS: " + QString(m_sdgpsdata));
+                m_sdgpsdata.clear();
             }
             else{
-                gps_data.append(c);
+                m_sdgpsdata.append(c);
                 c = buf.data()[27] ^ 0x4f;
                 if( (c == 0x0a) || (c == 0x0d) ){
-                    gps_data.append('\0');
-                    sd_gps_cnt = 0;
-                    QTextStream(stderr) << "GPS: " << QString(gps_data) << Qt::endl;
-                    if(gps_data[0] == '$') emit update_log("GPS: " + QString(gps_data));
-                    gps_data.clear();
+                    m_sdgpsdata.append('\0');
+                    m_sdgpscnt = 0;
+                    QTextStream(stderr) << "GPS: " << QString(m_sdgpsdata) << Qt::endl;
+                    if(m_sdgpsdata[0] == '$') emit update_log("GPS: " + QString(m_sdgpsdata));
+                    m_sdgpsdata.clear();
                 }
                 else{
-                    gps_data.append(c);
+                    m_sdgpsdata.append(c);
                     c = buf.data()[28] ^ 0x93;
                     if( (c == 0x0a) || (c == 0x0d) ){
-                        gps_data.append('\0');
-                        sd_gps_cnt = 0;
-                        QTextStream(stderr) << "GPS: " << QString(gps_data) << Qt::endl;
-                        if(gps_data[0] == '$') emit update_log("GPS: " + QString(gps_data));
-                        gps_data.clear();
+                        m_sdgpsdata.append('\0');
+                        m_sdgpscnt = 0;
+                        QTextStream(stderr) << "GPS: " << QString(m_sdgpsdata) << Qt::endl;
+                        if(m_sdgpsdata[0] == '$') emit update_log("GPS: " + QString(m_sdgpsdata));
+                        m_sdgpsdata.clear();
                     }
                     else{
-                        gps_data.append(c);
+                        m_sdgpsdata.append(c);
                     }
                 }
             }
-            sd_gps_cnt = 0;
+            m_sdgpscnt = 0;
         }
-        if(sd_sync && (sd_txt_seq == 1) && (buf.data()[16] == 1) && (buf.data()[26] == 0x30)){
-		   user_data[0] = buf.data()[27] ^ 0x4f;
-		   user_data[1] = buf.data()[28] ^ 0x93;
-           ++sd_txt_seq;
-		}
-        if(sd_sync && (sd_txt_seq == 2) && (buf.data()[16] == 2)){
-		   user_data[2] = buf.data()[26] ^ 0x70;
-		   user_data[3] = buf.data()[27] ^ 0x4f;
-		   user_data[4] = buf.data()[28] ^ 0x93;
-           ++sd_txt_seq;
+        if(m_sdsync && (m_sdtxtseq == 1) && (buf.data()[16] == 1) && (buf.data()[26] == 0x30)){
+		   m_sduserdata[0] = buf.data()[27] ^ 0x4f;
+		   m_sduserdata[1] = buf.data()[28] ^ 0x93;
+           ++m_sdtxtseq;
+		}
+        if(m_sdsync && (m_sdtxtseq == 2) && (buf.data()[16] == 2)){
+		   m_sduserdata[2] = buf.data()[26] ^ 0x70;
+		   m_sduserdata[3] = buf.data()[27] ^ 0x4f;
+		   m_sduserdata[4] = buf.data()[28] ^ 0x93;
+           ++m_sdtxtseq;
         }
-        if(sd_sync && (sd_txt_seq == 3) && ((buf.data()[16] == 3) || (buf.data()[16] == 5)) && (buf.data()[26] == 0x31)){
-		   user_data[5] = buf.data()[27] ^ 0x4f;
-		   user_data[6] = buf.data()[28] ^ 0x93;
-           ++sd_txt_seq;
-		}
-        if(sd_sync && (sd_txt_seq == 4) && ((buf.data()[16] == 4) || (buf.data()[16] == 6))){
-		   user_data[7] = buf.data()[26] ^ 0x70;
-		   user_data[8] = buf.data()[27] ^ 0x4f;
-		   user_data[9] = buf.data()[28] ^ 0x93;
-           ++sd_txt_seq;
-		}
-        if(sd_sync && (sd_txt_seq == 5) && ((buf.data()[16] == 5) || (buf.data()[16] == 9)) && (buf.data()[26] == 0x32)){
-		   user_data[10] = buf.data()[27] ^ 0x4f;
-		   user_data[11] = buf.data()[28] ^ 0x93;
-           ++sd_txt_seq;
-		}
-        if(sd_sync && (sd_txt_seq == 6) && ((buf.data()[16] == 6) || (buf.data()[16] == 10))){
-		   user_data[12] = buf.data()[26] ^ 0x70;
-		   user_data[13] = buf.data()[27] ^ 0x4f;
-		   user_data[14] = buf.data()[28] ^ 0x93;
-           ++sd_txt_seq;
-		}
-        if(sd_sync && (sd_txt_seq == 7) && ((buf.data()[16] == 7) || (buf.data()[16] == 13)) && (buf.data()[26] == 0x33)){
-		   user_data[15] = buf.data()[27] ^ 0x4f;
-		   user_data[16] = buf.data()[28] ^ 0x93;
-           ++sd_txt_seq;
-		}
-        if(sd_sync && (sd_txt_seq == 8) && ((buf.data()[16] == 8) || (buf.data()[16] == 14))){
-		   user_data[17] = buf.data()[26] ^ 0x70;
-		   user_data[18] = buf.data()[27] ^ 0x4f;
-		   user_data[19] = buf.data()[28] ^ 0x93;
-           user_data[20] = '\0';
-           sd_txt_seq = 0;
-		   m_modeinfo.usertxt = QString(user_data);
+        if(m_sdsync && (m_sdtxtseq == 3) && ((buf.data()[16] == 3) || (buf.data()[16] == 5)) && (buf.data()[26] == 0x31)){
+		   m_sduserdata[5] = buf.data()[27] ^ 0x4f;
+		   m_sduserdata[6] = buf.data()[28] ^ 0x93;
+           ++m_sdtxtseq;
+		}
+        if(m_sdsync && (m_sdtxtseq == 4) && ((buf.data()[16] == 4) || (buf.data()[16] == 6))){
+		   m_sduserdata[7] = buf.data()[26] ^ 0x70;
+		   m_sduserdata[8] = buf.data()[27] ^ 0x4f;
+		   m_sduserdata[9] = buf.data()[28] ^ 0x93;
+           ++m_sdtxtseq;
+		}
+        if(m_sdsync && (m_sdtxtseq == 5) && ((buf.data()[16] == 5) || (buf.data()[16] == 9)) && (buf.data()[26] == 0x32)){
+		   m_sduserdata[10] = buf.data()[27] ^ 0x4f;
+		   m_sduserdata[11] = buf.data()[28] ^ 0x93;
+           ++m_sdtxtseq;
+		}
+        if(m_sdsync && (m_sdtxtseq == 6) && ((buf.data()[16] == 6) || (buf.data()[16] == 10))){
+		   m_sduserdata[12] = buf.data()[26] ^ 0x70;
+		   m_sduserdata[13] = buf.data()[27] ^ 0x4f;
+		   m_sduserdata[14] = buf.data()[28] ^ 0x93;
+           ++m_sdtxtseq;
+		}
+        if(m_sdsync && (m_sdtxtseq == 7) && ((buf.data()[16] == 7) || (buf.data()[16] == 13)) && (buf.data()[26] == 0x33)){
+		   m_sduserdata[15] = buf.data()[27] ^ 0x4f;
+		   m_sduserdata[16] = buf.data()[28] ^ 0x93;
+           ++m_sdtxtseq;
+		}
+        if(m_sdsync && (m_sdtxtseq == 8) && ((buf.data()[16] == 8) || (buf.data()[16] == 14))){
+		   m_sduserdata[17] = buf.data()[26] ^ 0x70;
+		   m_sduserdata[18] = buf.data()[27] ^ 0x4f;
+		   m_sduserdata[19] = buf.data()[28] ^ 0x93;
+           m_sduserdata[20] = '\0';
+           m_sdtxtseq = 0;
+		   m_modeinfo.usertxt = QString(m_sduserdata);
 		}
 		for(int i = 0; i < 9; ++i){
 			m_rxcodecq.append(buf.data()[17+i]);
@@ -354,8 +340,8 @@ void REF::process_udp()
 			m_modeinfo.ts = QDateTime::currentMSecsSinceEpoch();
 			emit update(m_modeinfo);
 			m_modeinfo.streamid = 0;
-            sd_sync = 0;
-            sd_gps_cnt = 0;
+            m_sdsync = 0;
+            m_sdgpscnt = 0;
 		}
 	}
 	//emit update(m_modeinfo);
@@ -373,17 +359,9 @@ void REF::hostname_lookup(QHostInfo i)
 		m_address = i.addresses().first();
 		m_udp = new QUdpSocket(this);
 		connect(m_udp, SIGNAL(readyRead()), this, SLOT(process_udp()));
-		m_udp->writeDatagram(out, m_address, m_modeinfo.port);
-
-        if(m_debug){
-            QDebug debug = qDebug();
-            debug.noquote();
-            QString s = "CONN:";
-            for(int i = 0; i < out.size(); ++i){
-                s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-            }
-            debug << s;
-        }
+		write_datagram(out, m_address, m_modeinfo.port);
+
+        trace("CONN", out);
 	}
 }
 
@@ -393,17 +371,9 @@ void REF::send_ping()
 	out.append(0x03);
 	out.append(0x60);
 	out.append('\x00');
-	m_udp->writeDatagram(out, m_address, m_modeinfo.port);
-
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "PING:";
-        for(int i = 0; i < out.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+	write_datagram(out, m_address, m_modeinfo.port);
+
+    trace("PING", out);
 }
 
 void REF::send_disconnect()
@@ -414,17 +384,9 @@ void REF::send_disconnect()
 	out.append(0x18);
 	out.append('\x00');
 	out.append('\x00');
-	m_udp->writeDatagram(out, m_address, m_modeinfo.port);
-
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "DISC:";
-        for(int i = 0; i < out.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+	write_datagram(out, m_address, m_modeinfo.port);
+
+    trace("DISC", out);
 }
 
 void REF::format_callsign(QString &s)
@@ -485,6 +447,17 @@ void REF::start_tx()
 	Mode::start_tx();
 }
 
+void REF::relay_tx(int codec, QByteArray frame)
+{
+	if(!m_tx){
+		format_callsign(m_txmycall);
+		format_callsign(m_txurcall);
+		format_callsign(m_txrptr1);
+		format_callsign(m_txrptr2);
+	}
+	Mode::relay_tx(codec, frame);
+}
+
 void REF::transmit()
 {
 	uint8_t ambe[9];
@@ -507,7 +480,7 @@ void REF::transmit()
 	}
 #endif
 
-	if(m_ttsid == 0){
+	if((m_ttsid == 0) && !m_relaytx){
 		if(m_audio->read(pcm, 160)){
 		}
 		else{
@@ -515,7 +488,16 @@ void REF::transmit()
 		}
 	}
 
-	if(m_hwtx){
+	if(m_relaytx){
+		if(m_tx && (m_txcodecq.size() < 9)){
+			return;
+		}
+		for(int i = 0; (i < 9) && !m_txcodecq.isEmpty(); ++i){
+			ambe[i] = m_txcodecq.dequeue();
+		}
+		send_frame(ambe);
+	}
+	else if(m_hwtx){
 #if !defined(Q_OS_IOS)
 		m_ambedev->encode(pcm);
 #endif
@@ -540,14 +522,12 @@ void REF::transmit()
 void REF::send_frame(uint8_t *ambe)
 {
 	QByteArray txdata;
-	static uint16_t txstreamid = 0;
-	static bool sendheader = 1;
 
-	if(txstreamid == 0){
-		txstreamid = static_cast<uint16_t>((::rand() & 0xFFFF));
+	if(m_txstreamid == 0){
+		m_txstreamid = static_cast<uint16_t>((::rand() & 0xFFFF));
 	}
-	if(sendheader){
-		sendheader = 0;
+	if(m_txsendheader){
+		m_txsendheader = 0;
 		txdata.resize(58);
 		txdata[0] = 0x3a;
 		txdata[1] = 0x80;
@@ -563,8 +543,8 @@ void REF::send_frame(uint8_t *ambe)
 		txdata[11] = 0x00;
 		txdata[12] = 0x02;
 		txdata[13] = 0x01;
-		txdata[14] = (txstreamid >> 8) & 0xff;
-		txdata[15] = txstreamid & 0xff;
+		txdata[14] = (m_txstreamid >> 8) & 0xff;
+		txdata[15] = m_txstreamid & 0xff;
 		txdata[16] = 0x80;
 		txdata[17] = 0x00;
 		txdata[18] = 0x00;
@@ -572,28 +552,20 @@ void REF::send_frame(uint8_t *ambe)
 		txdata.replace(20, 8, m_txrptr2.toLocal8Bit().data());
 		txdata.replace(28, 8, m_txrptr1.toLocal8Bit().data());
 		txdata.replace(36, 8, m_txurcall.toLocal8Bit().data());
-		txdata.replace(44, 8, m_txmycall.toLocal8Bit().data());
+		txdata.replace(44, 8, relay_callsign(m_txmycall).leftJustified(8, ' ', true).toLocal8Bit().data());
 		txdata.replace(52, 4, "AMBE");
 		CCRC::addCCITT161((uint8_t *)txdata.data() + 17, 41);
 
-		m_modeinfo.src = m_txmycall;
+		m_modeinfo.src = relay_callsign(m_txmycall);
 		m_modeinfo.dst = m_txurcall;
 		m_modeinfo.gw = m_txrptr1;
 		m_modeinfo.gw2 = m_txrptr2;
-		m_modeinfo.streamid = txstreamid;
+		m_modeinfo.streamid = m_txstreamid;
 		m_modeinfo.frame_number = m_txcnt;
 
-		m_udp->writeDatagram(txdata, m_address, m_modeinfo.port);
+		write_datagram(txdata, m_address, m_modeinfo.port);
 
-        if(m_debug){
-            QDebug debug = qDebug();
-            debug.noquote();
-            QString s = "SEND:";
-            for(int i = 0; i < txdata.size(); ++i){
-                s += " " + QString("%1").arg((uint8_t)txdata.data()[i], 2, 16, QChar('0'));
-            }
-            debug << s;
-        }
+        trace("SEND", txdata);
 	}
 
 	txdata.resize(29);
@@ -611,8 +583,8 @@ void REF::send_frame(uint8_t *ambe)
 	txdata[11] = 0x00;
 	txdata[12] = 0x02;
 	txdata[13] = 0x01;
-	txdata[14] = (txstreamid >> 8) & 0xff;
-	txdata[15] = txstreamid & 0xff;
+	txdata[14] = (m_txstreamid >> 8) & 0xff;
+	txdata[15] = m_txstreamid & 0xff;
 	txdata[16] = m_txcnt;
 	memcpy(txdata.data() + 17, ambe, 9);
 
@@ -672,7 +644,7 @@ void REF::send_frame(uint8_t *ambe)
 	}
 
 	if(m_txcnt == 20){
-		sendheader = 1;
+		m_txsendheader = 1;
 		m_txcnt = 0;
 	}
 	else{
@@ -693,31 +665,23 @@ void REF::send_frame(uint8_t *ambe)
 		txdata.append(0xc8);
 		txdata.append(0x7a);
 		m_txcnt = 0;
-		txstreamid = 0;
+		m_txstreamid = 0;
 		m_modeinfo.streamid = 0;
-		sendheader = 1;
+		m_txsendheader = 1;
 		m_txtimer->stop();
 
-		if((m_ttsid == 0) && (m_modeinfo.stream_state == TRANSMITTING) ){
+		if((m_ttsid == 0) && !m_relaytx && (m_modeinfo.stream_state == TRANSMITTING) ){
 			m_audio->stop_capture();
 		}
 		m_ttscnt = 0;
 		m_modeinfo.stream_state = STREAM_IDLE;
 	}
 
-	m_udp->writeDatagram(txdata, m_address, m_modeinfo.port);
+	write_datagram(txdata, m_address, m_modeinfo.port);
 	emit update_output_level(m_audio->level() * 2);
 	emit update(m_modeinfo);
 
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "SEND:";
-        for(int i = 0; i < txdata.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)txdata.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+    trace("SEND", txdata);
 }
 
 void REF::get_ambe()
@@ -742,29 +706,22 @@ void REF::process_rx_data()
 		qDebug() << "REF RX stream timeout ";
 		m_rxwatchdog = 0;
 		m_modeinfo.stream_state = STREAM_LOST;
+		PacketTrace::trigger(m_mode + " RX stream timeout");
 		m_modeinfo.ts = QDateTime::currentMSecsSinceEpoch();
 		emit update(m_modeinfo);
 		m_modeinfo.streamid = 0;
 	}
 
-	if(m_rxmodemq.size() > 2){
-		QByteArray out;
-		int s = m_rxmodemq[1];
-		if((m_rxmodemq[0] == 0xe0) && (m_rxmodemq.size() >= s)){
-			for(int i = 0; i < s; ++i){
-				out.append(m_rxmodemq.dequeue());
-			}
-#if !defined(Q_OS_IOS)
-			m_modem->write(out);
-#endif
-		}
-	}
+	write_modem();
 
 	if((!m_tx) && (m_rxcodecq.size() > 8) ){
 		for(int i = 0; i < 9; ++i){
 			ambe[i] = m_rxcodecq.dequeue();
 		}
-		if(m_hwrx){
+		if(m_relayrx){
+			emit relay_rx(CODEC_AMBE2400X1200, QByteArray((char *)ambe, 9));
+		}
+		else if(m_hwrx){
 #if !defined(Q_OS_IOS)
 			m_ambedev->decode(ambe);
 
@@ -793,6 +750,9 @@ void REF::process_rx_data()
 		m_rxcodecq.clear();
 		qDebug() << "REF playback stopped";
 		m_modeinfo.stream_state = STREAM_IDLE;
+		if(m_relayrx){
+			emit relay_rx_end();
+		}
 		return;
 	}
 }
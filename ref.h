@@ -27,8 +27,21 @@ public:
 	REF();
 	~REF();
 	uint8_t * get_frame(uint8_t *ambe);
+	QList<int> relay_codecs() { return {CODEC_AMBE2400X1200}; }
 private:
 	uint8_t packet_size;
+	bool m_sdsync;
+	int m_sdtxtseq;
+	int m_sdgpscnt;
+	int m_sdhdrcnt;
+	int m_sddebugcnt;
+	char m_sduserdata[21];
+	QByteArray m_sdgpsdata;
+	uint8_t m_sddebugdata[64];
+	uint16_t m_txstreamid;
+	bool m_txsendheader;
+public slots:
+	void relay_tx(int codec, QByteArray frame);
 private slots:
 	void toggle_tx(bool);
 	void start_tx();
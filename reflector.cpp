@@ -0,0 +1,94 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// droidstar-reflector: local stand-in reflector for load and latency testing.
+//
+//   droidstar-reflector -m DMR -p 62031 [--loss 5] [--jitter 40] [--reorder 2] [-i capture.dscap]
+//
+// Point DroidStar (or droidstar-replay/-load) at 127.0.0.1 and the given port.
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTimer>
+#include <cstdio>
+#include "loopbackreflector.h"
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	QCommandLineParser parser;
+	const QStringList modes = {"M17", "YSF", "FCS", "DMR", "P25", "NXDN", "REF", "XRF", "DCS", "IAX"};
+
+	parser.setApplicationDescription("Loopback reflector for DroidStar testing");
+	parser.addHelpOption();
+	parser.addOption({{"m", "mode"}, "Protocol: " + modes.join(", "), "mode", "M17"});
+	parser.addOption({{"p", "port"}, "UDP port to listen on", "port", "17000"});
+	parser.addOption({{"a", "address"}, "Address to bind", "address", "127.0.0.1"});
+	parser.addOption({"password", "DMR/IAX password", "password", "passw0rd"});
+	parser.addOption({"loss", "Percentage of sent packets to drop", "pct", "0"});
+	parser.addOption({"jitter", "Maximum random delay added to sent packets", "ms", "0"});
+	parser.addOption({"reorder", "Percentage of sent packets to swap with the next one", "pct", "0"});
+	parser.addOption({"seed", "Random seed for repeatable impairments", "seed", "1"});
+	parser.addOption({"no-echo", "Do not relay frames back to the sending client"});
+	parser.addOption({{"i", "inject"}, "Loop the stream frames of a packet capture to linked clients", "capture"});
+	parser.addOption({{"s", "speed"}, "Injection speed multiplier", "speed", "1"});
+	parser.process(app);
+
+	const QString mode = parser.value("mode").toUpper();
+
+	if(!modes.contains(mode)){
+		fprintf(stderr, "Unsupported mode %s\n", mode.toStdString().c_str());
+		return 1;
+	}
+
+	LoopbackReflector reflector(mode, parser.value("port").toUShort());
+	reflector.set_password(parser.value("password"));
+	reflector.set_loss(parser.value("loss").toInt());
+	reflector.set_jitter(parser.value("jitter").toInt());
+	reflector.set_reorder(parser.value("reorder").toInt());
+	reflector.set_seed(parser.value("seed").toUInt());
+	reflector.set_echo(!parser.isSet("no-echo"));
+
+	if(parser.isSet("inject") && !reflector.set_inject(parser.value("inject"), parser.value("speed").toInt())){
+		fprintf(stderr, "No %s stream frames in %s\n", mode.toStdString().c_str(), parser.value("inject").toStdString().c_str());
+		return 1;
+	}
+
+	if(!reflector.start(QHostAddress(parser.value("address")))){
+		return 1;
+	}
+
+	QObject::connect(&reflector, &LoopbackReflector::client_linked, [](QString client, qint64 ms) {
+		fprintf(stdout, "%s linked in %lld ms\n", client.toStdString().c_str(), ms);
+		fflush(stdout);
+	});
+	QObject::connect(&reflector, &LoopbackReflector::client_unlinked, [](QString client) {
+		fprintf(stdout, "%s unlinked\n", client.toStdString().c_str());
+		fflush(stdout);
+	});
+
+	QTimer stats;
+	QObject::connect(&stats, &QTimer::timeout, [&reflector]() {
+		const LoopbackReflector::STATS s = reflector.stats();
+		fprintf(stdout, "clients %u rx %u tx %u relayed %u injected %u dropped %u reordered %u\n",
+				s.clients, s.rx, s.tx, s.relayed, s.injected, s.dropped, s.reordered);
+		fflush(stdout);
+	});
+	stats.start(10000);
+
+	return app.exec();
+}
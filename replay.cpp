@@ -0,0 +1,140 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// droidstar-replay: feeds a packet capture back into a Mode without a network or sound card.
+//
+//   droidstar-replay [-s speed] [-o out.wav] [-d] capture.dscap
+//
+// speed 1 replays at the recorded rate, N replays N times faster and 0 replays as fast as possible.
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <cstdio>
+#include <functional>
+#include "mode.h"
+#include "packetcapture.h"
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	QCommandLineParser parser;
+	PacketCapture capture;
+	PacketCapture::RECORD rec;
+	QElapsedTimer wall;
+	quint32 rxcnt = 0;
+	quint32 txcnt = 0;
+	quint64 lastusec = 0;
+	qint64 replayms = -1;
+	int drain = 0;
+
+	parser.setApplicationDescription("Replay a DroidStar packet capture");
+	parser.addHelpOption();
+	parser.addOption({{"s", "speed"}, "Replay speed multiplier, 0 for as fast as possible", "speed", "1"});
+	parser.addOption({{"o", "output"}, "WAV file for decoded audio", "file", "replay.wav"});
+	parser.addOption({{"d", "debug"}, "Dump replayed packets to stderr"});
+	parser.addPositionalArgument("capture", "Capture file to replay");
+	parser.process(app);
+
+	if(parser.positionalArguments().size() != 1){
+		parser.showHelp(1);
+	}
+
+	const int speed = parser.value("speed").toInt();
+
+	if(!capture.open_read(parser.positionalArguments().at(0))){
+		return 1;
+	}
+
+	const PacketCapture::HEADER &h = capture.header();
+	Mode *mode = Mode::create_mode(h.mode);
+
+	if(mode == nullptr){
+		fprintf(stderr, "Unsupported mode %s\n", h.mode.toStdString().c_str());
+		return 1;
+	}
+
+	// The first received datagram identifies the reflector the capture was taken against
+	bool more = capture.read(rec);
+	while(more && (rec.dir != PacketCapture::CAPTURE_RX)){
+		more = capture.read(rec);
+	}
+
+	if(!more){
+		fprintf(stderr, "No received packets in capture\n");
+		return 1;
+	}
+
+	const QHostAddress address = rec.address;
+
+	if(h.mode == "IAX"){
+		mode->set_iax_params("", "", "", h.refname, h.host, h.port);
+	}
+	mode->init(h.callsign, h.dmrid, 0, h.module, h.refname, h.host, h.port, address.protocol() == QAbstractSocket::IPv6Protocol, "Software vocoder", "", "", "wav:" + parser.value("output"), false);
+	QMetaObject::invokeMethod(mode, "debug_changed", Q_ARG(bool, parser.isSet("debug")));
+	QObject::connect(mode, &QObject::destroyed, &app, &QCoreApplication::quit);
+
+	std::function<void()> finish = [&]() {
+		if(replayms < 0){
+			replayms = wall.elapsed();
+		}
+		if( (mode->m_modeinfo.stream_state != Mode::STREAM_IDLE) && (mode->m_modeinfo.stream_state != Mode::STREAM_LOST) && (drain++ < 50) ){
+			QTimer::singleShot(100, finish);
+			return;
+		}
+		fprintf(stdout, "%s: %u packets received, %u sent in capture\n", h.mode.toStdString().c_str(), rxcnt, txcnt);
+		fprintf(stdout, "capture %.3f s, replay %.3f s, %.1fx realtime\n", lastusec / 1e6, replayms / 1e3, replayms ? (lastusec / 1e3) / replayms : 0.0);
+		fprintf(stdout, "audio written to %s\n", parser.value("output").toStdString().c_str());
+		fflush(stdout);
+		QMetaObject::invokeMethod(mode, "deleteLater");
+		QCoreApplication::sendPostedEvents(mode, QEvent::DeferredDelete);
+	};
+
+	std::function<void()> next = [&]() {
+		while(more){
+			if(rec.dir == PacketCapture::CAPTURE_TX){
+				txcnt++;
+				more = capture.read(rec);
+				continue;
+			}
+			if(speed > 0){
+				const qint64 due = rec.usec / speed / 1000;
+				if(wall.elapsed() < due){
+					QTimer::singleShot(due - wall.elapsed(), next);
+					return;
+				}
+			}
+			lastusec = rec.usec;
+			mode->replay_datagram(rec.data, rec.address, rec.port);
+			rxcnt++;
+			more = capture.read(rec);
+			// Return to the event loop after every datagram so the rx/tx timers run between packets
+			QTimer::singleShot(0, next);
+			return;
+		}
+		finish();
+	};
+
+	QTimer::singleShot(0, [&]() {
+		mode->begin_replay(address, speed);
+		wall.start();
+		next();
+	});
+
+	return app.exec();
+}
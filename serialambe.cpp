@@ -16,51 +16,41 @@
 */
 
 #include <QMap>
-#include <QThread>
 #include <QDebug>
 #include <QtMath>
 #ifndef Q_OS_ANDROID
 #include <QSerialPortInfo>
 #endif
 #include "serialambe.h"
+#include "AMBE3000Defines.h"
 
 #define ENDLINE "\n"
 
 //#define DEBUG
 
-#define AMBE3000_START_BYTE		0x61
-#define AMBE3000_TYPE_CONFIG	0x00
-#define AMBE3000_TYPE_CHANNEL	0x01
-#define AMBE3000_TYPE_SPEECH	0x02
-#define AMBE3000_PKT_RATEP		0x0a
-#define AMBE3000_PKT_INIT		0x0b
-#define AMBE3000_PKT_RATEP		0x0a
-#define AMBE3000_PKT_PRODID		0x30
-#define AMBE3000_PKT_VERSTRING	0x31
-#define AMBE3000_PKT_READY		0x39
-#define AMBE3000_PKT_RESET		0x33
-#define AMBE3000_PKT_PARITYMODE	0x3f
-
-const uint8_t AMBEP251_4400_2800[17] = {AMBE3000_START_BYTE, 0x00, 0x0d, AMBE3000_TYPE_CONFIG, AMBE3000_PKT_RATEP, 0x05U, 0x58U, 0x08U, 0x6BU, 0x10U, 0x30U, 0x00U, 0x00U, 0x00U, 0x00U, 0x01U, 0x90U};		//DVSI P25 USB Dongle FEC
-const uint8_t AMBE2000_2400_1200[17] = {AMBE3000_START_BYTE, 0x00, 0x0d, AMBE3000_TYPE_CONFIG, AMBE3000_PKT_RATEP, 0x01U, 0x30U, 0x07U, 0x63U, 0x40U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x48U};
-const uint8_t AMBE3000_2450_1150[17] = {AMBE3000_START_BYTE, 0x00, 0x0d, AMBE3000_TYPE_CONFIG, AMBE3000_PKT_RATEP, 0x04U, 0x31U, 0x07U, 0x54U, 0x24U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x6fU, 0x48U};
-const uint8_t AMBE3000_2450_0000[17] = {AMBE3000_START_BYTE, 0x00, 0x0d, AMBE3000_TYPE_CONFIG, AMBE3000_PKT_RATEP, 0x04U, 0x31U, 0x07U, 0x54U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x70U, 0x31U};
-const uint8_t AMBE3000_PARITY_DISABLE[8] = {AMBE3000_START_BYTE, 0x00, 0x04, AMBE3000_TYPE_CONFIG, AMBE3000_PKT_PARITYMODE, 0x00, 0x2f, 0x14};
-const uint8_t AMBE3000_PRODID[5] = {AMBE3000_START_BYTE, 0x00, 0x01, AMBE3000_TYPE_CONFIG, AMBE3000_PKT_PRODID};
-const uint8_t AMBE3000_VERSION[5] = {AMBE3000_START_BYTE, 0x00, 0x01, AMBE3000_TYPE_CONFIG, AMBE3000_PKT_VERSTRING};
-
 //const uint8_t AMBE2020[48] = {0x13, 0xec, 0x00, 0x00, 0x10, 0x30, 0x00, 0x01, 0x00, 0x00, 0x42, 0x30, 0x00, 0x48, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
 //const uint8_t AMBE2020[4] = {0x04, 0x20, 0x01, 0x00};
 const uint8_t AMBE2020[5] = {0x05, 0x00, 0x18, 0x00, 0x01};
 SerialAMBE::SerialAMBE(QString protocol) :
+	m_serial(nullptr),
 	m_protocol(protocol),
-	m_decode_gain(1.0)
+	packet_size(9),
+	m_decode_gain(1.0),
+	m_timeout(new QTimer(this)),
+	m_lastrtt(0),
+	m_avgrtt(0),
+	m_replies(0)
 {
+	m_clock.start();
+	m_timeout->setSingleShot(true);
+	connect(m_timeout, &QTimer::timeout, this, &SerialAMBE::request_timeout);
 }
 
 SerialAMBE::~SerialAMBE()
 {
-	m_serial->close();
+	if(m_serial != nullptr){
+		m_serial->close();
+	}
 }
 
 QMap<QString, QString> SerialAMBE::discover_devices()
@@ -143,97 +133,154 @@ void SerialAMBE::connect_to_serial(QString p)
 
 void SerialAMBE::config_ambe()
 {
-    QByteArray a;
-    a.clear();
-    if(m_description != "DV Dongle"){
-        m_serial->setFlowControl(QSerialPort::HardwareControl);
-        m_serial->setRequestToSend(true);
-        a.append(reinterpret_cast<const char*>(AMBE3000_PARITY_DISABLE), sizeof(AMBE3000_PARITY_DISABLE));
-        m_serial->write(a);
-        QThread::msleep(100);
-        a.clear();
-        a.append(reinterpret_cast<const char*>(AMBE3000_PRODID), sizeof(AMBE3000_PRODID));
-        m_serial->write(a);
-        QThread::msleep(100);
-        a.clear();
-        a.append(reinterpret_cast<const char*>(AMBE3000_VERSION), sizeof(AMBE3000_VERSION));
-        m_serial->write(a);
-        QThread::msleep(100);
-        a.clear();
-    }
-
-    if(m_protocol == "DMR"){
-        a.append(reinterpret_cast<const char*>(AMBE3000_2450_1150), sizeof(AMBE3000_2450_1150));
-        packet_size = 9;
-    }
-    else if( (m_protocol == "YSF") || (m_protocol == "NXDN") ){
-        a.append(reinterpret_cast<const char*>(AMBE3000_2450_0000), sizeof(AMBE3000_2450_0000));
-        packet_size = 7;
-    }
-    else if(m_protocol == "P25"){
-        a.append(reinterpret_cast<const char*>(AMBEP251_4400_2800), sizeof(AMBEP251_4400_2800));
-    }
-    else if(m_description != "DV Dongle"){ //D-Star with AMBE3000
-        a.append(reinterpret_cast<const char*>(AMBE2000_2400_1200), sizeof(AMBE2000_2400_1200));
-        packet_size = 9;
-    }
-    else{
-        a.append(reinterpret_cast<const char*>(AMBE2020), sizeof(AMBE2020));
-        packet_size = 9;
-    }
-    m_serial->write(a);
+	QByteArray a;
+
+	m_clock.start();
+	if(m_description != "DV Dongle"){
+		m_serial->setFlowControl(QSerialPort::HardwareControl);
+		m_serial->setRequestToSend(true);
+		queue(QByteArray(reinterpret_cast<const char*>(AMBE3000_PARITY_DISABLE), sizeof(AMBE3000_PARITY_DISABLE)));
+		queue(QByteArray(reinterpret_cast<const char*>(AMBE3000_PRODID), sizeof(AMBE3000_PRODID)));
+		queue(QByteArray(reinterpret_cast<const char*>(AMBE3000_VERSION), sizeof(AMBE3000_VERSION)));
+	}
+
+	if(m_protocol == "DMR"){
+		a.append(reinterpret_cast<const char*>(AMBE3000_2450_1150), sizeof(AMBE3000_2450_1150));
+		packet_size = 9;
+	}
+	else if( (m_protocol == "YSF") || (m_protocol == "NXDN") ){
+		a.append(reinterpret_cast<const char*>(AMBE3000_2450_0000), sizeof(AMBE3000_2450_0000));
+		packet_size = 7;
+	}
+	else if(m_protocol == "P25"){
+		a.append(reinterpret_cast<const char*>(AMBEP251_4400_2800), sizeof(AMBEP251_4400_2800));
+	}
+	else if(m_description != "DV Dongle"){ //D-Star with AMBE3000
+		a.append(reinterpret_cast<const char*>(AMBE2000_2400_1200), sizeof(AMBE2000_2400_1200));
+		packet_size = 9;
+	}
+	else{
+		a.append(reinterpret_cast<const char*>(AMBE2020), sizeof(AMBE2020));
+		packet_size = 9;
+	}
+	// The dongle answers in order, so frames queued from now on reach it after the rate
+	queue(a);
+	emit ambedev_ready();
+}
+
+// DV Dongle packets are not answered one for one, they are written straight away
+void SerialAMBE::queue(const QByteArray &packet)
+{
+	if(m_description == "DV Dongle"){
+		m_serial->write(packet);
+		return;
+	}
+	m_txq.enqueue(packet);
+	send();
+}
+
+// Requests are answered with speech for AMBE, AMBE for speech and config for config
+static uint8_t reply_type(const QByteArray &packet)
+{
+	switch((uint8_t)packet[3]){
+	case AMBE3000_TYPE_CHANNEL:
+		return AMBE3000_TYPE_SPEECH;
+	case AMBE3000_TYPE_SPEECH:
+		return AMBE3000_TYPE_CHANNEL;
+	default:
+		return AMBE3000_TYPE_CONFIG;
+	}
+}
+
+void SerialAMBE::send()
+{
+	// The timer is running to give up on the late replies
+	if(!m_stale.isEmpty()){
+		return;
+	}
+	while((m_sent.size() < MAX_INFLIGHT) && !m_txq.isEmpty()){
+		const QByteArray packet = m_txq.dequeue();
 #ifdef DEBUG
-    fprintf(stderr, "SENDHW %d:%d:", a.size(), m_serialdata.size());
-    for(int i = 0; i < a.size(); ++i){
-        //if((d.data()[i] == 0x61) && (data.data()[i+1] == 0x01) && (data.data()[i+2] == 0x42) && (data.data()[i+3] == 0x02)){
-        //	i+= 6;
-        //}
-        fprintf(stderr, "%02x ", (unsigned char)a.data()[i]);
-    }
-    fprintf(stderr, "\n");
-    fflush(stderr);
+		fprintf(stderr, "SENDHW %d:%d:", (int)packet.size(), (int)m_sent.size());
+		for(int i = 0; i < packet.size(); ++i){
+			fprintf(stderr, "%02x ", (unsigned char)packet.data()[i]);
+		}
+		fprintf(stderr, "\n");
+		fflush(stderr);
 #endif
-    emit ambedev_ready();
+		m_sent.enqueue({m_clock.nsecsElapsed(), reply_type(packet)});
+		m_serial->write(packet);
+	}
+	if(m_sent.isEmpty()){
+		m_timeout->stop();
+	}
+	else if(!m_timeout->isActive()){
+		m_timeout->start(TIMEOUT_MS);
+	}
 }
 
-void SerialAMBE::receive_serial(QByteArray d)
+// A reply that never comes would otherwise close the window for good. Replies that come
+// late would be taken for those of newer requests, so they are waited out first.
+void SerialAMBE::request_timeout()
+{
+	if(!m_stale.isEmpty()){
+		qDebug() << "SerialAMBE:" << m_stale.size() << "replies never came";
+		m_stale.clear();
+		send();
+		return;
+	}
+	qDebug() << "SerialAMBE: no reply to" << m_sent.size() << "requests," << m_txq.size() << "queued";
+	m_stale.swap(m_sent);
+	m_timeout->start(TIMEOUT_MS);
+}
+
+// Returns false for a late reply to a request already given up, which is dropped. Packets
+// of another type than the oldest request is answered with are not replies.
+bool SerialAMBE::handle_reply(uint8_t type)
 {
-	for(int i = 0; i < d.size(); i++){
-		m_serialdata.append(d[i]);
+	if(!m_stale.isEmpty() && (m_stale.head().reply == type)){
+		m_stale.dequeue();
+		if(m_stale.isEmpty()){
+			m_timeout->stop();
+			send();
+		}
+		return false;
 	}
+	if(m_sent.isEmpty() || (m_sent.head().reply != type)){
+		return true;
+	}
+	const qint64 rtt = (m_clock.nsecsElapsed() - m_sent.dequeue().ns) / 1000;
+	m_avgrtt = m_replies++ ? (m_avgrtt * 7 + rtt) / 8 : rtt;
+	m_lastrtt = rtt;
+	m_timeout->stop();
+	send();
+	return true;
+}
+
+void SerialAMBE::receive_serial(QByteArray d)
+{
+	m_rx.append(d);
 
 	if(m_description == "DV Dongle"){
-		process_serial_2020();
+		process_2020();
 	}
 	else{
-		process_serial_3000();
+		process_3000();
 	}
 }
 
 void SerialAMBE::process_serial()
 {
 	QByteArray d = m_serial->readAll();
-	for(int i = 0; i < d.size(); i++){
-		m_serialdata.append(d[i]);
-	}
 #ifdef DEBUG
-	fprintf(stderr, "AMBEHW %d:%d:", d.size(), m_serialdata.size());
+	fprintf(stderr, "AMBEHW %d:%d:", (int)d.size(), (int)m_rx.size());
 	for(int i = 0; i < d.size(); ++i){
-		//if((d.data()[i] == 0x61) && (data.data()[i+1] == 0x01) && (data.data()[i+2] == 0x42) && (data.data()[i+3] == 0x02)){
-		//	i+= 6;
-		//}
 		fprintf(stderr, "%02x ", (unsigned char)d.data()[i]);
 	}
 	fprintf(stderr, "\n");
 	fflush(stderr);
 #endif
-
-	if(m_description == "DV Dongle"){
-		process_serial_2020();
-	}
-	else{
-		process_serial_3000();
-	}
+	receive_serial(d);
 }
 
 void SerialAMBE::decode(uint8_t *ambe)
@@ -253,18 +300,7 @@ void SerialAMBE::encode(int16_t *audio)
 		packet [(i*2)+7] = (audio[i] >> 8) & 0xff;
 		packet [(i*2)+8] = audio[i] & 0xff;
 	}
-	m_serial->write((char *)packet, 327);
-#ifdef DEBUG
-			fprintf(stderr, "SENDHW: ");
-			for(int i = 0; i < 326; ++i){
-				//if((d.data()[i] == 0x61) && (data.data()[i+1] == 0x01) && (data.data()[i+2] == 0x42) && (data.data()[i+3] == 0x02)){
-				//	i+= 6;
-				//}
-				fprintf(stderr, "%02x ", packet[i]);
-			}
-			fprintf(stderr, "\n");
-			fflush(stderr);
-#endif
+	queue(QByteArray((char *)packet, 327));
 }
 
 void SerialAMBE::decode_2020(uint8_t *ambe)
@@ -281,205 +317,170 @@ void SerialAMBE::decode_2020(uint8_t *ambe)
 
 void SerialAMBE::decode_3000(uint8_t *ambe)
 {
-	uint8_t packet[15] = {AMBE3000_START_BYTE, 0x00, 0x0b, AMBE3000_TYPE_CHANNEL, 0x01, 0x48};
+	uint8_t packet[15] = {AMBE3000_START_BYTE, 0x00, 0x0b, AMBE3000_TYPE_CHANNEL, AMBE3000_PKT_CHAND, 0x48};
 	if( packet_size == 7 ){
 		packet[2] = 0x09;
 		packet[5] = 0x31;
 	}
 	memcpy(packet+6, ambe, packet_size);
 
-	m_serial->write((char *)packet, (6 + packet_size));
+	queue(QByteArray((char *)packet, 6 + packet_size));
 }
 
-void SerialAMBE::process_serial_2020()
+// DV Dongle packets start with a little endian word, 13 bits of length including the
+// word and 3 bits of type. 0x8142 is 160 little endian samples, 0xa032 an AMBE frame.
+void SerialAMBE::process_2020()
 {
-	if( (m_serialdata.size() > 321) &&
-		((uint8_t)m_serialdata[0] == 0x42) &&
-		((uint8_t)m_serialdata[1] == 0x81)
-		)
-	{
-		emit data_ready();
-	}
-	if( (m_serialdata.size() > 49) &&
-		((uint8_t)m_serialdata[0] == 0x32) &&
-		((uint8_t)m_serialdata[1] == 0xa0) &&
-		((uint8_t)m_serialdata[0] == 0xec) &&
-		((uint8_t)m_serialdata[1] == 0x13)
-		)
-	{
-		emit data_ready();
-	}
-}
+	while(m_rx.size() >= 2){
+		const uint16_t h = (uint8_t)m_rx[0] | ((uint8_t)m_rx[1] << 8);
+		const int len = h & 0x1fff;
 
-void SerialAMBE::process_serial_3000()
-{
-	if(m_serialdata.size() < 3){
-		return;
-	}
-
-	while( (m_serialdata.size() > 3) &&
-		   (m_serialdata[0] == AMBE3000_START_BYTE) &&
-		   (m_serialdata[3] == 0x00) &&
-		   (m_serialdata.size() >= m_serialdata[2])
-		)
-	{
-		switch(m_serialdata[4]){
-		case AMBE3000_PKT_PARITYMODE:
-			if(!m_serialdata[5]){
-				qDebug() << "AMBE3000 Parity disabled";
+		if((h != 0x8142) && (h != 0xa032) && (len < 2 || len > 400)){
+			m_rx.remove(0, 1);
+			continue;
+		}
+		if(m_rx.size() < len){
+			break;
+		}
+		if(h == 0x8142){
+			QByteArray pcm(320, 0);
+			int16_t *p = (int16_t *)pcm.data();
+			for(int i = 0; i < 160; ++i){
+				p[i] = (uint8_t)m_rx[2 + i * 2] | ((uint8_t)m_rx[3 + i * 2] << 8);
 			}
-			else{
-				qDebug() << "ERROR: AMBE3000 Parity not disabled";
+			if(m_audioq.size() >= MAX_QUEUE){
+				m_audioq.dequeue();
 			}
-			break;
-		case AMBE3000_PKT_PRODID:
-			m_ambeprodid.clear();
-
-			for(int i = 0; i < (m_serialdata[2] - 2); ++i){
-				m_ambeprodid.append(m_serialdata[5+i]);
+			m_audioq.enqueue(pcm);
+		}
+		else if(h == 0xa032){
+			if(m_ambeq.size() >= MAX_QUEUE){
+				m_ambeq.dequeue();
 			}
+			m_ambeq.enqueue(m_rx.mid(24, packet_size));
+			emit data_ready();
+		}
+		m_rx.remove(0, len);
+	}
+}
+
+// AMBE-3000 packets are 0x61, a big endian length of what follows the type byte, the type
+// and the fields
+void SerialAMBE::process_3000()
+{
+	while(m_rx.size() >= 4){
+		if(m_rx[0] != (char)AMBE3000_START_BYTE){
+			const int start = m_rx.indexOf((char)AMBE3000_START_BYTE);
+			m_rx.remove(0, (start == -1) ? m_rx.size() : start);
+			continue;
+		}
+		const int len = 4 + (((uint8_t)m_rx[1] << 8) | (uint8_t)m_rx[2]);
+		const uint8_t type = m_rx[3];
 
-			qDebug() << "PRODID == " << m_ambeprodid;
+		if(type > AMBE3000_TYPE_SPEECH){
+			m_rx.remove(0, 1);
+			continue;
+		}
+		if(m_rx.size() < len){
 			break;
-		case AMBE3000_PKT_VERSTRING:
-			m_ambeverstring.clear();
+		}
+		const QByteArray pkt = m_rx.left(len);
+		int pos = 4;
+		m_rx.remove(0, len);
 
-			for(int i = 0; i < (m_serialdata[2] - 2); ++i){
-				m_ambeverstring.append(m_serialdata[5+i]);
+		if(!handle_reply(type)){
+			continue;
+		}
+		if((pkt.size() > pos) && ((uint8_t)pkt[pos] == AMBE3000_PKT_CHANNEL0) && (type != AMBE3000_TYPE_CONFIG)){
+			++pos;
+		}
+		if(type == AMBE3000_TYPE_CONFIG){
+			handle_config(pkt);
+		}
+		else if((type == AMBE3000_TYPE_CHANNEL) && (pkt.size() >= pos + 2 + packet_size) && (pkt[pos] == AMBE3000_PKT_CHAND)){
+			if(m_ambeq.size() >= MAX_QUEUE){
+				m_ambeq.dequeue();
 			}
-
-			qDebug() << "VERSTRING == " << m_ambeverstring;
-			break;
-		case AMBE3000_PKT_RATEP:
-			if(!m_serialdata[5]){
-				qDebug() << "AMBE3000 Rate set";
-				emit connected(true);
+			m_ambeq.enqueue(pkt.mid(pos + 2, packet_size));
+			emit data_ready();
+		}
+		else if((type == AMBE3000_TYPE_SPEECH) && (pkt.size() >= pos + 2 + 320) && (pkt[pos] == AMBE3000_PKT_SPEECHD)){
+			QByteArray pcm(320, 0);
+			int16_t *p = (int16_t *)pcm.data();
+			for(int i = 0; i < 160; ++i){
+				p[i] = ((uint8_t)pkt[pos + 2 + i * 2] << 8) | (uint8_t)pkt[pos + 3 + i * 2];
 			}
-			else{
-				qDebug() << "ERROR: AMBE3000 Rate not set";
-				emit connected(false);
+			if(m_audioq.size() >= MAX_QUEUE){
+				m_audioq.dequeue();
 			}
-			break;
-		default:
-			break;
+			m_audioq.enqueue(pcm);
 		}
-
-		do {
-			m_serialdata.dequeue();
-		}
-		while(m_serialdata.size() && m_serialdata[0] != AMBE3000_START_BYTE);
-	}
-
-	if( (m_serialdata.size() >= (6 + packet_size)) &&
-		(m_serialdata[0] == AMBE3000_START_BYTE) &&
-		(m_serialdata[3] == AMBE3000_TYPE_CHANNEL)
-		)
-	{
-		emit data_ready();
 	}
 }
 
-bool SerialAMBE::get_ambe(uint8_t *ambe)
+void SerialAMBE::handle_config(const QByteArray &pkt)
 {
-	bool r = false;
-	if(m_serialdata.isEmpty()){
-		return r;
-	}
-
-	if( (m_serialdata.size() > 3) &&
-		(m_serialdata[0] == AMBE3000_START_BYTE) &&
-		(m_serialdata[3] != AMBE3000_TYPE_CHANNEL)
-		)
-	{
-		do {
-			m_serialdata.dequeue();
-		}
-		while(m_serialdata.size() && m_serialdata[0] != AMBE3000_START_BYTE);
+	if(pkt.size() < 5){
+		return;
 	}
-
-	if( (m_serialdata.size() >= (6 + packet_size)) &&
-		(m_serialdata[0] == AMBE3000_START_BYTE) &&
-		(m_serialdata[3] == AMBE3000_TYPE_CHANNEL)
-		)
-	{
-		for(int i = 0; i < 6; ++i){
-			m_serialdata.dequeue();
+	switch((uint8_t)pkt[4]){
+	case AMBE3000_PKT_PARITYMODE:
+		if((pkt.size() > 5) && !pkt[5]){
+			qDebug() << "AMBE3000 Parity disabled";
+		}
+		else{
+			qDebug() << "ERROR: AMBE3000 Parity not disabled";
 		}
-		for(int i = 0; i < packet_size; i++){
-			ambe[i] = m_serialdata.dequeue();
+		break;
+	case AMBE3000_PKT_PRODID:
+		m_ambeprodid = QString::fromLatin1(pkt.mid(5, pkt.size() - 6));
+		qDebug() << "PRODID == " << m_ambeprodid;
+		break;
+	case AMBE3000_PKT_VERSTRING:
+		m_ambeverstring = QString::fromLatin1(pkt.mid(5, pkt.size() - 6));
+		qDebug() << "VERSTRING == " << m_ambeverstring;
+		break;
+	case AMBE3000_PKT_RATEP:
+		if((pkt.size() > 5) && !pkt[5]){
+			qDebug() << "AMBE3000 Rate set in" << m_clock.elapsed() << "ms";
+			emit connected(true);
 		}
-		r = true;
+		else{
+			qDebug() << "ERROR: AMBE3000 Rate not set";
+			emit connected(false);
+		}
+		break;
+	default:
+		break;
 	}
-	return r;
 }
 
-bool SerialAMBE::get_audio(int16_t *audio)
+bool SerialAMBE::get_ambe(uint8_t *ambe)
 {
-	bool r = false;
-	if(m_serialdata.isEmpty()){
-		return r;
-	}
-	uint8_t header[] = {AMBE3000_START_BYTE, 0x01, 0x42, AMBE3000_TYPE_SPEECH, 0x00, 0xA0};
-/*
-	if( (m_serialdata.size() > 3) &&
-		(m_serialdata[0] == 0x61) &&
-		(m_serialdata[3] != 0x02)
-		)
-	{
-		do {
-			m_serialdata.dequeue();
-		}
-		while(m_serialdata.size() && m_serialdata[0] != 0x61);
+	if(m_ambeq.isEmpty()){
+		return false;
 	}
+	const QByteArray a = m_ambeq.dequeue();
+	memcpy(ambe, a.constData(), a.size());
+	return true;
+}
 
-	//qDebug() << "get_audio() m_serialdata.size() == " << m_serialdata.size();
-
-	fprintf(stderr, "AMBEHW %d:%d:", m_serialdata.size(), m_serialdata.size());
-	for(int i = 0; i < m_serialdata.size(); ++i){
-		//if((d.data()[i] == 0x61) && (data.data()[i+1] == 0x01) && (data.data()[i+2] == 0x42) && (data.data()[i+3] == 0x02)){
-		//	i+= 6;
-		//}
-		fprintf(stderr, "%02x ", (unsigned char)m_serialdata[i]);
+bool SerialAMBE::get_audio(int16_t *audio)
+{
+	if(m_audioq.isEmpty()){
+		return false;
 	}
-	fprintf(stderr, "\n");
-	fflush(stderr);
-*/
-	if(m_serialdata.size() >= 326){
-		if ( ((uint8_t)m_serialdata[0] == header[0]) &&
-			 ((uint8_t)m_serialdata[1] == header[1]) &&
-			 ((uint8_t)m_serialdata[2] == header[2]) &&
-			 ((uint8_t)m_serialdata[3] == header[3]) &&
-			 ((uint8_t)m_serialdata[4] == header[4]) &&
-			 ((uint8_t)m_serialdata[5] == header[5])){
-			m_serialdata.dequeue();
-			m_serialdata.dequeue();
-			m_serialdata.dequeue();
-			m_serialdata.dequeue();
-			m_serialdata.dequeue();
-			m_serialdata.dequeue();
-			for(int i = 0; i < 160; i++){
-				//Byte swap BE to LE
-				audio[i] =  ((m_serialdata.dequeue() << 8) & 0xff00) | (m_serialdata.dequeue() & 0xff);
-				audio[i] = (qreal)audio[i] * m_decode_gain;
-			}
-			r = true;
-		}
-		else{
-			while( (m_serialdata.size() > 5) && (
-				((uint8_t)m_serialdata[0] != header[0]) ||
-				((uint8_t)m_serialdata[1] != header[1]) ||
-				((uint8_t)m_serialdata[2] != header[2]) ||
-				((uint8_t)m_serialdata[3] != header[3]) ||
-				((uint8_t)m_serialdata[4] != header[4]) ||
-				((uint8_t)m_serialdata[5] != header[5]))){
-					m_serialdata.dequeue();
-			}
-		}
+	const int16_t *p = (const int16_t *)m_audioq.head().constData();
+	for(int i = 0; i < 160; i++){
+		audio[i] = (qreal)p[i] * m_decode_gain;
 	}
-	return r;
+	m_audioq.dequeue();
+	return true;
 }
 
+// Drops the frames already decoded or encoded, requests in flight are still answered
 void SerialAMBE::clear_queue()
 {
-	m_serialdata.clear();
+	m_audioq.clear();
+	m_ambeq.clear();
 }
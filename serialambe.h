@@ -23,14 +23,27 @@
 #ifdef Q_OS_ANDROID
 #include "androidserialport.h"
 #endif
+#include <QElapsedTimer>
 #include <QQueue>
+#include <QTimer>
 
+// An AMBE-3000 dongle (ThumbDV, DVstick, DV3000) or a DV Dongle used as the vocoder of one
+// session. Requests are queued and written as soon as fewer than MAX_INFLIGHT of them are
+// waiting for a reply, so bring-up and frames never wait on a sleep. A packet is taken as
+// the reply to the oldest request only if its type is the one that request is answered
+// with. Requests still unanswered after TIMEOUT_MS are given up, and nothing is written
+// until their late replies are dropped or TIMEOUT_MS more has passed. Replies are cut out
+// of one receive buffer by the length in their header and queued for get_audio() and
+// get_ambe() as whole frames.
 class SerialAMBE : public QObject
 {
 	Q_OBJECT
 public:
 	SerialAMBE(QString);
 	~SerialAMBE();
+	static const int MAX_INFLIGHT = 2;
+	static const int TIMEOUT_MS = 500;
+	static const int MAX_QUEUE = 50;
 	static QMap<QString, QString>  discover_devices();
 	void connect_to_serial(QString);
 	QString get_ambe_description(){ return m_description; }
@@ -40,12 +53,15 @@ public:
 	bool get_ambe(uint8_t *ambe);
 	void decode(uint8_t *);
 	void encode(int16_t *);
-	void clear_queue();//{ m_serialdata.clear(); }
+	void clear_queue();
 	void set_decode_gain(qreal g){ m_decode_gain = g; }
+	qint64 get_last_rtt_us(){ return m_lastrtt; }
+	qint64 get_avg_rtt_us(){ return m_avgrtt; }
 private slots:
 	void process_serial();
 	void receive_serial(QByteArray);
-    void config_ambe();
+	void config_ambe();
+	void request_timeout();
 private:
 #ifndef Q_OS_ANDROID
 	QSerialPort *m_serial;
@@ -60,17 +76,33 @@ private:
 	QString m_ambeprodid;
 	uint8_t packet_size;
 	qreal m_decode_gain;
-	QQueue<char> m_serialdata;
+	QByteArray m_rx;
+	QQueue<QByteArray> m_txq;
+	struct REQUEST {
+		qint64 ns;					// When it was written
+		uint8_t reply;				// Packet type it is answered with
+	};
+	QQueue<REQUEST> m_sent;			// Requests in flight
+	QQueue<REQUEST> m_stale;		// Requests given up whose replies may still come
+	QQueue<QByteArray> m_audioq;	// 160 samples each, host order
+	QQueue<QByteArray> m_ambeq;		// packet_size bytes each
+	QTimer *m_timeout;
+	QElapsedTimer m_clock;
+	qint64 m_lastrtt;
+	qint64 m_avgrtt;
+	quint64 m_replies;
+	void queue(const QByteArray &);
+	void send();
 	void decode_2020(uint8_t *);
-	void encode_2020(int16_t *);
 	void decode_3000(uint8_t *);
-	void encode_3000(int16_t *);
-	void process_serial_2020();
-	void process_serial_3000();
+	void process_2020();
+	void process_3000();
+	void handle_config(const QByteArray &);
+	bool handle_reply(uint8_t);
 signals:
 	void connected(bool);
 	void data_ready();
-    void ambedev_ready();
+	void ambedev_ready();
 };
 
 #endif // SERIALAMBE_H
@@ -18,11 +18,18 @@
 #include <QMap>
 #include <QThread>
 #include <QDebug>
+#include <climits>
+#include <cstring>
 #include "serialmodem.h"
 #include "MMDVMDefines.h"
 
 //#define DEBUGHW
 #define MMDVM_TIMEOUT_MS 250
+#define MMDVM_TX_TARGET_MS 240
+#define MMDVM_TX_IDLE_MS 500
+
+// Air time of a frame in each of the modem's buffers
+static const int TX_FRAME_MS[7] = {20, 60, 60, 100, 180, 80, 40};
 
 SerialModem::SerialModem(QString mode)
 {
@@ -33,10 +40,22 @@ SerialModem::SerialModem(QString mode)
 	m_m17TXHang = 5;
 	m_ax25Enabled = false;
 	m_configured = 0;
+	m_rxstart_ns = 0;
+	m_rxlatency_ns = 0;
+	m_rxframes = 0;
+	m_maxbacklog = 0;
+	memset(m_txbuf, 0, sizeof(m_txbuf));
+	for(int i = 0; i < 7; ++i){
+		m_txbuf[i].space = -1;
+		m_txbuf[i].minfill = INT_MAX;
+	}
+	m_status_ns = 0;
+	m_clock.start();
 }
 
 SerialModem::~SerialModem()
 {
+	qDebug() << "SerialModem: " << m_rxframes << " frames received, average latency " << get_avg_latency_us() << " us, backlog " << m_maxbacklog << " frames";
 	m_serial->close();
 }
 
@@ -114,11 +133,11 @@ void SerialModem::connect_to_serial(QString p)
 	m_serial->setParity(QSerialPort::NoParity);
 
 	if (m_serial->open(QIODevice::ReadWrite)) {
-		m_modemtimer = new QTimer();
 		m_statustimer = new QTimer();
-		connect(m_modemtimer, SIGNAL(timeout()), this, SLOT(process_modem()));
+		m_txtimer = new QTimer();
+		m_txtimer->setSingleShot(true);
 		connect(m_statustimer, SIGNAL(timeout()), this, SLOT(get_status_modem()));
-		m_modemtimer->start(19);
+		connect(m_txtimer, SIGNAL(timeout()), this, SLOT(tx_tick()));
 #ifndef Q_OS_ANDROID
 		connect(m_serial, &QSerialPort::readyRead, this, &SerialModem::process_serial);
         config_modem();
@@ -153,9 +172,11 @@ void SerialModem::config_modem()
 
 void SerialModem::receive_serial(QByteArray d)
 {
-	for(int i = 0; i < d.size(); i++){
-		m_serialdata.enqueue(d[i]);
+	if(m_serialdata.isEmpty()){
+		m_rxstart_ns = m_clock.nsecsElapsed();
 	}
+	m_serialdata.append(d);
+	process_modem();
 }
 
 void SerialModem::process_serial()
@@ -164,9 +185,10 @@ void SerialModem::process_serial()
 	QByteArray d = m_serial->readAll();
 	m_statustimer->start(MMDVM_TIMEOUT_MS);
 
-	for(int i = 0; i < d.size(); i++){
-		m_serialdata.enqueue(d[i]);
+	if(m_serialdata.isEmpty()){
+		m_rxstart_ns = m_clock.nsecsElapsed();
 	}
+	m_serialdata.append(d);
 #ifdef DEBUGHW
 	fprintf(stderr, "MODEMRX %d:%d:", d.size(), m_serialdata.size());
 	for(int i = 0; i < d.size(); ++i){
@@ -178,90 +200,157 @@ void SerialModem::process_serial()
 	fprintf(stderr, "\n");
 	fflush(stderr);
 #endif
+	process_modem();
 }
 
+// Every complete frame in the buffer is handled as soon as it is read, the rest is kept
+// for the next read
 void SerialModem::process_modem()
 {
-	QByteArray out;
-
-	if(m_serialdata.size() < 3){
-		return;
-	}
-
-	if(((uint8_t)m_serialdata[0] == MMDVM_FRAME_START) && (m_serialdata.size() >= m_serialdata[1])){
-		const uint8_t r = (uint8_t)m_serialdata[2];
-		const uint8_t s = (uint8_t)m_serialdata[1];
-
-		if(r == MMDVM_NAK){
-			qDebug() << "Received MMDVM_NAK";
-			for(int i = 0; i < s; ++i){
-				m_serialdata.dequeue();
-			}
-//			if( (m_serialdata.size() > 3) && (m_serialdata[3] == 2) ){
-
-//			}
+	const qint64 now = m_clock.nsecsElapsed();
+	int p = 0;
+	int frames = 0;
+
+	while((m_serialdata.size() - p) >= 3){
+		if((uint8_t)m_serialdata[p] != MMDVM_FRAME_START){
+			++p;
+			continue;
 		}
+		const uint8_t s = (uint8_t)m_serialdata[p+1];
+		const uint8_t r = (uint8_t)m_serialdata[p+2];
 
-		else if(r == MMDVM_ACK){
-			qDebug() << "Received MMDVM_ACK";
-//			if( (m_serialdata.size() > 3) && ( (m_serialdata[3] == 2) || (m_serialdata[3] == 4) ) ){
-
-//			}
-			for(int i = 0; i < s; ++i){
-				m_serialdata.dequeue();
+		if(s < 3){
+			++p;
+			continue;
+		}
+		if((m_serialdata.size() - p) < s){
+			break;
+		}
+		const QByteArray f = m_serialdata.mid(p, s);
+		p += s;
+		++frames;
+
+		if((r == MMDVM_ACK) || (r == MMDVM_NAK)){
+			qDebug() << ((r == MMDVM_ACK) ? "Received MMDVM_ACK" : "Received MMDVM_NAK");
+			// The config follows the frequency, once the modem has taken it
+			if((m_configured == 2) && (s > 3) && ((uint8_t)f[3] == MMDVM_SET_FREQ)){
+				set_config();
+				m_configured = 3;
+				emit connected(true);
 			}
 		}
 
 		else if(r == MMDVM_GET_VERSION){
-			if(m_serialdata.size() >= s){
-				m_protocol = m_serialdata[3];
-				m_version.clear();
-				uint8_t desc_offset = (m_protocol == 2) ? 23 : 4;
-
-				for(int i = 0; i < (s-desc_offset); ++i){
-					m_version.append(m_serialdata[desc_offset+i]);
-				}
-				qDebug() << "MMDVM Protocol " << m_protocol << ": " << m_version;
+			m_protocol = f[3];
+			m_version.clear();
+			uint8_t desc_offset = (m_protocol == 2) ? 23 : 4;
+
+			for(int i = 0; i < (s-desc_offset); ++i){
+				m_version.append(f[desc_offset+i]);
+			}
+			qDebug() << "MMDVM Protocol " << m_protocol << ": " << m_version;
 #ifdef DEBUGHW
-				fprintf(stderr, "MMDVM Protocol %d version %s", m_protocol, m_version.toStdString().c_str());
-				fprintf(stderr, "\n");
-				fflush(stderr);
+			fprintf(stderr, "MMDVM Protocol %d version %s", m_protocol, m_version.toStdString().c_str());
+			fprintf(stderr, "\n");
+			fflush(stderr);
 #endif
-				emit modem_ready();
-				m_configured = 1;
+			emit modem_ready();
+			if(m_configured == 0){
+				set_freq();
+				m_configured = 2;
 			}
-			for(int i = 0; i < s; ++i){
-				m_serialdata.dequeue();
-			}
-			return; //need for m_configured
 		}
 
 		else if(r == MMDVM_GET_STATUS){
-			qDebug() << "Received MMDVM_GET_STATUS";
-			for(int i = 0; i < s; ++i){
-				m_serialdata.dequeue();
-			}
+			handle_status(f);
 		}
 
-		else if(m_serialdata.size() >= s){
-			for(int i = 0; i < s; ++i){
-				out.append(m_serialdata.dequeue());
-			}
-			emit modem_data_ready(out);
+		else{
+			m_rxlatency_ns += ((now - m_rxstart_ns) - m_rxlatency_ns) / 16;
+			++m_rxframes;
+			emit modem_data_ready(f);
 		}
+		m_rxstart_ns = now;
 	}
-	//need receive and dequeue serial data (MMDVM_ACK) before send new command
-	if (m_configured == 1) {
-		set_freq();
-		m_configured++;
-		return;
+	m_serialdata.remove(0, p);
+	if(frames > m_maxbacklog){
+		m_maxbacklog = frames;
+	}
+}
+
+int SerialModem::tx_buffer(uint8_t type)
+{
+	switch(type){
+	case MMDVM_DSTAR_HEADER:
+	case MMDVM_DSTAR_DATA:
+	case MMDVM_DSTAR_EOT:
+		return 0;
+	case MMDVM_DMR_DATA1:
+		return 1;
+	case MMDVM_DMR_DATA2:
+		return 2;
+	case MMDVM_YSF_DATA:
+		return 3;
+	case MMDVM_P25_HDR:
+	case MMDVM_P25_LDU:
+		return 4;
+	case MMDVM_NXDN_DATA:
+		return 5;
+	case MMDVM_M17_LINK_SETUP:
+	case MMDVM_M17_STREAM:
+	case MMDVM_M17_EOT:
+		return 6;
+	default:
+		return -1;
 	}
-	//need receive and dequeue serial data (MMDVM_ACK) before send new command
-	if (m_configured == 2) {
-		set_config();
-		m_configured++;
-		emit connected(true);
+}
+
+// Both protocols put the free space of D-Star, DMR slot 1 and 2, YSF, P25 and NXDN from
+// offset 6. Protocol 1 has POCSAG next and M17 after it, protocol 2 has M17 next and FM,
+// POCSAG and AX.25 after it. Older firmware stops before M17.
+int SerialModem::status_space(const QByteArray &f, uint8_t protocol, int buffer)
+{
+	static const int OFFSET_P1[7] = {6, 7, 8, 9, 10, 11, 13};
+	static const int OFFSET_P2[7] = {6, 7, 8, 9, 10, 11, 12};
+
+	if((buffer < 0) || (buffer >= 7)){
+		return -1;
+	}
+	const int o = (protocol == 1) ? OFFSET_P1[buffer] : OFFSET_P2[buffer];
+	return (o < f.size()) ? (uint8_t)f[o] : -1;
+}
+
+// The fill the space gives corrects the time the frames sent will have gone on air, and
+// ends an over that has stopped.
+void SerialModem::handle_status(const QByteArray &f)
+{
+	const qint64 now = m_clock.nsecsElapsed();
+
+	m_status_ns = now;
+	for(int i = 0; i < 7; ++i){
+		TXBUFFER &b = m_txbuf[i];
+		b.space = status_space(f, m_protocol, i);
+		if(b.space == -1){
+			continue;
+		}
+		b.capacity = qMax(b.capacity, b.space);
+		const int fill = b.capacity - b.space;
+		b.empty_ns = now + fill * TX_FRAME_MS[i] * 1000000LL;
+		if(b.frames){
+			b.minfill = qMin(b.minfill, fill);
+			b.maxfill = qMax(b.maxfill, fill);
+			b.sumfill += fill;
+			++b.samples;
+		}
+		if(b.frames && ((now - b.last_ns) > MMDVM_TX_IDLE_MS * 1000000LL)){
+			end_tx_over(b);
+		}
 	}
+#ifdef DEBUGHW
+	fprintf(stderr, "MMDVM space %d %d %d %d %d %d %d queued %d\n", m_txbuf[0].space, m_txbuf[1].space, m_txbuf[2].space, m_txbuf[3].space, m_txbuf[4].space, m_txbuf[5].space, m_txbuf[6].space, (int)m_txq.size());
+	fflush(stderr);
+#endif
+	flush_tx();
 }
 
 void SerialModem::get_status_modem()
@@ -474,6 +563,11 @@ void SerialModem::set_mode(uint8_t m)
 
 void SerialModem::write(QByteArray b)
 {
+	if((b.size() > 2) && (tx_buffer(b[2]) != -1)){
+		m_txq.enqueue(b);
+		flush_tx();
+		return;
+	}
 	m_statustimer->stop();
 	m_serial->write(b);
 	m_statustimer->start(MMDVM_TIMEOUT_MS);
@@ -487,6 +581,77 @@ void SerialModem::write(QByteArray b)
 #endif
 }
 
+// A frame goes as soon as the modem has room for it, up to a fill of MMDVM_TX_TARGET_MS of
+// air time, or one frame short of full. Between status replies the fill is worked out
+// from the air time of what has been sent, so the next frame goes when a frame's worth has
+// gone on air. A D-Star header takes the room of four frames.
+void SerialModem::flush_tx()
+{
+	while(!m_txq.isEmpty()){
+		const QByteArray &f = m_txq.head();
+		const int t = tx_buffer(f[2]);
+		const int cost = ((uint8_t)f[2] == MMDVM_DSTAR_HEADER) ? 4 : 1;
+		const qint64 period = TX_FRAME_MS[t] * 1000000LL;
+		const qint64 now = m_clock.nsecsElapsed();
+		TXBUFFER &b = m_txbuf[t];
+
+		if(b.space != -1){
+			const int fill = (b.empty_ns > now) ? (int)((b.empty_ns - now + period - 1) / period) : 0;
+			const int target = qMin(qMax(2, MMDVM_TX_TARGET_MS / TX_FRAME_MS[t]), b.capacity - 1);
+			if(fill && ((fill + cost) > target)){
+				const qint64 due = b.empty_ns - (qint64)qMax(0, target - cost) * period;
+				m_txtimer->start(qMax(1, (int)((due - now + 999999) / 1000000)));
+				return;
+			}
+		}
+
+		if(b.frames && ((now - b.last_ns) <= MMDVM_TX_IDLE_MS * 1000000LL)){
+			if(b.empty_ns < now){
+				++b.underruns;
+			}
+		}
+		else{
+			end_tx_over(b);
+		}
+		b.empty_ns = qMax(b.empty_ns, now) + cost * period;
+		b.last_ns = now;
+		++b.frames;
+		m_serial->write(f);
+#ifdef DEBUGHW
+		fprintf(stderr, "MODEMTX %d:%d:", (int)f.size(), (int)m_txq.size());
+		for(int i = 0; i < f.size(); ++i){
+			fprintf(stderr, "%02x ", (unsigned char)f.data()[i]);
+		}
+		fprintf(stderr, "\n");
+		fflush(stderr);
+#endif
+		m_txq.dequeue();
+	}
+}
+
+void SerialModem::end_tx_over(TXBUFFER &b)
+{
+	if(b.frames){
+		qDebug() << "SerialModem: TX over of " << b.frames << " frames, " << b.underruns << " underruns, buffer fill min/avg/max " << (b.samples ? b.minfill : 0) << "/" << (b.samples ? b.sumfill / b.samples : 0) << "/" << b.maxfill << " of " << b.capacity;
+	}
+	b.frames = 0;
+	b.underruns = 0;
+	b.minfill = INT_MAX;
+	b.maxfill = 0;
+	b.sumfill = 0;
+	b.samples = 0;
+}
+
+// Status replies are asked for while frames are held, in case reads have kept the status
+// timer from firing
+void SerialModem::tx_tick()
+{
+	if((m_clock.nsecsElapsed() - m_status_ns) > MMDVM_TIMEOUT_MS * 1000000LL){
+		get_status_modem();
+	}
+	flush_tx();
+}
+
 void SerialModem::set_cc(uint32_t cc)
 {
 	m_dmrColorCode = cc;
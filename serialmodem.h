@@ -23,6 +23,7 @@
 #ifdef Q_OS_ANDROID
 #include "androidserialport.h"
 #endif
+#include <QElapsedTimer>
 #include <QQueue>
 #include <QTimer>
 
@@ -38,16 +39,22 @@ public:
 	static QMap<QString, QString>  discover_devices();
 	void connect_to_serial(QString);
 	QString get_mmdvm_version(){ return m_version; }
+	// Voice frames are queued and sent to keep the modem's buffer at a target fill by the
+	// space its status reports, commands go at once
 	void write(QByteArray);
 	void set_cc(uint32_t);
+	qint64 get_avg_latency_us() { return m_rxlatency_ns / 1000; }
+	int get_max_backlog() { return m_maxbacklog; }
+	// Free space of one of the 7 TX buffers in a status frame, -1 if the frame has none
+	static int status_space(const QByteArray &f, uint8_t protocol, int buffer);
 public slots:
 	void set_mode(uint8_t);
 private slots:
 	void process_serial();
 	void receive_serial(QByteArray);
     void config_modem();
-	void process_modem();
 	void get_status_modem();
+	void tx_tick();
 	void set_freq();
 	void set_config();
 private:
@@ -60,10 +67,30 @@ private:
 	uint8_t m_protocol;
 	uint8_t m_configured;
 	uint32_t m_baudrate;
-	QTimer *m_modemtimer;
 	QTimer *m_statustimer;
+	QTimer *m_txtimer;
 	uint8_t packet_size;
-	QQueue<char> m_serialdata;
+	QByteArray m_serialdata;
+	QElapsedTimer m_clock;
+	qint64 m_rxstart_ns;		// When the first byte of the frame being read came in
+	qint64 m_rxlatency_ns;		// Average of first byte to dispatch
+	quint64 m_rxframes;
+	int m_maxbacklog;			// Most frames complete in one read
+	QQueue<QByteArray> m_txq;
+	struct TXBUFFER {
+		int space;				// Free frames the modem last reported, -1 before a status
+		int capacity;			// Most free frames reported, the size of the buffer
+		qint64 empty_ns;		// When what has been sent will have gone on air
+		qint64 last_ns;			// When the last frame of the over was sent
+		int frames;
+		int underruns;
+		int minfill;
+		int maxfill;
+		int sumfill;
+		int samples;
+	};
+	TXBUFFER m_txbuf[7];		// D-Star, DMR slot 1 and 2, YSF, P25, NXDN, M17 as in the status
+	qint64 m_status_ns;
 	uint32_t m_rxfreq;
 	uint32_t m_txfreq;
 	uint32_t m_dmrColorCode;
@@ -107,6 +134,12 @@ private:
 	bool m_fmEnabled;
 	int m_rxDCOffset;
 	int m_txDCOffset;	
+
+	void process_modem();
+	void handle_status(const QByteArray &f);
+	void flush_tx();
+	void end_tx_over(TXBUFFER &b);
+	static int tx_buffer(uint8_t type);
 signals:
 	void data_ready();
 	void modem_data_ready(QByteArray);
@@ -0,0 +1,339 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <QFile>
+#include "sessionmanager.h"
+#if !defined(Q_OS_IOS)
+#include "ambepool.h"
+#endif
+
+SessionManager::SessionManager(int threads, QObject *parent) :
+	QObject(parent),
+	m_nextid(0),
+	m_owner(-1),
+	m_volume(1.0),
+	m_mixer(nullptr),
+	m_gatewaypool(new QThreadPool(this)),
+	m_ambepool(nullptr)
+{
+	qRegisterMetaType<Mode::MODEINFO>("Mode::MODEINFO");
+
+	if(threads < 1){
+		threads = qMax(1, QThread::idealThreadCount());
+	}
+	m_gatewaypool->setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
+
+	for(int i = 0; i < threads; ++i){
+		QThread *t = new QThread(this);
+		QObject *a = new QObject;
+		t->setObjectName("session" + QString::number(i));
+		a->moveToThread(t);
+		connect(t, SIGNAL(finished()), a, SLOT(deleteLater()));
+		t->start();
+		m_threads.append(t);
+		m_anchors.append(a);
+	}
+}
+
+SessionManager::~SessionManager()
+{
+	remove_all();
+
+	// Mode::deleteLater() sends the disconnect on the session thread and posts a deferred
+	// delete, which is run when the thread finishes. A blocking call on each thread makes
+	// sure every queued deleteLater() has been handled before the threads are stopped.
+	for(QObject *a : m_anchors){
+		QMetaObject::invokeMethod(a, []() {}, Qt::BlockingQueuedConnection);
+	}
+	m_gatewaypool->waitForDone();
+#if !defined(Q_OS_IOS)
+	delete m_ambepool;
+#endif
+	if(m_mixer != nullptr){
+		QMetaObject::invokeMethod(m_mixer, "deleteLater");
+	}
+	for(QThread *t : m_threads){
+		t->quit();
+		t->wait();
+	}
+}
+
+QThread * SessionManager::least_loaded()
+{
+	QThread *thread = m_threads.first();
+	int least = m_sessions.size() + 1;
+
+	for(QThread *t : m_threads){
+		int n = 0;
+		for(const SESSION &s : m_sessions){
+			if(s.thread == t){
+				++n;
+			}
+		}
+		if(n < least){
+			least = n;
+			thread = t;
+		}
+	}
+	return thread;
+}
+
+int SessionManager::add_session(const SESSION_CONFIG &c)
+{
+	Mode *m = Mode::create_mode(c.mode);
+
+	if(m == nullptr){
+		qWarning() << "SessionManager: unsupported mode" << c.mode;
+		return -1;
+	}
+
+	const int id = m_nextid++;
+	SESSION s;
+	s.mode = m;
+	s.thread = least_loaded();
+	s.priority = c.priority;
+	s.closing = false;
+
+	if(c.mode == "IAX"){
+		m->set_iax_params(c.iax_user, c.iax_password, c.iax_callingname, c.refname, c.host, c.port);
+		m->set_iax_media(c.iax_codec, c.iax_trunk);
+	}
+
+	const QString audioout = (m_mixer != nullptr) ? "mixer:" + QString::number(c.priority) : c.audioout;
+	m->init(c.callsign, c.dmrid, c.nxdnid, c.module, c.refname, c.host, c.port, c.ipv6, c.vocoder, c.modem, c.audioin, audioout, false);
+
+	if(c.mode == "DMR"){
+		m->set_dmr_params(c.dmr_essid, c.dmr_password, c.dmr_lat, c.dmr_lon, c.dmr_location, c.dmr_desc, c.dmr_freq, c.dmr_url, c.dmr_swid, c.dmr_pkgid, c.dmr_options);
+		m->set_dmr_cc(c.dmr_cc);
+	}
+
+	m->moveToThread(s.thread);
+	m_sessions[id] = s;
+	m_ids[m] = id;
+
+	connect(m, SIGNAL(update(Mode::MODEINFO)), this, SLOT(mode_update(Mode::MODEINFO)));
+	connect(m, SIGNAL(update_log(QString)), this, SLOT(mode_log(QString)));
+	connect(m, SIGNAL(update_output_level(unsigned short)), this, SLOT(mode_output_level(unsigned short)));
+	connect(m, SIGNAL(destroyed(QObject*)), this, SLOT(mode_destroyed(QObject*)));
+
+	QMetaObject::invokeMethod(m, "begin_connect");
+
+	if(c.mode == "DMR"){
+		QMetaObject::invokeMethod(m, "dmr_tgid_changed", Q_ARG(int, c.dmr_tgid));
+	}
+
+	if((m_owner != -1) && (m_owner != id)){
+		QMetaObject::invokeMethod(m, "out_audio_vol_changed", Q_ARG(qreal, 0));
+	}
+	else{
+		QMetaObject::invokeMethod(m, "out_audio_vol_changed", Q_ARG(qreal, m_volume));
+	}
+
+	qDebug() << "SessionManager: session" << id << c.mode << c.host << c.port << "on" << s.thread->objectName();
+	return id;
+}
+
+void SessionManager::remove_session(int id)
+{
+	if(!m_sessions.contains(id) || m_sessions[id].closing){
+		return;
+	}
+	m_sessions[id].closing = true;
+	QMetaObject::invokeMethod(m_sessions[id].mode, "deleteLater");
+}
+
+void SessionManager::remove_all()
+{
+	for(int id : m_sessions.keys()){
+		remove_session(id);
+	}
+}
+
+void SessionManager::enable_mixer(QString audioout)
+{
+	if(m_mixer != nullptr){
+		return;
+	}
+	m_mixer = new AudioMixer(audioout);
+	m_mixer->moveToThread(m_threads.first());
+	QMetaObject::invokeMethod(m_mixer, "start");
+	set_audio_owner(-1);
+}
+
+CodecRelay * SessionManager::add_relay(int a, int b)
+{
+	if((a == b) || !m_sessions.contains(a) || !m_sessions.contains(b)){
+		qWarning() << "SessionManager: cannot relay session" << a << "to" << b;
+		return nullptr;
+	}
+	if(!CodecRelay::can_relay(m_sessions[a].mode, m_sessions[b].mode) && !CodecRelay::can_relay(m_sessions[b].mode, m_sessions[a].mode)){
+		qWarning() << "SessionManager: sessions" << a << "and" << b << "have no codec in common";
+		return nullptr;
+	}
+	qDebug() << "SessionManager: relaying session" << a << "and" << b;
+	return new CodecRelay(m_sessions[a].mode, m_sessions[b].mode, this);
+}
+
+TranscodeGateway * SessionManager::add_gateway(int a, int b)
+{
+	if((a == b) || !m_sessions.contains(a) || !m_sessions.contains(b)){
+		qWarning() << "SessionManager: cannot bridge session" << a << "to" << b;
+		return nullptr;
+	}
+	if(!TranscodeGateway::can_bridge(m_sessions[a].mode, m_sessions[b].mode) && !TranscodeGateway::can_bridge(m_sessions[b].mode, m_sessions[a].mode)){
+		qWarning() << "SessionManager: sessions" << a << "and" << b << "cannot be transcoded";
+		return nullptr;
+	}
+	qDebug() << "SessionManager: bridging session" << a << "and" << b << "on" << m_gatewaypool->maxThreadCount() << "threads";
+	TranscodeGateway *g = new TranscodeGateway(m_sessions[a].mode, m_sessions[b].mode, m_gatewaypool, &m_dmrids, &m_dmrcalls, this);
+#if !defined(Q_OS_IOS)
+	if((m_ambepool != nullptr) && m_ambepool->channels()){
+		g->set_hardware(m_ambepool);
+	}
+#endif
+	return g;
+}
+
+int SessionManager::open_ambe_devices(const QStringList &ports)
+{
+#if !defined(Q_OS_IOS)
+	if(m_ambepool == nullptr){
+		m_ambepool = new AMBEPool;
+	}
+	const int n = m_ambepool->open(ports);
+	qDebug() << "SessionManager:" << n << "AMBE channels on" << ports;
+	return n;
+#else
+	Q_UNUSED(ports);
+	return 0;
+#endif
+}
+
+// Reads a DMRIDs.dat, one "id callsign [name]" per line, for the talker lookup of the
+// gateways. Returns the number of IDs read.
+int SessionManager::load_dmr_ids(QString file)
+{
+	QFile f(file);
+
+	if(!f.open(QIODevice::ReadOnly)){
+		qWarning() << "SessionManager: cannot read" << file;
+		return 0;
+	}
+	m_dmrids.clear();
+	m_dmrcalls.clear();
+	while(!f.atEnd()){
+		const QString line = f.readLine();
+		if(line.startsWith('#')){
+			continue;
+		}
+		const QStringList ids = line.simplified().split(' ');
+		if(ids.size() >= 2){
+			const uint32_t id = ids.at(0).toUInt();
+			m_dmrids[id] = (ids.size() == 3) ? ids.at(1) + " " + ids.at(2) : ids.at(1);
+			if(!m_dmrcalls.contains(ids.at(1).toUpper())){
+				m_dmrcalls[ids.at(1).toUpper()] = id;
+			}
+		}
+	}
+	f.close();
+	return m_dmrids.size();
+}
+
+void SessionManager::set_output_volume(qreal v)
+{
+	m_volume = v;
+	set_audio_owner(m_owner);
+}
+
+void SessionManager::set_audio_owner(int id)
+{
+	m_owner = id;
+
+	for(auto it = m_sessions.constBegin(); it != m_sessions.constEnd(); ++it){
+		if(it.value().closing){
+			continue;
+		}
+		const qreal v = ((id == -1) || (id == it.key())) ? m_volume : 0;
+		QMetaObject::invokeMethod(it.value().mode, "out_audio_vol_changed", Q_ARG(qreal, v));
+	}
+}
+
+void SessionManager::mode_update(Mode::MODEINFO info)
+{
+	const int id = session_id(sender());
+
+	if(id == -1){
+		return;
+	}
+
+	// Without a mixer only one session is audible at a time
+	if(m_mixer == nullptr){
+		switch(info.stream_state){
+		case Mode::STREAM_NEW:
+		case Mode::STREAMING:
+			if((m_owner == -1) || ((m_owner != id) && (m_sessions[id].priority > m_sessions[m_owner].priority))){
+				set_audio_owner(id);
+			}
+			break;
+		case Mode::STREAM_END:
+		case Mode::STREAM_LOST:
+		case Mode::STREAM_IDLE:
+			if(m_owner == id){
+				set_audio_owner(-1);
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	emit session_update(id, info);
+}
+
+void SessionManager::mode_log(QString s)
+{
+	const int id = session_id(sender());
+
+	if(id != -1){
+		emit session_log(id, s);
+	}
+}
+
+void SessionManager::mode_output_level(unsigned short l)
+{
+	const int id = session_id(sender());
+
+	if(id != -1){
+		emit session_output_level(id, l);
+	}
+}
+
+void SessionManager::mode_destroyed(QObject *o)
+{
+	const int id = m_ids.value(o, -1);
+
+	if(id == -1){
+		return;
+	}
+	m_ids.remove(o);
+	m_sessions.remove(id);
+
+	if(m_owner == id){
+		set_audio_owner(-1);
+	}
+	emit session_removed(id);
+}
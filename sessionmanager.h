@@ -0,0 +1,129 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SESSIONMANAGER_H
+#define SESSIONMANAGER_H
+
+#include <QObject>
+#include <QThread>
+#include <QThreadPool>
+#include <QMap>
+#include "mode.h"
+#include "audiomixer.h"
+#include "codecrelay.h"
+#include "transcodegateway.h"
+
+class AMBEPool;
+
+// Runs several Mode instances at once, e.g. an M17 reflector and a DMR talkgroup, spread
+// over a fixed pool of threads. All sessions share one playback device; the session that
+// starts receiving first holds the audio until its stream ends, unless a session with a
+// higher priority starts talking. With enable_mixer() the sessions are instead summed by
+// an AudioMixer, lower priorities ducked while a higher one is active. add_relay() links
+// two sessions so voice received on either is retransmitted on the other, add_gateway()
+// does the same through PCM for sessions without a codec in common. With
+// open_ambe_devices() the gateways transcode AMBE on a pool of dongles.
+class SessionManager : public QObject
+{
+	Q_OBJECT
+public:
+	SessionManager(int threads = 0, QObject *parent = nullptr);
+	~SessionManager();
+	struct SESSION_CONFIG {
+		QString mode;
+		QString callsign;
+		uint32_t dmrid = 0;
+		uint16_t nxdnid = 0;
+		char module = ' ';
+		QString refname;
+		QString host;
+		int port = 0;
+		bool ipv6 = false;
+		QString vocoder = "Software vocoder";
+		QString modem;
+		QString audioin = "OS default";
+		QString audioout = "OS default";
+		int priority = 0;
+		uint32_t dmr_tgid = 0;
+		uint32_t dmr_cc = 1;
+		uint8_t dmr_essid = 0;
+		QString dmr_password;
+		QString dmr_lat = "0";
+		QString dmr_lon = "0";
+		QString dmr_location;
+		QString dmr_desc;
+		QString dmr_freq = "0";
+		QString dmr_url;
+		QString dmr_swid;
+		QString dmr_pkgid;
+		QString dmr_options;
+		QString iax_user;
+		QString iax_password;
+		QString iax_callingname;
+		QString iax_codec = "ulaw";
+		int iax_trunk = 0;
+	};
+	int add_session(const SESSION_CONFIG &c);
+	void remove_session(int id);
+	void remove_all();
+	QList<int> sessions() { return m_sessions.keys(); }
+	Mode * mode(int id) { return m_sessions.contains(id) ? m_sessions[id].mode : nullptr; }
+	int threads() { return m_threads.size(); }
+	int audio_owner() { return m_owner; }
+	void set_output_volume(qreal v);
+	void enable_mixer(QString audioout);
+	CodecRelay * add_relay(int a, int b);
+	TranscodeGateway * add_gateway(int a, int b);
+	int load_dmr_ids(QString file);
+	// Opens AMBE-3000 and AMBE-3003 dongles for the gateways added from then on, returns the number of channels
+	int open_ambe_devices(const QStringList &ports);
+signals:
+	void session_update(int id, Mode::MODEINFO);
+	void session_log(int id, QString);
+	void session_output_level(int id, unsigned short);
+	void session_removed(int id);
+private slots:
+	void mode_update(Mode::MODEINFO);
+	void mode_log(QString);
+	void mode_output_level(unsigned short);
+	void mode_destroyed(QObject *);
+private:
+	struct SESSION {
+		Mode *mode;
+		QThread *thread;
+		int priority;
+		bool closing;
+	};
+	QList<QThread *> m_threads;
+	QList<QObject *> m_anchors;
+	QMap<int, SESSION> m_sessions;
+	QMap<QObject *, int> m_ids;
+	int m_nextid;
+	int m_owner;
+	qreal m_volume;
+	AudioMixer *m_mixer;
+	QThreadPool *m_gatewaypool;
+	AMBEPool *m_ambepool;
+	QHash<uint32_t, QString> m_dmrids;
+	QHash<QString, uint32_t> m_dmrcalls;
+
+	int session_id(QObject *o) { return m_ids.value(o, -1); }
+	QThread * least_loaded();
+	void set_audio_owner(int id);
+};
+
+#endif // SESSIONMANAGER_H
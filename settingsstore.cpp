@@ -0,0 +1,66 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <QDebug>
+#include "settingsstore.h"
+
+SettingsStore::SettingsStore(QSettings *settings, int quiet_ms, QObject *parent) :
+	QObject(parent),
+	m_settings(settings),
+	m_timer(new QTimer(this)),
+	m_changes(0),
+	m_syncs(0)
+{
+	m_timer->setSingleShot(true);
+	m_timer->setInterval(quiet_ms);
+	connect(m_timer, &QTimer::timeout, this, &SettingsStore::flush);
+}
+
+// The INI file holds every value as a string, so values are compared as strings
+void SettingsStore::set(const QString &key, const QVariant &v)
+{
+	if(value(key).toString() == v.toString()){
+		return;
+	}
+	m_dirty[key] = v;
+	++m_changes;
+	m_timer->start();
+}
+
+QVariant SettingsStore::value(const QString &key, const QVariant &def)
+{
+	auto it = m_dirty.constFind(key);
+	if(it != m_dirty.constEnd()){
+		return it.value();
+	}
+	return m_settings->value(key, def);
+}
+
+void SettingsStore::flush()
+{
+	m_timer->stop();
+	if(m_dirty.isEmpty()){
+		return;
+	}
+	for(auto it = m_dirty.constBegin(); it != m_dirty.constEnd(); ++it){
+		m_settings->setValue(it.key(), it.value());
+	}
+	m_settings->sync();
+	++m_syncs;
+	qDebug() << "SettingsStore: wrote" << m_dirty.size() << "keys," << m_syncs << "writes for" << m_changes << "changes";
+	m_dirty.clear();
+}
@@ -0,0 +1,47 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SETTINGSSTORE_H
+#define SETTINGSSTORE_H
+
+#include <QObject>
+#include <QHash>
+#include <QSettings>
+#include <QTimer>
+
+// Writes to a QSettings file in batches. Values that differ from the stored ones are held
+// until no value has changed for the quiet period, then written with a single sync, so a
+// text field being typed into costs one write rather than one per keystroke.
+class SettingsStore : public QObject
+{
+	Q_OBJECT
+public:
+	SettingsStore(QSettings *settings, int quiet_ms, QObject *parent = nullptr);
+	void set(const QString &key, const QVariant &v);
+	QVariant value(const QString &key, const QVariant &def = QVariant());
+	bool dirty() { return !m_dirty.isEmpty(); }
+public slots:
+	void flush();
+private:
+	QSettings *m_settings;
+	QTimer *m_timer;
+	QHash<QString, QVariant> m_dirty;
+	quint32 m_changes;
+	quint32 m_syncs;
+};
+
+#endif // SETTINGSSTORE_H
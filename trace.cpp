@@ -0,0 +1,74 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// droidstar-trace: print a packet trace written by DroidStar or droidstard.
+//
+//   droidstar-trace [-m M17] [-t RECV] trace-20240101-120000.dstrace
+//
+// One line per packet, oldest first, with the wall clock time it was recorded, the mode,
+// the tag and the payload in hex. Payloads longer than the trace keeps end in "...".
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <cstdio>
+#include "packettrace.h"
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	QCommandLineParser parser;
+
+	parser.setApplicationDescription("DroidStar packet trace printer");
+	parser.addHelpOption();
+	parser.addOption({{"m", "mode"}, "Only packets of this mode", "mode"});
+	parser.addOption({{"t", "tag"}, "Only packets with this tag (RECV, SEND, PING...)", "tag"});
+	parser.addPositionalArgument("trace", "The .dstrace file");
+	parser.process(app);
+
+	if(parser.positionalArguments().size() != 1){
+		parser.showHelp(1);
+	}
+	const QByteArray mode = parser.value("mode").toUpper().toLatin1();
+	const QByteArray tag = parser.value("tag").toUpper().toLatin1();
+	PacketTrace::HEADER h;
+	QList<PacketTrace::RECORD> records;
+	int shown = 0;
+
+	if(!PacketTrace::load(parser.positionalArguments().at(0), h, records)){
+		fprintf(stderr, "%s is not a trace file\n", parser.positionalArguments().at(0).toStdString().c_str());
+		return 1;
+	}
+	fprintf(stdout, "%s, %s, %d packets\n", QDateTime::fromMSecsSinceEpoch(h.wall_ms).toString("yyyy.MM.dd hh:mm:ss.zzz").toStdString().c_str(),
+			h.reason.toStdString().c_str(), (int)records.size());
+
+	for(const PacketTrace::RECORD &r : records){
+		if((!mode.isEmpty() && (r.mode != mode)) || (!tag.isEmpty() && (r.tag != tag))){
+			continue;
+		}
+		// The trace clock has no date, the header ties it to the wall clock
+		const qint64 ms = h.wall_ms - (qint64)(h.wall_ns - r.ns) / 1000000;
+		const QString s = PacketTrace::format(r.tag.constData(), r.data);
+		fprintf(stdout, "%s %-4s %3d %s%s\n", QDateTime::fromMSecsSinceEpoch(ms).toString("hh:mm:ss.zzz").toStdString().c_str(),
+				r.mode.constData(), r.size, s.toStdString().c_str(), (r.size > r.data.size()) ? " ..." : "");
+		++shown;
+	}
+	if(shown < records.size()){
+		fprintf(stdout, "%d of %d packets shown\n", shown, (int)records.size());
+	}
+	return 0;
+}
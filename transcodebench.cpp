@@ -0,0 +1,315 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// droidstar-transcodebench: IMBE <-> AMBE transcoding, parameter domain against PCM.
+//
+//   droidstar-transcodebench [-i speech.wav] [-s seconds]
+//
+// The input, 8 kHz 16 bit mono WAV or raw PCM, or synthetic speech when none is given,
+// is encoded with the source vocoder and decoded again as the reference. Each frame is
+// then transcoded once through PCM, decode and encode, and once with the model parameters
+// only, and both results are decoded and compared with the reference. Distances are the
+// mean log spectral distance over the frames with speech, raw and with the level offset
+// taken out, at the frame delay that fits best.
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QRandomGenerator>
+#include <QVector>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "imbe_vocoder/imbe_vocoder_api.h"
+#include "mbe/mbevocoder_api.h"
+
+static const int BINS = 128;
+
+static QVector<int16_t> synthetic_speech(int seconds)
+{
+	static const double formants[4][3] = {{700, 1200, 2600}, {300, 2200, 3000}, {500, 900, 2400}, {2500, 3200, 3600}};
+	QVector<int16_t> pcm(seconds * 8000);
+	QRandomGenerator rng(1);
+	double phase = 0, y1[3] = {0, 0, 0}, y2[3] = {0, 0, 0};
+
+	// Half second segments: three vowels, a fricative and a pause
+	for(int n = 0; n < pcm.size(); ++n){
+		const double t = n / 8000.0;
+		const int seg = (int)(t / 0.5);
+		const int kind = seg % 5;
+		const double st = fmod(t, 0.5);
+		const double f0 = 100 + 60 * sin(2 * M_PI * 0.3 * t) + 40 * (seg % 3);
+		double x = 0, s = 0;
+
+		if(kind < 3){
+			phase += f0 / 8000;
+			if(phase >= 1){
+				phase -= 1;
+				x = 3000;
+			}
+		}
+		else if(kind == 3){
+			x = (rng.bounded(32768) - 16384) / 40.0;
+		}
+		for(int k = 0; k < 3; ++k){
+			const double th = 2 * M_PI * (formants[kind & 3][k] + 50 * sin(2 * M_PI * 0.7 * t + k)) / 8000;
+			const double y = x * 0.03 + 1.94 * cos(th) * y1[k] - 0.9409 * y2[k];
+			y2[k] = y1[k];
+			y1[k] = y;
+			s += y * (k ? 0.6 : 1.0);
+		}
+		s *= (kind == 4) ? 0 : qMin(1.0, qMin(st, 0.5 - st) * 20) * 4;
+		pcm[n] = (int16_t)qBound(-32768.0, s, 32767.0);
+	}
+	return pcm;
+}
+
+static QVector<int16_t> read_pcm(const QString &file)
+{
+	QVector<int16_t> pcm;
+	QFile f(file);
+
+	if(!f.open(QIODevice::ReadOnly)){
+		return pcm;
+	}
+	QByteArray d = f.readAll();
+	if(d.startsWith("RIFF")){
+		const int i = d.indexOf("data");
+		d = (i == -1) ? QByteArray() : d.mid(i + 8);
+	}
+	pcm.resize(d.size() / 2);
+	memcpy(pcm.data(), d.constData(), pcm.size() * 2);
+	return pcm;
+}
+
+static void spectrum(const int16_t *pcm, double *db)
+{
+	for(int k = 0; k < BINS; ++k){
+		double re = 0, im = 0;
+		for(int n = 0; n < FRAME; ++n){
+			const double v = pcm[n] * (0.5 - 0.5 * cos(2 * M_PI * n / FRAME));
+			re += v * cos(2 * M_PI * k * n / (2 * BINS));
+			im -= v * sin(2 * M_PI * k * n / (2 * BINS));
+		}
+		db[k] = 10 * log10(re * re + im * im + 1);
+	}
+}
+
+struct RESULT {
+	double lsd = 1e9;
+	double nlsd = 0;
+	double level = 0;
+	int delay = 0;
+};
+
+// Bins 2 to 114 cover 62 Hz to 3.6 kHz, frames quieter than -50 dBFS are left out
+static RESULT compare(const QVector<int16_t> &ref, const QVector<int16_t> &test)
+{
+	const int frames = ref.size() / FRAME;
+	QVector<double> r(frames * BINS), t(frames * BINS);
+	RESULT best;
+
+	for(int f = 0; f < frames; ++f){
+		spectrum(&ref[f * FRAME], &r[f * BINS]);
+		spectrum(&test[f * FRAME], &t[f * BINS]);
+	}
+	for(int delay = 0; delay < 5; ++delay){
+		double sum = 0, nsum = 0, eref = 0, etest = 0;
+		int n = 0;
+		for(int f = 2; f + delay < frames; ++f){
+			double e = 0, mean = 0, d = 0, nd = 0;
+			for(int i = 0; i < FRAME; ++i){
+				e += (double)ref[f * FRAME + i] * ref[f * FRAME + i];
+			}
+			if(e / FRAME < 10000){
+				continue;
+			}
+			const double *a = &r[f * BINS];
+			const double *b = &t[(f + delay) * BINS];
+			for(int k = 2; k < 115; ++k){
+				mean += a[k] - b[k];
+			}
+			mean /= 113;
+			for(int k = 2; k < 115; ++k){
+				d += (a[k] - b[k]) * (a[k] - b[k]);
+				nd += (a[k] - b[k] - mean) * (a[k] - b[k] - mean);
+			}
+			sum += sqrt(d / 113);
+			nsum += sqrt(nd / 113);
+			eref += e;
+			for(int i = 0; i < FRAME; ++i){
+				etest += (double)test[(f + delay) * FRAME + i] * test[(f + delay) * FRAME + i];
+			}
+			++n;
+		}
+		if(n && (sum / n < best.lsd)){
+			best.lsd = sum / n;
+			best.nlsd = nsum / n;
+			best.level = 10 * log10((etest + 1) / (eref + 1));
+			best.delay = delay;
+		}
+	}
+	return best;
+}
+
+static void ambe_encode(MBEVocoder &v, bool dstar, int16_t *pcm, uint8_t *ambe)
+{
+	memset(ambe, 0, 9);
+	if(dstar){
+		v.encode_2400x1200(pcm, ambe);
+	}
+	else{
+		v.encode_2450(pcm, ambe);
+	}
+}
+
+static void ambe_decode(MBEVocoder &v, bool dstar, int16_t *pcm, uint8_t *ambe)
+{
+	if(dstar){
+		v.decode_2400x1200(pcm, ambe);
+	}
+	else{
+		v.decode_2450(pcm, ambe);
+	}
+}
+
+static void print(const char *dir, const char *path, double us, const RESULT &r)
+{
+	fprintf(stdout, "%-18s %-6s %10.1f %8.2f %8.2f %+8.1f %6d\n", dir, path, us, r.lsd, r.nlsd, r.level, r.delay);
+}
+
+// P25 to DMR/NXDN/YSF DN or D-STAR
+static void imbe_to_ambe(const QVector<int16_t> &speech, bool dstar)
+{
+	const int frames = speech.size() / FRAME;
+	QVector<int16_t> ref(frames * FRAME), viapcm(frames * FRAME), viaparams(frames * FRAME), pcm = speech;
+	QVector<uint8_t> imbe(frames * 11), a(frames * 9), b(frames * 9);
+	imbe_vocoder enc, dec;
+	QElapsedTimer t;
+	double us[2];
+
+	for(int f = 0; f < frames; ++f){
+		enc.encode_4400(&pcm[f * FRAME], &imbe[f * 11]);
+		dec.decode_4400(&ref[f * FRAME], &imbe[f * 11]);
+	}
+	{
+		imbe_vocoder d;
+		MBEVocoder e;
+		int16_t p[FRAME];
+		t.start();
+		for(int f = 0; f < frames; ++f){
+			d.decode_4400(p, &imbe[f * 11]);
+			ambe_encode(e, dstar, p, &a[f * 9]);
+		}
+		us[0] = t.nsecsElapsed() / 1000.0 / frames;
+	}
+	{
+		MBEVocoder e;
+		t.start();
+		for(int f = 0; f < frames; ++f){
+			if(dstar){
+				e.imbe_to_ambe_2400x1200(&imbe[f * 11], &b[f * 9]);
+			}
+			else{
+				e.imbe_to_ambe_2450(&imbe[f * 11], &b[f * 9]);
+			}
+		}
+		us[1] = t.nsecsElapsed() / 1000.0 / frames;
+	}
+	MBEVocoder da, db;
+	for(int f = 0; f < frames; ++f){
+		ambe_decode(da, dstar, &viapcm[f * FRAME], &a[f * 9]);
+		ambe_decode(db, dstar, &viaparams[f * FRAME], &b[f * 9]);
+	}
+	const char *dir = dstar ? "IMBE->AMBE2400" : "IMBE->AMBE2450";
+	print(dir, "pcm", us[0], compare(ref, viapcm));
+	print(dir, "params", us[1], compare(ref, viaparams));
+}
+
+static void ambe_to_imbe(const QVector<int16_t> &speech, bool dstar)
+{
+	const int frames = speech.size() / FRAME;
+	QVector<int16_t> ref(frames * FRAME), viapcm(frames * FRAME), viaparams(frames * FRAME), pcm = speech;
+	QVector<uint8_t> ambe(frames * 9), a(frames * 11), b(frames * 11);
+	MBEVocoder enc, dec;
+	QElapsedTimer t;
+	double us[2];
+
+	for(int f = 0; f < frames; ++f){
+		ambe_encode(enc, dstar, &pcm[f * FRAME], &ambe[f * 9]);
+		ambe_decode(dec, dstar, &ref[f * FRAME], &ambe[f * 9]);
+	}
+	{
+		MBEVocoder d;
+		imbe_vocoder e;
+		int16_t p[FRAME];
+		t.start();
+		for(int f = 0; f < frames; ++f){
+			ambe_decode(d, dstar, p, &ambe[f * 9]);
+			e.encode_4400(p, &a[f * 11]);
+		}
+		us[0] = t.nsecsElapsed() / 1000.0 / frames;
+	}
+	{
+		MBEVocoder d;
+		t.start();
+		for(int f = 0; f < frames; ++f){
+			if(dstar){
+				d.ambe_2400x1200_to_imbe(&ambe[f * 9], &b[f * 11]);
+			}
+			else{
+				d.ambe_2450_to_imbe(&ambe[f * 9], &b[f * 11]);
+			}
+		}
+		us[1] = t.nsecsElapsed() / 1000.0 / frames;
+	}
+	imbe_vocoder da, db;
+	for(int f = 0; f < frames; ++f){
+		da.decode_4400(&viapcm[f * FRAME], &a[f * 11]);
+		db.decode_4400(&viaparams[f * FRAME], &b[f * 11]);
+	}
+	const char *dir = dstar ? "AMBE2400->IMBE" : "AMBE2450->IMBE";
+	print(dir, "pcm", us[0], compare(ref, viapcm));
+	print(dir, "params", us[1], compare(ref, viaparams));
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	QCommandLineParser parser;
+
+	parser.setApplicationDescription("IMBE/AMBE transcoding benchmark");
+	parser.addHelpOption();
+	parser.addOption({{"i", "input"}, "8 kHz 16 bit mono WAV or raw PCM", "file"});
+	parser.addOption({{"s", "seconds"}, "Length of the synthetic speech", "seconds", "10"});
+	parser.process(app);
+
+	const QVector<int16_t> speech = parser.isSet("input") ? read_pcm(parser.value("input")) : synthetic_speech(qMax(1, parser.value("seconds").toInt()));
+
+	if(speech.size() < FRAME * 10){
+		fprintf(stderr, "Not enough input\n");
+		return 1;
+	}
+	fprintf(stdout, "%d frames, distances in dB, delay in frames\n", (int)(speech.size() / FRAME));
+	fprintf(stdout, "%-18s %-6s %10s %8s %8s %8s %6s\n", "direction", "path", "us_frame", "lsd", "lsd_norm", "level", "delay");
+	imbe_to_ambe(speech, false);
+	imbe_to_ambe(speech, true);
+	ambe_to_imbe(speech, false);
+	ambe_to_imbe(speech, true);
+	return 0;
+}
@@ -0,0 +1,250 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "transcodegateway.h"
+#if !defined(Q_OS_IOS)
+#include "ambepool.h"
+#include "vocoderregistry.h"
+#endif
+
+TranscodeGateway::TranscodeGateway(Mode *a, Mode *b, QThreadPool *pool, const QHash<uint32_t, QString> *dmrids, const QHash<QString, uint32_t> *dmrcalls, QObject *parent) :
+	QObject(parent),
+	m_pool(pool),
+	m_hw(nullptr),
+	m_dmrids(dmrids),
+	m_dmrcalls(dmrcalls),
+	m_active(-1),
+	m_agc(true),
+	m_debug(false)
+{
+	m_talkerid[0] = 0;
+	m_talkerid[1] = 0;
+	qRegisterMetaType<Mode::MODEINFO>("Mode::MODEINFO");
+	m_modes[0] = a;
+	m_modes[1] = b;
+
+	for(int i = 0; i < 2; ++i){
+		connect(m_modes[i], SIGNAL(relay_rx(int,QByteArray)), this, SLOT(mode_relay_rx(int,QByteArray)));
+		connect(m_modes[i], SIGNAL(relay_rx_end()), this, SLOT(mode_relay_rx_end()));
+		connect(m_modes[i], SIGNAL(update(Mode::MODEINFO)), this, SLOT(mode_update(Mode::MODEINFO)));
+		QMetaObject::invokeMethod(m_modes[i], "set_relay_rx", Q_ARG(bool, true));
+
+		if(!can_bridge(m_modes[i], m_modes[i ^ 1])){
+			qWarning() << "TranscodeGateway: cannot transcode from" << m_modes[i]->metaObject()->className() << "to" << m_modes[i ^ 1]->metaObject()->className();
+		}
+	}
+}
+
+TranscodeGateway::~TranscodeGateway()
+{
+	for(int i = 0; i < 2; ++i){
+		if(m_modes[i]){
+			disconnect(m_modes[i], nullptr, this, nullptr);
+			QMetaObject::invokeMethod(m_modes[i], "set_relay_rx", Q_ARG(bool, false));
+			if(m_active == (i ^ 1)){
+				QMetaObject::invokeMethod(m_modes[i], "relay_tx_end");
+			}
+		}
+		qDeleteAll(m_pipes[i]);
+	}
+}
+
+bool TranscodeGateway::can_bridge(Mode *from, Mode *to)
+{
+	for(int c : from->relay_codecs()){
+		if(TranscodePipeline::can_decode(c)){
+			return target_codec(to) != Mode::CODEC_NONE;
+		}
+	}
+	return false;
+}
+
+int TranscodeGateway::target_codec(Mode *to)
+{
+	for(int c : to->relay_codecs()){
+		if(TranscodePipeline::can_encode(c)){
+			return c;
+		}
+	}
+	return Mode::CODEC_NONE;
+}
+
+int TranscodeGateway::side(QObject *o)
+{
+	for(int i = 0; i < 2; ++i){
+		if(m_modes[i] == o){
+			return i;
+		}
+	}
+	return -1;
+}
+
+// DMR and P25 carry a DMR ID, NXDN has its own 16 bit IDs and the rest send callsigns
+bool TranscodeGateway::has_ids(Mode *m)
+{
+	const QString c = m->metaObject()->className();
+	return (c == "DMR") || (c == "P25");
+}
+
+TranscodePipeline * TranscodeGateway::pipeline(int dir, int codec)
+{
+	Mode *to = m_modes[dir ^ 1];
+	TranscodePipeline *p = m_pipes[dir].value(codec, nullptr);
+
+	if(p != nullptr){
+		return p;
+	}
+	if(!to || !TranscodePipeline::can_decode(codec) || (target_codec(to) == Mode::CODEC_NONE)){
+		return nullptr;
+	}
+	p = new TranscodePipeline(codec, target_codec(to), m_pool);
+	p->set_agc(m_agc);
+	p->set_hardware(m_hw);
+	p->set_talker(m_talkercall[dir], m_talkerid[dir]);
+	connect(p, &TranscodePipeline::talker, to, &Mode::relay_talker, Qt::QueuedConnection);
+	connect(p, &TranscodePipeline::frame, to, &Mode::relay_tx, Qt::QueuedConnection);
+	connect(p, &TranscodePipeline::end, to, &Mode::relay_tx_end, Qt::QueuedConnection);
+	connect(p, &TranscodePipeline::end, this, &TranscodeGateway::pipeline_end, Qt::QueuedConnection);
+	m_pipes[dir][codec] = p;
+	if(m_debug){
+		qDebug() << "TranscodeGateway: direction" << dir << "codec" << codec << "->" << p->to();
+	}
+	return p;
+}
+
+TranscodePipeline::STATS TranscodeGateway::stats(int dir)
+{
+	TranscodePipeline::STATS st;
+
+	for(TranscodePipeline *p : m_pipes[dir & 1]){
+		const TranscodePipeline::STATS s = p->stats();
+		st.frames_in += s.frames_in;
+		st.frames_out += s.frames_out;
+		st.dropped += s.dropped;
+		st.decode_ns += s.decode_ns;
+		st.encode_ns += s.encode_ns;
+	}
+	return st;
+}
+
+void TranscodeGateway::set_agc(bool agc)
+{
+	m_agc = agc;
+	for(int i = 0; i < 2; ++i){
+		for(TranscodePipeline *p : m_pipes[i]){
+			p->set_agc(agc);
+		}
+	}
+}
+
+void TranscodeGateway::mode_relay_rx(int codec, QByteArray frame)
+{
+	const int s = side(sender());
+	TranscodePipeline *p;
+
+	if(s == -1){
+		return;
+	}
+	if((m_active != -1) && (m_active != s)){
+		return;
+	}
+	p = pipeline(s, codec);
+	if(p == nullptr){
+		return;
+	}
+	if(m_active == -1){
+		m_active = s;
+		if(m_debug){
+			qDebug() << "TranscodeGateway: over from side" << s << "codec" << codec << "->" << p->to();
+		}
+	}
+	p->push(frame);
+}
+
+void TranscodeGateway::mode_relay_rx_end()
+{
+	const int s = side(sender());
+
+	if((s == -1) || (s != m_active)){
+		return;
+	}
+	for(TranscodePipeline *p : m_pipes[s]){
+		p->push_end();
+	}
+	m_active = -1;
+}
+
+// The source fills in its talker over the first frames of a stream, YSF only once the
+// header has been decoded, so every update is passed on until the pipeline sends the
+// talker ahead of its first encoded frame
+void TranscodeGateway::mode_update(Mode::MODEINFO info)
+{
+	const int s = side(sender());
+	QString call;
+	uint32_t id = 0;
+
+	if((s == -1) || ((m_active != -1) && (m_active != s))){
+		return;
+	}
+	if((info.stream_state != Mode::STREAM_NEW) && (info.stream_state != Mode::STREAMING)){
+		return;
+	}
+
+	if(!info.src.simplified().isEmpty()){
+		call = info.src.simplified().split(' ').first().toUpper();
+	}
+	else if(info.srcid && m_dmrids){
+		call = m_dmrids->value(info.srcid).split(' ').first().toUpper();
+	}
+	if(!call.isEmpty() && m_dmrcalls){
+		id = m_dmrcalls->value(call, 0);
+	}
+	if(!id && has_ids(m_modes[s])){
+		id = info.srcid;
+	}
+	m_talkercall[s] = call;
+	m_talkerid[s] = id;
+	for(TranscodePipeline *p : m_pipes[s]){
+		p->set_talker(call, id);
+	}
+}
+
+void TranscodeGateway::pipeline_end()
+{
+	TranscodePipeline *p = qobject_cast<TranscodePipeline *>(sender());
+
+	for(int i = 0; (p != nullptr) && (i < 2); ++i){
+		for(TranscodePipeline *q : m_pipes[i]){
+			if(q != p){
+				continue;
+			}
+			const TranscodePipeline::STATS st = stats(i);
+			const quint64 frames = st.frames_out - m_last[i].frames_out;
+			const qint64 ns = (st.decode_ns - m_last[i].decode_ns) + (st.encode_ns - m_last[i].encode_ns);
+			emit update_log(QString("Gateway %1 to %2: %3 frames, %4 dropped, %5 us per frame").arg(m_modes[i] ? m_modes[i]->metaObject()->className() : "?", m_modes[i ^ 1] ? m_modes[i ^ 1]->metaObject()->className() : "?").arg(frames).arg(st.dropped - m_last[i].dropped).arg(frames ? ns / 1000 / (qint64)frames : 0));
+			m_last[i] = st;
+#if !defined(Q_OS_IOS)
+			if(m_hw != nullptr){
+				for(const AMBEPool::CHANNEL_STATS &c : m_hw->stats()){
+					emit update_log(QString("AMBE %1 channel %2: %3, %4 streams, depth %5, rtt %6 us, average %7 us, %8 frames, %9 timeouts").arg(c.device).arg(c.channel).arg(VocoderRegistry::codec_name(c.codec)).arg(c.streams).arg(c.depth).arg(c.last_rtt_us).arg(c.avg_rtt_us).arg(c.frames).arg(c.timeouts));
+				}
+			}
+#endif
+			return;
+		}
+	}
+}
@@ -0,0 +1,75 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRANSCODEGATEWAY_H
+#define TRANSCODEGATEWAY_H
+
+#include <QObject>
+#include <QHash>
+#include <QPointer>
+#include <QThreadPool>
+#include "mode.h"
+#include "transcodepipeline.h"
+
+// Links two modes through PCM, so any pair can be bridged, M17 and IAX included, at the
+// cost of a decode and an encode per frame. The vocoders run in a TranscodePipeline per
+// direction on a shared thread pool instead of the session threads. The talker of each
+// over is looked up in the DMR ID database, a callsign for the modes that send one and a
+// DMR ID for DMR and P25. Like CodecRelay the link is half duplex.
+class TranscodeGateway : public QObject
+{
+	Q_OBJECT
+public:
+	TranscodeGateway(Mode *a, Mode *b, QThreadPool *pool, const QHash<uint32_t, QString> *dmrids = nullptr, const QHash<QString, uint32_t> *dmrcalls = nullptr, QObject *parent = nullptr);
+	~TranscodeGateway();
+	// Direction 0 is a to b, 1 is b to a
+	TranscodePipeline::STATS stats(int dir);
+	void set_agc(bool agc);
+	// Logs each new pipeline and the start of every over
+	void set_debug(bool debug) { m_debug = debug; }
+	// AMBE decoding and encoding on a pool of dongles, for the pipelines created from now on
+	void set_hardware(AMBEPool *hw) { m_hw = hw; }
+	static bool can_bridge(Mode *from, Mode *to);
+signals:
+	void update_log(QString);
+private slots:
+	void mode_relay_rx(int codec, QByteArray frame);
+	void mode_relay_rx_end();
+	void mode_update(Mode::MODEINFO info);
+	void pipeline_end();
+private:
+	QPointer<Mode> m_modes[2];
+	QThreadPool *m_pool;
+	AMBEPool *m_hw;
+	const QHash<uint32_t, QString> *m_dmrids;
+	const QHash<QString, uint32_t> *m_dmrcalls;
+	// One pipeline per source codec, a pipeline still draining an over is never replaced
+	QHash<int, TranscodePipeline *> m_pipes[2];
+	TranscodePipeline::STATS m_last[2];
+	QString m_talkercall[2];
+	uint32_t m_talkerid[2];
+	int m_active;
+	bool m_agc;
+	bool m_debug;
+
+	int side(QObject *o);
+	static int target_codec(Mode *to);
+	TranscodePipeline * pipeline(int dir, int codec);
+	bool has_ids(Mode *m);
+};
+
+#endif // TRANSCODEGATEWAY_H
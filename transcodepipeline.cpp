@@ -0,0 +1,363 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <QElapsedTimer>
+#include <cmath>
+#include <cstring>
+#include "transcodepipeline.h"
+#include "vocoderregistry.h"
+#if !defined(Q_OS_IOS)
+#include "ambepool.h"
+#endif
+#include "g711.h"
+
+// AGC aims for -20 dBFS RMS, frames below -54 dBFS are taken as silence and leave the gain alone
+#define AGC_TARGET		3277.0f
+#define AGC_FLOOR		65.0f
+#define AGC_MIN_GAIN	0.25f
+#define AGC_MAX_GAIN	8.0f
+#define AGC_ATTACK		0.5f
+#define AGC_RELEASE		0.05f
+
+TranscodePipeline::TranscodePipeline(int from, int to, QThreadPool *pool, QObject *parent) :
+	QObject(parent),
+	m_from(from),
+	m_to(to),
+	m_pool(pool),
+	m_closing(false),
+	m_agc(true),
+	m_talkerid(0),
+	m_hw(nullptr),
+	m_mbedec(nullptr),
+	m_imbedec(nullptr),
+	m_agcgain(1.0f),
+	m_mbeenc(nullptr),
+	m_imbeenc(nullptr),
+	m_c2dec(nullptr),
+	m_c2enc(nullptr),
+	m_started(false)
+{
+}
+
+TranscodePipeline::~TranscodePipeline()
+{
+	m_mutex.lock();
+	m_closing = true;
+	while(m_stages[0].running || m_stages[1].running){
+		m_idle.wait(&m_mutex);
+	}
+	m_mutex.unlock();
+
+	VocoderRegistry::destroy(m_mbedec);
+	delete m_imbedec;
+	VocoderRegistry::destroy(m_mbeenc);
+	delete m_imbeenc;
+#ifdef USE_EXTERNAL_CODEC2
+	if(m_c2dec) codec2_destroy(m_c2dec);
+	if(m_c2enc) codec2_destroy(m_c2enc);
+#else
+	delete m_c2dec;
+	delete m_c2enc;
+#endif
+}
+
+bool TranscodePipeline::can_decode(int codec)
+{
+	return frame_bytes(codec) > 0;
+}
+
+bool TranscodePipeline::can_encode(int codec)
+{
+	return frame_bytes(codec) > 0;
+}
+
+int TranscodePipeline::frame_bytes(int codec)
+{
+	switch(codec){
+	case Mode::CODEC_AMBE2450:
+		return 7;
+	case Mode::CODEC_AMBE2450X1150:
+	case Mode::CODEC_AMBE2400X1200:
+		return 9;
+	case Mode::CODEC_IMBE4400:
+		return 11;
+	case Mode::CODEC_CODEC2_3200:
+	case Mode::CODEC_CODEC2_1600:
+		return 8;
+	case Mode::CODEC_ULAW:
+		return 160;
+	default:
+		return 0;
+	}
+}
+
+int TranscodePipeline::frame_samples(int codec)
+{
+	return (codec == Mode::CODEC_CODEC2_1600) ? 320 : 160;
+}
+
+TranscodePipeline::STATS TranscodePipeline::stats()
+{
+	QMutexLocker l(&m_mutex);
+	return m_stats;
+}
+
+void TranscodePipeline::push(const QByteArray &frame)
+{
+	QMutexLocker l(&m_mutex);
+	++m_stats.frames_in;
+	if(frame.size() < frame_bytes(m_from)){
+		++m_stats.dropped;
+		return;
+	}
+	enqueue(0, frame);
+}
+
+void TranscodePipeline::push_end()
+{
+	QMutexLocker l(&m_mutex);
+	enqueue(0, QByteArray());
+}
+
+void TranscodePipeline::set_talker(QString callsign, uint32_t id)
+{
+	QMutexLocker l(&m_mutex);
+	m_talkercall = callsign;
+	m_talkerid = id;
+}
+
+// Called with m_mutex held. An empty item marks the end of an over and is never dropped.
+void TranscodePipeline::enqueue(int stage, const QByteArray &item)
+{
+	STAGE &s = m_stages[stage];
+
+	if(m_closing){
+		return;
+	}
+	if(!item.isEmpty() && (s.q.size() >= MAX_QUEUE)){
+		for(int i = 0; i < s.q.size(); ++i){
+			if(!s.q.at(i).isEmpty()){
+				s.q.removeAt(i);
+				++m_stats.dropped;
+				break;
+			}
+		}
+	}
+	s.q.enqueue(item);
+	if(!s.running){
+		s.running = true;
+		m_pool->start([this, stage]() { run(stage); });
+	}
+}
+
+void TranscodePipeline::run(int stage)
+{
+	QMutexLocker l(&m_mutex);
+	STAGE &s = m_stages[stage];
+	QElapsedTimer t;
+
+	while(!s.q.isEmpty() && !m_closing){
+		const QByteArray item = s.q.dequeue();
+		l.unlock();
+		t.start();
+		if(stage == 0){
+			QByteArray pcm;
+			if(!item.isEmpty()){
+				decode(item, pcm);
+			}
+			l.relock();
+			m_stats.decode_ns += t.nsecsElapsed();
+			if(item.isEmpty() || !pcm.isEmpty()){
+				enqueue(1, pcm);
+			}
+			continue;
+		}
+		if(item.isEmpty()){
+			const int n = frame_samples(m_to);
+			if(!m_pcm.isEmpty()){
+				m_pcm.resize(n, 0);
+				encode(m_pcm.data());
+			}
+			m_pcm.clear();
+			if(m_started){
+				m_started = false;
+				emit end();
+			}
+		}
+		else{
+			const int n = frame_samples(m_to);
+			const int old = m_pcm.size();
+			int done = 0;
+			m_pcm.resize(old + item.size() / sizeof(int16_t));
+			::memcpy(m_pcm.data() + old, item.constData(), item.size());
+			while((m_pcm.size() - done) >= n){
+				encode(m_pcm.data() + done);
+				done += n;
+			}
+			m_pcm.remove(0, done);
+		}
+		l.relock();
+		m_stats.encode_ns += t.nsecsElapsed();
+	}
+	s.running = false;
+	m_idle.wakeAll();
+}
+
+void TranscodePipeline::decode(const QByteArray &in, QByteArray &out)
+{
+	uint8_t codec[160];
+	const int n = frame_samples(m_from);
+	int16_t *pcm;
+
+	::memcpy(codec, in.constData(), frame_bytes(m_from));
+	out.resize(n * sizeof(int16_t));
+	pcm = (int16_t *)out.data();
+
+	switch(m_from){
+	case Mode::CODEC_AMBE2450:
+	case Mode::CODEC_AMBE2450X1150:
+	case Mode::CODEC_AMBE2400X1200:
+		if(m_mbedec == nullptr){
+			m_mbedec = vocoder(m_from);
+		}
+		VocoderRegistry::decode(m_mbedec, m_from, pcm, codec);
+		break;
+	case Mode::CODEC_IMBE4400:
+		if(m_imbedec == nullptr){
+			m_imbedec = new imbe_vocoder();
+		}
+		m_imbedec->decode_4400(pcm, codec);
+		break;
+	case Mode::CODEC_CODEC2_3200:
+	case Mode::CODEC_CODEC2_1600:
+#ifdef USE_EXTERNAL_CODEC2
+		if(m_c2dec == nullptr){
+			m_c2dec = codec2_create((m_from == Mode::CODEC_CODEC2_3200) ? CODEC2_MODE_3200 : CODEC2_MODE_1600);
+		}
+		codec2_decode(m_c2dec, pcm, codec);
+#else
+		if(m_c2dec == nullptr){
+			m_c2dec = new CCodec2(m_from == Mode::CODEC_CODEC2_3200);
+		}
+		m_c2dec->codec2_decode(pcm, codec);
+#endif
+		break;
+	case Mode::CODEC_ULAW:
+		G711::ulaw_decode(codec, pcm, n);
+		break;
+	default:
+		out.clear();
+		return;
+	}
+	if(m_agc){
+		agc(pcm, n);
+	}
+}
+
+// Encodes one frame of frame_samples(m_to) samples and sends it on
+void TranscodePipeline::encode(int16_t *pcm)
+{
+	uint8_t codec[160];
+	const int n = frame_samples(m_to);
+
+	::memset(codec, 0, sizeof(codec));
+
+	switch(m_to){
+	case Mode::CODEC_AMBE2450:
+	case Mode::CODEC_AMBE2450X1150:
+	case Mode::CODEC_AMBE2400X1200:
+		if(m_mbeenc == nullptr){
+			m_mbeenc = vocoder(m_to);
+		}
+		VocoderRegistry::encode(m_mbeenc, m_to, pcm, codec);
+		break;
+	case Mode::CODEC_IMBE4400:
+		if(m_imbeenc == nullptr){
+			m_imbeenc = new imbe_vocoder();
+		}
+		m_imbeenc->encode_4400(pcm, codec);
+		break;
+	case Mode::CODEC_CODEC2_3200:
+	case Mode::CODEC_CODEC2_1600:
+#ifdef USE_EXTERNAL_CODEC2
+		if(m_c2enc == nullptr){
+			m_c2enc = codec2_create((m_to == Mode::CODEC_CODEC2_3200) ? CODEC2_MODE_3200 : CODEC2_MODE_1600);
+		}
+		codec2_encode(m_c2enc, codec, pcm);
+#else
+		if(m_c2enc == nullptr){
+			m_c2enc = new CCodec2(m_to == Mode::CODEC_CODEC2_3200);
+		}
+		m_c2enc->codec2_encode(codec, pcm);
+#endif
+		break;
+	case Mode::CODEC_ULAW:
+		G711::ulaw_encode(pcm, codec, n);
+		break;
+	default:
+		return;
+	}
+
+	// The talker goes out just ahead of the first frame, from the same thread, so the
+	// destination sees them in order
+	if(!m_started){
+		QString call;
+		uint32_t id;
+		m_mutex.lock();
+		call = m_talkercall;
+		id = m_talkerid;
+		m_mutex.unlock();
+		m_started = true;
+		emit talker(call, id);
+	}
+	emit frame(m_to, QByteArray((const char *)codec, frame_bytes(m_to)));
+	m_mutex.lock();
+	++m_stats.frames_out;
+	m_mutex.unlock();
+}
+
+// Fast attack, slow release, with the gain change spread over the frame so it doesn't click
+void TranscodePipeline::agc(int16_t *pcm, int n)
+{
+	float sum = 0;
+	float gain = m_agcgain;
+
+	for(int i = 0; i < n; ++i){
+		sum += (float)pcm[i] * pcm[i];
+	}
+	const float rms = sqrtf(sum / n);
+
+	if(rms > AGC_FLOOR){
+		const float want = qBound(AGC_MIN_GAIN, AGC_TARGET / rms, AGC_MAX_GAIN);
+		gain += (want - gain) * ((want < gain) ? AGC_ATTACK : AGC_RELEASE);
+	}
+	for(int i = 0; i < n; ++i){
+		const float g = m_agcgain + (gain - m_agcgain) * i / n;
+		pcm[i] = (int16_t)qBound(-32768.0f, pcm[i] * g, 32767.0f);
+	}
+	m_agcgain = gain;
+}
+
+Vocoder * TranscodePipeline::vocoder(int codec)
+{
+#if !defined(Q_OS_IOS)
+	if(m_hw != nullptr){
+		return new AMBEPoolVocoder(m_hw);
+	}
+#endif
+	return VocoderRegistry::create(codec);
+}
@@ -0,0 +1,117 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRANSCODEPIPELINE_H
+#define TRANSCODEPIPELINE_H
+
+#include <QObject>
+#include <QMutex>
+#include <QQueue>
+#include <QThreadPool>
+#include <QWaitCondition>
+#include <atomic>
+#include "mode.h"
+#ifdef USE_EXTERNAL_CODEC2
+#include <codec2/codec2.h>
+#else
+#include "codec2/codec2_api.h"
+#endif
+
+class AMBEPool;
+
+// One direction of a TranscodeGateway: codec frames of one mode are decoded to 8 kHz PCM,
+// levelled by an AGC and encoded for another. Decoding and encoding are two stages with a
+// bounded queue in front of each, run as tasks on a shared QThreadPool. A stage never runs
+// on two threads at once, so its vocoder state needs no lock, while the two stages of a
+// direction and all other directions run in parallel. When a queue is full the oldest
+// frame is dropped, which bounds the delay a slow pool can add.
+class TranscodePipeline : public QObject
+{
+	Q_OBJECT
+public:
+	TranscodePipeline(int from, int to, QThreadPool *pool, QObject *parent = nullptr);
+	~TranscodePipeline();
+	static const int MAX_QUEUE = 10;
+	struct STATS {
+		quint64 frames_in = 0;
+		quint64 frames_out = 0;
+		quint64 dropped = 0;
+		qint64 decode_ns = 0;
+		qint64 encode_ns = 0;
+	};
+	static bool can_decode(int codec);
+	static bool can_encode(int codec);
+	static int frame_bytes(int codec);
+	static int frame_samples(int codec);
+	int from() { return m_from; }
+	int to() { return m_to; }
+	STATS stats();
+	void set_agc(bool agc) { m_agc = agc; }
+	// AMBE frames go to the pool's channels instead of the software vocoder, set before the first frame
+	void set_hardware(AMBEPool *hw) { m_hw = hw; }
+	// Thread safe, may be called from any thread
+	void push(const QByteArray &frame);
+	void push_end();
+	void set_talker(QString callsign, uint32_t id);
+signals:
+	void talker(QString callsign, uint32_t id);
+	void frame(int codec, QByteArray frame);
+	void end();
+private:
+	struct STAGE {
+		QQueue<QByteArray> q;
+		bool running = false;
+	};
+	int m_from;
+	int m_to;
+	QThreadPool *m_pool;
+	QMutex m_mutex;
+	QWaitCondition m_idle;
+	STAGE m_stages[2];
+	STATS m_stats;
+	bool m_closing;
+	std::atomic<bool> m_agc;		// Set from the gateway's thread, read by the decode stage
+	QString m_talkercall;
+	uint32_t m_talkerid;
+	AMBEPool *m_hw;
+
+	// Owned by the decode stage
+	Vocoder *m_mbedec;
+	imbe_vocoder *m_imbedec;
+	float m_agcgain;
+	// Owned by the encode stage
+	Vocoder *m_mbeenc;
+	imbe_vocoder *m_imbeenc;
+#ifdef USE_EXTERNAL_CODEC2
+	CODEC2 *m_c2dec;
+	CODEC2 *m_c2enc;
+#else
+	CCodec2 *m_c2dec;
+	CCodec2 *m_c2enc;
+#endif
+	QVector<int16_t> m_pcm;
+	bool m_started;
+
+	void enqueue(int stage, const QByteArray &item);
+	void run(int stage);
+	void decode(const QByteArray &in, QByteArray &out);
+	void encode(int16_t *pcm);
+	void agc(int16_t *pcm, int n);
+	Vocoder * vocoder(int codec);
+};
+
+#endif // TRANSCODEPIPELINE_H
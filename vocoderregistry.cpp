@@ -0,0 +1,522 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QLibrary>
+#include <QMutex>
+#include <QVector>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include "vocoderregistry.h"
+#include "mode.h"
+#ifdef USE_EXTERNAL_CODEC2
+#include <codec2/codec2.h>
+#else
+#include "codec2/codec2_api.h"
+#endif
+#ifdef USE_MD380_VOCODER
+#include <md380_vocoder.h>
+#endif
+
+#define BENCH_FRAMES	100		// 2 s of speech
+#define BENCH_SKIP		10		// Frames left out of the quality check while the vocoder settles
+#define BENCH_MAX_LAG	960		// Samples of codec delay searched for
+#define BENCH_LAG_STEP	40
+#define BANDS			32
+
+class MBEBackend : public Vocoder
+{
+public:
+	void decode_2400x1200(int16_t *pcm, uint8_t *codec) override { m_mbe.decode_2400x1200(pcm, codec); }
+	void decode_2450x1150(int16_t *pcm, uint8_t *codec) override { m_mbe.decode_2450x1150(pcm, codec); }
+	void decode_2450(int16_t *pcm, uint8_t *codec) override { m_mbe.decode_2450(pcm, codec); }
+	void encode_2400x1200(int16_t *pcm, uint8_t *codec) override { m_mbe.encode_2400x1200(pcm, codec); }
+	void encode_2450x1150(int16_t *pcm, uint8_t *codec) override { m_mbe.encode_2450x1150(pcm, codec); }
+	void encode_2450(int16_t *pcm, uint8_t *codec) override { m_mbe.encode_2450(pcm, codec); }
+private:
+	MBEVocoder m_mbe;
+};
+
+#ifdef USE_MD380_VOCODER
+// The firmware runs in one emulator for the whole process, so the calls are serialized.
+// It has no D-STAR rate.
+class MD380Backend : public Vocoder
+{
+public:
+	MD380Backend()
+	{
+		QMutexLocker l(&s_lock);
+		if(!s_init){
+			md380_init();
+			s_init = true;
+		}
+	}
+	void decode_2400x1200(int16_t *pcm, uint8_t *) override { memset(pcm, 0, 160 * sizeof(int16_t)); }
+	void decode_2450x1150(int16_t *pcm, uint8_t *codec) override { QMutexLocker l(&s_lock); md380_decode_fec(codec, pcm); }
+	void decode_2450(int16_t *pcm, uint8_t *codec) override { QMutexLocker l(&s_lock); md380_decode(codec, pcm); }
+	void encode_2400x1200(int16_t *, uint8_t *codec) override { memset(codec, 0, 9); }
+	void encode_2450x1150(int16_t *pcm, uint8_t *codec) override { QMutexLocker l(&s_lock); md380_encode_fec(codec, pcm); }
+	void encode_2450(int16_t *pcm, uint8_t *codec) override { QMutexLocker l(&s_lock); md380_encode(codec, pcm); }
+private:
+	static QMutex s_lock;
+	static bool s_init;
+};
+
+QMutex MD380Backend::s_lock;
+bool MD380Backend::s_init = false;
+
+static Vocoder * create_md380() { return new MD380Backend(); }
+#endif
+
+static Vocoder * create_mbelib() { return new MBEBackend(); }
+static void destroy_builtin(Vocoder *v) { delete v; }
+
+struct BACKEND {
+	QString name;
+	QList<int> codecs;
+	create_t *create;
+	destry_t *destroy;
+};
+
+typedef std::function<void(int16_t *, uint8_t *)> CODEC_FN;
+
+static const QList<int> s_ambe = {Mode::CODEC_AMBE2450, Mode::CODEC_AMBE2450X1150, Mode::CODEC_AMBE2400X1200};
+static const QList<int> s_codecs = {Mode::CODEC_AMBE2450, Mode::CODEC_AMBE2450X1150, Mode::CODEC_AMBE2400X1200, Mode::CODEC_IMBE4400, Mode::CODEC_CODEC2_3200, Mode::CODEC_CODEC2_1600};
+
+static QMutex s_mutex;
+static QMutex s_load_mutex;
+static bool s_initialized = false;
+static QList<BACKEND> s_backends;
+static QList<QLibrary *> s_libraries;
+static QList<VocoderRegistry::RESULT> s_results;
+static QHash<int, int> s_selected;			// Codec to index in s_backends
+static QHash<Vocoder *, destry_t *> s_live;
+
+// A vowel with a gliding pitch and a fricative, 0.4 s each
+static void synthetic_speech(int16_t *pcm, int n)
+{
+	double phase = 0;
+	unsigned int seed = 1;
+
+	for(int i = 0; i < n; ++i){
+		const double t = i / 8000.0;
+		const double f0 = 110 + 40 * sin(2 * M_PI * 0.4 * t);
+		double s = 0;
+		if(fmod(t, 0.8) < 0.4){
+			phase += 2 * M_PI * f0 / 8000;
+			for(int h = 1; h * f0 < 3800; ++h){
+				s += sin(h * phase) * 4000 / h * ((h * f0 < 900) ? 1.0 : 0.3);
+			}
+		}
+		else{
+			seed = seed * 1103515245 + 12345;
+			s = (((seed >> 8) & 0xffff) - 32768) / 16.0;
+		}
+		pcm[i] = (int16_t)qBound(-32768.0, s, 32767.0);
+	}
+}
+
+// Log power of a 160 sample frame in BANDS bands, basis holds the windowed cos and sin
+static void spectrum(const int16_t *pcm, const double *basis, double *out)
+{
+	for(int k = 0; k < BANDS; ++k){
+		const double *c = &basis[k * 320];
+		double re = 0, im = 0;
+		for(int i = 0; i < 160; ++i){
+			re += c[i] * pcm[i];
+			im += c[160 + i] * pcm[i];
+		}
+		out[k] = 10 * log10(re * re + im * im + 1);
+	}
+}
+
+// Mean log spectral distance per frame with the level difference of each frame taken out,
+// at the codec delay that gives the smallest
+static double spectral_distance(const QVector<int16_t> &in, const QVector<int16_t> &out)
+{
+	const int frames = in.size() / 160 - (BENCH_MAX_LAG / 160) - 1;
+	QVector<double> basis(BANDS * 320), ref(frames * BANDS);
+	double best = 1e9;
+
+	for(int k = 0; k < BANDS; ++k){
+		for(int i = 0; i < 160; ++i){
+			const double w = 0.5 - 0.5 * cos(2 * M_PI * i / 160);
+			basis[k * 320 + i] = w * cos(M_PI * (k + 0.5) * i / BANDS);
+			basis[k * 320 + 160 + i] = w * sin(M_PI * (k + 0.5) * i / BANDS);
+		}
+	}
+	for(int f = BENCH_SKIP; f < frames; ++f){
+		spectrum(&in[f * 160], basis.constData(), &ref[f * BANDS]);
+	}
+	for(int lag = 0; lag <= BENCH_MAX_LAG; lag += BENCH_LAG_STEP){
+		double total = 0;
+		for(int f = BENCH_SKIP; f < frames; ++f){
+			const double *a = &ref[f * BANDS];
+			double b[BANDS], m = 0, d = 0;
+			spectrum(&out[f * 160 + lag], basis.constData(), b);
+			for(int k = 0; k < BANDS; ++k){
+				m += (b[k] - a[k]) / BANDS;
+			}
+			for(int k = 0; k < BANDS; ++k){
+				d += (b[k] - a[k] - m) * (b[k] - a[k] - m);
+			}
+			total += sqrt(d / BANDS);
+		}
+		best = qMin(best, total / (frames - BENCH_SKIP));
+	}
+	return best;
+}
+
+static VocoderRegistry::RESULT measure(const QString &backend, int codec, CODEC_FN encode, CODEC_FN decode)
+{
+	const int n = (codec == Mode::CODEC_CODEC2_1600) ? 320 : 160;
+	const int frames = BENCH_FRAMES * 160 / n;
+	QVector<int16_t> in(BENCH_FRAMES * 160), out(BENCH_FRAMES * 160), pcm(n);
+	QVector<uint8_t> bits(frames * 16, 0);
+	VocoderRegistry::RESULT r;
+	QElapsedTimer t;
+	double ein = 0, eout = 0;
+
+	synthetic_speech(in.data(), in.size());
+	t.start();
+	for(int f = 0; f < frames; ++f){
+		memcpy(pcm.data(), &in[f * n], n * sizeof(int16_t));
+		encode(pcm.data(), &bits[f * 16]);
+	}
+	r.encode_us = t.nsecsElapsed() / 1000.0 / frames;
+	t.start();
+	for(int f = 0; f < frames; ++f){
+		decode(&out[f * n], &bits[f * 16]);
+	}
+	r.decode_us = t.nsecsElapsed() / 1000.0 / frames;
+
+	for(int i = BENCH_SKIP * 160; i < in.size(); ++i){
+		ein += (double)in[i] * in[i];
+		eout += (double)out[i] * out[i];
+	}
+	r.backend = backend;
+	r.codec = codec;
+	r.level = 10 * log10((eout + 1) / (ein + 1));
+	r.distance = spectral_distance(in, out);
+	r.passed = (fabs(r.level) <= VocoderRegistry::MAX_LEVEL) && (r.distance <= VocoderRegistry::MAX_DISTANCE);
+	r.selected = false;
+	return r;
+}
+
+static void load_plugins(const QStringList &plugin_dirs, QList<BACKEND> &backends)
+{
+	for(const QString &d : plugin_dirs){
+		const QDir dir(d);
+		for(const QString &f : dir.entryList({"vocoder_plugin*"}, QDir::Files)){
+			bool loaded = false;
+			for(const BACKEND &b : backends){
+				loaded |= (b.name == f);
+			}
+			if(loaded){
+				continue;
+			}
+			QLibrary *lib = new QLibrary(dir.filePath(f));
+			create_t *create = (create_t *)lib->resolve("create");
+			destry_t *destroy = (destry_t *)lib->resolve("destroy");
+			if(!create || !destroy){
+				qDebug() << "VocoderRegistry: not a vocoder plugin" << lib->fileName() << lib->errorString();
+				lib->unload();
+				delete lib;
+				continue;
+			}
+			s_libraries.append(lib);
+			backends.append({f, s_ambe, create, destroy});
+			qDebug() << "VocoderRegistry: loaded" << lib->fileName();
+		}
+	}
+}
+
+// Called with s_load_mutex held. The measuring is done on lists of its own, so create()
+// is never held up by it, and they are published when it is done.
+static void load(const QStringList &plugin_dirs)
+{
+	static bool done = false;
+	QList<BACKEND> backends;
+	QList<VocoderRegistry::RESULT> results;
+	QHash<int, int> selected;
+
+	if(done){
+		return;
+	}
+	done = true;
+#ifdef USE_MD380_VOCODER
+	backends.append({"md380", {Mode::CODEC_AMBE2450, Mode::CODEC_AMBE2450X1150}, create_md380, destroy_builtin});
+#endif
+	backends.append({"mbelib", s_ambe, create_mbelib, destroy_builtin});
+	load_plugins(plugin_dirs, backends);
+
+	// The first backend for a codec is used if none of them pass
+	for(int codec : s_ambe){
+		int best = -1;
+		int first = -1;
+		double best_us = 0;
+		for(int i = 0; i < backends.size(); ++i){
+			if(!backends[i].codecs.contains(codec)){
+				continue;
+			}
+			Vocoder *v = backends[i].create();
+			if(v == nullptr){
+				continue;
+			}
+			const VocoderRegistry::RESULT r = measure(backends[i].name, codec,
+				[v, codec](int16_t *pcm, uint8_t *f) { VocoderRegistry::encode(v, codec, pcm, f); },
+				[v, codec](int16_t *pcm, uint8_t *f) { VocoderRegistry::decode(v, codec, pcm, f); });
+			backends[i].destroy(v);
+			results.append(r);
+			if(first == -1){
+				first = i;
+			}
+			if(r.passed && ((best == -1) || (r.encode_us + r.decode_us < best_us))){
+				best = i;
+				best_us = r.encode_us + r.decode_us;
+			}
+		}
+		if(best == -1){
+			best = first;
+		}
+		if(best == -1){
+			continue;
+		}
+		selected[codec] = best;
+		for(VocoderRegistry::RESULT &r : results){
+			r.selected |= (r.codec == codec) && (r.backend == backends[best].name);
+		}
+	}
+
+	{
+		imbe_vocoder imbe;
+		results.append(measure("imbe_vocoder", Mode::CODEC_IMBE4400,
+			[&imbe](int16_t *pcm, uint8_t *f) { imbe.encode_4400(pcm, f); },
+			[&imbe](int16_t *pcm, uint8_t *f) { imbe.decode_4400(pcm, f); }));
+		results.last().selected = true;
+	}
+	for(int codec : {Mode::CODEC_CODEC2_3200, Mode::CODEC_CODEC2_1600}){
+#ifdef USE_EXTERNAL_CODEC2
+		CODEC2 *c2 = codec2_create((codec == Mode::CODEC_CODEC2_3200) ? CODEC2_MODE_3200 : CODEC2_MODE_1600);
+		results.append(measure("libcodec2", codec,
+			[c2](int16_t *pcm, uint8_t *f) { codec2_encode(c2, f, pcm); },
+			[c2](int16_t *pcm, uint8_t *f) { codec2_decode(c2, pcm, f); }));
+		codec2_destroy(c2);
+#else
+		CCodec2 c2(codec == Mode::CODEC_CODEC2_3200);
+		results.append(measure("codec2", codec,
+			[&c2](int16_t *pcm, uint8_t *f) { c2.codec2_encode(f, pcm); },
+			[&c2](int16_t *pcm, uint8_t *f) { c2.codec2_decode(pcm, f); }));
+#endif
+		results.last().selected = true;
+	}
+
+	for(const VocoderRegistry::RESULT &r : results){
+		qDebug() << "VocoderRegistry:" << VocoderRegistry::codec_name(r.codec) << r.backend << "encode" << r.encode_us << "us decode" << r.decode_us << "us level" << r.level << "dB distance" << r.distance << "dB" << (r.passed ? "passed" : "failed") << (r.selected ? "selected" : "");
+	}
+
+	QMutexLocker l(&s_mutex);
+	s_backends = backends;
+	s_results = results;
+	s_selected = selected;
+	s_initialized = true;
+}
+
+void VocoderRegistry::init(const QStringList &plugin_dirs)
+{
+	QMutexLocker l(&s_load_mutex);
+	load(plugin_dirs);
+}
+
+bool VocoderRegistry::initialized()
+{
+	QMutexLocker l(&s_mutex);
+	return s_initialized;
+}
+
+Vocoder * VocoderRegistry::create(int codec)
+{
+	QMutexLocker l(&s_mutex);
+	Vocoder *v;
+
+	// Until init() is done every session gets mbelib, the next one gets the selection
+	if(!s_initialized && s_ambe.contains(codec)){
+		v = create_mbelib();
+		s_live[v] = destroy_builtin;
+		return v;
+	}
+	if(!s_selected.contains(codec)){
+		return nullptr;
+	}
+	const BACKEND &b = s_backends[s_selected[codec]];
+	v = b.create();
+	if(v != nullptr){
+		s_live[v] = b.destroy;
+		qDebug() << "VocoderRegistry:" << codec_name(codec) << "using" << b.name;
+	}
+	return v;
+}
+
+// Vocoders the registry did not create, such as an AMBEPoolVocoder, are deleted
+void VocoderRegistry::destroy(Vocoder *v)
+{
+	if(v == nullptr){
+		return;
+	}
+	s_mutex.lock();
+	destry_t *d = s_live.take(v);
+	s_mutex.unlock();
+
+	if(d != nullptr){
+		d(v);
+	}
+	else{
+		delete v;
+	}
+}
+
+QString VocoderRegistry::selected(int codec)
+{
+	QMutexLocker l(&s_mutex);
+
+	for(const RESULT &r : s_results){
+		if((r.codec == codec) && r.selected){
+			return r.backend;
+		}
+	}
+	return QString();
+}
+
+QList<VocoderRegistry::RESULT> VocoderRegistry::results()
+{
+	QMutexLocker l(&s_mutex);
+	return s_results;
+}
+
+QStringList VocoderRegistry::report()
+{
+	QMutexLocker l(&s_mutex);
+	QStringList lines;
+
+	for(int codec : s_codecs){
+		QStringList times;
+		QString sel;
+		for(const RESULT &r : s_results){
+			if(r.codec != codec){
+				continue;
+			}
+			times.append(QString("%1 %2/%3%4").arg(r.backend).arg(r.encode_us, 0, 'f', 0).arg(r.decode_us, 0, 'f', 0).arg(r.passed ? "" : " failed"));
+			if(r.selected){
+				sel = r.backend;
+			}
+		}
+		if(!times.isEmpty()){
+			lines.append(QString("%1: %2, encode/decode us per frame: %3").arg(codec_name(codec), sel, times.join(", ")));
+		}
+	}
+	return lines;
+}
+
+QString VocoderRegistry::describe(QString mode, QString vocoder)
+{
+	const int codec = mode_codec(mode);
+
+	if(codec == Mode::CODEC_NONE){
+		return QString();
+	}
+	if((vocoder != "None") && (vocoder != "Software vocoder") && s_ambe.contains(codec)){
+		return codec_name(codec) + ": SerialAMBE " + vocoder;
+	}
+	for(const RESULT &r : results()){
+		if((r.codec == codec) && r.selected){
+			return QString("%1: %2, %3 us encode, %4 us decode").arg(codec_name(codec), r.backend).arg(r.encode_us, 0, 'f', 0).arg(r.decode_us, 0, 'f', 0);
+		}
+	}
+	return codec_name(codec);
+}
+
+int VocoderRegistry::mode_codec(QString mode)
+{
+	if(mode == "DMR"){
+		return Mode::CODEC_AMBE2450X1150;
+	}
+	if((mode == "NXDN") || (mode == "YSF") || (mode == "FCS")){
+		return Mode::CODEC_AMBE2450;
+	}
+	if((mode == "REF") || (mode == "XRF") || (mode == "DCS")){
+		return Mode::CODEC_AMBE2400X1200;
+	}
+	if(mode == "P25"){
+		return Mode::CODEC_IMBE4400;
+	}
+	if(mode == "M17"){
+		return Mode::CODEC_CODEC2_3200;
+	}
+	return Mode::CODEC_NONE;
+}
+
+QString VocoderRegistry::codec_name(int codec)
+{
+	switch(codec){
+	case Mode::CODEC_AMBE2450:
+		return "AMBE 2450";
+	case Mode::CODEC_AMBE2450X1150:
+		return "AMBE 2450x1150";
+	case Mode::CODEC_AMBE2400X1200:
+		return "AMBE 2400x1200";
+	case Mode::CODEC_IMBE4400:
+		return "IMBE 4400";
+	case Mode::CODEC_CODEC2_3200:
+		return "Codec2 3200";
+	case Mode::CODEC_CODEC2_1600:
+		return "Codec2 1600";
+	case Mode::CODEC_ULAW:
+		return "u-law";
+	default:
+		return "none";
+	}
+}
+
+void VocoderRegistry::encode(Vocoder *v, int codec, int16_t *pcm, uint8_t *frame)
+{
+	if(codec == Mode::CODEC_AMBE2450){
+		v->encode_2450(pcm, frame);
+	}
+	else if(codec == Mode::CODEC_AMBE2450X1150){
+		v->encode_2450x1150(pcm, frame);
+	}
+	else if(codec == Mode::CODEC_AMBE2400X1200){
+		v->encode_2400x1200(pcm, frame);
+	}
+}
+
+void VocoderRegistry::decode(Vocoder *v, int codec, int16_t *pcm, uint8_t *frame)
+{
+	if(codec == Mode::CODEC_AMBE2450){
+		v->decode_2450(pcm, frame);
+	}
+	else if(codec == Mode::CODEC_AMBE2450X1150){
+		v->decode_2450x1150(pcm, frame);
+	}
+	else if(codec == Mode::CODEC_AMBE2400X1200){
+		v->decode_2400x1200(pcm, frame);
+	}
+}
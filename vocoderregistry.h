@@ -0,0 +1,75 @@
+/*
+	Copyright (C) 2019-2021 Doug McLain
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef VOCODERREGISTRY_H
+#define VOCODERREGISTRY_H
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include "vocoder_plugin.h"
+
+// The software vocoders this build can use. The AMBE backends are mbelib, the md380
+// firmware when built with USE_MD380_VOCODER, and any vocoder_plugin.* library found in
+// the plugin directories that exports create() and destroy() for the Vocoder interface.
+// init() runs every backend over a couple of seconds of synthetic speech for each codec it
+// handles, times the encode and decode and checks the decoded speech against the input.
+// The fastest backend that passes is used for that codec from then on. IMBE and Codec2
+// have one built-in backend each and are measured for the report only. A SerialAMBE
+// dongle is used instead whenever it is picked as the vocoder in the settings, and the
+// gateways use an AMBEPool when one is open, both are paced by the device so they are not
+// measured.
+class VocoderRegistry
+{
+public:
+	struct RESULT {
+		QString backend;
+		int codec;
+		double encode_us;	// Per frame
+		double decode_us;
+		double level;		// dB, decoded against input
+		double distance;	// dB, log spectral distance with the level and delay taken out
+		bool passed;
+		bool selected;
+	};
+	// Decoded speech must be within MAX_LEVEL dB of the input and within MAX_DISTANCE dB
+	// log spectral distance. The built-in vocoders measure 7.6 to 10.0 dB, silence,
+	// noise and frames of the wrong rate 10.5 to 12.7 dB and 17 to 125 dB down.
+	static constexpr double MAX_LEVEL = 12.0;
+	static constexpr double MAX_DISTANCE = 11.0;
+
+	// Loads the plugins and measures the backends, once. Blocks until done, so the GUI
+	// calls it from a pool thread. Until then create() hands out mbelib for the AMBE codecs.
+	static void init(const QStringList &plugin_dirs);
+	static bool initialized();
+	// A vocoder for one of the AMBE codecs, or nullptr for any other codec
+	static Vocoder * create(int codec);
+	static void destroy(Vocoder *v);
+	static QString selected(int codec);
+	static QList<RESULT> results();
+	// One line per codec with the selection and timings, for the log
+	static QStringList report();
+	// What a session of this mode decodes with, the SerialAMBE device when vocoder names one
+	static QString describe(QString mode, QString vocoder);
+	// The voice codec of a mode, CODEC_NONE for IAX
+	static int mode_codec(QString mode);
+	static QString codec_name(int codec);
+	static void encode(Vocoder *v, int codec, int16_t *pcm, uint8_t *frame);
+	static void decode(Vocoder *v, int codec, int16_t *pcm, uint8_t *frame);
+};
+
+#endif // VOCODERREGISTRY_H
@@ -21,10 +21,8 @@
 #include "Golay24128.h"
 #include "chamming.h"
 #include "MMDVMDefines.h"
+#include "packettrace.h"
 #include <cstring>
-#ifdef USE_MD380_VOCODER
-#include <md380_vocoder.h>
-#endif
 
 
 const uint32_t IMBE_INTERLEAVE[] = {
@@ -106,9 +104,6 @@ YSF::YSF() :
 {
     m_mode = "YSF";
 	m_attenuation = 5;
-#ifdef USE_MD380_VOCODER
-    md380_init();
-#endif
 }
 
 YSF::~YSF()
@@ -122,19 +117,10 @@ void YSF::process_udp()
 	QHostAddress sender;
 	quint16 senderPort;
 	char ysftag[11];
-	buf.resize(m_udp->pendingDatagramSize());
 	int p = 5000;
-	m_udp->readDatagram(buf.data(), buf.size(), &sender, &senderPort);
-
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "RECV:";
-        for(int i = 0; i < buf.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)buf.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+	read_datagram(buf, &sender, &senderPort);
+
+    trace("RECV", buf);
 
 	if(((buf.size() == 14) && (m_refname.left(3) != "FCS")) || ((buf.size() == 7) && (m_refname.left(3) == "FCS"))){
 		if(m_modeinfo.status == CONNECTING){
@@ -150,15 +136,14 @@ void YSF::process_udp()
 			m_rxtimer = new QTimer();
 			connect(m_rxtimer, SIGNAL(timeout()), this, SLOT(process_rx_data()));
 
-			m_audio = new AudioEngine(m_audioin, m_audioout);
-			m_audio->init();
+			m_audio = open_audio();
 
 			if(m_refname.left(3) == "FCS"){
 				char info[100U];
 				::sprintf(info, "%9u%9u%-6.6s%-12.12s%7u", 438000000, 438000000, "AA00AA", "MMDVM", 1234567);
 				::memset(info + 43U, ' ', 57U);
 				out.append(info, 100);
-				m_udp->writeDatagram(out, m_address, m_modeinfo.port);
+				write_datagram(out, m_address, m_modeinfo.port);
 				p = 800;
 				set_fcs_mode(true, m_refname.left(8).toStdString());
 			}
@@ -293,17 +278,9 @@ void YSF::hostname_lookup(QHostInfo i)
 		m_address = i.addresses().first();
 		m_udp = new QUdpSocket(this);
 		connect(m_udp, SIGNAL(readyRead()), this, SLOT(process_udp()));
-		m_udp->writeDatagram(out, m_address, m_modeinfo.port);
-
-        if(m_debug){
-            QDebug debug = qDebug();
-            debug.noquote();
-            QString s = "CONN:";
-            for(int i = 0; i < out.size(); ++i){
-                s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-            }
-            debug << s;
-        }
+		write_datagram(out, m_address, m_modeinfo.port);
+
+        trace("CONN", out);
 	}
 }
 
@@ -328,17 +305,9 @@ void YSF::send_ping()
 		out.append(m_modeinfo.callsign.toUtf8());
 		out.append(10 - m_modeinfo.callsign.size(), ' ');
 	}
-	m_udp->writeDatagram(out, m_address, m_modeinfo.port);
-
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "PING:";
-        for(int i = 0; i < out.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+	write_datagram(out, m_address, m_modeinfo.port);
+
+    trace("PING", out);
 }
 
 void YSF::send_disconnect()
@@ -360,17 +329,9 @@ void YSF::send_disconnect()
 		out.append(m_modeinfo.callsign.toUtf8());
 		out.append(10 - m_modeinfo.callsign.size(), ' ');
 	}
-	m_udp->writeDatagram(out, m_address, m_modeinfo.port);
-
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "DISC:";
-        for(int i = 0; i < out.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)out.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+	write_datagram(out, m_address, m_modeinfo.port);
+
+    trace("DISC", out);
 }
 
 void YSF::decode_header(uint8_t* data)
@@ -698,18 +659,10 @@ void YSF::process_modem_data(QByteArray d)
 	}
 
 	++m_txcnt;
-	m_udp->writeDatagram(d, m_address, m_modeinfo.port);
+	write_datagram(d, m_address, m_modeinfo.port);
 	qDebug() << "Sending modem to network.....................................................";
 
-    if(m_debug){
-        QDebug debug = qDebug();
-        debug.noquote();
-        QString s = "SEND:";
-        for(int i = 0; i < d.size(); ++i){
-            s += " " + QString("%1").arg((uint8_t)d.data()[i], 2, 16, QChar('0'));
-        }
-        debug << s;
-    }
+    trace("SEND", d);
 }
 
 void YSF::transmit()
@@ -733,14 +686,17 @@ void YSF::transmit()
 		}
 	}
 #endif
-	if(m_ttsid == 0){
+	if((m_ttsid == 0) && !m_relaytx){
 		if(m_audio->read(pcm, 160)){
 		}
 		else{
 			return;
 		}
 	}
-	if(m_hwtx && !m_txfullrate){
+	if(m_relaytx){
+		s = m_txfullrate ? 11 : 7;
+	}
+	else if(m_hwtx && !m_txfullrate){
 #if !defined(Q_OS_IOS)
 		m_ambedev->encode(pcm);
 #endif
@@ -753,11 +709,7 @@ void YSF::transmit()
 		else{
 			s = 7;
 			if(m_modeinfo.sw_vocoder_loaded){
-#ifdef USE_MD380_VOCODER
-                md380_encode(ambe, pcm);
-#else
 				m_mbevocoder->encode_2450(pcm, ambe);
-#endif
 			}
 		}
 
@@ -781,6 +733,15 @@ void YSF::transmit()
 	}
 }
 
+// A relayed over is sent as VW when the source is IMBE and as DN when it is AMBE
+void YSF::relay_tx(int codec, QByteArray frame)
+{
+	if(!m_tx){
+		m_txfullrate = (codec == CODEC_IMBE4400);
+	}
+	Mode::relay_tx(codec, frame);
+}
+
 void YSF::send_frame()
 {
 	QByteArray txdata;
@@ -798,23 +759,15 @@ void YSF::send_frame()
 
 		frame_size = ::memcmp(m_ysfFrame, "YSFD", 4) ? 130 : 155;
 		txdata.append((char *)m_ysfFrame, frame_size);
-		m_udp->writeDatagram(txdata, m_address, m_modeinfo.port);
+		write_datagram(txdata, m_address, m_modeinfo.port);
 		++m_txcnt;
 
-        if(m_debug){
-            QDebug debug = qDebug();
-            debug.noquote();
-            QString s = "SEND:";
-            for(int i = 0; i < txdata.size(); ++i){
-                s += " " + QString("%1").arg((uint8_t)txdata.data()[i], 2, 16, QChar('0'));
-            }
-            debug << s;
-        }
+        trace("SEND", txdata);
 	}
 	else{
 		fprintf(stderr, "YSF TX stopped\n");
 		m_txtimer->stop();
-		if(m_ttsid == 0){
+		if((m_ttsid == 0) && !m_relaytx){
 			m_audio->stop_capture();
 		}
 		encode_header(1);
@@ -822,7 +775,7 @@ void YSF::send_frame()
 		m_ttscnt = 0;
 		frame_size = ::memcmp(m_ysfFrame, "YSFD", 4) ? 130 : 155;
 		txdata.append((char *)m_ysfFrame, frame_size);
-		m_udp->writeDatagram(txdata, m_address, m_modeinfo.port);
+		write_datagram(txdata, m_address, m_modeinfo.port);
 		m_modeinfo.stream_state = STREAM_IDLE;
 	}
 	emit update_output_level(m_audio->level() * 8);
@@ -833,7 +786,8 @@ void YSF::encode_header(bool eot)
 {
 	uint8_t callsign[12];
 	::memcpy(callsign, "          ", 10);
-	::memcpy(callsign, m_modeinfo.callsign.toStdString().c_str(), ::strlen(m_modeinfo.callsign.toStdString().c_str()));
+	const std::string src = relay_callsign(m_modeinfo.callsign).left(10).toStdString();
+	::memcpy(callsign, src.c_str(), src.size());
 
 	uint8_t *p_frame = m_ysfFrame;
 	if(m_fcs){
@@ -888,7 +842,8 @@ void YSF::encode_vw()
 {
 	uint8_t callsign[12];
 	::memcpy(callsign, "          ", 10);
-	::memcpy(callsign, m_modeinfo.callsign.toStdString().c_str(), ::strlen(m_modeinfo.callsign.toStdString().c_str()));
+	const std::string src = relay_callsign(m_modeinfo.callsign).left(10).toStdString();
+	::memcpy(callsign, src.c_str(), src.size());
 	uint8_t *p_frame = m_ysfFrame;
 	if(m_fcs){
 		::memset(p_frame + 120U, 0, 10U);
@@ -1044,7 +999,8 @@ void YSF::encode_dv2()
 {
 	uint8_t callsign[12];
 	::memcpy(callsign, "          ", 10);
-	::memcpy(callsign, m_modeinfo.callsign.toStdString().c_str(), ::strlen(m_modeinfo.callsign.toStdString().c_str()));
+	const std::string src = relay_callsign(m_modeinfo.callsign).left(10).toStdString();
+	::memcpy(callsign, src.c_str(), src.size());
 	uint8_t *p_frame = m_ysfFrame;
 	if(m_fcs){
 		::memset(p_frame + 120U, 0, 10U);
@@ -1365,33 +1321,25 @@ void YSF::process_rx_data()
 	int16_t pcm[160];
 	uint8_t ambe[7];
 	uint8_t imbe[11];
-	static uint8_t cnt = 0;
 
 	if(m_rxwatchdog++ > 20){
 		qDebug() << "YSF RX stream timeout ";
 		m_modeinfo.stream_state = STREAM_LOST;
+		PacketTrace::trigger(m_mode + " RX stream timeout");
 		m_modeinfo.ts = QDateTime::currentMSecsSinceEpoch();
 		emit update(m_modeinfo);
 	}
 
-	if((m_rxmodemq.size() > 2) && (++cnt >= 5)){
-		QByteArray out;
-		int s = m_rxmodemq[1];
-		if((m_rxmodemq[0] == MMDVM_FRAME_START) && (m_rxmodemq.size() >= s)){
-			for(int i = 0; i < s; ++i){
-				out.append(m_rxmodemq.dequeue());
-			}
-#if !defined(Q_OS_IOS)
-			m_modem->write(out);
-#endif
-		}
-		cnt = 0;
-	}
+	write_modem();
 
 	if((!m_tx) && (m_rximbecodecq.size() > 10)){
 		for(int i = 0; i < 11; ++i){
 			imbe[i] = m_rximbecodecq.dequeue();
 		}
+		if(m_relayrx){
+			emit relay_rx(CODEC_IMBE4400, QByteArray((char *)imbe, 11));
+			return;
+		}
         m_imbevocoder.decode_4400(pcm, imbe);
 		m_audio->write(pcm, 160);
 		emit update_output_level(m_audio->level());
@@ -1401,7 +1349,10 @@ void YSF::process_rx_data()
 		for(int i = 0; i < 7; ++i){
 			ambe[i] = m_rxcodecq.dequeue();
 		}
-		if(m_hwrx){
+		if(m_relayrx){
+			emit relay_rx(CODEC_AMBE2450, QByteArray((char *)ambe, 7));
+		}
+		else if(m_hwrx){
 #if !defined(Q_OS_IOS)
 			m_ambedev->decode(ambe);
 
@@ -1413,11 +1364,7 @@ void YSF::process_rx_data()
 		}
 		else{
 			if(m_modeinfo.sw_vocoder_loaded){
-#ifdef USE_MD380_VOCODER
-                md380_decode(ambe, pcm);
-#else
 				m_mbevocoder->decode_2450(pcm, ambe);
-#endif
 			}
 			else{
 				memset(pcm, 0, 160 * sizeof(int16_t));
@@ -1437,6 +1384,9 @@ void YSF::process_rx_data()
 		//m_ambedev->clear_queue();
 		qDebug() << "YSF playback stopped";
 		m_modeinfo.stream_state = STREAM_IDLE;
+		if(m_relayrx){
+			emit relay_rx_end();
+		}
 		return;
 	}
 }
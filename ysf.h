@@ -60,6 +60,9 @@ public:
 	YSF();
 	~YSF();
 	void set_fcs_mode(bool y, std::string f = "        "){ m_fcs = y; m_fcsname = f; }
+	QList<int> relay_codecs() { return {CODEC_AMBE2450, CODEC_IMBE4400}; }
+public slots:
+	void relay_tx(int codec, QByteArray frame);
 private slots:
 	void process_udp();
 	void process_rx_data();